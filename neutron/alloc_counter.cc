@@ -0,0 +1,27 @@
+#include "neutron/alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace neutron {
+
+static std::atomic<int64_t> num_allocations;
+
+int64_t NumAllocations() {
+  return num_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace neutron
+
+void *operator new(size_t size) {
+  neutron::num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
@@ -0,0 +1,38 @@
+#pragma once
+
+// Counts heap allocations so benchmarks can report them.  Linking with
+// alloc_counter.cc replaces the global operator new.
+//
+//   void BM_Foo(benchmark::State &state) {
+//     neutron::AllocationCounter allocs(state);
+//     for (auto _ : state) {
+//       ...
+//     }
+//   }
+//
+// adds an "allocs" counter with the average number of allocations per
+// iteration.
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+
+namespace neutron {
+
+// Number of allocations made by operator new since the program started.
+int64_t NumAllocations();
+
+class AllocationCounter {
+public:
+  explicit AllocationCounter(benchmark::State &state)
+      : state_(state), start_(NumAllocations()) {}
+  ~AllocationCounter() {
+    state_.counters["allocs"] = benchmark::Counter(
+        double(NumAllocations() - start_), benchmark::Counter::kAvgIterations);
+  }
+
+private:
+  benchmark::State &state_;
+  int64_t start_;
+};
+
+} // namespace neutron
@@ -61,37 +61,8 @@ absl::Status Generator::Generate(const Message &msg) {
   return absl::OkStatus();
 }
 
-static int EnumCSize(const Message &msg) {
-  // Look for the biggest constant type.
-
-  int size = 0;
-  for (auto & [ name, c ] : msg.Constants()) {
-    switch (c->Type()) {
-    case FieldType::kInt8:
-    case FieldType::kUint8:
-      size = std::max(size, 1);
-      break;
-    case FieldType::kInt16:
-    case FieldType::kUint16:
-      size = std::max(size, 2);
-      break;
-    case FieldType::kInt32:
-    case FieldType::kUint32:
-      size = std::max(size, 4);
-      break;
-    case FieldType::kInt64:
-    case FieldType::kUint64:
-      size = std::max(size, 8);
-      break;
-    default:
-      break;
-    }
-  }
-  return size;
-}
-
 static std::string EnumCType(const Message &msg) {
-  int size = EnumCSize(msg);
+  int size = msg.EnumSize();
 
   switch (size) {
   case 0:
@@ -109,7 +80,7 @@ static std::string EnumCType(const Message &msg) {
 }
 
 static std::string EnumCTypeName(const Message &msg) {
-  int size = EnumCSize(msg);
+  int size = msg.EnumSize();
 
   switch (size) {
   case 0:
@@ -0,0 +1,92 @@
+// Benchmarks for the C serdes messages, beside the C++ ones for the same
+// message.
+//
+// bazel run -c opt //neutron:c_serdes_benchmark
+
+#include "neutron/alloc_counter.h"
+#include "neutron/c_serdes/runtime.h"
+#include "neutron/c_serdes/test_msgs/Fixed.h"
+#include "neutron/serdes/runtime.h"
+#include "neutron/serdes/test_msgs/Fixed.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+test_msgs_Fixed MakeFixed() {
+  test_msgs_Fixed fixed = {};
+  fixed.foo = 1234;
+  fixed.sub.seq = 42;
+  for (int i = 0; i < 10; i++) {
+    fixed.afloat[i] = 1.5f * i;
+  }
+  for (int i = 0; i < 20; i++) {
+    fixed.adouble[i] = 2.5 * i;
+  }
+  fixed.t = {45, 67};
+  return fixed;
+}
+
+void BM_CSerialize(benchmark::State &state) {
+  test_msgs_Fixed fixed = MakeFixed();
+  char buffer[sizeof(test_msgs_Fixed)];
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        test_msgs_Fixed_SerializeToArray(&fixed, buffer, sizeof(buffer)));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(buffer));
+}
+BENCHMARK(BM_CSerialize);
+
+void BM_CDeserialize(benchmark::State &state) {
+  test_msgs_Fixed fixed = MakeFixed();
+  char buffer[sizeof(test_msgs_Fixed)];
+  test_msgs_Fixed_SerializeToArray(&fixed, buffer, sizeof(buffer));
+  test_msgs_Fixed fixed2;
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        test_msgs_Fixed_DeserializeFromArray(&fixed2, buffer, sizeof(buffer)));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(buffer));
+}
+BENCHMARK(BM_CDeserialize);
+
+// The C message is laid out as it is serialized, so the C++ message can be
+// filled in from it.
+test_msgs::serdes::Fixed MakeSerdesFixed() {
+  test_msgs_Fixed fixed = MakeFixed();
+  test_msgs::serdes::Fixed msg;
+  (void)msg.DeserializeFromArray(reinterpret_cast<const char *>(&fixed),
+                                 sizeof(fixed));
+  return msg;
+}
+
+void BM_CppSerialize(benchmark::State &state) {
+  test_msgs::serdes::Fixed fixed = MakeSerdesFixed();
+  char buffer[sizeof(test_msgs_Fixed)];
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixed.SerializeToArray(buffer, sizeof(buffer)));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(buffer));
+}
+BENCHMARK(BM_CppSerialize);
+
+void BM_CppDeserialize(benchmark::State &state) {
+  test_msgs_Fixed fixed = MakeFixed();
+  test_msgs::serdes::Fixed fixed2;
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixed2.DeserializeFromArray(
+        reinterpret_cast<const char *>(&fixed), sizeof(fixed)));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(fixed));
+}
+BENCHMARK(BM_CppDeserialize);
+
+} // namespace
@@ -1,5 +1,6 @@
 #include "neutron/descriptor.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_format.h"
 #include "neutron/package.h"
 #include "toolbelt/hexdump.h"
 
@@ -43,10 +44,36 @@ static int FromFieldType(FieldType t) {
   }
 }
 
-absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg) {
+// Enums are sent as the smallest unsigned type that holds all their
+// constants, so that is the field type.  The enum's name stays in
+// msg_package/msg_name.
+static int EnumFieldType(const Message &msg) {
+  switch (msg.EnumSize()) {
+  case 2:
+    return descriptor::Field::TYPE_UINT16;
+  case 4:
+    return descriptor::Field::TYPE_UINT32;
+  case 8:
+    return descriptor::Field::TYPE_UINT64;
+  default:
+    return descriptor::Field::TYPE_UINT8;
+  }
+}
+
+static int MessageFieldType(const MessageField &field) {
+  if (field.Msg() != nullptr && field.Msg()->IsEnum()) {
+    return EnumFieldType(*field.Msg());
+  }
+  return descriptor::Field::TYPE_MESSAGE;
+}
+
+absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg,
+                                                      bool compact_v2) {
   descriptor::Descriptor desc;
   desc.package = msg.GetPackage()->Name();
   desc.name = msg.Name();
+  desc.version = descriptor::Descriptor::VERSION;
+  desc.flags = compact_v2 ? descriptor::Descriptor::FLAG_COMPACT_V2 : 0;
   int index = 0;
   absl::flat_hash_set<std::string> imports;
 
@@ -65,6 +92,7 @@ absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg) {
       f.msg_package = msg_field->MsgPackage().empty() ? msg.GetPackage()->Name()
                                                       : msg_field->MsgPackage();
       f.msg_name = msg_field->MsgName();
+      f.type = MessageFieldType(*msg_field);
       f.array_size = descriptor::Field::FIELD_PRIMITIVE;
       imports.insert(f.msg_package + "/" + f.msg_name);
     } else if (field->IsArray()) {
@@ -81,6 +109,7 @@ absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg) {
                             ? msg.GetPackage()->Name()
                             : msg_field->MsgPackage();
         f.msg_name = msg_field->MsgName();
+        f.type = MessageFieldType(*msg_field);
         imports.insert(f.msg_package + "/" + f.msg_name);
       }
     } else {
@@ -134,11 +163,26 @@ absl::StatusOr<descriptor::Descriptor> DecodeDescriptor(const char *addr,
   if (absl::Status status =
           desc.DeserializeFromBuffer(buffer, /*compact=*/true);
       !status.ok()) {
-    return status;
+    // Descriptors before version 2 end after the fields.  They are decoded
+    // as version 0 so that the caller can say why they are rejected.
+    if (!serdes::IsTruncated(status) || buffer.Size() != len ||
+        desc.version != 0) {
+      return status;
+    }
   }
   return desc;
 }
 
+absl::Status CheckDescriptorVersion(const descriptor::Descriptor &desc) {
+  if (desc.version < descriptor::Descriptor::VERSION) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Descriptor for %s/%s has version %d; it was generated by an older "
+        "neutron and must be regenerated",
+        desc.package, desc.name, static_cast<int>(desc.version)));
+  }
+  return absl::OkStatus();
+}
+
 absl::StatusOr<descriptor::Descriptor>
 DecodeDescriptor(absl::Span<const char> span) {
   return DecodeDescriptor(span.data(), span.size());
@@ -10,7 +10,8 @@
 
 namespace neutron {
 
-absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg);
+absl::StatusOr<descriptor::Descriptor> MakeDescriptor(const Message &msg,
+                                                      bool compact_v2 = false);
 absl::Status EncodeDescriptorAsHex(const descriptor::Descriptor &desc,
                                    int max_width, bool with_0x_prefix,
                                    std::ostream &os);
@@ -20,6 +21,10 @@ absl::StatusOr<descriptor::Descriptor> DecodeDescriptor(
 absl::StatusOr<descriptor::Descriptor> DecodeDescriptor(
    absl::Span<const char> span);
 
+// Returns an error if the descriptor is older than descriptor::VERSION.
+// Older descriptors use different field type numbers.
+absl::Status CheckDescriptorVersion(const descriptor::Descriptor &desc);
+
 std::vector<std::string> FieldNames(const descriptor::Descriptor &desc);
 
 
@@ -25,6 +25,8 @@ absl::Status Descriptor::WriteToBuffer(neutron::serdes::Buffer& buffer) const {
   for (auto& m : this->fields) {
     if (absl::Status status = m.WriteToBuffer(buffer); !status.ok()) return status;
   }
+  if (absl::Status status = Write(buffer, this->version); !status.ok()) return status;
+  if (absl::Status status = Write(buffer, this->flags); !status.ok()) return status;
   return absl::OkStatus();
 }
 
@@ -36,6 +38,8 @@ absl::Status Descriptor::WriteCompactToBuffer(neutron::serdes::Buffer& buffer, b
   for (auto& m : this->fields) {
     if (absl::Status status = m.WriteCompactToBuffer(buffer, true); !status.ok()) return status;
   }
+  if (absl::Status status = WriteCompact(buffer, this->version); !status.ok()) return status;
+  if (absl::Status status = WriteCompact(buffer, this->flags); !status.ok()) return status;
   if (!internal) {
      return buffer.FlushZeroes();
   }
@@ -62,6 +66,8 @@ absl::Status Descriptor::ReadFromBuffer(neutron::serdes::Buffer& buffer) {
       this->fields.push_back(std::move(tmp));
     }
   }
+  if (absl::Status status = Read(buffer, this->version); !status.ok()) return status;
+  if (absl::Status status = Read(buffer, this->flags); !status.ok()) return status;
   return absl::OkStatus();
 }
 
@@ -78,6 +84,8 @@ absl::Status Descriptor::ReadCompactFromBuffer(neutron::serdes::Buffer& buffer)
       this->fields.push_back(std::move(tmp));
     }
   }
+  if (absl::Status status = ReadCompact(buffer, this->version); !status.ok()) return status;
+  if (absl::Status status = ReadCompact(buffer, this->flags); !status.ok()) return status;
   return absl::OkStatus();
 }
 
@@ -93,6 +101,8 @@ size_t Descriptor::SerializedSize() const {
   for (auto& m : this->fields) {
     length += m.SerializedSize();
   }
+  length += sizeof(this->version);
+  length += sizeof(this->flags);
   return length;
 }
 
@@ -104,6 +114,8 @@ void Descriptor::CompactSerializedSize(neutron::serdes::SizeAccumulator& acc) co
   for (auto& m : this->fields) {
     m.CompactSerializedSize(acc);
   }
+  Accumulate(acc, this->version);
+  Accumulate(acc, this->flags);
 }
 
 size_t Descriptor::CompactSerializedSize() const {
@@ -126,6 +138,8 @@ absl::Status Descriptor::Expand(const neutron::serdes::Buffer& src, neutron::ser
         return status;
     }
   }
+  if (absl::Status status = ExpandField(src, dest, uint8_t{}); !status.ok()) return status;
+  if (absl::Status status = ExpandField(src, dest, uint8_t{}); !status.ok()) return status;
   return absl::OkStatus();
 }
 
@@ -142,6 +156,8 @@ absl::Status Descriptor::Compact(const neutron::serdes::Buffer& src, neutron::se
         return status;
     }
   }
+  if (absl::Status status = CompactField(src, dest, uint8_t{}); !status.ok()) return status;
+  if (absl::Status status = CompactField(src, dest, uint8_t{}); !status.ok()) return status;
   if (!internal) {
     return dest.FlushZeroes();
   }
@@ -153,6 +169,8 @@ absl::Status Descriptor::Compact(const neutron::serdes::Buffer& src, neutron::se
   if (this->name != m.name) return false;
   if (this->imports != m.imports) return false;
   if (this->fields != m.fields) return false;
+  if (this->version != m.version) return false;
+  if (this->flags != m.flags) return false;
   return true;
 }
 
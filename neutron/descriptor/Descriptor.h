@@ -7,11 +7,15 @@
 
 namespace descriptor {
 struct Descriptor {
+  static constexpr uint8_t FLAG_COMPACT_V2 = 1;
+  static constexpr uint8_t VERSION = 2;
 
   std::string package = {};
   std::string name = {};
   std::vector<std::string> imports = {};
   std::vector<descriptor::Field> fields = {};
+  uint8_t version = {};
+  uint8_t flags = {};
 
   static const char* Name() { return "Descriptor"; }
   static const char* FullName() { return "descriptor/Descriptor"; }
@@ -36,11 +40,12 @@ struct Descriptor {
   static constexpr unsigned char _descriptor[] = {
 0x0a,0x64,0x65,0x73,0x63,0x72,0x69,0x70,0x74,0x6f,0x72,0x0a,0x44,0x65,0x73,0x63,0x72,
 0x69,0x70,0x74,0x6f,0x72,0x01,0x10,0x64,0x65,0x73,0x63,0x72,0x69,0x70,0x74,0x6f,0x72,
-0x2f,0x46,0x69,0x65,0x6c,0x64,0x04,0x00,0x07,0x70,0x61,0x63,0x6b,0x61,0x67,0x65,0x0b,
+0x2f,0x46,0x69,0x65,0x6c,0x64,0x06,0x00,0x07,0x70,0x61,0x63,0x6b,0x61,0x67,0x65,0x0b,
 0x7e,0xfa,0x00,0x01,0x04,0x6e,0x61,0x6d,0x65,0x0b,0x7e,0xfa,0x00,0x02,0x07,0x69,0x6d,
 0x70,0x6f,0x72,0x74,0x73,0x0b,0x7f,0xfa,0x00,0x03,0x06,0x66,0x69,0x65,0x6c,0x64,0x73,
 0x0e,0x7f,0x0a,0x64,0x65,0x73,0x63,0x72,0x69,0x70,0x74,0x6f,0x72,0x05,0x46,0x69,0x65,
-0x6c,0x64
+0x6c,0x64,0x04,0x07,0x76,0x65,0x72,0x73,0x69,0x6f,0x6e,0x02,0x7e,0xfa,0x00,0x05,0x05,
+0x66,0x6c,0x61,0x67,0x73,0x02,0x7e,0xfa,0x00,0x02,0x00
   };
   static absl::Span<const char> GetDescriptor() {
     return absl::Span<const char>(reinterpret_cast<const char*>(_descriptor), sizeof(_descriptor));
@@ -60,6 +65,10 @@ inline std::ostream& operator<<(std::ostream& os, const Descriptor& msg) {
     os << m.DebugString();
   }
   os << std::endl;
+  os << "version: ";
+  os << static_cast<int>(msg.version) << std::endl;
+  os << "flags: ";
+  os << static_cast<int>(msg.flags) << std::endl;
   return os;
 }
 }    // namespace descriptor
@@ -7,7 +7,7 @@ namespace descriptor {
 struct Field {
   static constexpr int16_t FIELD_PRIMITIVE = -2;
   static constexpr int16_t FIELD_VECTOR = -1;
-  static constexpr uint8_t TYPE_BOOL = 13;
+  static constexpr uint8_t TYPE_BOOL = 15;
   static constexpr uint8_t TYPE_DURATION = 13;
   static constexpr uint8_t TYPE_FLOAT32 = 9;
   static constexpr uint8_t TYPE_FLOAT64 = 10;
@@ -56,7 +56,7 @@ struct Field {
 0x6d,0x65,0x0b,0x7e,0xfa,0x00,0x02,0x04,0x74,0x79,0x70,0x65,0x02,0x7e,0xfa,0x00,0x03,
 0x0a,0x61,0x72,0x72,0x61,0x79,0x5f,0x73,0x69,0x7a,0x65,0x03,0x7e,0xfa,0x00,0x04,0x0b,
 0x6d,0x73,0x67,0x5f,0x70,0x61,0x63,0x6b,0x61,0x67,0x65,0x0b,0x7e,0xfa,0x00,0x05,0x08,
-0x6d,0x73,0x67,0x5f,0x6e,0x61,0x6d,0x65,0x0b,0x7e
+0x6d,0x73,0x67,0x5f,0x6e,0x61,0x6d,0x65,0x0b,0x7e,0xfa,0x00,0x02,0x00
   };
   static absl::Span<const char> GetDescriptor() {
     return absl::Span<const char>(reinterpret_cast<const char*>(_descriptor), sizeof(_descriptor));
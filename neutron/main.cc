@@ -25,6 +25,16 @@ ABSL_FLAG(bool, zeros, false, "Generate zero-copy ROS messages");
 ABSL_FLAG(std::string, add_namespace, "",
           "Add a namespace to the message classes");
 ABSL_FLAG(std::string, lang, "c++", "Language to generate for");
+ABSL_FLAG(bool, compact_v2, false,
+          "Use the compact v2 encoding (XOR encoded float vectors and arrays) "
+          "for C++ messages");
+ABSL_FLAG(bool, pmr, false,
+          "Use std::pmr strings and vectors in C++ messages so they can be "
+          "allocated from a std::pmr::memory_resource");
+ABSL_FLAG(bool, single_thread_buffers, false,
+          "Share the buffer of a zero-copy message tree with a non-atomic "
+          "count.  The tree must then only be copied or destroyed on one "
+          "thread at a time");
 
 void GenerateSerialization(const std::vector<std::filesystem::path> &files) {
   if (absl::GetFlag(FLAGS_all)) {
@@ -39,7 +49,8 @@ void GenerateSerialization(const std::vector<std::filesystem::path> &files) {
     if (absl::GetFlag(FLAGS_lang) == "c++") {
       neutron::serdes::Generator gen(
           absl::GetFlag(FLAGS_out), absl::GetFlag(FLAGS_runtime_path),
-          absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace));
+          absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace),
+          absl::GetFlag(FLAGS_compact_v2), absl::GetFlag(FLAGS_pmr));
       for (auto & [ pname, package ] : scanner->Packages()) {
         for (auto & [ mname, msg ] : package->Messages()) {
           absl::Status s = msg->Generate(gen);
@@ -130,7 +141,8 @@ void GenerateSerialization(const std::vector<std::filesystem::path> &files) {
     if (absl::GetFlag(FLAGS_lang) == "c++") {
       neutron::serdes::Generator gen(
           absl::GetFlag(FLAGS_out), absl::GetFlag(FLAGS_runtime_path),
-          absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace));
+          absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace),
+          absl::GetFlag(FLAGS_compact_v2), absl::GetFlag(FLAGS_pmr));
       absl::Status s = msg->Generate(gen);
       if (!s.ok()) {
         std::cerr << s << std::endl;
@@ -164,7 +176,8 @@ void GenerateZeroCopy(const std::vector<std::filesystem::path> &files) {
     }
     neutron::zeros::Generator gen(
         absl::GetFlag(FLAGS_out), absl::GetFlag(FLAGS_runtime_path),
-        absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace));
+        absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace),
+        absl::GetFlag(FLAGS_single_thread_buffers));
     for (auto & [ pname, package ] : scanner->Packages()) {
       for (auto & [ mname, msg ] : package->Messages()) {
         absl::Status s = msg->Generate(gen);
@@ -236,7 +249,8 @@ void GenerateZeroCopy(const std::vector<std::filesystem::path> &files) {
   for (auto &msg : messages) {
     neutron::zeros::Generator gen(
         absl::GetFlag(FLAGS_out), absl::GetFlag(FLAGS_runtime_path),
-        absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace));
+        absl::GetFlag(FLAGS_msg_path), absl::GetFlag(FLAGS_add_namespace),
+        absl::GetFlag(FLAGS_single_thread_buffers));
     absl::Status s = msg->Generate(gen);
     if (!s.ok()) {
       std::cerr << s << std::endl;
@@ -11,12 +11,18 @@ def _neutron_serdes_action(
         other_srcs,
         outputs,
         add_namespace,
-        lang):
+        lang,
+        compact_v2,
+        pmr):
     inputs = depset(direct = srcs, transitive = [depset(imports + other_srcs)])
     prefix = "serdes" if lang == "c++" else "c_serdes"
     neutron_args = ["--ros", "--out={}/{}/{}".format(out_dir, package_name, prefix), "--runtime_path=", "--msg_path={}".format(package_name), "--lang=" + lang]
     if add_namespace:
         neutron_args.append("--add_namespace=" + add_namespace)
+    if compact_v2:
+        neutron_args.append("--compact_v2")
+    if pmr:
+        neutron_args.append("--pmr")
     if imports:
         imports_arg = "--imports="
         sep = ""
@@ -77,6 +83,8 @@ def _neutron_serdes_impl(ctx):
             outputs,
             ctx.attr.add_namespace,
             ctx.attr.lang,
+            ctx.attr.compact_v2,
+            ctx.attr.pmr,
         )
 
     return [DefaultInfo(files = depset(output_files + srcs)), MessageInfo(messages = srcs + imports)]
@@ -94,6 +102,8 @@ _neutron_serdes_gen = rule(
         "package_name": attr.string(),
         "add_namespace": attr.string(),
         "lang": attr.string(default = "c++"),
+        "compact_v2": attr.bool(default = False),
+        "pmr": attr.bool(default = False),
     },
     implementation = _neutron_serdes_impl,
 )
@@ -205,7 +215,7 @@ _split_files = rule(
     implementation = _split_files_impl,
 )
 
-def neutron_serdes_library(name, srcs = [], deps = [], runtime = "@neutron//neutron:serdes_runtime", add_namespace = "", lang = "c++"):
+def neutron_serdes_library(name, srcs = [], deps = [], runtime = "@neutron//neutron:serdes_runtime", add_namespace = "", lang = "c++", compact_v2 = False, pmr = False):
     """
     Generate a cc_libary for ROS messages specified in srcs.
 
@@ -216,6 +226,11 @@ def neutron_serdes_library(name, srcs = [], deps = [], runtime = "@neutron//neut
         runtime: label for serdes runtime.
         add_namespace: add namespace to the message types
         lang: language to generate (only c and c++ supported)
+        compact_v2: use the compact v2 encoding (XOR encoded float vectors
+            and arrays).  Both ends must agree on this.
+        pmr: use std::pmr strings and vectors so messages can be allocated
+            from a std::pmr::memory_resource.  The wire format is unchanged.
+            Nested messages should come from libraries that also use pmr.
     """
     neutron = name + "_neutron_serdes"
     neutron_deps = []
@@ -229,6 +244,8 @@ def neutron_serdes_library(name, srcs = [], deps = [], runtime = "@neutron//neut
         package_name = native.package_name(),
         add_namespace = add_namespace,
         lang = lang,
+        compact_v2 = compact_v2,
+        pmr = pmr,
     )
 
     srcs = name + "_srcs"
@@ -0,0 +1,104 @@
+#pragma once
+
+// A pool of dynamic serialization buffers.
+//
+// A buffer taken from the pool keeps the memory it grew to when it goes back,
+// so after the first few messages serializing in steady state does no
+// allocation at all.  Use the thread's own pool with BufferPool::ThreadLocal
+// to avoid sharing a pool between threads.
+
+#include "neutron/serdes/runtime.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace neutron::serdes {
+
+class BufferPool {
+public:
+  // A buffer on loan from the pool.  It goes back to the pool, rewound, when
+  // this is destroyed.
+  class Handle {
+  public:
+    Handle() = default;
+    Handle(BufferPool *pool, std::unique_ptr<Buffer> buffer)
+        : pool_(pool), buffer_(std::move(buffer)) {}
+    Handle(const Handle &) = delete;
+    Handle &operator=(const Handle &) = delete;
+    Handle(Handle &&) = default;
+    Handle &operator=(Handle &&h) {
+      if (this != &h) {
+        Return();
+        pool_ = h.pool_;
+        buffer_ = std::move(h.buffer_);
+      }
+      return *this;
+    }
+    ~Handle() { Return(); }
+
+    Buffer &operator*() const { return *buffer_; }
+    Buffer *operator->() const { return buffer_.get(); }
+    Buffer *get() const { return buffer_.get(); }
+
+  private:
+    void Return() {
+      if (buffer_ != nullptr) {
+        pool_->Put(std::move(buffer_));
+      }
+    }
+
+    BufferPool *pool_ = nullptr;
+    std::unique_ptr<Buffer> buffer_;
+  };
+
+  // New buffers start with initial_size bytes from allocator (malloc if
+  // nullptr), which must outlive the pool.  At most max_free buffers are
+  // kept when they are returned.
+  explicit BufferPool(size_t initial_size = 1024, size_t max_free = 16,
+                      BufferAllocator *allocator = nullptr)
+      : initial_size_(initial_size), max_free_(max_free),
+        allocator_(allocator) {}
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // Gets an empty buffer, reusing a returned one if there is one.
+  Handle Get() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        std::unique_ptr<Buffer> buffer = std::move(free_.back());
+        free_.pop_back();
+        return Handle(this, std::move(buffer));
+      }
+    }
+    return Handle(this, std::make_unique<Buffer>(initial_size_, allocator_));
+  }
+
+  size_t NumFree() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+  }
+
+  // A pool for the calling thread.  Handles must not outlive the thread.
+  static BufferPool &ThreadLocal() {
+    thread_local BufferPool pool;
+    return pool;
+  }
+
+private:
+  void Put(std::unique_ptr<Buffer> buffer) {
+    buffer->Rewind();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < max_free_) {
+      free_.push_back(std::move(buffer));
+    }
+  }
+
+  size_t initial_size_;
+  size_t max_free_;
+  BufferAllocator *allocator_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> free_;
+};
+
+} // namespace neutron::serdes
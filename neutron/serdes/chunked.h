@@ -0,0 +1,365 @@
+#pragma once
+
+// Serialization into a sequence of bounded chunks.
+//
+// A fixed buffer fails if the message doesn't fit in it.  For transports
+// with fixed size slots, such as ring buffers and shared memory blocks, the
+// generated SerializeIncremental writes as much of the message as fits in
+// the current chunk and carries on in the next one.  Like the incremental
+// parser, the position in each nested message is kept in a stack of frames.
+//
+// Every chunk except the last is filled completely.  A field that doesn't
+// fit in what's left of a chunk is written to a spill buffer and copied out
+// from there.  Strings, uint8 vectors and, in ROS format, vectors and arrays
+// of fixed size types are copied straight from the message instead, so a
+// large field never needs a copy of its own.  In compact format the count
+// of pending zeroes is carried from one chunk to the next.
+//
+//   neutron::serdes::ChunkedSerializer<Foo> s(&msg);
+//   for (;;) {
+//     absl::StatusOr<bool> done = s.Fill(slot, slot_size);
+//     ...send s.Used() bytes of the slot...
+//     if (*done) break;
+//   }
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "neutron/serdes/runtime.h"
+#include <deque>
+
+namespace neutron::serdes {
+
+enum class SerializeResult {
+  kDone,  // The field or message has been written.
+  kMore,  // The chunk is full.
+  kError, // The writer's status says what went wrong.
+};
+
+// Where a message is up to.
+struct SerializeFrame {
+  uint32_t field = 0;       // Field being written.
+  bool have_header = false; // Length of a string or vector written.
+  bool spilled = false;     // Field is in the spill buffer.
+  uint32_t index = 0;       // Next message in a message vector.
+  size_t body = 0;          // Number of body bytes copied.
+};
+
+class ChunkedWriter {
+public:
+  explicit ChunkedWriter(bool compact = false) : compact_(compact) {}
+
+  bool Compact() const { return compact_; }
+  const absl::Status &Status() const { return status_; }
+
+  void Reset() {
+    frames_.clear();
+    depth_ = 0;
+    num_zeroes_ = 0;
+    status_ = absl::OkStatus();
+  }
+
+  // Sets the memory for the next call to SerializeIncremental.
+  void SetChunk(char *addr, size_t size) {
+    start_ = p_ = addr;
+    end_ = addr + size;
+    depth_ = 0;
+  }
+
+  // Number of bytes written to the chunk.
+  size_t Used() const { return p_ - start_; }
+
+  SerializeFrame &Enter() {
+    if (depth_ == frames_.size()) {
+      frames_.emplace_back();
+    }
+    return frames_[depth_++];
+  }
+
+  SerializeResult Leave() {
+    frames_.pop_back();
+    depth_--;
+    return SerializeResult::kDone;
+  }
+
+  void NextField(SerializeFrame &frame) {
+    uint32_t field = frame.field + 1;
+    frame = SerializeFrame();
+    frame.field = field;
+  }
+
+  // Writes a field with fn(buffer), where fn is one of the usual Write
+  // functions.  If it doesn't fit in the chunk it goes through the spill
+  // buffer.
+  template <typename Fn> SerializeResult WriteWith(SerializeFrame &frame, Fn fn) {
+    if (frame.spilled) {
+      return Drain(frame);
+    }
+    Buffer out(p_, end_ - p_);
+    out.SetNumZeroes(num_zeroes_);
+    if (fn(out).ok()) {
+      p_ = out.Addr();
+      num_zeroes_ = out.NumZeroes();
+      return SerializeResult::kDone;
+    }
+    spill_.Rewind();
+    spill_.SetNumZeroes(num_zeroes_);
+    if (absl::Status status = fn(spill_); !status.ok()) {
+      return Fail(std::move(status));
+    }
+    num_zeroes_ = spill_.NumZeroes();
+    spill_pos_ = 0;
+    frame.spilled = true;
+    return Drain(frame);
+  }
+
+  template <typename T> SerializeResult Write(SerializeFrame &frame, const T &v) {
+    return WriteWith(frame, [this, &v](Buffer &b) {
+      return compact_ ? WriteCompact(b, v) : neutron::serdes::Write(b, v);
+    });
+  }
+
+  template <typename A>
+  SerializeResult Write(SerializeFrame &frame, const BasicString<A> &v) {
+    if (SerializeResult r = WriteHeader(frame, [this, &v](Buffer &b) {
+          return compact_ ? b.WriteUnsignedLeb128(uint32_t(v.size()))
+                          : neutron::serdes::Write(b, uint32_t(v.size()));
+        });
+        r != SerializeResult::kDone) {
+      return r;
+    }
+    return WriteBody(frame, v.data(), v.size());
+  }
+
+  template <typename T, typename A>
+  SerializeResult Write(SerializeFrame &frame, const std::vector<T, A> &v) {
+    if (compact_ && !std::is_same<T, uint8_t>::value) {
+      return WriteWith(frame, [&v](Buffer &b) { return WriteCompact(b, v); });
+    }
+    if constexpr (IsBulkCopyable<T>()) {
+      return WriteBulk(frame, v);
+    } else {
+      return WriteWith(frame,
+                       [&v](Buffer &b) { return neutron::serdes::Write(b, v); });
+    }
+  }
+
+  template <typename T, size_t N>
+  SerializeResult Write(SerializeFrame &frame, const std::array<T, N> &v) {
+    if (compact_ && !std::is_same<T, uint8_t>::value) {
+      return WriteWith(frame, [&v](Buffer &b) { return WriteCompact(b, v); });
+    }
+    if constexpr (IsBulkCopyable<T>()) {
+      return WriteBulk(frame, v);
+    } else {
+      return WriteWith(frame,
+                       [&v](Buffer &b) { return neutron::serdes::Write(b, v); });
+    }
+  }
+
+  // Enum arrays are written as their wire type W, one value at a time in
+  // compact format.
+  template <typename W, typename E, typename A>
+  SerializeResult WriteEnums(SerializeFrame &frame, const std::vector<E, A> &v) {
+    if (!compact_) {
+      return WriteBulk(frame, v);
+    }
+    return WriteWith(frame, [&v](Buffer &b) {
+      if (absl::Status status = WriteCompact(b, uint32_t(v.size()));
+          !status.ok()) {
+        return status;
+      }
+      return WriteCompactEnums<W>(b, v.data(), v.size());
+    });
+  }
+
+  template <typename W, typename E, size_t N>
+  SerializeResult WriteEnums(SerializeFrame &frame, const std::array<E, N> &v) {
+    if (!compact_) {
+      return WriteBulk(frame, v);
+    }
+    return WriteWith(frame, [&v](Buffer &b) {
+      return WriteCompactEnums<W>(b, v.data(), N);
+    });
+  }
+
+  // The number of messages in a message vector.
+  template <typename M, typename A>
+  SerializeResult WriteSize(SerializeFrame &frame, const std::vector<M, A> &v) {
+    if (frame.have_header) {
+      return SerializeResult::kDone;
+    }
+    SerializeResult r = Write(frame, uint32_t(v.size()));
+    if (r == SerializeResult::kDone) {
+      frame.have_header = true;
+    }
+    return r;
+  }
+
+  template <typename M, size_t N>
+  SerializeResult WriteSize(SerializeFrame &frame, const std::array<M, N> &) {
+    return SerializeResult::kDone;
+  }
+
+  // Writes any zeroes still pending at the end of a compact message.
+  SerializeResult Flush(SerializeFrame &frame) {
+    return WriteWith(frame, [](Buffer &b) { return b.FlushZeroes(); });
+  }
+
+private:
+  SerializeResult Fail(absl::Status status) {
+    status_ = std::move(status);
+    return SerializeResult::kError;
+  }
+
+  // Copies what's left of the spill buffer.
+  SerializeResult Drain(SerializeFrame &frame) {
+    size_t n = std::min(spill_.Size() - spill_pos_, size_t(end_ - p_));
+    memcpy(p_, spill_.data() + spill_pos_, n);
+    p_ += n;
+    spill_pos_ += n;
+    if (spill_pos_ < spill_.Size()) {
+      return SerializeResult::kMore;
+    }
+    frame.spilled = false;
+    return SerializeResult::kDone;
+  }
+
+  template <typename W, typename E>
+  static absl::Status WriteCompactEnums(Buffer &b, const E *v, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      if (absl::Status status = WriteCompact(b, W(v[i])); !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Whatever comes before the body of a string, vector or array, written by
+  // fn.
+  template <typename Fn>
+  SerializeResult WriteHeader(SerializeFrame &frame, Fn fn) {
+    if (frame.have_header) {
+      return SerializeResult::kDone;
+    }
+    SerializeResult r = WriteWith(frame, fn);
+    if (r == SerializeResult::kDone) {
+      frame.have_header = true;
+    }
+    return r;
+  }
+
+  // Vectors and arrays whose bodies are copied from the message.  This
+  // matches WriteCompact for uint8 vectors and arrays.
+  template <typename T, typename A>
+  SerializeResult WriteBulk(SerializeFrame &frame, const std::vector<T, A> &v) {
+    if (SerializeResult r = WriteHeader(frame, [this, &v](Buffer &b) {
+          if (!compact_) {
+            return neutron::serdes::Write(b, uint32_t(v.size()));
+          }
+          if (v.empty()) {
+            return b.WriteUnsignedLeb128(0);
+          }
+          if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+            return status;
+          }
+          return b.WriteUnsignedLeb128(uint32_t(v.size()));
+        });
+        r != SerializeResult::kDone) {
+      return r;
+    }
+    return WriteBody(frame, reinterpret_cast<const char *>(v.data()),
+                     v.size() * sizeof(T));
+  }
+
+  template <typename T, size_t N>
+  SerializeResult WriteBulk(SerializeFrame &frame, const std::array<T, N> &v) {
+    if (SerializeResult r = WriteHeader(frame, [this](Buffer &b) {
+          return compact_ ? b.FlushZeroes() : absl::OkStatus();
+        });
+        r != SerializeResult::kDone) {
+      return r;
+    }
+    return WriteBody(frame, reinterpret_cast<const char *>(v.data()),
+                     N * sizeof(T));
+  }
+
+  // Copies size bytes from the message as they fit.
+  SerializeResult WriteBody(SerializeFrame &frame, const char *src,
+                            size_t size) {
+    size_t n = std::min(size - frame.body, size_t(end_ - p_));
+    if (n > 0) {
+      memcpy(p_, src + frame.body, n);
+      p_ += n;
+      frame.body += n;
+    }
+    return frame.body == size ? SerializeResult::kDone : SerializeResult::kMore;
+  }
+
+  bool compact_;
+  char *start_ = nullptr;
+  char *p_ = nullptr;
+  char *end_ = nullptr;
+  std::deque<SerializeFrame> frames_;
+  size_t depth_ = 0;
+  Buffer spill_;
+  size_t spill_pos_ = 0;
+  int num_zeroes_ = 0;
+  absl::Status status_;
+};
+
+// Serializes a message of type M into a sequence of chunks.
+template <typename M> class ChunkedSerializer {
+public:
+  // The message must not change until it has been completely written.
+  explicit ChunkedSerializer(const M *msg, bool compact = false)
+      : msg_(msg), writer_(compact) {}
+
+  // Writes the next part of the message to [addr, addr + size).  Returns
+  // true when the message is complete.  Used() says how much of the chunk
+  // was written, which is all of it unless this is the last.
+  absl::StatusOr<bool> Fill(char *addr, size_t size) {
+    if (done_) {
+      return absl::InternalError("Message is already complete");
+    }
+    writer_.SetChunk(addr, size);
+    SerializeResult r = SerializeResult::kDone;
+    if (!fields_done_) {
+      r = msg_->SerializeIncremental(writer_);
+      fields_done_ = r == SerializeResult::kDone;
+    }
+    if (fields_done_ && writer_.Compact()) {
+      r = writer_.Flush(flush_frame_);
+    }
+    switch (r) {
+    case SerializeResult::kDone:
+      done_ = true;
+      return true;
+    case SerializeResult::kMore:
+      return false;
+    case SerializeResult::kError:
+      break;
+    }
+    return writer_.Status();
+  }
+
+  size_t Used() const { return writer_.Used(); }
+  bool Done() const { return done_; }
+
+  // Starts again with another message.
+  void Reset(const M *msg) {
+    msg_ = msg;
+    writer_.Reset();
+    flush_frame_ = SerializeFrame();
+    fields_done_ = false;
+    done_ = false;
+  }
+
+private:
+  const M *msg_;
+  ChunkedWriter writer_;
+  SerializeFrame flush_frame_;
+  bool fields_done_ = false;
+  bool done_ = false;
+};
+
+} // namespace neutron::serdes
@@ -0,0 +1,269 @@
+#pragma once
+
+// Delta, zigzag and bit-packed encoding of integer vectors and arrays for the
+// compact v2 format.
+//
+// Timestamps, sequence numbers and indices usually change by a small or
+// constant amount from one value to the next.  We write the first value as a
+// zigzag LEB128 and then the differences between consecutive values,
+// zigzag encoded, in blocks of kPackBlockSize.  Each block has a header of
+// the bit width (one byte) and the minimum value in the block (LEB128),
+// followed by each value minus the minimum packed into width bits, least
+// significant bit first (frame of reference).  A vector with a constant
+// stride packs into zero bits per value.  Differences are computed modulo
+// the width of the type so any sequence of values works.
+//
+// All of this is raw bytes, with no zero run markers.
+
+#include "neutron/serdes/varint.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace neutron::serdes {
+
+constexpr size_t kPackBlockSize = 128;
+
+template <typename U> inline U ZigZagEncode(U v) {
+  using S = std::make_signed_t<U>;
+  return U(v << 1) ^ U(S(v) >> (sizeof(U) * 8 - 1));
+}
+
+template <typename U> inline U ZigZagDecode(U v) {
+  return U(v >> 1) ^ U(-(v & 1));
+}
+
+inline int PackWidth(uint64_t v) { return v == 0 ? 0 : 64 - __builtin_clzll(v); }
+
+// Writes values of up to 64 bits, least significant bit first.
+class BitPacker {
+public:
+  explicit BitPacker(char *p) : p_(p) {}
+
+  // v must fit in width bits, which is between 1 and 64.
+  void Put(uint64_t v, int width) {
+    acc_ |= v << pending_;
+    if (pending_ + width >= 64) {
+      memcpy(p_, &acc_, sizeof(acc_));
+      p_ += sizeof(acc_);
+      int used = 64 - pending_;
+      acc_ = used < 64 ? v >> used : 0;
+      pending_ = pending_ + width - 64;
+    } else {
+      pending_ += width;
+    }
+  }
+
+  char *Finish() {
+    for (; pending_ > 0; pending_ -= 8) {
+      *p_++ = char(acc_);
+      acc_ >>= 8;
+    }
+    pending_ = 0;
+    return p_;
+  }
+
+private:
+  char *p_;
+  uint64_t acc_ = 0;
+  int pending_ = 0;
+};
+
+// Fills block with the zigzag encoded differences for values [start, start +
+// count) at p and returns their minimum and maximum.
+template <typename U>
+inline void PackDeltas(const char *p, size_t start, size_t count,
+                       uint64_t *block, uint64_t &min, uint64_t &max) {
+  U prev;
+  memcpy(&prev, p + (start - 1) * sizeof(U), sizeof(U));
+  min = ~uint64_t(0);
+  max = 0;
+  for (size_t i = 0; i < count; i++) {
+    U v;
+    memcpy(&v, p + (start + i) * sizeof(U), sizeof(U));
+    uint64_t z = ZigZagEncode<U>(U(v - prev));
+    prev = v;
+    block[i] = z;
+    min = z < min ? z : min;
+    max = z > max ? z : max;
+  }
+}
+
+// Encodes n values of integer type T at p, which need not be aligned.  If out
+// is nullptr nothing is written.  Returns the encoded size in bytes.
+template <typename T>
+inline size_t PackEncode(const char *p, size_t n, char *out) {
+  using U = std::make_unsigned_t<T>;
+  if (n == 0) {
+    return 0;
+  }
+  U first;
+  memcpy(&first, p, sizeof(U));
+  uint64_t z = ZigZagEncode<U>(first);
+  size_t size = PackLeb128Size(z);
+  char *q = out;
+  if (out != nullptr) {
+    q = PackLeb128(q, z);
+  }
+  uint64_t block[kPackBlockSize];
+  for (size_t start = 1; start < n; start += kPackBlockSize) {
+    size_t count = n - start < kPackBlockSize ? n - start : kPackBlockSize;
+    uint64_t min, max;
+    PackDeltas<U>(p, start, count, block, min, max);
+    int width = PackWidth(max - min);
+    size_t data = (count * width + 7) / 8;
+    size += 1 + PackLeb128Size(min) + data;
+    if (out == nullptr) {
+      continue;
+    }
+    *q++ = char(width);
+    q = PackLeb128(q, min);
+    if (width == 0) {
+      continue;
+    }
+    BitPacker packer(q);
+    for (size_t i = 0; i < count; i++) {
+      packer.Put(block[i] - min, width);
+    }
+    q = packer.Finish();
+  }
+  return size;
+}
+
+template <typename T> inline size_t PackedSize(const char *p, size_t n) {
+  return PackEncode<T>(p, n, nullptr);
+}
+
+// Undoes the zigzag and differences for count values in block, which hold
+// the packed values plus the block minimum.  prev is the value before the
+// block and is updated to the last value.
+template <typename U>
+inline void UnpackDeltas(uint64_t *block, size_t count, U &prev, char *out) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  if constexpr (sizeof(U) == 4) {
+    // Four lanes at a time: zigzag decode and a prefix sum within the lanes,
+    // then add the running total.
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i carry = _mm_set1_epi32(int(prev));
+    for (; i + 4 <= count; i += 4) {
+      __m128i z = _mm_set_epi32(int(block[i + 3]), int(block[i + 2]),
+                                int(block[i + 1]), int(block[i]));
+      __m128i d = _mm_xor_si128(
+          _mm_srli_epi32(z, 1),
+          _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+      d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+      d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+      d = _mm_add_epi32(d, carry);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * sizeof(U)), d);
+      carry = _mm_shuffle_epi32(d, 0xff);
+    }
+    prev = U(_mm_cvtsi128_si32(carry));
+  }
+#endif
+  for (; i < count; i++) {
+    prev = U(prev + ZigZagDecode<U>(U(block[i])));
+    memcpy(out + i * sizeof(U), &prev, sizeof(U));
+  }
+}
+
+// Decodes the first value, which is written on its own, into prev.
+template <typename U>
+inline DecodeResult PackDecodeFirst(const char *&p, const char *end,
+                                    U &prev) {
+  uint64_t z;
+  if (DecodeResult r = UnpackLeb128(p, end, z); r != DecodeResult::kOk) {
+    return r;
+  }
+  prev = ZigZagDecode<U>(U(z));
+  return DecodeResult::kOk;
+}
+
+// Decodes a block of count values from [p, end) into out, which need not be
+// aligned.  prev is the value before the block and is updated to the last
+// value.  p is only moved if the whole block is there.
+template <typename U>
+inline DecodeResult PackDecodeBlock(const char *&p, const char *end,
+                                    size_t count, U &prev, char *out) {
+  const char *q = p;
+  if (q == end) {
+    return DecodeResult::kTruncated;
+  }
+  int width = uint8_t(*q++);
+  if (width > int(sizeof(U) * 8)) {
+    return DecodeResult::kMalformed;
+  }
+  uint64_t min;
+  if (DecodeResult r = UnpackLeb128(q, end, min); r != DecodeResult::kOk) {
+    return r;
+  }
+  size_t data = (count * width + 7) / 8;
+  if (size_t(end - q) < data) {
+    return DecodeResult::kTruncated;
+  }
+  uint64_t block[kPackBlockSize];
+  uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+  for (size_t i = 0; i < count; i++) {
+    size_t bit = i * width;
+    size_t byte = bit / 8;
+    int shift = int(bit % 8);
+    uint64_t v;
+    if (width == 0) {
+      v = 0;
+    } else if (size_t(end - q) >= byte + 9) {
+      uint64_t word;
+      memcpy(&word, q + byte, sizeof(word));
+      v = word >> shift;
+      if (shift + width > 64) {
+        v |= uint64_t(uint8_t(q[byte + 8])) << (64 - shift);
+      }
+    } else {
+      // Close to the end of the buffer, so read only the bytes we need.
+      v = 0;
+      int bits = 0;
+      for (size_t b = byte; bits < shift + width; b++, bits += 8) {
+        uint64_t x = uint8_t(q[b]);
+        v |= bits == 0 ? x >> shift : x << (bits - shift);
+      }
+    }
+    block[i] = (v & mask) + min;
+  }
+  p = q + data;
+  UnpackDeltas<U>(block, count, prev, out);
+  return DecodeResult::kOk;
+}
+
+// Decodes n values of integer type T from [p, end) into out, which need not
+// be aligned.  On success p is moved past the encoded values.
+template <typename T>
+inline DecodeResult PackDecode(const char *&p, const char *end, char *out,
+                               size_t n) {
+  using U = std::make_unsigned_t<T>;
+  if (n == 0) {
+    return DecodeResult::kOk;
+  }
+  const char *q = p;
+  U prev;
+  if (DecodeResult r = PackDecodeFirst(q, end, prev);
+      r != DecodeResult::kOk) {
+    return r;
+  }
+  memcpy(out, &prev, sizeof(U));
+  for (size_t start = 1; start < n; start += kPackBlockSize) {
+    size_t count = n - start < kPackBlockSize ? n - start : kPackBlockSize;
+    if (DecodeResult r =
+            PackDecodeBlock(q, end, count, prev, out + start * sizeof(U));
+        r != DecodeResult::kOk) {
+      return r;
+    }
+  }
+  p = q;
+  return DecodeResult::kOk;
+}
+
+} // namespace neutron::serdes
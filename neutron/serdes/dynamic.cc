@@ -0,0 +1,685 @@
+#include "neutron/serdes/dynamic.h"
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "neutron/descriptor.h"
+
+namespace neutron::serdes {
+
+namespace {
+
+// Largest minimum size of a message.  Counts are 32 bits so a count times
+// a minimum size fits in 64 bits.
+constexpr uint64_t kMaxMinSize = uint64_t(1) << 32;
+
+// A string or vector: where its contents are in the arena and how many
+// bytes or elements there are.
+struct ArenaRef {
+  uint32_t offset;
+  uint32_t size;
+};
+
+ArenaRef ReadRef(const char *p) {
+  ArenaRef ref;
+  memcpy(&ref, p, sizeof(ref));
+  return ref;
+}
+
+void WriteRef(char *p, ArenaRef ref) { memcpy(p, &ref, sizeof(ref)); }
+
+// Size of a value of a field type, or 0 if it's not a value.
+uint32_t ValueSize(uint8_t type) {
+  switch (type) {
+  case descriptor::Field::TYPE_INT8:
+  case descriptor::Field::TYPE_UINT8:
+  case descriptor::Field::TYPE_BOOL:
+    return 1;
+  case descriptor::Field::TYPE_INT16:
+  case descriptor::Field::TYPE_UINT16:
+    return 2;
+  case descriptor::Field::TYPE_INT32:
+  case descriptor::Field::TYPE_UINT32:
+  case descriptor::Field::TYPE_FLOAT32:
+    return 4;
+  case descriptor::Field::TYPE_INT64:
+  case descriptor::Field::TYPE_UINT64:
+  case descriptor::Field::TYPE_FLOAT64:
+  case descriptor::Field::TYPE_TIME:
+  case descriptor::Field::TYPE_DURATION:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+// Calls fn with a value of the integer type that values of a field type are
+// sent as in compact format.
+template <typename Fn> absl::Status WithWireType(uint8_t type, Fn fn) {
+  switch (type) {
+  case descriptor::Field::TYPE_INT8:
+    return fn(int8_t{});
+  case descriptor::Field::TYPE_UINT8:
+  case descriptor::Field::TYPE_BOOL:
+    return fn(uint8_t{});
+  case descriptor::Field::TYPE_INT16:
+    return fn(int16_t{});
+  case descriptor::Field::TYPE_UINT16:
+    return fn(uint16_t{});
+  case descriptor::Field::TYPE_INT32:
+    return fn(int32_t{});
+  case descriptor::Field::TYPE_UINT32:
+  case descriptor::Field::TYPE_FLOAT32:
+  case descriptor::Field::TYPE_TIME:
+  case descriptor::Field::TYPE_DURATION:
+    return fn(uint32_t{});
+  case descriptor::Field::TYPE_INT64:
+    return fn(int64_t{});
+  case descriptor::Field::TYPE_UINT64:
+  case descriptor::Field::TYPE_FLOAT64:
+    return fn(uint64_t{});
+  default:
+    return absl::InternalError(
+        absl::StrFormat("Field type %d is not a value", int(type)));
+  }
+}
+
+// uint8 and bool arrays and vectors are sent as they are in both formats.
+bool IsBytes(const DynamicField &field) {
+  return (field.type == descriptor::Field::TYPE_UINT8 ||
+          field.type == descriptor::Field::TYPE_BOOL) &&
+         !field.IsEnum() && (field.IsArray() || field.IsVector());
+}
+
+bool Compatible(const DynamicField &field, uint8_t type) {
+  return field.type == type || (type == descriptor::Field::TYPE_UINT8 &&
+                                field.type == descriptor::Field::TYPE_BOOL);
+}
+
+// Smallest serialized size of an element of a field in ROS format, used to
+// reject impossible vector lengths before allocating.
+uint64_t MinRosSize(const DynamicField &field) {
+  switch (field.type) {
+  case descriptor::Field::TYPE_STRING:
+    return 4;
+  case descriptor::Field::TYPE_MESSAGE:
+    return field.msg->MinRosSize();
+  default:
+    return field.element_size;
+  }
+}
+
+// Smallest number of values in an element of a field in compact format.
+uint64_t MinCompactValues(const DynamicField &field) {
+  return field.type == descriptor::Field::TYPE_MESSAGE
+             ? field.msg->MinCompactValues()
+             : 1;
+}
+
+struct RosFormat {
+  static absl::Status ReadLength(const Buffer &b, uint32_t &n) {
+    return Read(b, n);
+  }
+
+  // Checks that there can be n elements of the field.
+  static absl::Status CheckCount(const Buffer &b, uint32_t n,
+                                 const DynamicField &field) {
+    return b.Check(n * MinRosSize(field));
+  }
+
+  static absl::Status ReadValues(const Buffer &b, uint8_t, char *out,
+                                 size_t size) {
+    return ReadBytes(b, out, size);
+  }
+
+  static absl::Status ReadBytes(const Buffer &b, char *out, size_t size) {
+    if (absl::Status status = b.Check(size); !status.ok()) {
+      return status;
+    }
+    memcpy(out, b.Addr(), size);
+    b.Addr() += size;
+    return absl::OkStatus();
+  }
+
+  static absl::Status WriteLength(Buffer &b, uint32_t n) { return Write(b, n); }
+
+  static absl::Status WriteValues(Buffer &b, uint8_t, const char *p,
+                                  size_t size) {
+    return WriteBytes(b, p, size);
+  }
+
+  static absl::Status WriteBytes(Buffer &b, const char *p, size_t size) {
+    if (absl::Status status = b.HasSpaceFor(size); !status.ok()) {
+      return status;
+    }
+    memcpy(b.Addr(), p, size);
+    b.Addr() += size;
+    return absl::OkStatus();
+  }
+
+  static absl::Status WriteByteVector(Buffer &b, const char *p, uint32_t n) {
+    if (absl::Status status = WriteLength(b, n); !status.ok()) {
+      return status;
+    }
+    return WriteBytes(b, p, n);
+  }
+
+  static absl::Status WriteByteArray(Buffer &b, const char *p, size_t n) {
+    return WriteBytes(b, p, n);
+  }
+};
+
+// As written by WriteCompact and CompactField.
+struct CompactFormat {
+  static absl::Status ReadLength(const Buffer &b, uint32_t &n) {
+    return b.ReadUnsignedLeb128(n);
+  }
+
+  // Every value takes a byte unless it is in a zero run, which holds at
+  // most kMaxZeroes values.  The arena needs at most 8 bytes per value so
+  // this bounds the allocation by the remaining input.
+  static absl::Status CheckCount(const Buffer &b, uint32_t n,
+                                 const DynamicField &field) {
+    return b.Check(n * MinCompactValues(field) / kMaxZeroes);
+  }
+
+  static absl::Status ReadValues(const Buffer &b, uint8_t type, char *out,
+                                 size_t size) {
+    return WithWireType(type, [&](auto v) {
+      return b.ReadLeb128Values<decltype(v)>(out, size / sizeof(v));
+    });
+  }
+
+  static absl::Status ReadBytes(const Buffer &b, char *out, size_t size) {
+    return RosFormat::ReadBytes(b, out, size);
+  }
+
+  static absl::Status WriteLength(Buffer &b, uint32_t n) {
+    return b.WriteUnsignedLeb128(n);
+  }
+
+  static absl::Status WriteValues(Buffer &b, uint8_t type, const char *p,
+                                  size_t size) {
+    return WithWireType(type, [&](auto v) {
+      return WriteCompactValues<decltype(v)>(b, p, size / sizeof(v));
+    });
+  }
+
+  static absl::Status WriteBytes(Buffer &b, const char *p, size_t size) {
+    return RosFormat::WriteBytes(b, p, size);
+  }
+
+  static absl::Status WriteByteVector(Buffer &b, const char *p, uint32_t n) {
+    // An empty vector doesn't flush the zeroes.
+    if (n > 0) {
+      if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+        return status;
+      }
+    }
+    if (absl::Status status = WriteLength(b, n); !status.ok()) {
+      return status;
+    }
+    return WriteBytes(b, p, n);
+  }
+
+  static absl::Status WriteByteArray(Buffer &b, const char *p, size_t n) {
+    if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+      return status;
+    }
+    return WriteBytes(b, p, n);
+  }
+};
+
+
+template <typename F>
+absl::Status Decode(const DynamicType &type, uint32_t base, const Buffer &b,
+                    DynamicArena &arena) {
+  for (auto &field : type.Fields()) {
+    // Where the elements go and how many there are.
+    uint32_t offset = base + field.offset;
+    uint32_t n = field.IsArray() ? uint32_t(field.array_size) : 1;
+    if (field.IsVector()) {
+      if (absl::Status status = F::ReadLength(b, n); !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = F::CheckCount(b, n, field);
+          !status.ok()) {
+        return status;
+      }
+      uint32_t contents = arena.Allocate(size_t(n) * field.element_size);
+      WriteRef(arena.data.data() + offset, {contents, n});
+      offset = contents;
+    }
+    switch (field.type) {
+    case descriptor::Field::TYPE_MESSAGE:
+      for (uint32_t i = 0; i < n; i++) {
+        if (absl::Status status = Decode<F>(
+                *field.msg, offset + i * field.element_size, b, arena);
+            !status.ok()) {
+          return status;
+        }
+      }
+      break;
+    case descriptor::Field::TYPE_STRING:
+      for (uint32_t i = 0; i < n; i++) {
+        uint32_t size;
+        if (absl::Status status = F::ReadLength(b, size); !status.ok()) {
+          return status;
+        }
+        if (absl::Status status = b.Check(size); !status.ok()) {
+          return status;
+        }
+        uint32_t contents = arena.Allocate(size);
+        memcpy(arena.data.data() + contents, b.Addr(), size);
+        b.Addr() += size;
+        WriteRef(arena.data.data() + offset + i * field.element_size,
+                 {contents, size});
+      }
+      break;
+    default: {
+      size_t size = size_t(n) * field.element_size;
+      char *out = arena.data.data() + offset;
+      if (absl::Status status = IsBytes(field)
+                                    ? F::ReadBytes(b, out, size)
+                                    : F::ReadValues(b, field.type, out, size);
+          !status.ok()) {
+        return status;
+      }
+      break;
+    }
+    }
+  }
+  return absl::OkStatus();
+}
+
+template <typename F>
+absl::Status Encode(const DynamicType &type, uint32_t base, Buffer &b,
+                    const DynamicArena &arena) {
+  const char *data = arena.data.data();
+  for (auto &field : type.Fields()) {
+    uint32_t offset = base + field.offset;
+    uint32_t n = field.IsArray() ? uint32_t(field.array_size) : 1;
+    if (field.IsVector()) {
+      ArenaRef ref = ReadRef(data + offset);
+      offset = ref.offset;
+      n = ref.size;
+      if (IsBytes(field)) {
+        if (absl::Status status = F::WriteByteVector(b, data + offset, n);
+            !status.ok()) {
+          return status;
+        }
+        continue;
+      }
+      if (absl::Status status = F::WriteLength(b, n); !status.ok()) {
+        return status;
+      }
+    }
+    switch (field.type) {
+    case descriptor::Field::TYPE_MESSAGE:
+      for (uint32_t i = 0; i < n; i++) {
+        if (absl::Status status =
+                Encode<F>(*field.msg, offset + i * field.element_size, b, arena);
+            !status.ok()) {
+          return status;
+        }
+      }
+      break;
+    case descriptor::Field::TYPE_STRING:
+      for (uint32_t i = 0; i < n; i++) {
+        ArenaRef ref = ReadRef(data + offset + i * field.element_size);
+        if (absl::Status status = F::WriteLength(b, ref.size); !status.ok()) {
+          return status;
+        }
+        if (absl::Status status = F::WriteBytes(b, data + ref.offset, ref.size);
+            !status.ok()) {
+          return status;
+        }
+      }
+      break;
+    default: {
+      size_t size = size_t(n) * field.element_size;
+      if (absl::Status status =
+              IsBytes(field) ? F::WriteByteArray(b, data + offset, size)
+                             : F::WriteValues(b, field.type, data + offset, size);
+          !status.ok()) {
+        return status;
+      }
+      break;
+    }
+    }
+  }
+  return absl::OkStatus();
+}
+
+} // namespace
+
+int DynamicType::FieldIndex(std::string_view name) const {
+  // absl::string_view may not be std::string_view.
+  if (auto it = index_.find(absl::string_view(name.data(), name.size()));
+      it != index_.end()) {
+    return it->second;
+  }
+  return -1;
+}
+
+absl::StatusOr<const DynamicType *>
+DynamicTypeCache::Get(const std::string &name) {
+  if (auto it = types_.find(name); it != types_.end()) {
+    return it->second.get();
+  }
+  absl::StatusOr<absl::Span<const char>> data = resolver_(name);
+  if (!data.ok()) {
+    return absl::InternalError(absl::StrFormat(
+        "Can't find descriptor for %s: %s", name, data.status().ToString()));
+  }
+  absl::StatusOr<descriptor::Descriptor> desc = DecodeDescriptor(*data);
+  if (!desc.ok()) {
+    return desc.status();
+  }
+  return Build(*desc);
+}
+
+absl::StatusOr<const DynamicType *>
+DynamicTypeCache::FromDescriptor(absl::Span<const char> descriptor) {
+  absl::StatusOr<descriptor::Descriptor> desc = DecodeDescriptor(descriptor);
+  if (!desc.ok()) {
+    return desc.status();
+  }
+  if (auto it = types_.find(desc->package + "/" + desc->name);
+      it != types_.end()) {
+    return it->second.get();
+  }
+  return Build(*desc);
+}
+
+absl::StatusOr<const DynamicType *>
+DynamicTypeCache::Build(const descriptor::Descriptor &desc) {
+  std::string name = desc.package + "/" + desc.name;
+  if (absl::Status status = CheckDescriptorVersion(desc); !status.ok()) {
+    return status;
+  }
+  if ((desc.flags & descriptor::Descriptor::FLAG_COMPACT_V2) != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s was generated with --compact_v2 which dynamic messages don't "
+        "support",
+        name));
+  }
+  if (!building_.insert(name).second) {
+    return absl::InternalError(
+        absl::StrFormat("Message %s contains itself", name));
+  }
+  auto type = std::make_unique<DynamicType>();
+  type->name_ = name;
+  uint32_t offset = 0;
+  for (auto &f : desc.fields) {
+    DynamicField field;
+    field.name = f.name;
+    field.type = f.type;
+    field.array_size = f.array_size;
+    if (!f.msg_name.empty()) {
+      field.msg_name = f.msg_package + "/" + f.msg_name;
+    }
+    uint32_t alignment;
+    switch (f.type) {
+    case descriptor::Field::TYPE_MESSAGE: {
+      absl::StatusOr<const DynamicType *> msg = Get(field.msg_name);
+      if (!msg.ok()) {
+        building_.erase(name);
+        return absl::InternalError(absl::StrFormat(
+            "%s.%s: %s", name, f.name, msg.status().message()));
+      }
+      field.msg = *msg;
+      field.element_size = field.msg->Size();
+      alignment = field.msg->Alignment();
+      break;
+    }
+    case descriptor::Field::TYPE_STRING:
+      field.element_size = sizeof(ArenaRef);
+      alignment = alignof(ArenaRef);
+      break;
+    default:
+      field.element_size = ValueSize(f.type);
+      if (field.element_size == 0) {
+        building_.erase(name);
+        return absl::InternalError(absl::StrFormat(
+            "%s.%s: unknown field type %d", name, f.name, int(f.type)));
+      }
+      // Time and Duration are pairs of uint32.
+      alignment = f.type == descriptor::Field::TYPE_TIME ||
+                          f.type == descriptor::Field::TYPE_DURATION
+                      ? 4
+                      : field.element_size;
+      break;
+    }
+    uint32_t size = field.element_size;
+    uint64_t min_ros = MinRosSize(field);
+    uint64_t min_compact = MinCompactValues(field);
+    if (field.IsVector()) {
+      size = sizeof(ArenaRef);
+      alignment = alignof(ArenaRef);
+      min_ros = 4;
+      min_compact = 1;
+    } else if (field.IsArray()) {
+      size *= uint32_t(field.array_size);
+      min_ros *= uint64_t(field.array_size);
+      min_compact *= uint64_t(field.array_size);
+    }
+    // Capped so that a count times the minimum can't overflow.
+    type->min_ros_size_ =
+        std::min(type->min_ros_size_ + min_ros, kMaxMinSize);
+    type->min_compact_values_ =
+        std::min(type->min_compact_values_ + min_compact, kMaxMinSize);
+    field.offset = AlignSize(offset, alignment);
+    offset = field.offset + size;
+    type->alignment_ = std::max(type->alignment_, alignment);
+    type->index_[field.name] = int(type->fields_.size());
+    type->fields_.push_back(std::move(field));
+  }
+  type->size_ = AlignSize(offset, type->alignment_);
+  building_.erase(name);
+  const DynamicType *result = type.get();
+  types_[name] = std::move(type);
+  return result;
+}
+
+absl::StatusOr<const DynamicField *> DynamicRef::Find(FieldId f) const {
+  int index = f.index;
+  if (index < 0) {
+    index = type_->FieldIndex(f.name);
+    if (index < 0) {
+      return absl::NotFoundError(
+          absl::StrFormat("%s has no field %s", type_->Name(), f.name));
+    }
+  }
+  if (size_t(index) >= type_->Fields().size()) {
+    return absl::NotFoundError(
+        absl::StrFormat("%s has no field %d", type_->Name(), index));
+  }
+  return &type_->Fields()[index];
+}
+
+absl::StatusOr<uint32_t> DynamicRef::ElementOffset(const DynamicField &field,
+                                                   size_t i) const {
+  uint32_t offset = base_ + field.offset;
+  size_t n = 1;
+  if (field.IsVector()) {
+    ArenaRef ref = ReadRef(Addr(offset));
+    offset = ref.offset;
+    n = ref.size;
+  } else if (field.IsArray()) {
+    n = size_t(field.array_size);
+  }
+  if (i >= n) {
+    return absl::OutOfRangeError(absl::StrFormat(
+        "Index %d out of range for %s.%s", i, type_->Name(), field.name));
+  }
+  return offset + uint32_t(i) * field.element_size;
+}
+
+absl::StatusOr<char *> DynamicRef::ValueAddr(FieldId f, uint8_t type,
+                                             size_t i) const {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  if (!Compatible(**field, type)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("%s.%s has type %d, not %d", type_->Name(),
+                        (*field)->name, int((*field)->type), int(type)));
+  }
+  absl::StatusOr<uint32_t> offset = ElementOffset(**field, i);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  return Addr(*offset);
+}
+
+absl::StatusOr<absl::Span<char>> DynamicRef::Values(FieldId f,
+                                                    uint8_t type) const {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  const DynamicField &fd = **field;
+  if (!Compatible(fd, type) || !(fd.IsArray() || fd.IsVector())) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s.%s is not an array of type %d", type_->Name(), fd.name, int(type)));
+  }
+  if (fd.IsVector()) {
+    ArenaRef ref = ReadRef(Addr(base_ + fd.offset));
+    return absl::Span<char>(Addr(ref.offset), size_t(ref.size) * fd.element_size);
+  }
+  return absl::Span<char>(Addr(base_ + fd.offset),
+                          size_t(fd.array_size) * fd.element_size);
+}
+
+absl::Status DynamicRef::Resize(FieldId f, size_t n, uint8_t type) {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  const DynamicField &fd = **field;
+  if (!fd.IsVector() || (type != 0 && !Compatible(fd, type))) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("%s.%s is not a vector of type %d", type_->Name(),
+                        fd.name, int(type)));
+  }
+  // The old contents are left where they are in the arena.
+  uint32_t contents = arena_->Allocate(n * fd.element_size);
+  ArenaRef ref = ReadRef(Addr(base_ + fd.offset));
+  memcpy(Addr(contents), Addr(ref.offset),
+         std::min(n, size_t(ref.size)) * fd.element_size);
+  WriteRef(Addr(base_ + fd.offset), {contents, uint32_t(n)});
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string_view> DynamicRef::GetString(FieldId f,
+                                                       size_t i) const {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  if ((*field)->type != descriptor::Field::TYPE_STRING) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s.%s is not a string", type_->Name(), (*field)->name));
+  }
+  absl::StatusOr<uint32_t> offset = ElementOffset(**field, i);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  ArenaRef ref = ReadRef(Addr(*offset));
+  return std::string_view(Addr(ref.offset), ref.size);
+}
+
+absl::Status DynamicRef::SetString(FieldId f, std::string_view s, size_t i) {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  if ((*field)->type != descriptor::Field::TYPE_STRING) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s.%s is not a string", type_->Name(), (*field)->name));
+  }
+  absl::StatusOr<uint32_t> offset = ElementOffset(**field, i);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  uint32_t contents = arena_->Allocate(s.size());
+  memcpy(Addr(contents), s.data(), s.size());
+  WriteRef(Addr(*offset), {contents, uint32_t(s.size())});
+  return absl::OkStatus();
+}
+
+absl::StatusOr<DynamicRef> DynamicRef::GetMessage(FieldId f, size_t i) const {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  if ((*field)->type != descriptor::Field::TYPE_MESSAGE) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s.%s is not a message", type_->Name(), (*field)->name));
+  }
+  absl::StatusOr<uint32_t> offset = ElementOffset(**field, i);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  return DynamicRef(arena_, (*field)->msg, *offset);
+}
+
+absl::StatusOr<size_t> DynamicRef::Size(FieldId f) const {
+  absl::StatusOr<const DynamicField *> field = Find(f);
+  if (!field.ok()) {
+    return field.status();
+  }
+  if ((*field)->IsVector()) {
+    return ReadRef(Addr(base_ + (*field)->offset)).size;
+  }
+  if ((*field)->IsArray()) {
+    return size_t((*field)->array_size);
+  }
+  return absl::InvalidArgumentError(absl::StrFormat(
+      "%s.%s is not an array or vector", type_->Name(), (*field)->name));
+}
+
+DynamicMessage::DynamicMessage(const DynamicType *type,
+                               std::unique_ptr<DynamicArena> arena)
+    : DynamicRef(arena.get(), type, 0), owned_arena_(std::move(arena)) {
+  Clear();
+}
+
+void DynamicMessage::Clear() {
+  arena_->data.clear();
+  arena_->Allocate(type_->Size());
+}
+
+absl::Status DynamicMessage::DeserializeFromArray(const char *addr, size_t len,
+                                                  bool compact) {
+  Buffer buffer(const_cast<char *>(addr), len);
+  if (absl::Status status = DeserializeFromBuffer(buffer, compact);
+      !status.ok()) {
+    return status;
+  }
+  return buffer.CheckAtEnd();
+}
+
+absl::Status DynamicMessage::DeserializeFromBuffer(const Buffer &buffer,
+                                                   bool compact) {
+  Clear();
+  if (compact) {
+    return Decode<CompactFormat>(*type_, 0, buffer, *arena_);
+  }
+  return Decode<RosFormat>(*type_, 0, buffer, *arena_);
+}
+
+absl::Status DynamicMessage::SerializeToBuffer(Buffer &buffer,
+                                               bool compact) const {
+  if (compact) {
+    if (absl::Status status = Encode<CompactFormat>(*type_, 0, buffer, *arena_);
+        !status.ok()) {
+      return status;
+    }
+    return buffer.FlushZeroes();
+  }
+  return Encode<RosFormat>(*type_, 0, buffer, *arena_);
+}
+
+} // namespace neutron::serdes
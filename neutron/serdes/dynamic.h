@@ -0,0 +1,289 @@
+#pragma once
+
+// Messages whose type is only known at run time.
+//
+// A DynamicType is the layout of a message, built from its descriptor and
+// those of the messages it refers to.  Types are built once and kept in a
+// DynamicTypeCache.  A DynamicMessage holds one message of a type in a
+// single arena: fixed size fields are stored in place, nested messages and
+// fixed arrays of messages inline in their parent, and strings and vectors
+// as an offset and length of their contents further on in the arena.
+// Values are stored as they are in memory, so vectors and arrays of them
+// can be seen as spans.
+//
+// Fields are accessed by index or name:
+//
+//   neutron::serdes::DynamicTypeCache cache;
+//   absl::StatusOr<const neutron::serdes::DynamicType *> type =
+//       cache.Get("test_msgs/All");
+//   neutron::serdes::DynamicMessage msg(*type);
+//   absl::Status status = msg.DeserializeFromArray(addr, len);
+//   absl::StatusOr<int32_t> i32 = msg.Get<int32_t>("i32");
+//   absl::StatusOr<std::string_view> bar =
+//       msg.GetMessage("vn", 0)->GetString("bar");
+//
+// Like the Transcoder, this doesn't support messages generated with
+// --compact_v2 and returns an error for their descriptors and for
+// descriptors older than descriptor::Descriptor::VERSION.
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "neutron/common_runtime.h"
+#include "neutron/descriptor/Field.h"
+#include "neutron/serdes/runtime.h"
+#include "neutron/serdes/transcoder.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace neutron::serdes {
+
+class DynamicType;
+
+struct DynamicField {
+  std::string name;
+  uint8_t type;         // descriptor::Field::TYPE_*
+  int16_t array_size;   // As in descriptor::Field.
+  std::string msg_name; // package/Name of a message or enum.
+  const DynamicType *msg = nullptr; // For message fields.
+  uint32_t offset = 0;       // Offset in the message.
+  uint32_t element_size = 0; // Size of a value, string reference or message.
+
+  bool IsArray() const { return array_size >= 0; }
+  bool IsVector() const {
+    return array_size == descriptor::Field::FIELD_VECTOR;
+  }
+  bool IsEnum() const {
+    return type != descriptor::Field::TYPE_MESSAGE && !msg_name.empty();
+  }
+};
+
+class DynamicType {
+public:
+  const std::string &Name() const { return name_; }
+  const std::vector<DynamicField> &Fields() const { return fields_; }
+
+  // Index of the named field, or -1.
+  int FieldIndex(std::string_view name) const;
+
+  // Size and alignment of the message in an arena.
+  uint32_t Size() const { return size_; }
+  uint32_t Alignment() const { return alignment_; }
+
+  // Smallest number of bytes the message takes in ROS format and smallest
+  // number of values it has in compact format, before zero runs are
+  // compressed.  Used to reject impossible vector lengths.
+  uint64_t MinRosSize() const { return min_ros_size_; }
+  uint64_t MinCompactValues() const { return min_compact_values_; }
+
+private:
+  friend class DynamicTypeCache;
+
+  std::string name_;
+  std::vector<DynamicField> fields_;
+  absl::flat_hash_map<std::string, int> index_;
+  uint32_t size_ = 0;
+  uint32_t alignment_ = 1;
+  uint64_t min_ros_size_ = 0;
+  uint64_t min_compact_values_ = 0;
+};
+
+// Builds types from descriptors and keeps them.  The types live as long as
+// the cache.
+class DynamicTypeCache {
+public:
+  explicit DynamicTypeCache(DescriptorResolver resolver = MuxDescriptor)
+      : resolver_(std::move(resolver)) {}
+  DynamicTypeCache(const DynamicTypeCache &) = delete;
+  DynamicTypeCache &operator=(const DynamicTypeCache &) = delete;
+
+  // Type for a message given its full name (package/Name).
+  absl::StatusOr<const DynamicType *> Get(const std::string &name);
+
+  // Type for the message with the given descriptor.  Messages it refers to
+  // are found by name.
+  absl::StatusOr<const DynamicType *>
+  FromDescriptor(absl::Span<const char> descriptor);
+
+private:
+  absl::StatusOr<const DynamicType *> Build(const descriptor::Descriptor &desc);
+
+  DescriptorResolver resolver_;
+  absl::flat_hash_map<std::string, std::unique_ptr<DynamicType>> types_;
+  absl::flat_hash_set<std::string> building_;
+};
+
+// The descriptor type that T is stored as.
+template <typename T> constexpr uint8_t DynamicTypeOf() {
+  if constexpr (std::is_same<T, int8_t>::value) {
+    return descriptor::Field::TYPE_INT8;
+  } else if constexpr (std::is_same<T, uint8_t>::value) {
+    return descriptor::Field::TYPE_UINT8;
+  } else if constexpr (std::is_same<T, int16_t>::value) {
+    return descriptor::Field::TYPE_INT16;
+  } else if constexpr (std::is_same<T, uint16_t>::value) {
+    return descriptor::Field::TYPE_UINT16;
+  } else if constexpr (std::is_same<T, int32_t>::value) {
+    return descriptor::Field::TYPE_INT32;
+  } else if constexpr (std::is_same<T, uint32_t>::value) {
+    return descriptor::Field::TYPE_UINT32;
+  } else if constexpr (std::is_same<T, int64_t>::value) {
+    return descriptor::Field::TYPE_INT64;
+  } else if constexpr (std::is_same<T, uint64_t>::value) {
+    return descriptor::Field::TYPE_UINT64;
+  } else if constexpr (std::is_same<T, float>::value) {
+    return descriptor::Field::TYPE_FLOAT32;
+  } else if constexpr (std::is_same<T, double>::value) {
+    return descriptor::Field::TYPE_FLOAT64;
+  } else if constexpr (std::is_same<T, Time>::value) {
+    return descriptor::Field::TYPE_TIME;
+  } else if constexpr (std::is_same<T, Duration>::value) {
+    return descriptor::Field::TYPE_DURATION;
+  } else {
+    static_assert(sizeof(T) == 0, "Not a dynamic value type");
+    return 0;
+  }
+}
+
+// Names a field by index or name.
+struct FieldId {
+  FieldId(int i) : index(i) {}
+  FieldId(std::string_view n) : name(n) {}
+  FieldId(const char *n) : name(n) {}
+
+  int index = -1;
+  std::string_view name;
+};
+
+// Memory for a dynamic message.  Everything in it is referred to by offset
+// so it can grow.
+struct DynamicArena {
+  std::vector<char> data;
+
+  // Allocates n zeroed bytes aligned to 8 and returns their offset.
+  uint32_t Allocate(size_t n) {
+    uint32_t offset = AlignSize(uint32_t(data.size()));
+    data.resize(offset + n);
+    return offset;
+  }
+};
+
+// A message, or a message inside one, in an arena.  Refs stay valid while
+// the DynamicMessage they came from exists.
+class DynamicRef {
+public:
+  DynamicRef(DynamicArena *arena, const DynamicType *type, uint32_t base)
+      : arena_(arena), type_(type), base_(base) {}
+
+  const DynamicType *Type() const { return type_; }
+
+  // Value of a number, enum, bool, time or duration field.  For arrays and
+  // vectors, i is the element.  Bools and uint8 enums are uint8_t and other
+  // enums are their unsigned integer type.
+  template <typename T> absl::StatusOr<T> Get(FieldId f, size_t i = 0) const {
+    absl::StatusOr<char *> p = ValueAddr(f, DynamicTypeOf<T>(), i);
+    if (!p.ok()) {
+      return p.status();
+    }
+    T v;
+    memcpy(&v, *p, sizeof(T));
+    return v;
+  }
+
+  template <typename T> absl::Status Set(FieldId f, T v, size_t i = 0) {
+    absl::StatusOr<char *> p = ValueAddr(f, DynamicTypeOf<T>(), i);
+    if (!p.ok()) {
+      return p.status();
+    }
+    memcpy(*p, &v, sizeof(T));
+    return absl::OkStatus();
+  }
+
+  // All the values in an array or vector.
+  template <typename T>
+  absl::StatusOr<absl::Span<const T>> GetSpan(FieldId f) const {
+    absl::StatusOr<absl::Span<char>> values = Values(f, DynamicTypeOf<T>());
+    if (!values.ok()) {
+      return values.status();
+    }
+    return absl::Span<const T>(reinterpret_cast<const T *>(values->data()),
+                               values->size() / sizeof(T));
+  }
+
+  // Replaces the contents of a vector of values.
+  template <typename T>
+  absl::Status SetVector(FieldId f, absl::Span<const T> v) {
+    if (absl::Status status = Resize(f, v.size(), DynamicTypeOf<T>());
+        !status.ok()) {
+      return status;
+    }
+    absl::StatusOr<absl::Span<char>> values = Values(f, DynamicTypeOf<T>());
+    if (!values.ok()) {
+      return values.status();
+    }
+    memcpy(values->data(), v.data(), v.size() * sizeof(T));
+    return absl::OkStatus();
+  }
+
+  // A string field, or an element of a string array or vector.
+  absl::StatusOr<std::string_view> GetString(FieldId f, size_t i = 0) const;
+  absl::Status SetString(FieldId f, std::string_view s, size_t i = 0);
+
+  // A message field, or an element of a message array or vector.
+  absl::StatusOr<DynamicRef> GetMessage(FieldId f, size_t i = 0) const;
+
+  // Number of elements in an array or vector.
+  absl::StatusOr<size_t> Size(FieldId f) const;
+
+  // Sets the number of elements in a vector of any type.  New elements are
+  // zero or empty.
+  absl::Status Resize(FieldId f, size_t n) { return Resize(f, n, 0); }
+
+protected:
+  absl::StatusOr<const DynamicField *> Find(FieldId f) const;
+  char *Addr(uint32_t offset) const { return arena_->data.data() + offset; }
+
+  // Address of value i of a field of the given type.
+  absl::StatusOr<char *> ValueAddr(FieldId f, uint8_t type, size_t i) const;
+  absl::StatusOr<absl::Span<char>> Values(FieldId f, uint8_t type) const;
+  // With type 0 any vector can be resized.
+  absl::Status Resize(FieldId f, size_t n, uint8_t type);
+  // Offset of element i of a field and the field.
+  absl::StatusOr<uint32_t> ElementOffset(const DynamicField &field,
+                                         size_t i) const;
+
+  DynamicArena *arena_;
+  const DynamicType *type_;
+  uint32_t base_;
+};
+
+class DynamicMessage : public DynamicRef {
+public:
+  // An empty message: numbers are zero and strings and vectors empty.
+  explicit DynamicMessage(const DynamicType *type)
+      : DynamicMessage(type, std::make_unique<DynamicArena>()) {}
+
+  absl::Status DeserializeFromArray(const char *addr, size_t len,
+                                    bool compact = false);
+  absl::Status DeserializeFromBuffer(const Buffer &buffer,
+                                     bool compact = false);
+  absl::Status SerializeToBuffer(Buffer &buffer, bool compact = false) const;
+
+  // Size of the arena, which is all the memory the message uses apart from
+  // this object.
+  size_t ArenaSize() const { return arena_->data.size(); }
+
+  // Empties the message, keeping the arena's memory.
+  void Clear();
+
+private:
+  DynamicMessage(const DynamicType *type, std::unique_ptr<DynamicArena> arena);
+
+  std::unique_ptr<DynamicArena> owned_arena_;
+};
+
+} // namespace neutron::serdes
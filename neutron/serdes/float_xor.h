@@ -0,0 +1,302 @@
+#pragma once
+
+// XOR encoding of float vectors and arrays for the compact v2 format.
+//
+// Slowly varying float series share their sign, exponent and high mantissa
+// bits with the previous value, so the XOR of consecutive values is mostly
+// zero bits.  Following Gorilla (Pelkonen et al, VLDB 2015), the values are
+// written as a bit stream, most significant bit first:
+//
+// - The first value is written in full.
+// - If the XOR with the previous value is zero, a single 0 bit.
+// - Otherwise a 1 bit followed by either
+//   - 0 and the meaningful bits of the XOR, when they fit in the window set
+//     by the last 11 control word, or
+//   - 1, the number of leading zero bits, the number of meaningful bits
+//     minus one, and the meaningful bits.  This sets the window.
+//
+// The counts take 5 bits for float32 and 6 bits for float64.  The stream
+// is padded with zero bits to a whole byte.  Its length isn't written since
+// the decoder knows how many values to expect.
+
+#include "neutron/serdes/varint.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace neutron::serdes {
+
+// Number of bits in each of the leading zero and length counts.
+template <typename U> constexpr int XorCountBits() {
+  return sizeof(U) == 4 ? 5 : 6;
+}
+
+// Counts the bits that would be written.
+class XorBitCounter {
+public:
+  void Put(uint64_t, int bits) { bits_ += bits; }
+  void Finish() {}
+  size_t Bytes() const { return (bits_ + 7) / 8; }
+
+private:
+  size_t bits_ = 0;
+};
+
+// Writes bits to memory that the caller has made sure is big enough.
+class XorBitWriter {
+public:
+  explicit XorBitWriter(char *p) : p_(p) {}
+
+  // v must fit in bits, which is between 1 and 64.
+  void Put(uint64_t v, int bits) {
+    if (bits > 32) {
+      Put(v >> 32, bits - 32);
+      v &= 0xffffffff;
+      bits = 32;
+    }
+    acc_ = (acc_ << bits) | v;
+    pending_ += bits;
+    while (pending_ >= 8) {
+      pending_ -= 8;
+      *p_++ = char(acc_ >> pending_);
+    }
+  }
+
+  // Pads the last byte with zero bits.
+  void Finish() {
+    if (pending_ > 0) {
+      *p_++ = char(acc_ << (8 - pending_));
+      pending_ = 0;
+    }
+  }
+
+  // After Finish, this is the end of the stream.
+  char *Addr() const { return p_; }
+
+private:
+  char *p_;
+  uint64_t acc_ = 0;
+  int pending_ = 0;
+};
+
+class XorBitReader {
+public:
+  XorBitReader(const char *p, const char *end) : p_(p), end_(end) {}
+
+  // Returns false if the stream is truncated.  bits is between 1 and 64.
+  bool Get(int bits, uint64_t &v) {
+    if (bits > 32) {
+      uint64_t high;
+      if (!Get(bits - 32, high) || !Get(32, v)) {
+        return false;
+      }
+      v |= high << 32;
+      return true;
+    }
+    while (pending_ < bits) {
+      if (p_ == end_) {
+        return false;
+      }
+      acc_ = (acc_ << 8) | uint8_t(*p_++);
+      pending_ += 8;
+    }
+    pending_ -= bits;
+    v = (acc_ >> pending_) & (~uint64_t(0) >> (64 - bits));
+    return true;
+  }
+
+  // Once all values have been read, the padding bits have been consumed too,
+  // so this is the end of the stream.
+  const char *Addr() const { return p_; }
+
+  // The byte holding the next bit to be read, and how many bits of that
+  // byte have been read already.
+  const char *Position(int &bit) const {
+    bit = (8 - pending_ % 8) % 8;
+    return p_ - (pending_ + 7) / 8;
+  }
+
+private:
+  const char *p_;
+  const char *end_;
+  uint64_t acc_ = 0;
+  int pending_ = 0;
+};
+
+inline int XorLeadingZeroes(uint32_t v) { return __builtin_clz(v); }
+inline int XorLeadingZeroes(uint64_t v) { return __builtin_clzll(v); }
+inline int XorTrailingZeroes(uint32_t v) { return __builtin_ctz(v); }
+inline int XorTrailingZeroes(uint64_t v) { return __builtin_ctzll(v); }
+
+// Encodes n values with the bit pattern U (uint32_t or uint64_t) at p, which
+// need not be aligned.  Sink is XorBitCounter or XorBitWriter.
+template <typename U, typename Sink>
+inline void XorEncode(const char *p, size_t n, Sink &sink) {
+  constexpr int kBits = sizeof(U) * 8;
+  constexpr int kCountBits = XorCountBits<U>();
+  if (n == 0) {
+    return;
+  }
+  U prev;
+  memcpy(&prev, p, sizeof(U));
+  sink.Put(prev, kBits);
+  int window_leading = -1;
+  int window_trailing = 0;
+  for (size_t i = 1; i < n; i++) {
+    U v;
+    memcpy(&v, p + i * sizeof(U), sizeof(U));
+    U x = v ^ prev;
+    prev = v;
+    if (x == 0) {
+      sink.Put(0, 1);
+      continue;
+    }
+    int leading = XorLeadingZeroes(x);
+    int trailing = XorTrailingZeroes(x);
+    if (window_leading >= 0 && leading >= window_leading &&
+        trailing >= window_trailing) {
+      sink.Put(0b10, 2);
+      sink.Put(x >> window_trailing, kBits - window_leading - window_trailing);
+      continue;
+    }
+    int length = kBits - leading - trailing;
+    sink.Put(0b11, 2);
+    sink.Put(uint64_t(leading), kCountBits);
+    sink.Put(uint64_t(length - 1), kCountBits);
+    sink.Put(x >> trailing, length);
+    window_leading = leading;
+    window_trailing = trailing;
+  }
+  sink.Finish();
+}
+
+// Size in bytes of the encoded values.
+template <typename U> inline size_t XorEncodedSize(const char *p, size_t n) {
+  XorBitCounter counter;
+  XorEncode<U>(p, n, counter);
+  return counter.Bytes();
+}
+
+// Decodes the value after prev and sets prev to it.  The window is that set
+// by the last 11 control word, with a negative window_leading if there
+// hasn't been one.
+template <typename U>
+inline DecodeResult XorDecodeNext(XorBitReader &reader, U &prev,
+                                  int &window_leading, int &window_trailing) {
+  constexpr int kBits = sizeof(U) * 8;
+  constexpr int kCountBits = XorCountBits<U>();
+  uint64_t control;
+  if (!reader.Get(1, control)) {
+    return DecodeResult::kTruncated;
+  }
+  if (control == 0) {
+    return DecodeResult::kOk;
+  }
+  if (!reader.Get(1, control)) {
+    return DecodeResult::kTruncated;
+  }
+  if (control != 0) {
+    uint64_t leading, length;
+    if (!reader.Get(kCountBits, leading) || !reader.Get(kCountBits, length)) {
+      return DecodeResult::kTruncated;
+    }
+    length++;
+    if (leading + length > uint64_t(kBits)) {
+      return DecodeResult::kMalformed;
+    }
+    window_leading = int(leading);
+    window_trailing = kBits - int(leading) - int(length);
+  } else if (window_leading < 0) {
+    // Reusing a window that was never set.
+    return DecodeResult::kMalformed;
+  }
+  uint64_t bits;
+  if (!reader.Get(kBits - window_leading - window_trailing, bits)) {
+    return DecodeResult::kTruncated;
+  }
+  prev ^= U(bits) << window_trailing;
+  return DecodeResult::kOk;
+}
+
+// Decodes n values from [p, end) into out, which need not be aligned.  On
+// success, p is moved past the encoded values.
+template <typename U>
+inline DecodeResult XorDecode(const char *&p, const char *end, char *out,
+                              size_t n) {
+  constexpr int kBits = sizeof(U) * 8;
+  if (n == 0) {
+    return DecodeResult::kOk;
+  }
+  XorBitReader reader(p, end);
+  uint64_t bits;
+  if (!reader.Get(kBits, bits)) {
+    return DecodeResult::kTruncated;
+  }
+  U prev = U(bits);
+  memcpy(out, &prev, sizeof(U));
+  int window_leading = -1;
+  int window_trailing = 0;
+  for (size_t i = 1; i < n; i++) {
+    if (DecodeResult r =
+            XorDecodeNext(reader, prev, window_leading, window_trailing);
+        r != DecodeResult::kOk) {
+      return r;
+    }
+    memcpy(out + i * sizeof(U), &prev, sizeof(U));
+  }
+  p = reader.Addr();
+  return DecodeResult::kOk;
+}
+
+// Where XorDecodeSome is up to in a stream.
+struct XorDecodeState {
+  int bit = 0; // Bits of the byte at the position that have been read.
+  int window_leading = -1;
+  int window_trailing = 0;
+};
+
+// Decodes values [start, start + count) of a stream of n values into out,
+// which holds all n, carrying on from the position p and state left by
+// decoding the values before start.  After the last value p is moved past
+// the padding.  Nothing is updated unless all count values are there.
+template <typename U>
+inline DecodeResult XorDecodeSome(const char *&p, const char *end, char *out,
+                                  size_t start, size_t count, size_t n,
+                                  XorDecodeState &state) {
+  constexpr int kBits = sizeof(U) * 8;
+  XorBitReader reader(p, end);
+  uint64_t bits;
+  if (state.bit > 0 && !reader.Get(state.bit, bits)) {
+    return DecodeResult::kTruncated;
+  }
+  XorDecodeState next = state;
+  U prev;
+  size_t i = start;
+  if (i == 0) {
+    if (!reader.Get(kBits, bits)) {
+      return DecodeResult::kTruncated;
+    }
+    prev = U(bits);
+    memcpy(out, &prev, sizeof(U));
+    i++;
+  } else {
+    memcpy(&prev, out + (i - 1) * sizeof(U), sizeof(U));
+  }
+  for (; i < start + count; i++) {
+    if (DecodeResult r = XorDecodeNext(reader, prev, next.window_leading,
+                                       next.window_trailing);
+        r != DecodeResult::kOk) {
+      return r;
+    }
+    memcpy(out + i * sizeof(U), &prev, sizeof(U));
+  }
+  p = reader.Position(next.bit);
+  if (start + count == n && next.bit > 0) {
+    p++;
+    next.bit = 0;
+  }
+  state = next;
+  return DecodeResult::kOk;
+}
+
+} // namespace neutron::serdes
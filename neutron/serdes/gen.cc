@@ -2,6 +2,7 @@
 #include "neutron/serdes/gen.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
 #include "neutron/common_gen.h"
 #include "neutron/descriptor.h"
 #include "neutron/md5.h"
@@ -62,37 +63,8 @@ absl::Status Generator::Generate(const Message &msg) {
   return absl::OkStatus();
 }
 
-static int EnumCSize(const Message &msg) {
-  // Look for the biggest constant type.
-
-  int size = 0;
-  for (auto & [ name, c ] : msg.Constants()) {
-    switch (c->Type()) {
-    case FieldType::kInt8:
-    case FieldType::kUint8:
-      size = std::max(size, 1);
-      break;
-    case FieldType::kInt16:
-    case FieldType::kUint16:
-      size = std::max(size, 2);
-      break;
-    case FieldType::kInt32:
-    case FieldType::kUint32:
-      size = std::max(size, 4);
-      break;
-    case FieldType::kInt64:
-    case FieldType::kUint64:
-      size = std::max(size, 8);
-      break;
-    default:
-      break;
-    }
-  }
-  return size;
-}
-
 static std::string EnumCType(const Message &msg) {
-  int size = EnumCSize(msg);
+  int size = msg.EnumSize();
 
   switch (size) {
   case 0:
@@ -171,6 +143,41 @@ MessageFieldIncludeFile(const Message &msg,
   return "serdes/" + field->MsgPackage() + "/" + field->MsgName() + ".h";
 }
 
+static bool IsEnumArray(const ArrayField &array) {
+  if (array.Base()->Type() != FieldType::kMessage) {
+    return false;
+  }
+  auto msg_field = std::static_pointer_cast<MessageField>(array.Base());
+  return msg_field->Msg() != nullptr && msg_field->Msg()->IsEnum();
+}
+
+std::string Generator::CompactV2Suffix(const ArrayField &array) const {
+  if (!compact_v2_) {
+    return "";
+  }
+  switch (array.Base()->Type()) {
+  case FieldType::kFloat32:
+  case FieldType::kFloat64:
+    return "Xor";
+  case FieldType::kInt16:
+  case FieldType::kUint16:
+  case FieldType::kInt32:
+  case FieldType::kUint32:
+  case FieldType::kInt64:
+  case FieldType::kUint64:
+    return "Packed";
+  default:
+    return "";
+  }
+}
+
+std::string Generator::MemberCType(FieldType type) const {
+  if (pmr_ && type == FieldType::kString) {
+    return "std::pmr::string";
+  }
+  return FieldCType(type);
+}
+
 std::shared_ptr<Field> Generator::ResolveField(std::shared_ptr<Field> field) {
   if (field->IsArray()) {
     auto array = std::static_pointer_cast<ArrayField>(field);
@@ -193,6 +200,16 @@ absl::Status Generator::GenerateHeader(const Message &msg, std::ostream &os) {
      << "neutron/serdes/runtime.h\"\n";
   os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
      << "neutron/serdes/mux.h\"\n";
+  os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
+     << "neutron/serdes/view.h\"\n";
+  os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
+     << "neutron/serdes/chunked.h\"\n";
+  os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
+     << "neutron/serdes/incremental.h\"\n";
+  os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
+     << "neutron/serdes/iovec.h\"\n";
+  os << "#include \"" << (runtime_path_.empty() ? "" : (runtime_path_ + "/"))
+     << "neutron/serdes/lz.h\"\n";
   os << "\n";
   // Include files for message fields
   absl::flat_hash_set<std::string> hdrs;
@@ -221,6 +238,9 @@ absl::Status Generator::GenerateHeader(const Message &msg, std::ostream &os) {
     if (absl::Status status = GenerateStruct(msg, os); !status.ok()) {
       return status;
     }
+    if (absl::Status status = GenerateView(msg, os); !status.ok()) {
+      return status;
+    }
   }
 
   os << "}    // namespace " << msg.GetPackage()->Name() << Namespace(true)
@@ -269,24 +289,43 @@ absl::Status Generator::GenerateStruct(const Message &msg, std::ostream &os) {
     } else if (field->IsArray()) {
       auto array = std::static_pointer_cast<ArrayField>(field);
       const char *container =
-          array->IsFixedSize() ? "std::array" : "std::vector";
+          array->IsFixedSize() ? "std::array"
+                               : (pmr_ ? "std::pmr::vector" : "std::vector");
       os << "  " << container << "<";
       if (array->Base()->Type() == FieldType::kMessage) {
         auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
         os << MessageFieldTypeName(msg, msg_field);
       } else {
-        os << FieldCType(array->Base()->Type());
+        os << MemberCType(array->Base()->Type());
       }
       if (array->IsFixedSize()) {
         os << ", " << array->Size();
       }
       os << ">";
     } else {
-      os << "  " << FieldCType(field->Type());
+      os << "  " << MemberCType(field->Type());
     }
     os << " " << SanitizeFieldName(field->Name()) << " = {};\n";
   }
   os << "\n";
+  if (pmr_) {
+    os << "  // Strings and vectors, including those in nested messages, use "
+          "the\n";
+    os << "  // allocator passed to the constructor.\n";
+    os << "  using allocator_type = std::pmr::polymorphic_allocator<char>;\n";
+    os << "  " << msg.Name() << "() = default;\n";
+    os << "  explicit " << msg.Name() << "(const allocator_type& alloc);\n";
+    os << "  " << msg.Name() << "(const " << msg.Name()
+       << "& m, const allocator_type& alloc);\n";
+    os << "  " << msg.Name() << "(" << msg.Name()
+       << "&& m, const allocator_type& alloc);\n";
+    os << "  // Deserializes a message whose strings and vectors are allocated "
+          "from\n";
+    os << "  // resource, such as a std::pmr::monotonic_buffer_resource.\n";
+    os << "  static absl::StatusOr<" << msg.Name()
+       << "> DeserializeFromArray(const char* addr, size_t len, "
+          "std::pmr::memory_resource* resource, bool compact = false);\n";
+  }
   os << "  static const char* Name() { return \"" << msg.Name() << "\"; }\n";
   os << "  static const char* FullName() { return \"" << msg.GetPackage()->Name()
      << "/" << msg.Name() << "\"; }\n";
@@ -299,31 +338,88 @@ absl::Status Generator::GenerateStruct(const Message &msg, std::ostream &os) {
         "len, bool compact = false);\n";
   os << "  absl::Status DeserializeFromBuffer(neutron::serdes::Buffer& "
         "buffer, bool compact = false);\n";
+  os << "  // As above with the message in a frame compressed by lz, which "
+        "keeps\n";
+  os << "  // history from earlier messages.  A null lz doesn't compress.\n";
+  os << "  absl::Status SerializeToBuffer(neutron::serdes::Buffer& buffer, "
+        "bool compact, neutron::serdes::LzContext* lz) const;\n";
+  os << "  absl::Status DeserializeFromBuffer(neutron::serdes::Buffer& "
+        "buffer, bool compact, neutron::serdes::LzContext* lz);\n";
   os << "  size_t SerializedSize() const;\n";
   os << "  size_t CompactSerializedSize() const;\n";
   os << "  void CompactSerializedSize(neutron::serdes::SizeAccumulator& acc) "
         "const;\n";
   os << "  absl::Status WriteToBuffer(neutron::serdes::Buffer& buffer) "
         "const;\n";
+  os << "  // ROS format without a status per field.  Errors are latched in the "
+        "buffer.\n";
+  os << "  void WriteLatchedToBuffer(neutron::serdes::Buffer& buffer) "
+        "const;\n";
   os << "  absl::Status WriteCompactToBuffer(neutron::serdes::Buffer& buffer, "
         "bool internal = false) "
         "const;\n";
+  os << "  absl::Status PresizedSerializeToBuffer(neutron::serdes::Buffer& "
+        "buffer, bool compact = false) const;\n";
+  os << "  void WriteUncheckedToBuffer(neutron::serdes::Buffer& buffer) "
+        "const;\n";
+  os << "  // Serializes in ROS format without copying large uint8 vectors "
+        "and arrays.\n";
+  os << "  // The message must outlive the writer's iovecs.\n";
+  os << "  absl::Status SerializeToIovec(neutron::serdes::IovecWriter& writer) "
+        "const;\n";
+  os << "  absl::Status WriteToIovec(neutron::serdes::IovecWriter& writer) "
+        "const;\n";
+  os << "  // Writes as much as fits in the writer's current chunk, carrying on "
+        "from\n";
+  os << "  // where the last chunk ended.  See neutron/serdes/chunked.h.\n";
+  os << "  neutron::serdes::SerializeResult "
+        "SerializeIncremental(neutron::serdes::ChunkedWriter& writer) "
+        "const;\n";
+  os << "  void WriteCompactUncheckedToBuffer(neutron::serdes::Buffer& "
+        "buffer, bool internal = false) const;\n";
   os << "  absl::Status ReadFromBuffer(neutron::serdes::Buffer& "
         "buffer);\n";
+  os << "  void ReadLatchedFromBuffer(neutron::serdes::Buffer& buffer);\n";
   os << "  absl::Status ReadCompactFromBuffer(neutron::serdes::Buffer& "
         "buffer);\n";
+  os << "  // Reads from the parser's current chunk, carrying on from where "
+        "the last\n";
+  os << "  // chunk ended.  See neutron/serdes/incremental.h.\n";
+  os << "  neutron::serdes::ParseResult "
+        "ParseIncremental(neutron::serdes::IncrementalParser& parser);\n";
   os << "  static absl::Status Expand(const neutron::serdes::Buffer& src, "
         "neutron::serdes::Buffer& dest);\n";
   os << "  static absl::Status Compact(const neutron::serdes::Buffer& "
         "src, "
         "neutron::serdes::Buffer& dest, bool internal = false);\n";
+  os << "\n";
+  os << "  // Random access to messages serialized in ROS format.  An offset "
+        "index\n";
+  os << "  // holds the offset of each field from the start of the message, "
+        "followed\n";
+  os << "  // by the size of the message.\n";
+  os << "  static constexpr size_t kNumFields = " << std::dec
+     << msg.Fields().size() << ";\n";
+  os << "  using OffsetIndex = std::array<uint32_t, kNumFields + 1>;\n";
+  os << "  // Moves p past the message at p.  Returns false if it doesn't fit "
+        "before end.\n";
+  os << "  static bool Skip(const char*& p, const char* end);\n";
+  os << "  static absl::Status Skip(neutron::serdes::Buffer& buffer);\n";
+  os << "  // Fills in index for the message at p and moves p past it.\n";
+  os << "  static bool BuildOffsetIndex(const char*& p, const char* end, "
+        "OffsetIndex& index);\n";
+  os << "  // The index of the message in [addr, addr + len).\n";
+  os << "  static absl::StatusOr<OffsetIndex> BuildOffsetIndex(const char* "
+        "addr, size_t len);\n";
+  os << "\n";
   os << "  bool operator==(const " << msg.Name() << "& m) const;\n";
   os << "  bool operator!=(const " << msg.Name() << "& m) const {\n";
   os << "    return !this->operator==(m);\n";
   os << "  }\n";
   os << "  std::string DebugString() const;\n";
   os << "  static constexpr unsigned char _descriptor[] = {\n";
-  absl::StatusOr<descriptor::Descriptor> desc = MakeDescriptor(msg);
+  absl::StatusOr<descriptor::Descriptor> desc =
+      MakeDescriptor(msg, compact_v2_);
   if (!desc.ok()) {
     return desc.status();
   }
@@ -420,15 +516,54 @@ absl::Status Generator::GenerateSource(const Message &msg, std::ostream &os) {
   os << "  neutron::serdes::Buffer buffer(const_cast<char*>(addr), len);\n";
   os << "  return DeserializeFromBuffer(buffer, compact);\n";
   os << "}\n\n";
+  os << "absl::Status " << msg.Name()
+     << "::SerializeToBuffer(neutron::serdes::Buffer& buffer, bool compact, "
+        "neutron::serdes::LzContext* lz) const {\n";
+  os << "  return neutron::serdes::LzSerializeToBuffer(*this, buffer, "
+        "compact, lz);\n";
+  os << "}\n\n";
+  os << "absl::Status " << msg.Name()
+     << "::DeserializeFromBuffer(neutron::serdes::Buffer& buffer, bool "
+        "compact, neutron::serdes::LzContext* lz) {\n";
+  os << "  return neutron::serdes::LzDeserializeFromBuffer(*this, buffer, "
+        "compact, lz);\n";
+  os << "}\n\n";
+
+  if (pmr_) {
+    if (absl::Status status = GenerateAllocatorConstructors(msg, os);
+        !status.ok()) {
+      return status;
+    }
+  }
 
   if (absl::Status status = GenerateSerializer(msg, os); !status.ok()) {
     return status;
   }
 
+  if (absl::Status status = GeneratePresizedSerializer(msg, os);
+      !status.ok()) {
+    return status;
+  }
+
+  if (absl::Status status = GenerateIovecSerializer(msg, os);
+      !status.ok()) {
+    return status;
+  }
+
+  if (absl::Status status = GenerateChunkedSerializer(msg, os);
+      !status.ok()) {
+    return status;
+  }
+
   if (absl::Status status = GenerateDeserializer(msg, os); !status.ok()) {
     return status;
   }
 
+  if (absl::Status status = GenerateIncrementalParser(msg, os);
+      !status.ok()) {
+    return status;
+  }
+
   if (absl::Status status = GenerateLength(msg, os); !status.ok()) {
     return status;
   }
@@ -442,6 +577,14 @@ absl::Status Generator::GenerateSource(const Message &msg, std::ostream &os) {
     return status;
   }
 
+  if (absl::Status status = GenerateSkip(msg, os); !status.ok()) {
+    return status;
+  }
+
+  if (absl::Status status = GenerateViewSource(msg, os); !status.ok()) {
+    return status;
+  }
+
   os << "  bool " << msg.Name() << "::operator==(const " << msg.Name()
      << "& m) const {\n";
   for (auto &field : msg.Fields()) {
@@ -462,6 +605,72 @@ absl::Status Generator::GenerateSource(const Message &msg, std::ostream &os) {
   return absl::OkStatus();
 }
 
+// In pmr mode the struct is allocator aware so that std::pmr vectors of
+// messages pass their allocator on to the elements.  The copy and move
+// constructors that take an allocator copy the contents into memory from the
+// new allocator.
+absl::Status Generator::GenerateAllocatorConstructors(const Message &msg,
+                                                      std::ostream &os) {
+  std::vector<std::string> inits;
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (!msg_field->Msg()->IsEnum()) {
+        inits.push_back(name + "(neutron::serdes::MakeWithAllocator<" +
+                        MessageFieldTypeName(msg, msg_field) + ">(alloc))");
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (!array->IsFixedSize()) {
+        inits.push_back(name + "(alloc)");
+        continue;
+      }
+      std::string type;
+      if (array->Base()->Type() == FieldType::kMessage) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        if (!msg_field->Msg()->IsEnum()) {
+          type = MessageFieldTypeName(msg, msg_field);
+        }
+      } else if (array->Base()->Type() == FieldType::kString) {
+        type = MemberCType(FieldType::kString);
+      }
+      if (!type.empty()) {
+        inits.push_back(name + "(neutron::serdes::MakeArray<" + type + ", " +
+                        std::to_string(array->Size()) + ">(alloc))");
+      }
+    } else if (field->Type() == FieldType::kString) {
+      inits.push_back(name + "(alloc)");
+    }
+  }
+  os << msg.Name() << "::" << msg.Name() << "(const allocator_type& alloc)";
+  if (!inits.empty()) {
+    os << "\n    : " << absl::StrJoin(inits, ",\n      ");
+  }
+  os << " {}\n\n";
+
+  os << msg.Name() << "::" << msg.Name() << "(const " << msg.Name()
+     << "& m, const allocator_type& alloc)\n";
+  os << "    : " << msg.Name() << "(alloc) {\n";
+  os << "  *this = m;\n";
+  os << "}\n\n";
+  os << msg.Name() << "::" << msg.Name() << "(" << msg.Name()
+     << "&& m, const allocator_type& alloc)\n";
+  os << "    : " << msg.Name() << "(alloc) {\n";
+  os << "  *this = std::move(m);\n";
+  os << "}\n\n";
+
+  os << "absl::StatusOr<" << msg.Name() << "> " << msg.Name()
+     << "::DeserializeFromArray(const char* addr, size_t len, "
+        "std::pmr::memory_resource* resource, bool compact) {\n";
+  os << "  " << msg.Name() << " msg{allocator_type(resource)};\n";
+  os << "  if (absl::Status status = msg.DeserializeFromArray(addr, len, "
+        "compact); !status.ok()) return status;\n";
+  os << "  return msg;\n";
+  os << "}\n\n";
+  return absl::OkStatus();
+}
+
 absl::Status Generator::GenerateSerializer(const Message &msg,
                                            std::ostream &os) {
   os << "absl::Status " << msg.Name()
@@ -473,72 +682,305 @@ absl::Status Generator::GenerateSerializer(const Message &msg,
   os << "  return WriteToBuffer(buffer);\n";
   os << "}\n\n";
 
-  for (std::string write : {"Write", "WriteCompact"}) {
-    bool is_compact = write == "WriteCompact";
-    os << "absl::Status " << msg.Name() << "::" << write
+  // ROS format has no state between fields so errors are latched in the
+  // buffer and checked once at the end.
+  os << "absl::Status " << msg.Name()
+     << "::WriteToBuffer(neutron::serdes::Buffer& buffer) const {\n";
+  os << "  WriteLatchedToBuffer(buffer);\n";
+  os << "  return buffer.TakeError();\n";
+  os << "}\n\n";
+
+  os << "void " << msg.Name()
+     << "::WriteLatchedToBuffer(neutron::serdes::Buffer& buffer) const {\n";
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg() == nullptr) {
+        abort();
+      }
+      // Enum classes have the same layout as their wire type.
+      if (msg_field->Msg()->IsEnum()) {
+        os << "  WriteLatched(buffer, this->" << name << ");\n";
+      } else {
+        os << "  this->" << name << ".WriteLatchedToBuffer(buffer);\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage &&
+          !IsEnumArray(*array)) {
+        if (!array->IsFixedSize()) {
+          os << "  WriteLatched(buffer, uint32_t(this->" << name
+             << ".size()));\n";
+        }
+        os << "  for (auto& m : this->" << name << ") {\n";
+        os << "    m.WriteLatchedToBuffer(buffer);\n";
+        os << "  }\n";
+      } else {
+        os << "  WriteLatched(buffer, this->" << name << ");\n";
+      }
+    } else {
+      os << "  WriteLatched(buffer, this->" << name << ");\n";
+    }
+  }
+  os << "}\n\n";
+
+  os << "absl::Status " << msg.Name()
+     << "::WriteCompactToBuffer(neutron::serdes::Buffer& buffer, bool "
+        "internal) const {\n";
+  for (auto &field : msg.Fields()) {
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg() == nullptr) {
+        abort();
+      }
+      if (msg_field->Msg()->IsEnum()) {
+        os << "  if (absl::Status status = WriteCompact(buffer, "
+           << EnumCType(*msg_field->Msg()) << "(this->"
+           << SanitizeFieldName(field->Name()) << "))"
+           << "; !status.ok()) return status;\n";
+      } else {
+        os << "  if (absl::Status status = this->"
+           << SanitizeFieldName(field->Name())
+           << ".WriteCompactToBuffer(buffer, true)"
+           << "; !status.ok()) return status;\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage) {
+        if (!array->IsFixedSize()) {
+          os << "  if (absl::Status status = WriteCompact"
+             << "(buffer, uint32_t(this->" << SanitizeFieldName(field->Name())
+             << ".size())); !status.ok()) return status;\n";
+        }
+        auto msg_field =
+            std::static_pointer_cast<MessageField>(array->Base());
+        os << "  for (auto& m : this->" << SanitizeFieldName(field->Name())
+           << ") {\n";
+        if (msg_field->Msg()->IsEnum()) {
+          os << "    if (absl::Status status = WriteCompact(buffer, "
+             << EnumCType(*msg_field->Msg())
+             << "(m)); "
+                "!status.ok()) return status;\n";
+        } else {
+          os << "    if (absl::Status status = m.WriteCompactToBuffer(buffer, "
+                "true)"
+             << "; !status.ok()) return status;\n";
+        }
+        os << "  }\n";
+      } else {
+        os << "  if (absl::Status status = WriteCompact"
+           << CompactV2Suffix(*array) << "(buffer, this->"
+           << SanitizeFieldName(field->Name())
+           << "); !status.ok()) return status;\n";
+      }
+    } else {
+      os << "  if (absl::Status status = WriteCompact(buffer, this->"
+         << SanitizeFieldName(field->Name())
+         << "); !status.ok()) return status;\n";
+    }
+  }
+  os << "  if (!internal) {\n";
+  os << "     return buffer.FlushZeroes();\n";
+  os << "  }\n";
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+  return absl::OkStatus();
+}
+
+// The iovec serializer writes ROS format like WriteToBuffer except that uint8
+// vectors and arrays go through WriteIovec, which can refer to them in place.
+absl::Status Generator::GenerateIovecSerializer(const Message &msg,
+                                                std::ostream &os) {
+  os << "absl::Status " << msg.Name()
+     << "::SerializeToIovec(neutron::serdes::IovecWriter& writer) const {\n";
+  os << "  writer.Reset();\n";
+  os << "  return WriteToIovec(writer);\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << msg.Name()
+     << "::WriteToIovec(neutron::serdes::IovecWriter& writer) const {\n";
+  for (auto &field : msg.Fields()) {
+    std::string name = "this->" + SanitizeFieldName(field->Name());
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << "  if (absl::Status status = Write(writer.Header(), "
+           << EnumCType(*msg_field->Msg()) << "(" << name
+           << ")); !status.ok()) return status;\n";
+      } else {
+        os << "  if (absl::Status status = " << name
+           << ".WriteToIovec(writer); !status.ok()) return status;\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage &&
+          !IsEnumArray(*array)) {
+        if (!array->IsFixedSize()) {
+          os << "  if (absl::Status status = Write(writer.Header(), uint32_t("
+             << name << ".size())); !status.ok()) return status;\n";
+        }
+        os << "  for (auto& m : " << name << ") {\n";
+        os << "    if (absl::Status status = m.WriteToIovec(writer); "
+              "!status.ok()) return status;\n";
+        os << "  }\n";
+      } else if (array->Base()->Type() != FieldType::kMessage &&
+                 FieldCType(array->Base()->Type()) == "uint8_t") {
+        os << "  if (absl::Status status = WriteIovec(writer, " << name
+           << "); !status.ok()) return status;\n";
+      } else {
+        os << "  if (absl::Status status = Write(writer.Header(), " << name
+           << "); !status.ok()) return status;\n";
+      }
+    } else {
+      os << "  if (absl::Status status = Write(writer.Header(), " << name
+         << "); !status.ok()) return status;\n";
+    }
+  }
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+  return absl::OkStatus();
+}
+
+// The chunked serializer is the mirror image of the incremental parser.  It
+// writes one field at a time and keeps the field it is up to in the
+// writer's frame for the message so it can carry on in the next chunk.
+absl::Status Generator::GenerateChunkedSerializer(const Message &msg,
+                                                  std::ostream &os) {
+  os << "neutron::serdes::SerializeResult " << msg.Name()
+     << "::SerializeIncremental(neutron::serdes::ChunkedWriter& writer) const "
+        "{\n";
+  os << "  using neutron::serdes::SerializeResult;\n";
+  os << "  neutron::serdes::SerializeFrame& frame = writer.Enter();\n";
+  os << "  for (; frame.field < kNumFields; writer.NextField(frame)) {\n";
+  os << "    SerializeResult r = SerializeResult::kDone;\n";
+  os << "    switch (frame.field) {\n";
+  int index = 0;
+  for (auto &field : msg.Fields()) {
+    std::string name = "this->" + SanitizeFieldName(field->Name());
+    os << "    case " << index++ << ":\n";
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << "      r = writer.Write(frame, " << EnumCType(*msg_field->Msg())
+           << "(" << name << "));\n";
+      } else {
+        os << "      r = " << name << ".SerializeIncremental(writer);\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (IsEnumArray(*array)) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        os << "      r = writer.WriteEnums<" << EnumCType(*msg_field->Msg())
+           << ">(frame, " << name << ");\n";
+      } else if (array->Base()->Type() == FieldType::kMessage) {
+        os << "      if (r = writer.WriteSize(frame, " << name
+           << "); r != SerializeResult::kDone) break;\n";
+        os << "      for (; frame.index < " << name
+           << ".size(); frame.index++) {\n";
+        os << "        if (r = " << name
+           << "[frame.index].SerializeIncremental(writer); r != "
+              "SerializeResult::kDone) break;\n";
+        os << "      }\n";
+      } else if (std::string suffix = CompactV2Suffix(*array);
+                 !suffix.empty()) {
+        os << "      r = writer.Compact() ? writer.WriteWith(frame, "
+              "[this](neutron::serdes::Buffer& buffer) { return WriteCompact"
+           << suffix << "(buffer, " << name << "); }) : writer.Write(frame, "
+           << name << ");\n";
+      } else {
+        os << "      r = writer.Write(frame, " << name << ");\n";
+      }
+    } else {
+      os << "      r = writer.Write(frame, " << name << ");\n";
+    }
+    os << "      break;\n";
+  }
+  os << "    }\n";
+  os << "    if (r != SerializeResult::kDone) return r;\n";
+  os << "  }\n";
+  os << "  return writer.Leave();\n";
+  os << "}\n\n";
+  return absl::OkStatus();
+}
+
+// The presized serializer calculates the exact serialized size once,
+// reserves that much space in the buffer and then writes all the fields
+// with no capacity checks and no per-field status.
+absl::Status Generator::GeneratePresizedSerializer(const Message &msg,
+                                                   std::ostream &os) {
+  os << "absl::Status " << msg.Name()
+     << "::PresizedSerializeToBuffer(neutron::serdes::Buffer& buffer, bool "
+        "compact) const {\n";
+  os << "  size_t size = compact ? CompactSerializedSize() : "
+        "SerializedSize();\n";
+  os << "  if (absl::Status status = buffer.Reserve(size); !status.ok()) "
+        "return status;\n";
+  os << "  if (compact) {\n";
+  os << "    WriteCompactUncheckedToBuffer(buffer);\n";
+  os << "  } else {\n";
+  os << "    WriteUncheckedToBuffer(buffer);\n";
+  os << "  }\n";
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  for (std::string write : {"WriteUnchecked", "WriteCompactUnchecked"}) {
+    bool is_compact = write == "WriteCompactUnchecked";
+    os << "void " << msg.Name() << "::" << write
        << "ToBuffer(neutron::serdes::Buffer& buffer"
-       << (is_compact ? ", bool internal" : "")
-       << ") "
-          "const {\n";
+       << (is_compact ? ", bool internal" : "") << ") const {\n";
 
     for (auto &field : msg.Fields()) {
       if (field->Type() == FieldType::kMessage) {
         auto msg_field = std::static_pointer_cast<MessageField>(field);
-        if (msg_field->Msg() == nullptr) {
-          abort();
-        }
         if (msg_field->Msg()->IsEnum()) {
-          os << "  if (absl::Status status = " << write << "(buffer, "
-             << EnumCType(*msg_field->Msg()) << "(this->"
-             << SanitizeFieldName(field->Name()) << "))"
-             << "; !status.ok()) return status;\n";
+          os << "  " << write << "(buffer, " << EnumCType(*msg_field->Msg())
+             << "(this->" << SanitizeFieldName(field->Name()) << "));\n";
         } else {
-          os << "  if (absl::Status status = this->"
-             << SanitizeFieldName(field->Name()) << "." << write
-             << "ToBuffer(buffer" << (is_compact ? ", true" : "") << ")"
-             << "; !status.ok()) return status;\n";
+          os << "  this->" << SanitizeFieldName(field->Name()) << "." << write
+             << "ToBuffer(buffer" << (is_compact ? ", true" : "") << ");\n";
         }
       } else if (field->IsArray()) {
         auto array = std::static_pointer_cast<ArrayField>(field);
-        if (array->Base()->Type() == FieldType::kMessage) {
+        if (!is_compact && IsEnumArray(*array)) {
+          os << "  " << write << "(buffer, this->"
+             << SanitizeFieldName(field->Name()) << ");\n";
+        } else if (array->Base()->Type() == FieldType::kMessage) {
           if (!array->IsFixedSize()) {
-            os << "  if (absl::Status status = " << write
-               << "(buffer, uint32_t(this->" << SanitizeFieldName(field->Name())
-               << ".size())); !status.ok()) return status;\n";
+            os << "  " << write << "(buffer, uint32_t(this->"
+               << SanitizeFieldName(field->Name()) << ".size()));\n";
           }
           auto msg_field =
               std::static_pointer_cast<MessageField>(array->Base());
           os << "  for (auto& m : this->" << SanitizeFieldName(field->Name())
              << ") {\n";
           if (msg_field->Msg()->IsEnum()) {
-            os << "    if (absl::Status status = " << write << "(buffer, "
-               << EnumCType(*msg_field->Msg())
-               << "(m)); "
-                  "!status.ok()) return status;\n";
+            os << "    " << write << "(buffer, "
+               << EnumCType(*msg_field->Msg()) << "(m));\n";
           } else {
-            os << "    if (absl::Status status = m." << write
-               << "ToBuffer(buffer" << (is_compact ? ", true" : "") << ")"
-               << "; !status.ok()) return status;\n";
+            os << "    m." << write << "ToBuffer(buffer"
+               << (is_compact ? ", true" : "") << ");\n";
           }
           os << "  }\n";
         } else {
-          auto array = std::static_pointer_cast<ArrayField>(field);
-          os << "  if (absl::Status status = " << write << "(buffer, this->"
-             << SanitizeFieldName(field->Name())
-             << "); !status.ok()) return status;\n";
+          // The v2 suffix goes before Unchecked.
+          os << "  "
+             << (is_compact ? "WriteCompact" + CompactV2Suffix(*array) +
+                                  "Unchecked"
+                            : write)
+             << "(buffer, this->" << SanitizeFieldName(field->Name())
+             << ");\n";
         }
       } else {
-        os << "  if (absl::Status status = " << write << "(buffer, this->"
-           << SanitizeFieldName(field->Name())
-           << "); !status.ok()) return status;\n";
+        os << "  " << write << "(buffer, this->"
+           << SanitizeFieldName(field->Name()) << ");\n";
       }
     }
     if (is_compact) {
       os << "  if (!internal) {\n";
-      os << "     return buffer.FlushZeroes();\n";
+      os << "    buffer.FlushZeroesUnchecked();\n";
       os << "  }\n";
     }
-    os << "  return absl::OkStatus();\n";
     os << "}\n\n";
   }
   return absl::OkStatus();
@@ -559,7 +1001,57 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
   os << "    return buffer.CheckAtEnd();\n";
   os << "}\n\n";
 
-  for (std::string read : {"Read", "ReadCompact"}) {
+  os << "absl::Status " << msg.Name()
+     << "::ReadFromBuffer(neutron::serdes::Buffer& buffer) {\n";
+  os << "  ReadLatchedFromBuffer(buffer);\n";
+  os << "  return buffer.TakeError();\n";
+  os << "}\n\n";
+
+  os << "void " << msg.Name()
+     << "::ReadLatchedFromBuffer(neutron::serdes::Buffer& buffer) {\n";
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << "  ReadLatched(buffer, this->" << name << ");\n";
+      } else {
+        os << "  this->" << name << ".ReadLatchedFromBuffer(buffer);\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage &&
+          !IsEnumArray(*array)) {
+        if (array->IsFixedSize()) {
+          os << "  for (auto& m : this->" << name << ") {\n";
+          os << "    m.ReadLatchedFromBuffer(buffer);\n";
+          os << "  }\n";
+        } else {
+          // Stop at the first error rather than trusting the count.  The
+          // new element is read in place so that it uses the vector's
+          // allocator.
+          os << "  {\n";
+          os << "    int32_t size = 0;\n";
+          os << "    ReadLatched(buffer, size);\n";
+          os << "    this->" << name << ".clear();\n";
+          os << "    for (int32_t i = 0; i < size && !buffer.Failed(); i++) "
+                "{\n";
+          os << "      this->" << name
+             << ".emplace_back().ReadLatchedFromBuffer(buffer);\n";
+          os << "    }\n";
+          os << "  }\n";
+        }
+      } else {
+        os << "  ReadLatched(buffer, this->" << name << ");\n";
+      }
+    } else {
+      os << "  ReadLatched(buffer, this->" << name << ");\n";
+    }
+  }
+  os << "}\n\n";
+
+  {
+    std::string read = "ReadCompact";
     os << "absl::Status " << msg.Name() << "::" << read
        << "FromBuffer(neutron::serdes::Buffer& buffer) {\n";
     for (auto &field : msg.Fields()) {
@@ -594,6 +1086,10 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
                << "(buffer, size); "
                   "!status.ok()) "
                   "return status;\n";
+            // The elements are appended, so a message that is read into
+            // again must not keep the old ones.
+            os << "    this->" << SanitizeFieldName(field->Name())
+               << ".clear();\n";
           }
           os << "    for (int32_t i = 0; i < size; i++) {\n";
           if (msg_field->Msg()->IsEnum()) {
@@ -619,6 +1115,14 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
                  << "FromBuffer(buffer)"
                  << "; !status.ok()) return status;\n";
               os << "    }\n";
+            } else if (pmr_) {
+              // Read into the new element so that it uses the vector's
+              // allocator.
+              os << "      if (absl::Status status = this->"
+                 << SanitizeFieldName(field->Name()) << ".emplace_back()."
+                 << read << "FromBuffer(buffer)"
+                 << "; !status.ok()) return status;\n";
+              os << "    }\n";
             } else {
               os << "      " << MessageFieldTypeName(msg, msg_field)
                  << " tmp;\n";
@@ -633,9 +1137,9 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
           }
           os << "  }\n";
         } else {
-          auto array = std::static_pointer_cast<ArrayField>(field);
-          os << "  if (absl::Status status = " << read << "(buffer, this->"
-             << SanitizeFieldName(field->Name())
+          os << "  if (absl::Status status = "
+             << read << CompactV2Suffix(*array)
+             << "(buffer, this->" << SanitizeFieldName(field->Name())
              << "); !status.ok()) return status;\n";
         }
 
@@ -651,6 +1155,64 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
   return absl::OkStatus();
 }
 
+// The incremental parser reads one field at a time.  The field being read is
+// kept in the parser's frame for the message so that when the data runs out
+// the function can return and later carry on with the same field.
+absl::Status Generator::GenerateIncrementalParser(const Message &msg,
+                                                  std::ostream &os) {
+  os << "neutron::serdes::ParseResult " << msg.Name()
+     << "::ParseIncremental(neutron::serdes::IncrementalParser& parser) {\n";
+  os << "  using neutron::serdes::ParseResult;\n";
+  os << "  neutron::serdes::ParseFrame& frame = parser.Enter();\n";
+  os << "  for (; frame.field < kNumFields; parser.NextField(frame)) {\n";
+  os << "    ParseResult r = ParseResult::kDone;\n";
+  os << "    switch (frame.field) {\n";
+  int index = 0;
+  for (auto &field : msg.Fields()) {
+    std::string name = "this->" + SanitizeFieldName(field->Name());
+    os << "    case " << index++ << ":\n";
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << "      r = parser.ReadEnum<" << EnumCType(*msg_field->Msg())
+           << ">(" << name << ");\n";
+      } else {
+        os << "      r = " << name << ".ParseIncremental(parser);\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (IsEnumArray(*array)) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        os << "      r = parser.ReadEnums<" << EnumCType(*msg_field->Msg())
+           << ">(frame, " << name << ");\n";
+      } else if (array->Base()->Type() == FieldType::kMessage) {
+        os << "      if (r = parser.ReadSize(frame, " << name
+           << "); r != ParseResult::kDone) break;\n";
+        os << "      for (; frame.index < frame.count; frame.index++) {\n";
+        os << "        if (r = " << name
+           << "[frame.index].ParseIncremental(parser); r != "
+              "ParseResult::kDone) break;\n";
+        os << "      }\n";
+      } else if (std::string suffix = CompactV2Suffix(*array);
+                 !suffix.empty()) {
+        os << "      r = parser.Read" << suffix << "(frame, " << name
+           << ");\n";
+      } else {
+        os << "      r = parser.Read(frame, " << name << ");\n";
+      }
+    } else {
+      os << "      r = parser.Read(frame, " << name << ");\n";
+    }
+    os << "      break;\n";
+  }
+  os << "    }\n";
+  os << "    if (r != ParseResult::kDone) return r;\n";
+  os << "  }\n";
+  os << "  return parser.Leave();\n";
+  os << "}\n\n";
+  return absl::OkStatus();
+}
+
 absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
   // Non-compact (ROS) serialized size.
   os << "size_t " << msg.Name() << "::SerializedSize() const {\n";
@@ -659,7 +1221,7 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
     if (field->Type() == FieldType::kMessage) {
       auto msg_field = std::static_pointer_cast<MessageField>(field);
       if (msg_field->Msg()->IsEnum()) {
-        os << "  length += " << EnumCSize(*msg_field->Msg()) << ";\n";
+        os << "  length += " << msg_field->Msg()->EnumSize() << ";\n";
       } else {
         os << "  length += this->" << SanitizeFieldName(field->Name())
            << ".SerializedSize();\n";
@@ -671,7 +1233,7 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
         if (msg_field->Msg()->IsEnum()) {
           os << "  length += " << (array->IsFixedSize() ? 0 : 4) << " + this->"
              << SanitizeFieldName(field->Name()) << ".size() * "
-             << EnumCSize(*msg_field->Msg()) << ";\n";
+             << msg_field->Msg()->EnumSize() << ";\n";
         } else {
 
           if (!array->IsFixedSize()) {
@@ -742,8 +1304,8 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
         }
         os << "  }\n";
       } else {
-        os << "  Accumulate(acc, this->" << SanitizeFieldName(field->Name())
-           << ");\n";
+        os << "  Accumulate" << CompactV2Suffix(*array) << "(acc, this->"
+           << SanitizeFieldName(field->Name()) << ");\n";
       }
     } else {
       os << "  Accumulate(acc, this->" << SanitizeFieldName(field->Name())
@@ -835,8 +1397,9 @@ absl::Status Generator::GenerateExpanderAndCompactor(const Message &msg,
           std::string array_size = array->IsFixedSize()
                                        ? absl::StrFormat(", %d", array->Size())
                                        : "";
-          auto array = std::static_pointer_cast<ArrayField>(field);
-          os << "  if (absl::Status status = " << func << "Field(src, " << vec_type
+          os << "  if (absl::Status status = " << func
+             << "Field" << CompactV2Suffix(*array) << "(src, "
+             << vec_type
              << "<" << FieldCType(array->Base()->Type()) << array_size
              << ">(), dest); !status.ok()) return status;\n";
         }
@@ -967,9 +1530,310 @@ absl::Status Generator::GenerateMux(const Message &msg, std::ostream &os) {
   os << "static struct " << msg_name << "MuxInitializer {\n";
   os << "  " << msg_name << "MuxInitializer() {\n";
   os << "    ::neutron::serdes::MessageMux::Instance().Register(" << msg_name
-     << "::FullName(), " << msg_name << "Metadata);\n";
+     << "::FullName(), " << msg_name << "Metadata, " << msg_name
+     << "::MD5());\n";
   os << "  }\n";
   os << "} " << msg_name << "MuxInitializer;\n";
   return absl::OkStatus();
 }
+// The view type for a field's value, for fields that aren't messages.
+static std::string ViewValueType(FieldType type) {
+  return type == FieldType::kString ? "std::string_view" : FieldCType(type);
+}
+
+// A FooView is a read-only view of a Foo serialized in ROS format.  It
+// records the offset of each field when it is set up and decodes the
+// fields when they are accessed.  Nested message views are set up when
+// their accessor is called.
+absl::Status Generator::GenerateView(const Message &msg, std::ostream &os) {
+  std::string view = msg.Name() + "View";
+  // The descriptor leaves the stream in hex.
+  os << std::dec;
+  os << "\n";
+  os << "// Read-only zero-copy view of a " << msg.Name()
+     << " serialized in ROS format.\n";
+  os << "// The serialized data must outlive the view.\n";
+  os << "class " << view << " {\n";
+  os << "public:\n";
+  os << "  static constexpr size_t kNumFields = " << msg.Name()
+     << "::kNumFields;\n";
+  os << "  " << view << "() = default;\n";
+  os << "  // Sets up a view of the message in [addr, addr + len).\n";
+  os << "  static absl::StatusOr<" << view
+     << "> Create(const char* addr, size_t len);\n";
+  os << "  // Sets up the view for the message at p and moves p past it.  "
+        "Returns\n";
+  os << "  // false if the message doesn't fit before end.\n";
+  os << "  bool Index(const char*& p, const char* end);\n";
+  os << "  size_t SerializedSize() const { return offsets_[kNumFields]; }\n";
+  os << "\n";
+
+  int index = 0;
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    std::string addr = absl::StrFormat("data_ + offsets_[%d]", index);
+    std::string end = absl::StrFormat("data_ + offsets_[%d]", index + 1);
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      std::string type = MessageFieldTypeName(msg, msg_field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << "  " << type << " " << name << "() const {\n";
+        os << "    return static_cast<" << type
+           << ">(neutron::serdes::ReadViewValue<"
+           << EnumCType(*msg_field->Msg()) << ">(" << addr << "));\n";
+        os << "  }\n";
+      } else {
+        os << "  " << type << "View " << name << "() const {\n";
+        os << "    " << type << "View v;\n";
+        os << "    const char* p = " << addr << ";\n";
+        os << "    v.Index(p, " << end << ");\n";
+        os << "    return v;\n";
+        os << "  }\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage &&
+          !IsEnumArray(*array)) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        std::string type = "neutron::serdes::MessageVectorView<" +
+                           MessageFieldTypeName(msg, msg_field) + "View>";
+        os << "  " << type << " " << name << "() const {\n";
+        if (array->IsFixedSize()) {
+          os << "    return " << type << "(" << addr << ", " << end << ", "
+             << array->Size() << ");\n";
+        } else {
+          os << "    return " << type << "::FromVector(" << addr << ", "
+             << end << ");\n";
+        }
+        os << "  }\n";
+      } else if (array->Base()->Type() == FieldType::kString) {
+        os << "  neutron::serdes::StringVectorView " << name
+           << "() const {\n";
+        if (array->IsFixedSize()) {
+          os << "    return neutron::serdes::StringVectorView(" << addr << ", "
+             << array->Size() << ");\n";
+        } else {
+          os << "    return neutron::serdes::StringVectorView::FromVector("
+             << addr << ");\n";
+        }
+        os << "  }\n";
+      } else {
+        // Enum classes have the same layout as their wire type.
+        std::string type =
+            IsEnumArray(*array)
+                ? MessageFieldTypeName(
+                      msg, std::static_pointer_cast<MessageField>(
+                               array->Base()))
+                : FieldCType(array->Base()->Type());
+        os << "  absl::Span<const " << type << "> " << name << "() const {\n";
+        if (array->IsFixedSize()) {
+          os << "    return neutron::serdes::ReadViewArray<" << type << ", "
+             << array->Size() << ">(" << addr << ");\n";
+        } else {
+          os << "    return neutron::serdes::ReadViewSpan<" << type << ">("
+             << addr << ");\n";
+        }
+        os << "  }\n";
+      }
+    } else if (field->Type() == FieldType::kString) {
+      os << "  std::string_view " << name << "() const {\n";
+      os << "    return neutron::serdes::ReadViewString(" << addr << ");\n";
+      os << "  }\n";
+    } else {
+      std::string type = FieldCType(field->Type());
+      os << "  " << type << " " << name << "() const {\n";
+      os << "    return neutron::serdes::ReadViewValue<" << type << ">("
+         << addr << ");\n";
+      os << "  }\n";
+    }
+    index++;
+  }
+  os << "\n";
+  os << "private:\n";
+  os << "  const char* data_ = nullptr;\n";
+  os << "  // Offset of each field from data_, followed by the end.\n";
+  os << "  " << msg.Name() << "::OffsetIndex offsets_ = {};\n";
+  os << "};\n";
+  return absl::OkStatus();
+}
+
+// The Skip and BuildOffsetIndex functions walk a message serialized in ROS
+// format without deserializing it.  Strings and vectors are skipped using
+// their length.  Skip merges consecutive fixed size fields into a single
+// bounds check.
+absl::Status Generator::GenerateSkip(const Message &msg, std::ostream &os) {
+  // The size in bytes of a fixed size field as a C++ expression, or empty
+  // if the size is only known from the data.
+  auto fixed_size = [&msg](const std::shared_ptr<Field> &field) -> std::string {
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        return "sizeof(" + EnumCType(*msg_field->Msg()) + ")";
+      }
+      return "";
+    }
+    if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (!array->IsFixedSize() ||
+          array->Base()->Type() == FieldType::kString) {
+        return "";
+      }
+      if (IsEnumArray(*array)) {
+        return absl::StrFormat(
+            "%d * sizeof(%s)", array->Size(),
+            EnumCType(
+                *std::static_pointer_cast<MessageField>(array->Base())->Msg()));
+      }
+      if (array->Base()->Type() == FieldType::kMessage) {
+        return "";
+      }
+      return absl::StrFormat("%d * sizeof(%s)", array->Size(),
+                             FieldCType(array->Base()->Type()));
+    }
+    if (field->Type() == FieldType::kString) {
+      return "";
+    }
+    return "sizeof(" + FieldCType(field->Type()) + ")";
+  };
+
+  // Skips a field whose size is only known from the data.
+  auto skip_variable = [this, &msg, &os](const std::shared_ptr<Field> &field) {
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      os << "  if (!" << MessageFieldTypeName(msg, msg_field)
+         << "::Skip(p, end)) return false;\n";
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      if (array->Base()->Type() == FieldType::kMessage &&
+          !IsEnumArray(*array)) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        os << "  {\n";
+        if (array->IsFixedSize()) {
+          os << "    uint32_t size = " << array->Size() << ";\n";
+        } else {
+          os << "    uint32_t size;\n";
+          os << "    if (!neutron::serdes::ReadViewCount(p, end, size)) "
+                "return false;\n";
+        }
+        os << "    for (uint32_t i = 0; i < size; i++) {\n";
+        os << "      if (!" << MessageFieldTypeName(msg, msg_field)
+           << "::Skip(p, end)) return false;\n";
+        os << "    }\n";
+        os << "  }\n";
+      } else {
+        std::string type =
+            IsEnumArray(*array)
+                ? EnumCType(*std::static_pointer_cast<MessageField>(
+                                 array->Base())
+                                 ->Msg())
+                : ViewValueType(array->Base()->Type());
+        if (array->IsFixedSize()) {
+          os << "  if (!neutron::serdes::SkipField(p, end, "
+                "neutron::serdes::ArrayTag<"
+             << type << ", " << array->Size() << ">())) return false;\n";
+        } else {
+          os << "  if (!neutron::serdes::SkipField(p, end, "
+                "neutron::serdes::VectorTag<"
+             << type << ">())) return false;\n";
+        }
+      }
+    } else {
+      os << "  if (!neutron::serdes::SkipField(p, end, std::string_view{})) "
+            "return false;\n";
+    }
+  };
+
+  os << "bool " << msg.Name() << "::Skip(const char*& p, const char* end) {\n";
+  std::vector<std::string> pending;
+  auto flush = [&pending, &os]() {
+    if (pending.empty()) {
+      return;
+    }
+    os << "  if (!neutron::serdes::SkipBytes(p, end, "
+       << absl::StrJoin(pending, " + ") << ")) return false;\n";
+    pending.clear();
+  };
+  for (auto &field : msg.Fields()) {
+    if (std::string size = fixed_size(field); !size.empty()) {
+      pending.push_back(size);
+      continue;
+    }
+    flush();
+    skip_variable(field);
+  }
+  flush();
+  os << "  return true;\n";
+  os << "}\n\n";
+
+  os << "absl::Status " << msg.Name()
+     << "::Skip(neutron::serdes::Buffer& buffer) {\n";
+  os << "  const char* p = buffer.Addr();\n";
+  os << "  if (!Skip(p, buffer.End())) {\n";
+  os << "    return absl::OutOfRangeError(\"Serialized " << msg.Name()
+     << " is truncated\");\n";
+  os << "  }\n";
+  os << "  buffer.Addr() = const_cast<char*>(p);\n";
+  os << "  return absl::OkStatus();\n";
+  os << "}\n\n";
+
+  os << "bool " << msg.Name()
+     << "::BuildOffsetIndex(const char*& p, const char* end, OffsetIndex& "
+        "index) {\n";
+  os << "  const char* start = p;\n";
+  int i = 0;
+  for (auto &field : msg.Fields()) {
+    os << "  index[" << i++ << "] = uint32_t(p - start);\n";
+    if (std::string size = fixed_size(field); !size.empty()) {
+      os << "  if (!neutron::serdes::SkipBytes(p, end, " << size
+         << ")) return false;\n";
+    } else {
+      skip_variable(field);
+    }
+  }
+  os << "  index[kNumFields] = uint32_t(p - start);\n";
+  os << "  return true;\n";
+  os << "}\n\n";
+
+  os << "absl::StatusOr<" << msg.Name() << "::OffsetIndex> " << msg.Name()
+     << "::BuildOffsetIndex(const char* addr, size_t len) {\n";
+  os << "  OffsetIndex index;\n";
+  os << "  const char* p = addr;\n";
+  os << "  if (!BuildOffsetIndex(p, addr + len, index)) {\n";
+  os << "    return absl::OutOfRangeError(\"Serialized " << msg.Name()
+     << " is truncated\");\n";
+  os << "  }\n";
+  os << "  if (p != addr + len) {\n";
+  os << "    return absl::InternalError(\"Extra data after serialized "
+     << msg.Name() << "\");\n";
+  os << "  }\n";
+  os << "  return index;\n";
+  os << "}\n";
+  return absl::OkStatus();
+}
+
+absl::Status Generator::GenerateViewSource(const Message &msg,
+                                           std::ostream &os) {
+  std::string view = msg.Name() + "View";
+  os << "\n";
+  os << "absl::StatusOr<" << view << "> " << view
+     << "::Create(const char* addr, size_t len) {\n";
+  os << "  " << view << " v;\n";
+  os << "  const char* p = addr;\n";
+  os << "  if (!v.Index(p, addr + len)) {\n";
+  os << "    return absl::InternalError(\"Serialized " << msg.Name()
+     << " is truncated\");\n";
+  os << "  }\n";
+  os << "  if (p != addr + len) {\n";
+  os << "    return absl::InternalError(\"Extra data after serialized "
+     << msg.Name() << "\");\n";
+  os << "  }\n";
+  os << "  return v;\n";
+  os << "}\n\n";
+
+  os << "bool " << view << "::Index(const char*& p, const char* end) {\n";
+  os << "  data_ = p;\n";
+  os << "  return " << msg.Name() << "::BuildOffsetIndex(p, end, offsets_);\n";
+  os << "}\n";
+  return absl::OkStatus();
+}
 } // namespace neutron::serdes
@@ -9,11 +9,14 @@ namespace neutron::serdes {
 class Generator : public neutron::Generator {
  public:
   Generator(std::filesystem::path root, std::string runtime_path,
-            std::string msg_path, std::string ns)
+            std::string msg_path, std::string ns, bool compact_v2 = false,
+            bool pmr = false)
       : root_(std::move(root)),
         runtime_path_(std::move(runtime_path)),
         msg_path_(std::move(msg_path)),
-        namespace_(std::move(ns)) {}
+        namespace_(std::move(ns)),
+        compact_v2_(compact_v2),
+        pmr_(pmr) {}
 
   absl::Status Generate(const Message &msg) override;
 
@@ -22,22 +25,48 @@ class Generator : public neutron::Generator {
   absl::Status GenerateSource(const Message &msg, std::ostream &os);
   absl::Status GenerateEnum(const Message &msg, std::ostream &os);
   absl::Status GenerateStruct(const Message &msg, std::ostream &os);
+  absl::Status GenerateAllocatorConstructors(const Message &msg,
+                                             std::ostream &os);
 
   absl::Status GenerateSerializer(const Message &msg, std::ostream &os);
+  absl::Status GeneratePresizedSerializer(const Message &msg,
+                                          std::ostream &os);
+  absl::Status GenerateIovecSerializer(const Message &msg, std::ostream &os);
+  absl::Status GenerateChunkedSerializer(const Message &msg,
+                                         std::ostream &os);
   absl::Status GenerateDeserializer(const Message &msg, std::ostream &os);
+  absl::Status GenerateIncrementalParser(const Message &msg,
+                                         std::ostream &os);
   absl::Status GenerateLength(const Message &msg, std::ostream &os);
   absl::Status GenerateExpanderAndCompactor(const Message &msg, std::ostream &os);
   absl::Status GenerateMux(const Message &msg, std::ostream &os);
+  absl::Status GenerateView(const Message &msg, std::ostream &os);
+  absl::Status GenerateSkip(const Message &msg, std::ostream &os);
+  absl::Status GenerateViewSource(const Message &msg, std::ostream &os);
 
   static std::shared_ptr<Field> ResolveField(std::shared_ptr<Field> field);
   std::string Namespace(bool prefix_colon_colon);
 
   std::string MessageFieldTypeName(const Message &msg,
                                    std::shared_ptr<MessageField> field);
+
+  // In compact v2, float vectors and arrays are XOR encoded and integer
+  // vectors and arrays may be delta bit-packed.  Returns the suffix for the
+  // runtime functions used for the array ("Xor" or "Packed"), or an empty
+  // string for the regular compact functions.
+  std::string CompactV2Suffix(const ArrayField &array) const;
+
+  // The C++ type of a string or scalar member of a struct.
+  std::string MemberCType(FieldType type) const;
+
   std::filesystem::path root_;
   std::string runtime_path_;
   std::string msg_path_;
   std::string namespace_;
+  bool compact_v2_;
+  // Strings and vectors are std::pmr types so that a message can be
+  // allocated from a std::pmr::memory_resource.
+  bool pmr_;
 };
 
 }  // namespace neutron::serdes
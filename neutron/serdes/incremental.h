@@ -0,0 +1,621 @@
+#pragma once
+
+// Resumable deserialization of messages that arrive in chunks.
+//
+// Each generated message has a ParseIncremental function that reads as many
+// fields as it can from the current chunk and returns kMore when it runs
+// out.  Feeding it the next chunk picks up where it stopped.  The position
+// in each nested message is kept in a stack of ParseFrames, one per level
+// of nesting, so a resumed parse goes straight back down to the field that
+// was being read.
+//
+// Strings, uint8 vectors and, in ROS format, vectors and arrays of fixed
+// size types are copied straight into the message as their bytes arrive.
+// The strings in a string vector are copied the same way, one after the
+// other.  Other vectors and arrays are read a batch of elements at a time,
+// and compact v2 packed integers a block at a time.  Anything smaller that
+// is split across chunks, such as a number or a batch, is collected until
+// it has all arrived and then read as usual.  This includes the count of
+// pending zeroes in the compact format, which is carried from one chunk to
+// the next.
+//
+// Running out of data in the middle of something is told apart from data
+// that is malformed, which is an error straight away rather than a wait for
+// more data that will never make sense.
+//
+// Use IncrementalDeserializer rather than the parser directly:
+//
+//   Foo msg;
+//   neutron::serdes::IncrementalDeserializer<Foo> d(&msg);
+//   while (...) {
+//     absl::StatusOr<bool> done = d.Feed(chunk, chunk_size);
+//     ...
+//   }
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "neutron/serdes/runtime.h"
+#include <algorithm>
+#include <deque>
+#include <string>
+
+namespace neutron::serdes {
+
+enum class ParseResult {
+  kDone,  // The field or message has been read.
+  kMore,  // Needs more data.
+  kError, // The parser's status says what went wrong.
+};
+
+// Where a message is up to.
+struct ParseFrame {
+  uint32_t field = 0; // Field being read.
+  // For vectors and strings that are read as their bytes arrive.
+  bool have_count = false;
+  uint32_t count = 0; // Number of elements.
+  uint32_t index = 0; // Next element of a vector or array.
+  size_t body = 0;    // Number of body bytes copied.
+  // For the strings in a string vector or array.
+  bool have_length = false;
+  uint32_t length = 0;
+  // For compact v2 vectors and arrays: the encoding of integers once it has
+  // been read and where a float XOR bit stream is up to.
+  int mode = -1;
+  XorDecodeState xor_state;
+};
+
+class IncrementalParser {
+public:
+  // A field that is split across chunks and can't be copied as it arrives
+  // is held until it is complete.  Fields bigger than max_field_size are
+  // rejected.
+  explicit IncrementalParser(bool compact = false,
+                             size_t max_field_size = 256 * 1024 * 1024)
+      : compact_(compact), max_field_size_(max_field_size) {}
+
+  bool Compact() const { return compact_; }
+  const absl::Status &Status() const { return status_; }
+
+  void Reset() {
+    frames_.clear();
+    depth_ = 0;
+    carry_.clear();
+    num_zeroes_ = 0;
+    status_ = absl::OkStatus();
+  }
+
+  // Sets the data for the next call to ParseIncremental.
+  void SetChunk(const char *addr, size_t size) {
+    p_ = addr;
+    end_ = addr + size;
+    depth_ = 0;
+  }
+
+  // Number of bytes left unused in the chunk.
+  size_t Remaining() const { return end_ - p_; }
+
+  // Called by a message when it starts or resumes.  Frames live in a deque
+  // so a reference to one stays valid when nested messages push theirs.
+  ParseFrame &Enter() {
+    if (depth_ == frames_.size()) {
+      frames_.emplace_back();
+    }
+    return frames_[depth_++];
+  }
+
+  // Called by a message when all its fields have been read.
+  ParseResult Leave() {
+    frames_.pop_back();
+    depth_--;
+    return ParseResult::kDone;
+  }
+
+  void NextField(ParseFrame &frame) {
+    uint32_t field = frame.field + 1;
+    frame = ParseFrame();
+    frame.field = field;
+  }
+
+  // Reads a field with fn(buffer), where fn is one of the usual Read
+  // functions.  If the field isn't all there, the data is kept and the read
+  // is tried again when there's more.
+  template <typename Fn> ParseResult ReadWith(Fn fn) {
+    bool done = false;
+    return ReadSteps([&done] { return done; },
+                     [&fn, &done](const Buffer &b) {
+                       absl::Status status = fn(b);
+                       done = status.ok();
+                       return status;
+                     });
+  }
+
+  template <typename T> ParseResult Read(ParseFrame &frame, T &v) {
+    return ReadWith([this, &v](const Buffer &b) {
+      return compact_ ? ReadCompact(b, v) : neutron::serdes::Read(b, v);
+    });
+  }
+
+  template <typename A> ParseResult Read(ParseFrame &frame, BasicString<A> &v) {
+    if (ParseResult r = ReadCount(frame); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadBody(frame, v.data(), frame.count, [&v, &frame] {
+      v.resize(frame.count);
+      return v.data();
+    });
+  }
+
+  template <typename T, typename A>
+  ParseResult Read(ParseFrame &frame, std::vector<T, A> &v) {
+    if (Streamed<T>()) {
+      return ReadBulk(frame, v);
+    }
+    if (ParseResult r = ReadElementCount(frame, v); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadElements(frame, v.data());
+  }
+
+  template <typename T, size_t N>
+  ParseResult Read(ParseFrame &frame, std::array<T, N> &v) {
+    if (Streamed<T>()) {
+      return ReadBulk(frame, v);
+    }
+    frame.count = N;
+    return ReadElements(frame, v.data());
+  }
+
+  // Compact v2 float vectors and arrays, which are XOR encoded.
+  template <typename T, typename A>
+  ParseResult ReadXor(ParseFrame &frame, std::vector<T, A> &v) {
+    if (!compact_) {
+      return Read(frame, v);
+    }
+    if (ParseResult r = ReadElementCount(frame, v); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadXorValues(frame, v.data());
+  }
+
+  template <typename T, size_t N>
+  ParseResult ReadXor(ParseFrame &frame, std::array<T, N> &v) {
+    if (!compact_) {
+      return Read(frame, v);
+    }
+    frame.count = N;
+    return ReadXorValues(frame, v.data());
+  }
+
+  // Compact v2 integer vectors and arrays, which may be delta packed.
+  template <typename T, typename A>
+  ParseResult ReadPacked(ParseFrame &frame, std::vector<T, A> &v) {
+    if (!compact_) {
+      return Read(frame, v);
+    }
+    if (ParseResult r = ReadElementCount(frame, v); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadPackedValues(frame, v.data());
+  }
+
+  template <typename T, size_t N>
+  ParseResult ReadPacked(ParseFrame &frame, std::array<T, N> &v) {
+    if (!compact_) {
+      return Read(frame, v);
+    }
+    frame.count = N;
+    return ReadPackedValues(frame, v.data());
+  }
+
+  // Enums are read as their wire type W.
+  template <typename W, typename E> ParseResult ReadEnum(E &e) {
+    W v;
+    ParseResult r = ReadWith([this, &v](const Buffer &b) {
+      return compact_ ? ReadCompact(b, v) : neutron::serdes::Read(b, v);
+    });
+    if (r == ParseResult::kDone) {
+      e = static_cast<E>(v);
+    }
+    return r;
+  }
+
+  // In compact format each element of an enum array is a LEB128 number of
+  // wire type W.
+  template <typename W, typename E, typename A>
+  ParseResult ReadEnums(ParseFrame &frame, std::vector<E, A> &v) {
+    if (!compact_) {
+      return ReadBulk(frame, v);
+    }
+    if (ParseResult r = ReadElementCount(frame, v); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadCompactEnums<W>(frame, v.data());
+  }
+
+  template <typename W, typename E, size_t N>
+  ParseResult ReadEnums(ParseFrame &frame, std::array<E, N> &v) {
+    if (!compact_) {
+      return ReadBulk(frame, v);
+    }
+    frame.count = N;
+    return ReadCompactEnums<W>(frame, v.data());
+  }
+
+  // The number of messages in a message vector.  The vector is resized when
+  // it is known.
+  template <typename M, typename A>
+  ParseResult ReadSize(ParseFrame &frame, std::vector<M, A> &v) {
+    if (ParseResult r = ReadCount(frame); r != ParseResult::kDone) {
+      return r;
+    }
+    if (frame.count > max_field_size_) {
+      return Fail(absl::InternalError(
+          absl::StrFormat("Too many messages in vector: %d", frame.count)));
+    }
+    if (v.size() != frame.count) {
+      v.resize(frame.count);
+    }
+    return ParseResult::kDone;
+  }
+
+  template <typename M, size_t N>
+  ParseResult ReadSize(ParseFrame &frame, std::array<M, N> &) {
+    frame.have_count = true;
+    frame.count = N;
+    return ParseResult::kDone;
+  }
+
+private:
+  // Elements of vectors and arrays read in one step.
+  static constexpr size_t kBatchSize = 64;
+
+  // Types whose vectors and arrays are copied as they arrive.  In compact
+  // format only uint8 bodies are stored as they are.
+  template <typename T> bool Streamed() const {
+    return compact_ ? std::is_same<T, uint8_t>::value : IsBulkCopyable<T>();
+  }
+
+  // Vectors and arrays whose bodies are stored as they are.
+  template <typename T, typename A>
+  ParseResult ReadBulk(ParseFrame &frame, std::vector<T, A> &v) {
+    if (ParseResult r = ReadCount(frame); r != ParseResult::kDone) {
+      return r;
+    }
+    return ReadBody(frame, reinterpret_cast<char *>(v.data()),
+                    size_t(frame.count) * sizeof(T), [&v, &frame] {
+                      v.resize(frame.count);
+                      return reinterpret_cast<char *>(v.data());
+                    });
+  }
+
+  template <typename T, size_t N>
+  ParseResult ReadBulk(ParseFrame &frame, std::array<T, N> &v) {
+    char *addr = reinterpret_cast<char *>(v.data());
+    return ReadBody(frame, addr, N * sizeof(T), [addr] { return addr; });
+  }
+
+  // Reads the count of a vector whose elements are read in steps and sizes
+  // the vector for them.
+  template <typename T, typename A>
+  ParseResult ReadElementCount(ParseFrame &frame, std::vector<T, A> &v) {
+    if (ParseResult r = ReadCount(frame); r != ParseResult::kDone) {
+      return r;
+    }
+    if (size_t(frame.count) * sizeof(T) > max_field_size_) {
+      return Fail(absl::InternalError(absl::StrFormat(
+          "Field of %d elements is bigger than the limit of %d bytes",
+          frame.count, max_field_size_)));
+    }
+    if (v.size() != frame.count) {
+      v.resize(frame.count);
+    }
+    return ParseResult::kDone;
+  }
+
+  // Reads elements [frame.index, frame.count) of v, which has been sized.
+  template <typename T> ParseResult ReadElements(ParseFrame &frame, T *v) {
+    return ReadBatches(
+        frame, [this, v](const Buffer &b, size_t index, size_t n) {
+          if constexpr (std::is_integral<T>::value) {
+            if (compact_) {
+              return b.ReadLeb128Values<T>(reinterpret_cast<char *>(v + index),
+                                           n);
+            }
+          }
+          for (size_t i = index; i < index + n; i++) {
+            if (absl::Status status = compact_
+                                          ? ReadCompact(b, v[i])
+                                          : neutron::serdes::Read(b, v[i]);
+                !status.ok()) {
+              return status;
+            }
+          }
+          return absl::OkStatus();
+        });
+  }
+
+  // Strings are copied as they arrive, one after the other.
+  template <typename A>
+  ParseResult ReadElements(ParseFrame &frame, BasicString<A> *v) {
+    for (; frame.index < frame.count; frame.index++) {
+      BasicString<A> &s = v[frame.index];
+      if (ParseResult r = ReadLength(frame.have_length, frame.length);
+          r != ParseResult::kDone) {
+        return r;
+      }
+      if (ParseResult r = ReadBody(frame, s.data(), frame.length,
+                                   [&s, &frame] {
+                                     s.resize(frame.length);
+                                     return s.data();
+                                   });
+          r != ParseResult::kDone) {
+        return r;
+      }
+      frame.have_length = false;
+      frame.body = 0;
+    }
+    return ParseResult::kDone;
+  }
+
+  template <typename W, typename E>
+  ParseResult ReadCompactEnums(ParseFrame &frame, E *v) {
+    return ReadBatches(frame, [v](const Buffer &b, size_t index, size_t n) {
+      for (size_t i = index; i < index + n; i++) {
+        W w;
+        if (absl::Status status = ReadCompact(b, w); !status.ok()) {
+          return status;
+        }
+        v[i] = static_cast<E>(w);
+      }
+      return absl::OkStatus();
+    });
+  }
+
+  template <typename T> ParseResult ReadXorValues(ParseFrame &frame, T *v) {
+    using U = typename XorBits<T>::type;
+    char *out = reinterpret_cast<char *>(v);
+    return ReadBatches(
+        frame, [&frame, out](const Buffer &b, size_t index, size_t n) {
+          if (b.NumZeroes() > 0) {
+            return absl::InternalError("Zero run overlaps XOR encoded values");
+          }
+          const char *p = b.Addr();
+          if (absl::Status status = DecodeStatus(
+                  XorDecodeSome<U>(p, b.End(), out, index, n, frame.count,
+                                   frame.xor_state),
+                  "XOR encoded", b.Addr(), b.End());
+              !status.ok()) {
+            return status;
+          }
+          b.Addr() = const_cast<char *>(p);
+          return absl::OkStatus();
+        });
+  }
+
+  // After the mode byte, LEB128 values are read in batches and delta packed
+  // values a block at a time.
+  template <typename T> ParseResult ReadPackedValues(ParseFrame &frame, T *v) {
+    using U = std::make_unsigned_t<T>;
+    if (frame.count == 0) {
+      // An empty vector has no mode byte.
+      return ParseResult::kDone;
+    }
+    if (frame.mode < 0) {
+      uint8_t mode;
+      if (ParseResult r =
+              ReadWith([&mode](const Buffer &b) { return b.Get(mode); });
+          r != ParseResult::kDone) {
+        return r;
+      }
+      if (mode != kCompactLeb128 && mode != kCompactDeltaPacked) {
+        return Fail(absl::InternalError(
+            absl::StrFormat("Unknown compact integer encoding %d", mode)));
+      }
+      frame.mode = mode;
+    }
+    char *out = reinterpret_cast<char *>(v);
+    if (frame.mode == kCompactLeb128) {
+      return ReadBatches(frame,
+                         [out](const Buffer &b, size_t index, size_t n) {
+                           return b.ReadLeb128Values<T>(
+                               out + index * sizeof(T), n);
+                         });
+    }
+    return ReadSteps(
+        [&frame] { return frame.index == frame.count; },
+        [&frame, out](const Buffer &b) {
+          if (b.NumZeroes() > 0) {
+            return absl::InternalError("Zero run overlaps packed values");
+          }
+          const char *p = b.Addr();
+          U prev;
+          size_t n = 1;
+          DecodeResult result;
+          if (frame.index == 0) {
+            result = PackDecodeFirst(p, b.End(), prev);
+            memcpy(out, &prev, sizeof(U));
+          } else {
+            memcpy(&prev, out + (frame.index - 1) * sizeof(U), sizeof(U));
+            n = std::min(kPackBlockSize, size_t(frame.count - frame.index));
+            result = PackDecodeBlock(p, b.End(), n, prev,
+                                     out + frame.index * sizeof(U));
+          }
+          if (absl::Status status =
+                  DecodeStatus(result, "packed", b.Addr(), b.End());
+              !status.ok()) {
+            return status;
+          }
+          b.Addr() = const_cast<char *>(p);
+          frame.index += uint32_t(n);
+          return absl::OkStatus();
+        });
+  }
+
+  // Reads elements [frame.index, frame.count) with read(buffer, index, n), a
+  // batch of n at a time, so an element split across chunks only means
+  // reading its batch again.
+  template <typename Fn> ParseResult ReadBatches(ParseFrame &frame, Fn read) {
+    return ReadSteps([&frame] { return frame.index == frame.count; },
+                     [&frame, &read](const Buffer &b) {
+                       size_t n = std::min(kBatchSize,
+                                           size_t(frame.count - frame.index));
+                       absl::Status status = read(b, frame.index, n);
+                       if (status.ok()) {
+                         frame.index += uint32_t(n);
+                       }
+                       return status;
+                     });
+  }
+
+  // Reads with step(buffer) until done() is true, keeping the position after
+  // each step.  When a step runs out of data, the data from where it started
+  // is kept and it is tried again when there's more.  Any other error fails
+  // the parse.
+  template <typename Done, typename Step>
+  ParseResult ReadSteps(Done done, Step step) {
+    const char *data = p_;
+    size_t size = end_ - p_;
+    size_t old = carry_.size();
+    if (old > 0) {
+      carry_.append(p_, size);
+      data = carry_.data();
+      size = carry_.size();
+    }
+    Buffer buffer(const_cast<char *>(data), size);
+    buffer.SetNumZeroes(num_zeroes_);
+    size_t used = 0;
+    while (!done()) {
+      if (absl::Status status = step(buffer); !status.ok()) {
+        if (!IsTruncated(status)) {
+          return Fail(std::move(status));
+        }
+        if (old > 0) {
+          carry_.erase(0, used);
+        } else {
+          carry_.assign(data + used, size - used);
+        }
+        p_ = end_;
+        if (carry_.size() > max_field_size_) {
+          return Fail(absl::InternalError(absl::StrFormat(
+              "Field is bigger than the limit of %d bytes", max_field_size_)));
+        }
+        return ParseResult::kMore;
+      }
+      used = buffer.Addr() - data;
+      num_zeroes_ = buffer.NumZeroes();
+    }
+    p_ += used - old;
+    carry_.clear();
+    return ParseResult::kDone;
+  }
+
+  ParseResult Fail(absl::Status status) {
+    status_ = std::move(status);
+    return ParseResult::kError;
+  }
+
+  // Reads the length of a string or vector into frame.count.
+  ParseResult ReadCount(ParseFrame &frame) {
+    return ReadLength(frame.have_count, frame.count);
+  }
+
+  ParseResult ReadLength(bool &have_length, uint32_t &length) {
+    if (have_length) {
+      return ParseResult::kDone;
+    }
+    uint32_t n;
+    ParseResult r = ReadWith([this, &n](const Buffer &b) {
+      return compact_ ? b.ReadUnsignedLeb128(n) : neutron::serdes::Read(b, n);
+    });
+    if (r == ParseResult::kDone) {
+      have_length = true;
+      length = n;
+    }
+    return r;
+  }
+
+  // Copies size bytes as they arrive.  Before the first byte, start() sizes
+  // the destination and returns its address.  After that dest is used.
+  template <typename Start>
+  ParseResult ReadBody(ParseFrame &frame, char *dest, size_t size,
+                       Start start) {
+    if (frame.body == 0) {
+      if (size > max_field_size_) {
+        return Fail(absl::InternalError(absl::StrFormat(
+            "Field of %d bytes is bigger than the limit of %d bytes", size,
+            max_field_size_)));
+      }
+      dest = start();
+    }
+    size_t n = std::min(size - frame.body, size_t(end_ - p_));
+    if (n > 0) {
+      memcpy(dest + frame.body, p_, n);
+      p_ += n;
+      frame.body += n;
+    }
+    return frame.body == size ? ParseResult::kDone : ParseResult::kMore;
+  }
+
+  bool compact_;
+  size_t max_field_size_;
+  const char *p_ = nullptr;
+  const char *end_ = nullptr;
+  std::deque<ParseFrame> frames_;
+  size_t depth_ = 0;
+  std::string carry_;  // Start of a field that is split across chunks.
+  int num_zeroes_ = 0; // Zeroes still to read in compact format.
+  absl::Status status_;
+};
+
+// Deserializes a message of type M from a sequence of chunks.
+template <typename M> class IncrementalDeserializer {
+public:
+  explicit IncrementalDeserializer(M *msg, bool compact = false)
+      : msg_(msg), parser_(compact) {}
+
+  // Reads what it can from the chunk.  Returns true when the message is
+  // complete, after which Remaining() says how many bytes of the chunk were
+  // not used.
+  absl::StatusOr<bool> Feed(const char *addr, size_t size) {
+    if (done_) {
+      return absl::InternalError("Message is already complete");
+    }
+    parser_.SetChunk(addr, size);
+    switch (msg_->ParseIncremental(parser_)) {
+    case ParseResult::kDone:
+      done_ = true;
+      return true;
+    case ParseResult::kMore:
+      return false;
+    case ParseResult::kError:
+      break;
+    }
+    return parser_.Status();
+  }
+
+  bool Done() const { return done_; }
+  size_t Remaining() const { return parser_.Remaining(); }
+
+  // Returns an error unless the whole message has been read.
+  absl::Status Finish() const {
+    if (!done_) {
+      return absl::InternalError(absl::StrFormat(
+          "Incomplete %s at end of data", M::FullName()));
+    }
+    return absl::OkStatus();
+  }
+
+  // Starts again with another message.
+  void Reset(M *msg) {
+    msg_ = msg;
+    parser_.Reset();
+    done_ = false;
+  }
+
+private:
+  M *msg_;
+  IncrementalParser parser_;
+  bool done_ = false;
+};
+
+} // namespace neutron::serdes
@@ -0,0 +1,109 @@
+#pragma once
+
+// Scatter-gather serialization in ROS format.
+//
+// Messages like images are mostly one big uint8 vector.  Rather than copying
+// it into a contiguous buffer only to write that to a socket or file, the
+// generated SerializeToIovec writes the small fields into a header buffer and
+// refers to the bodies of large uint8 vectors and arrays where they are in
+// the message.  The result is a list of iovecs to pass to writev.  The
+// message must not be changed or destroyed until the iovecs have been
+// written.
+
+#include "absl/types/span.h"
+#include "neutron/serdes/runtime.h"
+#include <sys/uio.h>
+#include <vector>
+
+namespace neutron::serdes {
+
+class IovecWriter {
+public:
+  // uint8 vectors and arrays of at least min_external bytes are referred to
+  // in place.  Anything smaller is copied into the header buffer.
+  explicit IovecWriter(size_t min_external = 4096, size_t initial_size = 256)
+      : min_external_(min_external), header_(initial_size) {}
+
+  size_t MinExternal() const { return min_external_; }
+
+  // The buffer that small fields are written to.
+  Buffer &Header() { return header_; }
+
+  void Reset() {
+    header_.Rewind();
+    external_.clear();
+    iovecs_.clear();
+  }
+
+  // Adds n bytes at addr, which are not copied, after what has been written
+  // to the header buffer so far.
+  void AddExternal(const void *addr, size_t n) {
+    external_.push_back({header_.Size(), addr, n});
+  }
+
+  // The iovecs for the serialized message.  They refer to the header buffer
+  // so they are only good until the writer is next used.
+  absl::Span<const struct iovec> Iovecs() {
+    iovecs_.clear();
+    char *header = header_.data();
+    size_t offset = 0;
+    for (auto &ext : external_) {
+      if (ext.offset > offset) {
+        iovecs_.push_back({header + offset, ext.offset - offset});
+        offset = ext.offset;
+      }
+      iovecs_.push_back({const_cast<void *>(ext.addr), ext.size});
+    }
+    if (header_.Size() > offset) {
+      iovecs_.push_back({header + offset, header_.Size() - offset});
+    }
+    return iovecs_;
+  }
+
+  // Total serialized size.
+  size_t Size() const {
+    size_t size = header_.Size();
+    for (auto &ext : external_) {
+      size += ext.size;
+    }
+    return size;
+  }
+
+private:
+  struct External {
+    size_t offset; // Offset into the header where this goes.
+    const void *addr;
+    size_t size;
+  };
+
+  size_t min_external_;
+  Buffer header_;
+  std::vector<External> external_;
+  std::vector<struct iovec> iovecs_;
+};
+
+template <typename A>
+inline absl::Status WriteIovec(IovecWriter &writer,
+                               const std::vector<uint8_t, A> &v) {
+  if (v.size() < writer.MinExternal()) {
+    return Write(writer.Header(), v);
+  }
+  if (absl::Status status = Write(writer.Header(), uint32_t(v.size()));
+      !status.ok()) {
+    return status;
+  }
+  writer.AddExternal(v.data(), v.size());
+  return absl::OkStatus();
+}
+
+template <size_t N>
+inline absl::Status WriteIovec(IovecWriter &writer,
+                               const std::array<uint8_t, N> &v) {
+  if (N < writer.MinExternal()) {
+    return Write(writer.Header(), v);
+  }
+  writer.AddExternal(v.data(), N);
+  return absl::OkStatus();
+}
+
+} // namespace neutron::serdes
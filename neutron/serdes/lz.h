@@ -0,0 +1,449 @@
+#pragma once
+
+// LZ block compression of serialized messages.
+//
+// Compact format removes zeros and small integers but leaves strings and
+// byte content as they are.  An LzContext compresses whole serialized
+// messages with a byte oriented LZ77 codec in the style of LZ4: one hash
+// probe per position, no entropy coding, and matches copied a word at a
+// time, so it runs at memory speeds rather than saving the last few
+// percent.
+//
+// A context keeps the last kLzWindowSize bytes of the messages it has
+// seen and matches can refer back into them.  Successive messages of one
+// type are usually much alike, so for a stream of them this does far
+// better than compressing each on its own.  The sender and receiver each
+// have a context per stream and must see the same messages in the same
+// order.
+//
+//   neutron::serdes::LzContext lz;
+//   absl::Status status = msg.SerializeToBuffer(buffer, true, &lz);
+//   ...
+//   neutron::serdes::LzContext lz;
+//   absl::Status status = msg.DeserializeFromBuffer(buffer, true, &lz);
+//
+// Each message is sent as a frame:
+//
+//   uint8    kLzMagic
+//   uint8    flags: kLzCompressed, kLzHistory
+//   LEB128   size of the message
+//   LEB128   stream position: bytes in the stream before the message
+//   uint32   size of the body, little endian
+//   body     the compressed message, or the message if it didn't compress
+//
+// A frame without kLzHistory doesn't refer to earlier messages and starts
+// a new stream for the receiver.  Otherwise the stream position must be
+// the receiver's, which catches lost or reordered messages.
+//
+// The body is a sequence of tokens.  The high 4 bits of a token are the
+// number of literals that follow it and the low 4 bits are the length of
+// a match after them, less kLzMinMatch.  A 15 in either is followed by
+// bytes added to it, up to and including the first that isn't 255.  The
+// literal bytes come next and then the match offset as a little endian
+// uint16.  The last token has only literals.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "neutron/serdes/runtime.h"
+#include "neutron/serdes/varint.h"
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace neutron::serdes {
+
+constexpr uint8_t kLzMagic = 0xb7;
+constexpr uint8_t kLzCompressed = 1;
+constexpr uint8_t kLzHistory = 2;
+
+constexpr size_t kLzWindowSize = 65535;
+constexpr size_t kLzMinMatch = 4;
+constexpr int kLzHashBits = 14;
+
+// Matches stop this far before the end of a message so the decoder can
+// copy whole words.  The last kLzLastLiterals bytes are always literals.
+constexpr size_t kLzMatchLimit = 12;
+constexpr size_t kLzLastLiterals = 5;
+
+// Largest frame header.
+constexpr size_t kLzMaxHeader = 2 + 10 + 10 + 4;
+
+// Largest compressed body for a message of n bytes.
+inline size_t LzMaxCompressedSize(size_t n) { return n + n / 255 + 16; }
+
+// Each byte of a body decodes to at most 255 bytes, since that is the most
+// a length byte can add to a match.
+inline uint64_t LzMaxDecompressedSize(uint64_t size) {
+  return size * 255 + 16;
+}
+
+constexpr size_t kLzDefaultMaxMessageSize = size_t(1) << 30;
+
+class LzContext {
+public:
+  LzContext() : table_(size_t(1) << kLzHashBits) {}
+
+  // Forgets the messages seen so far.  The next frame sent starts a new
+  // stream.
+  void Reset() {
+    history_ = 0;
+    std::fill(table_.begin(), table_.end(), 0);
+    table_base_ = stream_pos_;
+  }
+
+  // Appends a frame holding the n bytes at src to dest.
+  absl::Status Compress(const char *src, size_t n, Buffer &dest);
+
+  // Reads a frame from src and returns the message in it.  The result is
+  // valid until the next call.
+  absl::StatusOr<absl::Span<const char>> Decompress(const Buffer &src);
+
+  // Serialized form of a message before it is compressed.
+  Buffer &Scratch() { return scratch_; }
+
+  // Frames holding messages bigger than this are rejected by Decompress
+  // before any memory is allocated for them.
+  void SetMaxMessageSize(size_t n) { max_message_size_ = n; }
+
+private:
+  // Drops history beyond the window and makes room for n more bytes after
+  // it.
+  char *Append(size_t n);
+  size_t CompressBlock(size_t start, size_t end, char *out);
+  bool DecompressBlock(const char *ip, const char *iend, size_t start,
+                       size_t end);
+
+  static uint32_t Load32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static uint32_t Hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kLzHashBits);
+  }
+
+  // window_[0, history_) holds the end of the stream so far, which ends at
+  // stream_pos_.
+  std::vector<char> window_;
+  size_t history_ = 0;
+  uint64_t stream_pos_ = 0;
+
+  // Encoder hash table of stream positions, as offsets from table_base_
+  // plus one so that zero is empty.
+  std::vector<uint32_t> table_;
+  uint64_t table_base_ = 0;
+
+  size_t max_message_size_ = kLzDefaultMaxMessageSize;
+  Buffer scratch_;
+};
+
+inline char *LzContext::Append(size_t n) {
+  if (history_ > kLzWindowSize) {
+    memmove(window_.data(), window_.data() + history_ - kLzWindowSize,
+            kLzWindowSize);
+    history_ = kLzWindowSize;
+  }
+  // Slack for word copies past the end.
+  window_.resize(history_ + n + 16);
+  return window_.data() + history_;
+}
+
+inline absl::Status LzContext::Compress(const char *src, size_t n,
+                                        Buffer &dest) {
+  if (absl::Status status =
+          dest.HasSpaceFor(kLzMaxHeader + LzMaxCompressedSize(n));
+      !status.ok()) {
+    return status;
+  }
+  // Positions in the table are 32 bits so start again before they run out.
+  if (stream_pos_ + n - table_base_ >= (uint64_t(1) << 31)) {
+    std::fill(table_.begin(), table_.end(), 0);
+    table_base_ = stream_pos_;
+  }
+  bool history = history_ > 0;
+  memcpy(Append(n), src, n);
+
+  char *p = dest.Addr();
+  char *flags = p + 1;
+  p[0] = char(kLzMagic);
+  p = PackLeb128(p + 2, n);
+  p = PackLeb128(p, stream_pos_);
+  char *body_size = p;
+  char *body = p + sizeof(uint32_t);
+
+  size_t size = CompressBlock(history_, history_ + n, body);
+  *flags = char(history ? kLzHistory : 0);
+  if (size < n) {
+    *flags |= kLzCompressed;
+  } else {
+    memcpy(body, src, n);
+    size = n;
+  }
+  uint32_t size32 = uint32_t(size);
+  memcpy(body_size, &size32, sizeof(size32));
+  dest.Addr() = body + size;
+
+  history_ += n;
+  stream_pos_ += n;
+  return absl::OkStatus();
+}
+
+// Compresses window_[start, end) with window_[0, start) as history.
+inline size_t LzContext::CompressBlock(size_t start, size_t end, char *out) {
+  const char *base = window_.data();
+  // Stream position of base[0] relative to the table.
+  int64_t base_pos = int64_t(stream_pos_ - table_base_) - int64_t(start);
+  char *op = out;
+  size_t anchor = start;
+
+  auto put_length = [&op](size_t len) {
+    while (len >= 255) {
+      *op++ = char(255);
+      len -= 255;
+    }
+    *op++ = char(len);
+  };
+  auto put_literals = [&](size_t len, uint8_t match_code) {
+    *op++ = char((len >= 15 ? 0xf0 : len << 4) | match_code);
+    if (len >= 15) {
+      put_length(len - 15);
+    }
+    memcpy(op, base + anchor, len);
+    op += len;
+  };
+
+  if (end - start > kLzMatchLimit) {
+    size_t limit = end - kLzMatchLimit;
+    size_t match_end = end - kLzLastLiterals;
+    size_t ip = start;
+    while (ip < limit) {
+      uint32_t seq = Load32(base + ip);
+      uint32_t &entry = table_[Hash(seq)];
+      int64_t candidate = int64_t(entry) - 1 - base_pos;
+      bool empty = entry == 0;
+      entry = uint32_t(base_pos + int64_t(ip) + 1);
+      if (empty || candidate < 0 || ip - size_t(candidate) > kLzWindowSize ||
+          Load32(base + candidate) != seq) {
+        // Step further through data that doesn't match.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      size_t match = size_t(candidate);
+      size_t len = kLzMinMatch;
+      for (;;) {
+        if (ip + len + 8 > match_end) {
+          while (ip + len < match_end && base[ip + len] == base[match + len]) {
+            len++;
+          }
+          break;
+        }
+        uint64_t a, b;
+        memcpy(&a, base + ip + len, sizeof(a));
+        memcpy(&b, base + match + len, sizeof(b));
+        if (a != b) {
+          len += __builtin_ctzll(a ^ b) / 8;
+          break;
+        }
+        len += 8;
+      }
+      size_t code = len - kLzMinMatch;
+      put_literals(ip - anchor, uint8_t(code >= 15 ? 15 : code));
+      uint16_t offset = uint16_t(ip - match);
+      memcpy(op, &offset, sizeof(offset));
+      op += sizeof(offset);
+      if (code >= 15) {
+        put_length(code - 15);
+      }
+      ip += len;
+      anchor = ip;
+      if (ip < limit) {
+        table_[Hash(Load32(base + ip - 2))] =
+            uint32_t(base_pos + int64_t(ip - 2) + 1);
+      }
+    }
+  }
+  put_literals(end - anchor, 0);
+  return op - out;
+}
+
+inline absl::StatusOr<absl::Span<const char>>
+LzContext::Decompress(const Buffer &src) {
+  auto corrupt = [](const char *what) {
+    return absl::InternalError(
+        absl::StrFormat("Corrupt compressed message: %s", what));
+  };
+  const char *p = src.Addr();
+  const char *end = src.End();
+  if (end - p < 2 || uint8_t(p[0]) != kLzMagic) {
+    return corrupt("bad frame header");
+  }
+  uint8_t flags = uint8_t(p[1]);
+  p += 2;
+  uint64_t n, pos;
+  if (UnpackLeb128(p, end, n) != DecodeResult::kOk ||
+      UnpackLeb128(p, end, pos) != DecodeResult::kOk) {
+    return corrupt("bad frame header");
+  }
+  uint32_t size;
+  if (size_t(end - p) < sizeof(size)) {
+    return corrupt("bad frame header");
+  }
+  memcpy(&size, p, sizeof(size));
+  p += sizeof(size);
+  if (size_t(end - p) < size) {
+    return corrupt("truncated");
+  }
+  if ((flags & kLzCompressed) == 0 ? n != size
+                                   : n > LzMaxDecompressedSize(size)) {
+    return corrupt("bad message size");
+  }
+  if (n > max_message_size_) {
+    return absl::InternalError(absl::StrFormat(
+        "Compressed message of %d bytes is bigger than the limit of %d", n,
+        max_message_size_));
+  }
+  if ((flags & kLzHistory) == 0) {
+    history_ = 0;
+    stream_pos_ = pos;
+  } else if (pos != stream_pos_) {
+    return absl::InternalError(absl::StrFormat(
+        "Compressed message at stream position %d expected at %d", pos,
+        stream_pos_));
+  }
+
+  char *out = Append(n);
+  if ((flags & kLzCompressed) != 0) {
+    if (!DecompressBlock(p, p + size, history_, history_ + n)) {
+      return corrupt("bad block");
+    }
+  } else {
+    memcpy(out, p, n);
+  }
+  src.Addr() = const_cast<char *>(p) + size;
+  history_ += n;
+  stream_pos_ += n;
+  return absl::Span<const char>(out, n);
+}
+
+// Decodes into window_[start, end), which has 16 bytes of slack after it.
+inline bool LzContext::DecompressBlock(const char *ip, const char *iend,
+                                       size_t start, size_t end) {
+  char *base = window_.data();
+  char *op = base + start;
+  char *oend = base + end;
+
+  auto get_length = [&ip, iend](size_t &len) {
+    for (;;) {
+      if (ip == iend) {
+        return false;
+      }
+      uint8_t b = uint8_t(*ip++);
+      len += b;
+      if (b != 255) {
+        return true;
+      }
+    }
+  };
+
+  for (;;) {
+    if (ip == iend) {
+      return false;
+    }
+    uint8_t token = uint8_t(*ip++);
+    size_t literals = token >> 4;
+    if (literals == 15 && !get_length(literals)) {
+      return false;
+    }
+    if (size_t(iend - ip) < literals || size_t(oend - op) < literals) {
+      return false;
+    }
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (op == oend) {
+      return ip == iend;
+    }
+
+    uint16_t offset;
+    if (size_t(iend - ip) < sizeof(offset)) {
+      return false;
+    }
+    memcpy(&offset, ip, sizeof(offset));
+    ip += sizeof(offset);
+    size_t len = token & 15;
+    if (len == 15 && !get_length(len)) {
+      return false;
+    }
+    len += kLzMinMatch;
+    if (offset == 0 || offset > op - base || size_t(oend - op) < len) {
+      return false;
+    }
+    const char *match = op - offset;
+    char *match_end = op + len;
+    if (offset >= 8) {
+      // May write up to 7 bytes past the end of the match, into the slack.
+      while (op < match_end) {
+        memcpy(op, match, 8);
+        op += 8;
+        match += 8;
+      }
+      op = match_end;
+    } else {
+      // A short offset is a repeated pattern, usually a run of zeros.  Once
+      // a whole number of repeats at least 8 long is written we can copy
+      // from that far back a word at a time.
+      size_t step = offset * ((8 + offset - 1) / offset);
+      char *words = op + std::min(len, step);
+      while (op < words) {
+        *op++ = *match++;
+      }
+      while (op < match_end) {
+        memcpy(op, op - step, 8);
+        op += 8;
+      }
+      op = match_end;
+    }
+  }
+}
+
+// Serializes msg and appends it to buffer in a frame compressed by lz.
+// With a null lz this is just SerializeToBuffer.
+template <typename Msg>
+inline absl::Status LzSerializeToBuffer(const Msg &msg, Buffer &buffer,
+                                        bool compact, LzContext *lz) {
+  if (lz == nullptr) {
+    return msg.SerializeToBuffer(buffer, compact);
+  }
+  Buffer &raw = lz->Scratch();
+  raw.Rewind();
+  if (absl::Status status = msg.SerializeToBuffer(raw, compact);
+      !status.ok()) {
+    return status;
+  }
+  return lz->Compress(raw.data(), raw.Size(), buffer);
+}
+
+// Reads a frame written by LzSerializeToBuffer.  The buffer must hold just
+// the frame.
+template <typename Msg>
+inline absl::Status LzDeserializeFromBuffer(Msg &msg, Buffer &buffer,
+                                            bool compact, LzContext *lz) {
+  if (lz == nullptr) {
+    return msg.DeserializeFromBuffer(buffer, compact);
+  }
+  absl::StatusOr<absl::Span<const char>> raw = lz->Decompress(buffer);
+  if (!raw.ok()) {
+    return raw.status();
+  }
+  if (absl::Status status =
+          msg.DeserializeFromArray(raw->data(), raw->size(), compact);
+      !status.ok()) {
+    return status;
+  }
+  return buffer.CheckAtEnd();
+}
+
+} // namespace neutron::serdes
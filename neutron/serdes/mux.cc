@@ -4,103 +4,366 @@
 
 namespace neutron::serdes {
 
+absl::StatusOr<MessageHandle>
+MessageMux::Lookup(const std::string &name) const {
+  if (auto it = handles_.find(name); it != handles_.end()) {
+    return it->second;
+  }
+  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+}
+
+absl::StatusOr<MessageHandle> MessageMux::Lookup(absl::uint128 md5) const {
+  if (auto it = digests_.find(md5); it != digests_.end()) {
+    if (it->second == kAmbiguous) {
+      return absl::InternalError(absl::StrFormat(
+          "More than one SerdesMessage has MD5 %032x", md5));
+    }
+    return it->second;
+  }
+  return absl::InternalError(
+      absl::StrFormat("SerdesMessage with MD5 %032x not found", md5));
+}
+
+absl::StatusOr<absl::uint128> MessageMux::ParseMD5(std::string_view hex) {
+  if (hex.size() != 32) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("MD5 %s is not 32 hex digits", hex));
+  }
+  absl::uint128 md5 = 0;
+  for (char c : hex) {
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("MD5 %s is not 32 hex digits", hex));
+    }
+    md5 = (md5 << 4) | digit;
+  }
+  return md5;
+}
+
+absl::Status MessageMux::NotFound(MessageHandle handle) const {
+  return absl::InternalError(
+      absl::StrFormat("SerdesMessage with handle %d not found", handle));
+}
+
 absl::StatusOr<absl::Span<const char>>
 MessageMux::GetDescriptor(const std::string &name) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.get_descriptor();
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return GetDescriptor(*handle);
 }
 
-absl::Status MessageMux::SerializeToArray(const std::string &name,
-                                          const SerdesMessage &msg, char *addr,
-                                          size_t len, bool compact) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.serialize_to_array(msg, addr, len, compact);
+absl::StatusOr<absl::Span<const char>>
+MessageMux::GetDescriptor(MessageHandle handle) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return m->get_descriptor();
 }
 
-absl::Status MessageMux::DeserializeFromArray(const std::string &name,
-                                              SerdesMessage &msg, const char *addr,
-                                              size_t len, bool compact) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.deserialize_from_array(msg, addr, len, compact);
+absl::Status
+MessageMux::SerializeToArray(const std::string &name, const SerdesMessage &msg,
+                             char *addr, size_t len, bool compact) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return SerializeToArray(*handle, msg, addr, len, compact);
 }
 
-absl::Status MessageMux::SerializeToBuffer(const std::string &name,
-                                           const SerdesMessage &msg,
-                                           neutron::serdes::Buffer &buffer,
-                                           bool compact) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.serialize_to_buffer(msg, buffer, compact);
+absl::Status
+MessageMux::SerializeToArray(MessageHandle handle, const SerdesMessage &msg,
+                             char *addr, size_t len, bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return m->serialize_to_array(msg, addr, len, compact);
 }
 
-absl::Status MessageMux::DeserializeFromBuffer(const std::string &name,
-                                               SerdesMessage &msg,
-                                               neutron::serdes::Buffer &buffer,
-                                               bool compact) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.deserialize_from_buffer(msg, buffer, compact);
+absl::Status
+MessageMux::DeserializeFromArray(const std::string &name, SerdesMessage &msg,
+                                 const char *addr, size_t len, bool compact) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return DeserializeFromArray(*handle, msg, addr, len, compact);
 }
 
-absl::StatusOr<size_t> MessageMux::SerializedSize(const std::string &name,
-                                                  const SerdesMessage &msg) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.serialized_size(msg);
+absl::Status
+MessageMux::DeserializeFromArray(MessageHandle handle, SerdesMessage &msg,
+                                 const char *addr, size_t len, bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return m->deserialize_from_array(msg, addr, len, compact);
+}
+
+absl::Status
+MessageMux::SerializeToBuffer(const std::string &name, const SerdesMessage &msg,
+                              neutron::serdes::Buffer &buffer, bool compact) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
+  }
+  return SerializeToBuffer(*handle, msg, buffer, compact);
+}
+
+absl::Status
+MessageMux::SerializeToBuffer(MessageHandle handle, const SerdesMessage &msg,
+                              neutron::serdes::Buffer &buffer, bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->serialize_to_buffer(msg, buffer, compact);
+}
+
+absl::Status
+MessageMux::DeserializeFromBuffer(const std::string &name, SerdesMessage &msg,
+                                  neutron::serdes::Buffer &buffer,
+                                  bool compact) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
+  }
+  return DeserializeFromBuffer(*handle, msg, buffer, compact);
+}
+
+absl::Status
+MessageMux::DeserializeFromBuffer(MessageHandle handle, SerdesMessage &msg,
+                                  neutron::serdes::Buffer &buffer,
+                                  bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->deserialize_from_buffer(msg, buffer, compact);
 }
 
 absl::StatusOr<size_t>
-MessageMux::CompactSerializedSize(const std::string &name, const SerdesMessage &msg) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.compact_serialized_size(msg);
+MessageMux::SerializedSize(const std::string &name, const SerdesMessage &msg) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return SerializedSize(*handle, msg);
 }
 
-absl::StatusOr<std::string> MessageMux::DebugString(const std::string &name,
-                                                    const SerdesMessage &msg) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.debug_string(msg);
+absl::StatusOr<size_t>
+MessageMux::SerializedSize(MessageHandle handle, const SerdesMessage &msg) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return m->serialized_size(msg);
 }
 
-absl::Status MessageMux::StreamTo(const std::string &name, const SerdesMessage &msg,
-                                  std::ostream &os) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    it->second.stream_to(msg, os);
-    return absl::OkStatus();
+absl::StatusOr<size_t>
+MessageMux::CompactSerializedSize(const std::string &name,
+                                  const SerdesMessage &msg) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return CompactSerializedSize(*handle, msg);
+}
+
+absl::StatusOr<size_t>
+MessageMux::CompactSerializedSize(MessageHandle handle,
+                                  const SerdesMessage &msg) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->compact_serialized_size(msg);
+}
+
+absl::StatusOr<std::string>
+MessageMux::DebugString(const std::string &name, const SerdesMessage &msg) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
+  }
+  return DebugString(*handle, msg);
+}
+
+absl::StatusOr<std::string>
+MessageMux::DebugString(MessageHandle handle, const SerdesMessage &msg) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->debug_string(msg);
+}
+
+absl::Status MessageMux::StreamTo(const std::string &name,
+                                  const SerdesMessage &msg, std::ostream &os) {
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
+  }
+  return StreamTo(*handle, msg, os);
+}
+
+absl::Status MessageMux::StreamTo(MessageHandle handle,
+                                  const SerdesMessage &msg, std::ostream &os) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  m->stream_to(msg, os);
+  return absl::OkStatus();
 }
 
 absl::Status MessageMux::Compact(const std::string &name, const Buffer &src,
                                  Buffer &dest) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.compact(src, dest);
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return Compact(*handle, src, dest);
+}
+
+absl::Status MessageMux::Compact(MessageHandle handle, const Buffer &src,
+                                 Buffer &dest) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->compact(src, dest);
 }
 
 absl::Status MessageMux::Expand(const std::string &name, const Buffer &src,
                                 Buffer &dest) {
-  if (auto it = mux_.find(name); it != mux_.end()) {
-    return it->second.expand(src, dest);
+  absl::StatusOr<MessageHandle> handle = Lookup(name);
+  if (!handle.ok()) {
+    return handle.status();
   }
-  return absl::InternalError(absl::StrFormat("SerdesMessage %s not found", name));
+  return Expand(*handle, src, dest);
 }
 
-void MessageMux::Register(const std::string &name,
-                          MessageMetadata metadata) {
-  mux_[name] = metadata;
+absl::Status MessageMux::Expand(MessageHandle handle, const Buffer &src,
+                                Buffer &dest) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  return m->expand(src, dest);
+}
+
+absl::Status
+MessageMux::SerializeBatch(MessageHandle handle,
+                           absl::Span<const SerdesMessage *const> msgs,
+                           Buffer &buffer, bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  for (const SerdesMessage *msg : msgs) {
+    // The length is filled in when we know it.  The buffer may move so
+    // remember where it goes as an offset.
+    size_t start = buffer.Size();
+    if (absl::Status status = Write(buffer, uint32_t(0)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = m->serialize_to_buffer(*msg, buffer, compact);
+        !status.ok()) {
+      return status;
+    }
+    uint32_t length = uint32_t(buffer.Size() - start - sizeof(uint32_t));
+    memcpy(buffer.data() + start, &length, sizeof(length));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MessageMux::DeserializeBatch(MessageHandle handle,
+                                          absl::Span<SerdesMessage *const> msgs,
+                                          const char *addr, size_t len,
+                                          bool compact) {
+  const MessageMetadata *m = Find(handle);
+  if (m == nullptr) {
+    return NotFound(handle);
+  }
+  Buffer buffer(const_cast<char *>(addr), len);
+  for (SerdesMessage *msg : msgs) {
+    uint32_t length;
+    if (absl::Status status = Read(buffer, length); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = buffer.Check(length); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status =
+            m->deserialize_from_array(*msg, buffer.Addr(), length, compact);
+        !status.ok()) {
+      return status;
+    }
+    buffer.Addr() += length;
+  }
+  return buffer.CheckAtEnd();
+}
+
+MessageHandle MessageMux::Register(const std::string &name,
+                                   MessageMetadata metadata,
+                                   const std::string &md5) {
+  absl::StatusOr<absl::uint128> digest = ParseMD5(md5);
+  MessageHandle handle;
+  if (auto it = handles_.find(name); it != handles_.end()) {
+    handle = it->second;
+    table_[handle] = metadata;
+    // The old digest no longer describes the type.
+    if (std::optional<absl::uint128> old = md5s_[handle];
+        old.has_value() && (!digest.ok() || *digest != *old)) {
+      md5s_[handle] = std::nullopt;
+      RemoveDigest(*old, handle);
+    }
+  } else {
+    handle = MessageHandle(table_.size());
+    table_.push_back(metadata);
+    md5s_.push_back(std::nullopt);
+    handles_[name] = handle;
+  }
+  if (digest.ok()) {
+    md5s_[handle] = *digest;
+    auto [it, inserted] = digests_.emplace(*digest, handle);
+    if (!inserted && it->second != handle) {
+      it->second = kAmbiguous;
+    }
+  }
+  return handle;
+}
+
+void MessageMux::RemoveDigest(absl::uint128 md5, MessageHandle handle) {
+  auto it = digests_.find(md5);
+  if (it == digests_.end() ||
+      (it->second != handle && it->second != kAmbiguous)) {
+    return;
+  }
+  // An ambiguous digest may now belong to only one type, or none.
+  MessageHandle other = kAmbiguous;
+  int count = 0;
+  for (MessageHandle h = 0; h < md5s_.size(); h++) {
+    if (h != handle && md5s_[h] == md5) {
+      other = h;
+      count++;
+    }
+  }
+  if (count == 0) {
+    digests_.erase(it);
+  } else if (count == 1) {
+    it->second = other;
+  }
 }
 } // namespace neutron::serdes
@@ -1,9 +1,15 @@
 #pragma once
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include <deque>
 #include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 namespace descriptor {
   struct Descriptor;
@@ -28,6 +34,10 @@ struct MessageMetadata {
   absl::Status (*expand)(const Buffer& src, Buffer& dest);
 };
 
+// Registered types are numbered from 0 in the order they are registered.
+// Calls that take a handle index a table instead of hashing the name.
+using MessageHandle = uint32_t;
+
 class MessageMux {
   public:
   static MessageMux& Instance() {
@@ -35,6 +45,25 @@ class MessageMux {
     return instance;
   }
 
+  // Handle for a registered type, which stays the same for the life of the
+  // program.
+  absl::StatusOr<MessageHandle> Lookup(const std::string& name) const;
+
+  // Handle for the registered type with the given MD5 digest.  Types whose
+  // definitions are identical have the same digest and can't be told apart
+  // this way.
+  absl::StatusOr<MessageHandle> Lookup(absl::uint128 md5) const;
+
+  // The digest for an MD5 written in hex, as returned by a message's MD5().
+  static absl::StatusOr<absl::uint128> ParseMD5(std::string_view hex);
+
+  // Metadata for a handle, or nullptr if there isn't one.  The pointer stays
+  // valid when more types are registered.  Registering the same name again
+  // changes what it points to.
+  const MessageMetadata* Find(MessageHandle handle) const {
+    return handle < table_.size() ? &table_[handle] : nullptr;
+  }
+
   absl::StatusOr<absl::Span<const char>> GetDescriptor(const std::string& name);
   absl::Status SerializeToArray(const std::string& name, const SerdesMessage& msg, char* addr, size_t len, bool compact) ;
   absl::Status DeserializeFromArray(const std::string& name,  SerdesMessage& msg, const char* addr, size_t len, bool compact);
@@ -47,10 +76,44 @@ class MessageMux {
   absl::Status Compact(const std::string& name, const Buffer& src, Buffer& dest);
   absl::Status Expand(const std::string& name, const Buffer& src, Buffer& dest);
   
-  void Register(const std::string& name, MessageMetadata metadata) ;
+  absl::StatusOr<absl::Span<const char>> GetDescriptor(MessageHandle handle);
+  absl::Status SerializeToArray(MessageHandle handle, const SerdesMessage& msg, char* addr, size_t len, bool compact);
+  absl::Status DeserializeFromArray(MessageHandle handle, SerdesMessage& msg, const char* addr, size_t len, bool compact);
+  absl::Status SerializeToBuffer(MessageHandle handle, const SerdesMessage& msg, neutron::serdes::Buffer& buffer, bool compact);
+  absl::Status DeserializeFromBuffer(MessageHandle handle, SerdesMessage& msg, neutron::serdes::Buffer& buffer, bool compact);
+  absl::StatusOr<size_t> SerializedSize(MessageHandle handle, const SerdesMessage& msg);
+  absl::StatusOr<size_t> CompactSerializedSize(MessageHandle handle, const SerdesMessage& msg);
+  absl::StatusOr<std::string> DebugString(MessageHandle handle, const SerdesMessage& msg);
+  absl::Status StreamTo(MessageHandle handle, const SerdesMessage& msg, std::ostream& os);
+  absl::Status Compact(MessageHandle handle, const Buffer& src, Buffer& dest);
+  absl::Status Expand(MessageHandle handle, const Buffer& src, Buffer& dest);
+
+  // Appends the messages to buffer one after another, each preceded by its
+  // length as a uint32.
+  absl::Status SerializeBatch(MessageHandle handle, absl::Span<const SerdesMessage* const> msgs, Buffer& buffer, bool compact = false);
+
+  // Reads msgs.size() messages written by SerializeBatch.  The data must
+  // hold exactly that many.
+  absl::Status DeserializeBatch(MessageHandle handle, absl::Span<SerdesMessage* const> msgs, const char* addr, size_t len, bool compact = false);
+
+  // Registering a name again replaces its metadata and keeps its handle.
+  // The type can also be looked up by md5, if given in hex.  A digest from
+  // an earlier registration of the name is dropped if md5 differs.
+  MessageHandle Register(const std::string& name, MessageMetadata metadata, const std::string& md5 = "");
 
 private:
-  absl::flat_hash_map<std::string, MessageMetadata> mux_;
+  absl::Status NotFound(MessageHandle handle) const;
+  // Stops md5 finding handle, leaving it for any other type that has it.
+  void RemoveDigest(absl::uint128 md5, MessageHandle handle);
+
+  absl::flat_hash_map<std::string, MessageHandle> handles_;
+  // A deque so that adding a type doesn't move the others (see Find).
+  std::deque<MessageMetadata> table_;
+  // kAmbiguous for digests that more than one type has.
+  static constexpr MessageHandle kAmbiguous = ~MessageHandle(0);
+  absl::flat_hash_map<absl::uint128, MessageHandle> digests_;
+  // The digest each handle was registered with, if any.
+  std::vector<std::optional<absl::uint128>> md5s_;
 };
 
 }
@@ -5,14 +5,20 @@
 #include "absl/strings/str_format.h"
 #include "absl/types/span.h"
 #include "neutron/common_runtime.h"
+#include "neutron/serdes/delta_pack.h"
+#include "neutron/serdes/float_xor.h"
+#include "neutron/serdes/varint.h"
 #include "toolbelt/hexdump.h"
+#include <algorithm>
 #include <array>
 #include <iostream>
+#include <memory_resource>
 #include <sstream>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace neutron::serdes {
@@ -20,10 +26,68 @@ namespace neutron::serdes {
 // Base class for all messages.
 class SerdesMessage {};
 
-constexpr uint8_t kZeroMarker = 0xfa;
-// The max number of zeroes in a run is one more than than the zero marker since
-// the zero marker is followed by the number of zeroes - 2
-constexpr size_t kMaxZeroes = kZeroMarker + 1;
+// Strings and vectors are read and written whatever their allocator so that
+// messages generated with std::pmr members use the same functions.
+template <typename A>
+using BasicString = std::basic_string<char, std::char_traits<char>, A>;
+
+// Constructs a T that uses alloc if T is allocator aware.  Messages from
+// libraries generated without std::pmr members are default constructed.
+template <typename T, typename Alloc>
+inline T MakeWithAllocator(const Alloc &alloc) {
+  if constexpr (std::uses_allocator<T, Alloc>::value) {
+    return T(alloc);
+  } else {
+    return T();
+  }
+}
+
+// An array whose elements are all made with MakeWithAllocator.  Used for
+// arrays of strings and messages in std::pmr messages.
+template <typename T, size_t N, typename Alloc, size_t... I>
+inline std::array<T, N> MakeArray(const Alloc &alloc,
+                                  std::index_sequence<I...>) {
+  return {{((void)I, MakeWithAllocator<T>(alloc))...}};
+}
+
+template <typename T, size_t N, typename Alloc>
+inline std::array<T, N> MakeArray(const Alloc &alloc) {
+  return MakeArray<T, N>(alloc, std::make_index_sequence<N>());
+}
+
+// Types whose in-memory layout is identical to the ROS wire format.  Vectors
+// and arrays of these can be written and read with a single memcpy.  Enums
+// are included since the generated enum classes use the same underlying type
+// as their wire representation.  Bool is excluded because std::vector<bool>
+// is not contiguous (the generator uses uint8_t for bool anyway).
+template <typename T> constexpr bool IsBulkCopyable() {
+  return (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value) ||
+         std::is_enum<T>::value || std::is_same<T, Time>::value ||
+         std::is_same<T, Duration>::value;
+}
+
+static_assert(sizeof(Time) == 8 && sizeof(Duration) == 8,
+              "Time and Duration must match the ROS wire layout");
+
+// Vectors and arrays of these are written in compact form by scanning the
+// whole body for runs of zero values instead of one value at a time.  Time
+// and Duration are compacted as pairs of uint32_t.  A kCount of 0 means the
+// type is written element by element.
+template <typename T> struct CompactScalar {
+  using type = T;
+  static constexpr size_t kCount =
+      std::is_arithmetic<T>::value && !std::is_same<T, bool>::value ? 1 : 0;
+};
+
+template <> struct CompactScalar<Time> {
+  using type = uint32_t;
+  static constexpr size_t kCount = 2;
+};
+
+template <> struct CompactScalar<Duration> {
+  using type = uint32_t;
+  static constexpr size_t kCount = 2;
+};
 
 template <typename T> inline size_t SignedLeb128Size(const T &v) {
   size_t size = 0;
@@ -71,7 +135,7 @@ template <typename T> inline size_t Leb128Size(const T &v) {
   }
 }
 
-template <> inline size_t Leb128Size(const std::string &v) {
+template <typename A> inline size_t Leb128Size(const BasicString<A> &v) {
   return Leb128Size(v.size()) + v.size();
 }
 
@@ -87,7 +151,7 @@ inline size_t Leb128Size(const Duration &d) {
   return Leb128Size(d.secs) + Leb128Size(d.nsecs);
 }
 
-template <typename T> inline size_t Leb128Size(const std::vector<T> &v) {
+template <typename T, typename A> inline size_t Leb128Size(const std::vector<T, A> &v) {
   size_t size = Leb128Size(v.size());
   for (auto &e : v) {
     size += Leb128Size(e);
@@ -95,7 +159,7 @@ template <typename T> inline size_t Leb128Size(const std::vector<T> &v) {
   return size;
 }
 
-template <> inline size_t Leb128Size(const std::vector<uint8_t> &v) {
+template <typename A> inline size_t Leb128Size(const std::vector<uint8_t, A> &v) {
   // Body is not leb128 encoded so that we can use memcpy.
   size_t size = Leb128Size(v.size());
   return size + v.size();
@@ -128,6 +192,18 @@ struct SizeAccumulator {
 
   size_t Size() const { return size_; }
 
+  // Same as accumulating n zero values one at a time.  Every full run of
+  // kMaxZeroes costs 2 bytes and the remainder stays pending.
+  void AddZeroes(size_t n) {
+    size_t zeroes = size_t(num_zeroes_) + n;
+    if (zeroes > kMaxZeroes) {
+      size_t full_runs = (zeroes - 1) / kMaxZeroes;
+      size_ += 2 * full_runs;
+      zeroes -= full_runs * kMaxZeroes;
+    }
+    num_zeroes_ = int(zeroes);
+  }
+
   size_t size_ = 0;
   int num_zeroes_ = 0;
 };
@@ -163,7 +239,7 @@ struct SizeAccumulator {
     Accumulate(acc, *p);
   }
 
-  template <> inline void Accumulate(SizeAccumulator& acc, const std::string &s) {
+  template <typename A> inline void Accumulate(SizeAccumulator& acc, const BasicString<A> &s) {
     Accumulate(acc, s.size());
     acc.size_ += s.size();
   }
@@ -178,14 +254,40 @@ struct SizeAccumulator {
     Accumulate(acc, d.nsecs);
   }
 
-  template <typename T> inline void Accumulate(SizeAccumulator& acc, const std::vector<T> &v) {
+  // Accumulates the compact size of n values of type T at p, which need not
+  // be aligned.  Runs of zero values are found in bulk.
+  template <typename T>
+  inline void AccumulateValues(SizeAccumulator& acc, const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+      size_t zeroes =
+          CountZeroBytes(p + i * sizeof(T), (n - i) * sizeof(T)) / sizeof(T);
+      if (zeroes > 0) {
+        acc.AddZeroes(zeroes);
+        i += zeroes;
+        continue;
+      }
+      T v;
+      memcpy(&v, p + i * sizeof(T), sizeof(T));
+      Accumulate(acc, v);
+      i++;
+    }
+  }
+
+  template <typename T, typename A> inline void Accumulate(SizeAccumulator& acc, const std::vector<T, A> &v) {
     Accumulate(acc, v.size());
-    for (auto &e : v) {
-      Accumulate(acc, e);
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      AccumulateValues<typename CompactScalar<T>::type>(
+          acc, reinterpret_cast<const char *>(v.data()),
+          v.size() * CompactScalar<T>::kCount);
+    } else {
+      for (auto &e : v) {
+        Accumulate(acc, e);
+      }
     }
   }
 
-  template <> inline void Accumulate(SizeAccumulator& acc, const std::vector<uint8_t> &v) {
+  template <typename A> inline void Accumulate(SizeAccumulator& acc, const std::vector<uint8_t, A> &v) {
     if (v.empty()) {
       // Empty vector has a zero length and no body.  No need to flush
       // the zeroes.
@@ -198,8 +300,14 @@ struct SizeAccumulator {
   }
 
   template <typename T, size_t N> inline void Accumulate(SizeAccumulator& acc, const std::array<T, N> &v) {
-    for (auto &e : v) {
-      Accumulate(acc, e);
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      AccumulateValues<typename CompactScalar<T>::type>(
+          acc, reinterpret_cast<const char *>(v.data()),
+          N * CompactScalar<T>::kCount);
+    } else {
+      for (auto &e : v) {
+        Accumulate(acc, e);
+      }
     }
   }
 
@@ -208,17 +316,205 @@ struct SizeAccumulator {
     acc.size_ += N;
   }
 
+// Provides the memory for dynamic buffers.  Allocation failures abort, as
+// they always have for buffers.
+class BufferAllocator {
+public:
+  virtual ~BufferAllocator() = default;
+  virtual char *Allocate(size_t size) = 0;
+  // Moves p, which holds size bytes, to new_size bytes of memory.  Only the
+  // first used bytes need to be kept.  p may be nullptr with a size of 0.
+  virtual char *Reallocate(char *p, size_t size, size_t used,
+                           size_t new_size) = 0;
+  virtual void Free(char *p, size_t size) = 0;
+};
+
+// The default allocator, using malloc, realloc and free.
+class MallocBufferAllocator : public BufferAllocator {
+public:
+  char *Allocate(size_t size) override {
+    return reinterpret_cast<char *>(malloc(size));
+  }
+  char *Reallocate(char *p, size_t size, size_t used,
+                   size_t new_size) override {
+    return reinterpret_cast<char *>(realloc(p, new_size));
+  }
+  void Free(char *p, size_t size) override { free(p); }
+
+  static MallocBufferAllocator *Instance() {
+    static MallocBufferAllocator allocator;
+    return &allocator;
+  }
+};
+
+// Allocates from large blocks and frees nothing until Reset or destruction.
+// Use it for buffers whose lifetime ends at a known point, such as the end of
+// a publish cycle.  Not thread safe.
+class BufferArena : public BufferAllocator {
+public:
+  explicit BufferArena(size_t block_size = 64 * 1024,
+                       BufferAllocator *upstream = nullptr)
+      : block_size_(block_size),
+        upstream_(upstream == nullptr ? MallocBufferAllocator::Instance()
+                                      : upstream) {}
+  BufferArena(const BufferArena &) = delete;
+  BufferArena &operator=(const BufferArena &) = delete;
+  ~BufferArena() override { FreeBlocks(); }
+
+  char *Allocate(size_t size) override {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (size_t(limit_ - next_) < size) {
+      size_t block_size = std::max(block_size_, size);
+      char *block = upstream_->Allocate(block_size);
+      if (block == nullptr) {
+        return nullptr;
+      }
+      blocks_.push_back({block, block_size});
+      next_ = block;
+      limit_ = block + block_size;
+    }
+    char *p = next_;
+    next_ += size;
+    return p;
+  }
+
+  char *Reallocate(char *p, size_t size, size_t used,
+                   size_t new_size) override {
+    // The last allocation can grow in place.
+    size_t aligned = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (p != nullptr && p + aligned == next_ &&
+        size_t(limit_ - p) >= new_size) {
+      next_ = p + ((new_size + kAlignment - 1) & ~(kAlignment - 1));
+      return p;
+    }
+    char *q = Allocate(new_size);
+    if (q != nullptr && used > 0) {
+      memcpy(q, p, used);
+    }
+    return q;
+  }
+
+  void Free(char *p, size_t size) override {}
+
+  // Makes all the memory available again.  Nothing allocated from the arena
+  // may be used after this.  The most recent block is kept.
+  void Reset() {
+    if (blocks_.empty()) {
+      return;
+    }
+    Block last = blocks_.back();
+    blocks_.pop_back();
+    FreeBlocks();
+    blocks_.push_back(last);
+    next_ = last.addr;
+    limit_ = last.addr + last.size;
+  }
+
+private:
+  static constexpr size_t kAlignment = 16;
+  struct Block {
+    char *addr;
+    size_t size;
+  };
+
+  void FreeBlocks() {
+    for (auto &block : blocks_) {
+      upstream_->Free(block.addr, block.size);
+    }
+    blocks_.clear();
+    next_ = limit_ = nullptr;
+  }
+
+  size_t block_size_;
+  BufferAllocator *upstream_;
+  std::vector<Block> blocks_;
+  char *next_ = nullptr;
+  char *limit_ = nullptr;
+};
+
+// Serialized data released from a Buffer.  It is freed with the allocator
+// it came from, if any.
+class BufferData {
+public:
+  BufferData() = default;
+  BufferData(char *data, size_t size, size_t capacity,
+             BufferAllocator *allocator)
+      : data_(data), size_(size), capacity_(capacity), allocator_(allocator) {}
+  BufferData(const BufferData &) = delete;
+  BufferData &operator=(const BufferData &) = delete;
+  BufferData(BufferData &&d) { *this = std::move(d); }
+  BufferData &operator=(BufferData &&d) {
+    if (this != &d) {
+      Free();
+      data_ = std::exchange(d.data_, nullptr);
+      size_ = std::exchange(d.size_, 0);
+      capacity_ = std::exchange(d.capacity_, 0);
+      allocator_ = std::exchange(d.allocator_, nullptr);
+    }
+    return *this;
+  }
+  ~BufferData() { Free(); }
+
+  char *data() { return data_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view AsStringView() const {
+    return std::string_view(data_, size_);
+  }
+
+private:
+  void Free() {
+    if (data_ != nullptr && allocator_ != nullptr) {
+      allocator_->Free(data_, capacity_);
+    }
+    data_ = nullptr;
+  }
+
+  char *data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+  BufferAllocator *allocator_ = nullptr;
+};
+
+// Running out of data while reading is an OutOfRangeError and anything
+// else wrong with the data is an InternalError.  The incremental parser
+// waits for more data on the first and gives up on the second.
+inline bool IsTruncated(const absl::Status &status) {
+  return absl::IsOutOfRange(status);
+}
+
+// The status for the result of decoding raw values of the given kind.
+inline absl::Status DecodeStatus(DecodeResult result, const char *what,
+                                 const char *addr, const char *end) {
+  switch (result) {
+  case DecodeResult::kOk:
+    break;
+  case DecodeResult::kTruncated:
+    return absl::OutOfRangeError(absl::StrFormat(
+        "Truncated %s values at %p, end is %p", what, addr, end));
+  case DecodeResult::kMalformed:
+    return absl::InternalError(absl::StrFormat(
+        "Malformed %s values at %p, end is %p", what, addr, end));
+  }
+  return absl::OkStatus();
+}
+
 // Provides a statically sized or dynamic buffer used for serialization
 // of messages.
 class Buffer {
 public:
-  // Dynamic buffer with own memory allocation.
-  Buffer(size_t initial_size = 16) : owned_(true), size_(initial_size) {
+  // Dynamic buffer with own memory allocation.  If allocator is nullptr the
+  // memory comes from malloc.  The allocator must outlive the buffer.
+  Buffer(size_t initial_size = 16, BufferAllocator *allocator = nullptr)
+      : owned_(true), size_(initial_size),
+        allocator_(allocator == nullptr ? MallocBufferAllocator::Instance()
+                                        : allocator) {
     if (initial_size < 16) {
       // Need a reasonable size to start with.
       abort();
     }
-    start_ = reinterpret_cast<char *>(malloc(size_));
+    start_ = allocator_->Allocate(size_);
     if (start_ == nullptr) {
       abort();
     }
@@ -231,22 +527,64 @@ public:
       : owned_(false), start_(addr), size_(size), addr_(addr),
         end_(addr + size) {}
 
-  ~Buffer() {
-    if (owned_) {
-      free(start_);
+  // Buffers own their memory so they can be moved but not copied.
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+  Buffer(Buffer &&b) { *this = std::move(b); }
+  Buffer &operator=(Buffer &&b) {
+    if (this != &b) {
+      FreeMemory();
+      owned_ = std::exchange(b.owned_, false);
+      start_ = std::exchange(b.start_, nullptr);
+      size_ = std::exchange(b.size_, 0);
+      addr_ = std::exchange(b.addr_, nullptr);
+      end_ = std::exchange(b.end_, nullptr);
+      num_zeroes_ = std::exchange(b.num_zeroes_, 0);
+      allocator_ = std::exchange(b.allocator_, nullptr);
+      failed_ = std::exchange(b.failed_, false);
+      error_ = std::exchange(b.error_, absl::OkStatus());
     }
+    return *this;
   }
 
+  ~Buffer() { FreeMemory(); }
+
   size_t Size() const { return addr_ - start_; }
 
   size_t size() const { return Size(); }
 
+  // How many compact values to decode before growing the output again.
+  // Without zero runs each value takes at least a byte, so this is the
+  // bytes left, with a floor so that small inputs aren't read in tiny
+  // steps.
+  size_t ReadStep() const {
+    return std::max(size_t(end_ - addr_), size_t(4096));
+  }
+
   template <typename T> T *Data() { return reinterpret_cast<T *>(start_); }
 
   char *data() { return Data<char>(); }
 
+  // Copies the contents.  Use Release to take them without a copy.
   std::string AsString() const { return std::string(start_, addr_ - start_); }
 
+  // Hands the contents to the caller without copying them.  A dynamic buffer
+  // is left empty and allocates again when it is next written.  For a fixed
+  // buffer the result refers to the buffer's memory and doesn't own it.
+  BufferData Release() {
+    BufferData data(start_, addr_ - start_, size_, owned_ ? allocator_ : nullptr);
+    if (owned_) {
+      start_ = addr_ = end_ = nullptr;
+      size_ = 0;
+    }
+    num_zeroes_ = 0;
+    return data;
+  }
+
+  // Size of the memory.  For a dynamic buffer this is how much it can hold
+  // before it grows.
+  size_t Capacity() const { return size_; }
+
   template <typename T> absl::Span<const T> AsSpan() const {
     return absl::Span<T>(reinterpret_cast<const T *>(start_), addr_ - start_);
   }
@@ -256,7 +594,59 @@ public:
     end_ = start_;
   }
 
-  void Rewind() { addr_ = start_; }
+  void Rewind() {
+    addr_ = start_;
+    num_zeroes_ = 0;
+    ClearError();
+  }
+
+  // Latched errors.  The ROS format serializers and deserializers use
+  // WriteLatched and ReadLatched, which don't return a status.  The first
+  // error is latched in the buffer, later ones are ignored, and the result
+  // is checked once at the end with TakeError.
+  bool Failed() const { return failed_; }
+
+  // Latches status if it is an error and nothing has failed yet.  Returns
+  // true if status is ok.
+  bool Latch(absl::Status status) const {
+    if (status.ok()) {
+      return true;
+    }
+    if (!failed_) {
+      failed_ = true;
+      error_ = std::move(status);
+    }
+    return false;
+  }
+
+  // Returns the latched error, or ok, and clears it.
+  absl::Status TakeError() const {
+    failed_ = false;
+    return std::exchange(error_, absl::OkStatus());
+  }
+
+  void ClearError() const {
+    failed_ = false;
+    error_ = absl::OkStatus();
+  }
+
+  // Makes space for n more bytes like HasSpaceFor, latching the error if
+  // there isn't any.
+  bool ReserveLatched(size_t n) {
+    if (size_t(addr_ - start_) + n <= size_) {
+      return true;
+    }
+    return Latch(HasSpaceFor(n));
+  }
+
+  // Checks there are n more bytes to read like Check, latching the error if
+  // there aren't.
+  bool CheckLatched(size_t n) const {
+    if (size_t(end_ - addr_) >= n) {
+      return true;
+    }
+    return Latch(Check(n));
+  }
 
   absl::Status CheckAtEnd() const {
     if (addr_ != end_) {
@@ -279,6 +669,9 @@ public:
       T b = T(byte & 0x7f);
       v |= b << shift;
       shift += 7;
+      if ((byte & 0x80) != 0 && shift >= int(sizeof(T) * 8)) {
+        return absl::InternalError("LEB128 value is too long");
+      }
     } while (byte & 0x80);
 
     return absl::OkStatus();
@@ -318,20 +711,31 @@ public:
   }
 
   char*& Addr() const { return addr_; }
+  char *End() const { return end_; }
+
+  // Zeroes still to be read from a run in compact format.  Used to carry a
+  // run from one buffer to the next.
+  int NumZeroes() const { return num_zeroes_; }
+  void SetNumZeroes(int n) { num_zeroes_ = n; }
 
   absl::Status HasSpaceFor(size_t n) {
-    char *next = addr_ + n;
-    // Off-by-one complexity here.  The end is one past the end of the buffer.
-    if (next > end_) {
+    // Sizes rather than addresses since a released buffer has no memory.
+    size_t needed = size_t(addr_ - start_) + n;
+    if (needed > size_) {
       if (owned_) {
-        // Expand the buffer.
-        size_t new_size = size_ * 2;
+        // Expand the buffer.  Keep doubling until the request fits since
+        // bulk copies can ask for much more than the current size.
+        size_t new_size = std::max(size_ * 2, size_t(16));
+        while (new_size < needed) {
+          new_size *= 2;
+        }
 
-        char *new_start = reinterpret_cast<char *>(realloc(start_, new_size));
+        size_t curr_length = addr_ - start_;
+        char *new_start =
+            allocator_->Reallocate(start_, size_, curr_length, new_size);
         if (new_start == nullptr) {
           abort();
         }
-        size_t curr_length = addr_ - start_;
         start_ = new_start;
         addr_ = start_ + curr_length;
         end_ = start_ + new_size;
@@ -339,17 +743,45 @@ public:
         return absl::OkStatus();
       }
       return absl::InternalError(absl::StrFormat(
-          "No space in buffer: length: %d, need: %d", size_, next - start_));
+          "No space in buffer: length: %d, need: %d", size_, needed));
+    }
+    return absl::OkStatus();
+  }
+
+  // Make sure there is space for exactly n more bytes.  Unlike HasSpaceFor
+  // this doesn't round up, so a presized serialization does at most one
+  // allocation of exactly the right size.
+  absl::Status Reserve(size_t n) {
+    size_t needed = size_t(addr_ - start_) + n;
+    if (needed <= size_) {
+      return absl::OkStatus();
+    }
+    if (!owned_) {
+      return absl::InternalError(absl::StrFormat(
+          "No space in buffer: length: %d, need: %d", size_, needed));
     }
+    size_t curr_length = addr_ - start_;
+    size_t new_size = curr_length + n;
+    char *new_start =
+        allocator_->Reallocate(start_, size_, curr_length, new_size);
+    if (new_start == nullptr) {
+      abort();
+    }
+    start_ = new_start;
+    addr_ = start_ + curr_length;
+    end_ = start_ + new_size;
+    size_ = new_size;
     return absl::OkStatus();
   }
 
+  // Checks there are n more bytes to read.  Not having them is an
+  // OutOfRangeError (see IsTruncated).
   absl::Status Check(size_t n) const {
     char *next = addr_ + n;
     if (next <= end_) {
       return absl::OkStatus();
     }
-    return absl::InternalError(
+    return absl::OutOfRangeError(
         absl::StrFormat("Buffer overun when checking for %d bytes; current "
                         "address is %p, end is %p",
                         n, addr_, end_));
@@ -380,20 +812,41 @@ public:
   template <typename T> absl::Status ReadSignedLeb128(T &value) const {
     int shift = 0;
     uint8_t byte;
-    value = 0;
+    // Accumulate in 64 bits so that the shifts are well defined.
+    uint64_t v = 0;
 
     do {
       if (absl::Status status = Get(byte); !status.ok()) {
         return status;
       }
-      T b = T(byte & 0x7f);
-      value |= b << shift;
+      if (shift < 64) {
+        v |= uint64_t(byte & 0x7f) << shift;
+      }
       shift += 7;
 
-      if ((byte & 0x80) == 0 && (byte & 0x40) != 0) {
-        value |= -(1 << shift);
+      if ((byte & 0x80) == 0 && (byte & 0x40) != 0 && shift < 64) {
+        v |= ~uint64_t(0) << shift;
+      }
+      if ((byte & 0x80) != 0 && shift >= int(sizeof(T) * 8)) {
+        return absl::InternalError("LEB128 value is too long");
       }
     } while (byte & 0x80);
+    value = T(v);
+    return absl::OkStatus();
+  }
+
+  // Same as Put(0) n times.
+  absl::Status PutZeroes(size_t n) {
+    while (n > 0) {
+      if (num_zeroes_ == kMaxZeroes) {
+        if (absl::Status status = FlushZeroes(); !status.ok()) {
+          return status;
+        }
+      }
+      size_t zeroes = std::min(n, kMaxZeroes - size_t(num_zeroes_));
+      num_zeroes_ += int(zeroes);
+      n -= zeroes;
+    }
     return absl::OkStatus();
   }
 
@@ -428,6 +881,150 @@ public:
     return absl::OkStatus();
   }
 
+  // Unchecked versions of the compact writers.  These are used by the
+  // presized serializers that have already reserved the exact space needed
+  // using CompactSerializedSize, so there are no capacity checks.
+  void FlushZeroesUnchecked() {
+    if (num_zeroes_ > 0) {
+      if (num_zeroes_ == 1) {
+        *addr_++ = 0;
+      } else {
+        *addr_++ = kZeroMarker;
+        *addr_++ = num_zeroes_ - 2;
+      }
+      num_zeroes_ = 0;
+    }
+  }
+
+  void PutZeroesUnchecked(size_t n) {
+    while (n > 0) {
+      if (num_zeroes_ == kMaxZeroes) {
+        FlushZeroesUnchecked();
+      }
+      size_t zeroes = std::min(n, kMaxZeroes - size_t(num_zeroes_));
+      num_zeroes_ += int(zeroes);
+      n -= zeroes;
+    }
+  }
+
+  void PutUnchecked(uint8_t ch) {
+    if (ch == 0) {
+      if (num_zeroes_ == kMaxZeroes) {
+        FlushZeroesUnchecked();
+      }
+      num_zeroes_++;
+      return;
+    }
+    FlushZeroesUnchecked();
+    if (ch == kZeroMarker) {
+      *addr_++ = kZeroMarker;
+    }
+    *addr_++ = char(ch);
+  }
+
+  template <typename T> void WriteUnsignedLeb128Unchecked(T v) {
+    do {
+      uint8_t byte = v & 0x7f;
+      v >>= 7;
+      if (v != 0) {
+        byte |= 0x80;
+      }
+      PutUnchecked(byte);
+    } while (v != 0);
+  }
+
+  template <typename T> void WriteSignedLeb128Unchecked(T value) {
+    bool more = true;
+    while (more) {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      if ((value == 0 && (byte & 0x40) == 0) ||
+          (value == -1 && (byte & 0x40) != 0)) {
+        more = false;
+      } else {
+        byte |= 0x80;
+      }
+      PutUnchecked(byte);
+    }
+  }
+
+  // Reads n LEB128 encoded values of type T into out, which need not be
+  // aligned.  Runs of values that don't involve a zero-run marker are decoded
+  // in bulk by DecodeLeb128Run.  Zero runs are expanded with memset and only
+  // a value that contains a marker goes through Get one byte at a time.
+  template <typename T>
+  absl::Status ReadLeb128Values(char *out, size_t n) const {
+    while (n > 0) {
+      if (num_zeroes_ > 0) {
+        // Each zero byte in a run at a value boundary is a zero value.
+        size_t zeroes = std::min(n, size_t(num_zeroes_));
+        memset(out, 0, zeroes * sizeof(T));
+        num_zeroes_ -= int(zeroes);
+        out += zeroes * sizeof(T);
+        n -= zeroes;
+        continue;
+      }
+      const char *p = addr_;
+      size_t done = DecodeLeb128Run<T>(p, end_, out, n);
+      addr_ = const_cast<char *>(p);
+      out += done * sizeof(T);
+      n -= done;
+      if (n == 0) {
+        break;
+      }
+      // Next value involves a marker or is truncated.
+      T v;
+      if constexpr (std::is_unsigned<T>::value) {
+        if (absl::Status status = ReadUnsignedLeb128(v); !status.ok()) {
+          return status;
+        }
+      } else {
+        if (absl::Status status = ReadSignedLeb128(v); !status.ok()) {
+          return status;
+        }
+      }
+      memcpy(out, &v, sizeof(T));
+      out += sizeof(T);
+      n--;
+    }
+    return absl::OkStatus();
+  }
+
+  // Reads n XOR encoded values (see float_xor.h) into out.  The encoded
+  // stream is raw bytes so we can't be in the middle of a run of zeroes.
+  template <typename U>
+  absl::Status ReadXorValues(char *out, size_t n) const {
+    if (num_zeroes_ > 0) {
+      return absl::InternalError("Zero run overlaps XOR encoded values");
+    }
+    const char *p = addr_;
+    if (absl::Status status =
+            DecodeStatus(XorDecode<U>(p, end_, out, n), "XOR encoded", addr_,
+                         end_);
+        !status.ok()) {
+      return status;
+    }
+    addr_ = const_cast<char *>(p);
+    return absl::OkStatus();
+  }
+
+  // Reads n delta bit-packed values (see delta_pack.h) into out.  Like
+  // ReadXorValues, these are raw bytes.
+  template <typename T>
+  absl::Status ReadPackValues(char *out, size_t n) const {
+    if (num_zeroes_ > 0) {
+      return absl::InternalError("Zero run overlaps packed values");
+    }
+    const char *p = addr_;
+    if (absl::Status status = DecodeStatus(PackDecode<T>(p, end_, out, n),
+                                           "packed", addr_, end_);
+        !status.ok()) {
+      return status;
+    }
+    addr_ = const_cast<char *>(p);
+    return absl::OkStatus();
+  }
+
   absl::Status Get(uint8_t &v) const {
     if (num_zeroes_ > 0) {
       // We are running through a run of zeroes.
@@ -462,12 +1059,21 @@ public:
   }
 
  private:
+  void FreeMemory() {
+    if (owned_ && start_ != nullptr) {
+      allocator_->Free(start_, size_);
+    }
+  }
+
   bool owned_ = false;           // Memory is owned by this buffer.
   char *start_ = nullptr;        // Start of memory.
   size_t size_ = 0;              // Size of memory.
   mutable char *addr_ = nullptr; // Current read/write address.
   char *end_ = nullptr;          // End of buffer.
   mutable int num_zeroes_ = 0; // Number of zero bytes to write in compact mode.
+  BufferAllocator *allocator_ = nullptr; // Memory for dynamic buffers.
+  mutable bool failed_ = false;          // error_ has been latched.
+  mutable absl::Status error_;           // First latched error.
 };
 
   // Alignment is not guaranteed for any copies so to comply with
@@ -613,7 +1219,7 @@ public:
     return WriteCompact(dest, v);
   }
 
-  template <> inline absl::Status Write(Buffer& b, const std::string &v) {
+  template <typename A> inline absl::Status Write(Buffer& b, const BasicString<A> &v) {
     if (absl::Status status = b.HasSpaceFor(4 + v.size()); !status.ok()) {
       return status;
     }
@@ -625,13 +1231,13 @@ public:
     return absl::OkStatus();
   }
 
-  template <> inline absl::Status Read(const Buffer& b, std::string &v) {
+  template <typename A> inline absl::Status Read(const Buffer& b, BasicString<A> &v) {
     if (absl::Status status = b.Check(4); !status.ok()) {
       return status;
     }
     uint32_t size = 0;
     memcpy(&size, b.Addr(), sizeof(size));
-    if (absl::Status status = b.Check(size_t(size)); !status.ok()) {
+    if (absl::Status status = b.Check(4 + size_t(size)); !status.ok()) {
       return status;
     }
     v.resize(size);
@@ -640,7 +1246,7 @@ public:
     return absl::OkStatus();
   }
 
-  template <> inline absl::Status WriteCompact(Buffer& b, const std::string &v) {
+  template <typename A> inline absl::Status WriteCompact(Buffer& b, const BasicString<A> &v) {
     if (absl::Status status = b.WriteUnsignedLeb128(v.size()); !status.ok()) {
       return status;
     }
@@ -652,7 +1258,7 @@ public:
     return absl::OkStatus();
   }
 
-  template <> inline absl::Status ReadCompact(const Buffer& b, std::string &v) {
+  template <typename A> inline absl::Status ReadCompact(const Buffer& b, BasicString<A> &v) {
     uint32_t size = 0;
     if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
       return status;
@@ -700,52 +1306,113 @@ public:
     return absl::OkStatus();
   }
 
-  template <typename T> inline absl::Status Write(Buffer& b, const std::vector<T> &vec) {
-    if (absl::Status status = b.HasSpaceFor(4); !status.ok()) {
-      return status;
-    }
+  template <typename T, typename A> inline absl::Status Write(Buffer& b, const std::vector<T, A> &vec) {
     uint32_t size = static_cast<uint32_t>(vec.size());
-    memcpy(b.Addr(), &size, sizeof(size));
-    b.Addr() += 4;
-    for (auto &v : vec) {
-      if (absl::Status status = Write(b, v); !status.ok()) {
+    if constexpr (IsBulkCopyable<T>()) {
+      // One space check and a single memcpy for the whole body.
+      size_t body = vec.size() * sizeof(T);
+      if (absl::Status status = b.HasSpaceFor(4 + body); !status.ok()) {
+        return status;
+      }
+      memcpy(b.Addr(), &size, sizeof(size));
+      if (body > 0) {
+        memcpy(b.Addr() + 4, vec.data(), body);
+      }
+      b.Addr() += 4 + body;
+      return absl::OkStatus();
+    } else {
+      if (absl::Status status = b.HasSpaceFor(4); !status.ok()) {
         return status;
       }
+      memcpy(b.Addr(), &size, sizeof(size));
+      b.Addr() += 4;
+      for (auto &v : vec) {
+        if (absl::Status status = Write(b, v); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
-  template <typename T> inline absl::Status Read(const Buffer& b, std::vector<T> &vec) {
+  template <typename T, typename A> inline absl::Status Read(const Buffer& b, std::vector<T, A> &vec) {
     if (absl::Status status = b.Check(4); !status.ok()) {
       return status;
     }
     uint32_t size = 0;
     memcpy(&size, b.Addr(), sizeof(size));
-    b.Addr() += 4;
-    vec.resize(size);
-    for (uint32_t i = 0; i < size; i++) {
-      if (absl::Status status = Read(b, vec[i]); !status.ok()) {
+    if constexpr (IsBulkCopyable<T>()) {
+      // Check for the whole body before resizing so that a bad length
+      // doesn't cause a huge allocation.
+      size_t body = size_t(size) * sizeof(T);
+      if (absl::Status status = b.Check(4 + body); !status.ok()) {
+        return status;
+      }
+      vec.resize(size);
+      if (body > 0) {
+        memcpy(vec.data(), b.Addr() + 4, body);
+      }
+      b.Addr() += 4 + body;
+      return absl::OkStatus();
+    } else {
+      b.Addr() += 4;
+      vec.resize(size);
+      for (uint32_t i = 0; i < size; i++) {
+        if (absl::Status status = Read(b, vec[i]); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
+    }
+  }
+
+  // Writes n values of type T at p, which need not be aligned, in compact
+  // form.  Runs of zero values are found in bulk and added to the buffer's
+  // zero run in one go rather than through Put one byte at a time.
+  template <typename T>
+  inline absl::Status WriteCompactValues(Buffer& b, const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+      size_t zeroes =
+          CountZeroBytes(p + i * sizeof(T), (n - i) * sizeof(T)) / sizeof(T);
+      if (zeroes > 0) {
+        if (absl::Status status = b.PutZeroes(zeroes); !status.ok()) {
+          return status;
+        }
+        i += zeroes;
+        continue;
+      }
+      T v;
+      memcpy(&v, p + i * sizeof(T), sizeof(T));
+      if (absl::Status status = WriteCompact(b, v); !status.ok()) {
         return status;
       }
+      i++;
     }
     return absl::OkStatus();
   }
 
-  template <typename T> inline absl::Status WriteCompact(Buffer& b, const std::vector<T> &vec) {
+  template <typename T, typename A> inline absl::Status WriteCompact(Buffer& b, const std::vector<T, A> &vec) {
     if (absl::Status status = b.WriteUnsignedLeb128(vec.size()); !status.ok()) {
       return status;
     }
-    for (auto &v : vec) {
-      if (absl::Status status = WriteCompact(b, v); !status.ok()) {
-        return status;
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      return WriteCompactValues<typename CompactScalar<T>::type>(
+          b, reinterpret_cast<const char *>(vec.data()),
+          vec.size() * CompactScalar<T>::kCount);
+    } else {
+      for (auto &v : vec) {
+        if (absl::Status status = WriteCompact(b, v); !status.ok()) {
+          return status;
+        }
       }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   // Specialization vector of uint8_t so we can use memcpy instead of processing
   // the body byte by byte.
-  template <> inline absl::Status WriteCompact(Buffer& b, const std::vector<uint8_t> &vec) {
+  template <typename A> inline absl::Status WriteCompact(Buffer& b, const std::vector<uint8_t, A> &vec) {
     if (vec.empty()) {
       // Empty vector has a zero length and no body.  No need to flush
       // the zeroes.
@@ -768,27 +1435,47 @@ public:
     return absl::OkStatus();
   }
 
-  template <typename T> inline absl::Status ReadCompact(const Buffer& b, std::vector<T> &vec) {
+  template <typename T, typename A> inline absl::Status ReadCompact(const Buffer& b, std::vector<T, A> &vec) {
     uint32_t size = 0;
     if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
       return status;
     }
 
-    if (absl::Status status = b.Check(size_t(size)); !status.ok()) {
+    // Sanity check the size.  A zero run can encode up to kMaxZeroes
+    // values in two bytes so we can't expect a byte per value.
+    if (absl::Status status = b.Check(size_t(size) / kMaxZeroes);
+        !status.ok()) {
       return status;
     }
 
-    vec.resize(size);
-    for (uint32_t i = 0; i < size; i++) {
-      if (absl::Status status = ReadCompact(b, vec[i]); !status.ok()) {
-        return status;
+    // That still lets a short input claim about kMaxZeroes / 2 values per
+    // byte, so the vector grows in steps as the values are decoded and a
+    // bad size fails before it causes a huge allocation.
+    vec.clear();
+    size_t done = 0;
+    while (done < size) {
+      size_t n = std::min(size - done, b.ReadStep());
+      vec.resize(done + n);
+      if constexpr (std::is_integral<T>::value) {
+        if (absl::Status status = b.ReadLeb128Values<T>(
+                reinterpret_cast<char *>(vec.data() + done), n);
+            !status.ok()) {
+          return status;
+        }
+      } else {
+        for (size_t i = done; i < done + n; i++) {
+          if (absl::Status status = ReadCompact(b, vec[i]); !status.ok()) {
+            return status;
+          }
+        }
       }
+      done += n;
     }
     return absl::OkStatus();
   }
 
   // uint8_t specialization for memcpy.
-  template <> inline absl::Status ReadCompact(const Buffer& b, std::vector<uint8_t> &vec) {
+  template <typename A> inline absl::Status ReadCompact(const Buffer& b, std::vector<uint8_t, A> &vec) {
     uint32_t size = 0;
     if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
       return status;
@@ -811,34 +1498,63 @@ public:
       return status;
     }
 
-    if (absl::Status status = dest.Check(size_t(size)); !status.ok()) {
-      return status;
-    }
-    memcpy(dest.Addr(), &size, sizeof(size));
-    dest.Addr() += 4;
-    for (uint32_t i = 0; i < size; i++) {
-      if (absl::Status status = ExpandField(b, dest, T{}); !status.ok()) {
+    if constexpr (std::is_integral<T>::value) {
+      // Decode the body straight into the destination, which grows in
+      // steps as in ReadCompact.
+      if (absl::Status status = b.Check(size_t(size) / kMaxZeroes);
+          !status.ok()) {
         return status;
       }
-    }
-    return absl::OkStatus();
-  }
-
-  template <>
-  inline absl::Status ExpandField(const Buffer& b, const std::vector<uint8_t> &, Buffer &dest) {
+      if (absl::Status status = dest.HasSpaceFor(4); !status.ok()) {
+        return status;
+      }
+      memcpy(dest.Addr(), &size, sizeof(size));
+      dest.Addr() += 4;
+      size_t done = 0;
+      while (done < size) {
+        size_t n = std::min(size - done, b.ReadStep());
+        if (absl::Status status = dest.HasSpaceFor(n * sizeof(T));
+            !status.ok()) {
+          return status;
+        }
+        if (absl::Status status = b.ReadLeb128Values<T>(dest.Addr(), n);
+            !status.ok()) {
+          return status;
+        }
+        dest.Addr() += n * sizeof(T);
+        done += n;
+      }
+      return absl::OkStatus();
+    } else {
+      if (absl::Status status = dest.HasSpaceFor(4); !status.ok()) {
+        return status;
+      }
+      memcpy(dest.Addr(), &size, sizeof(size));
+      dest.Addr() += 4;
+      for (uint32_t i = 0; i < size; i++) {
+        if (absl::Status status = ExpandField(b, dest, T{}); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
+    }
+  }
+
+  template <>
+  inline absl::Status ExpandField(const Buffer& b, const std::vector<uint8_t> &, Buffer &dest) {
     uint32_t size = 0;
     if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
       return status;
     }
 
-    if (absl::Status status = dest.Check(size_t(size)); !status.ok()) {
+    if (absl::Status status = b.Check(size_t(size)); !status.ok()) {
       return status;
     }
-    memcpy(dest.Addr(), &size, sizeof(size));
-    dest.Addr() += 4;
-    if (absl::Status status = dest.HasSpaceFor(size); !status.ok()) {
+    if (absl::Status status = dest.HasSpaceFor(4 + size_t(size)); !status.ok()) {
       return status;
     }
+    memcpy(dest.Addr(), &size, sizeof(size));
+    dest.Addr() += 4;
     memcpy(dest.Addr(), b.Addr(), size);
     b.Addr() += size;
     dest.Addr() += size;
@@ -857,12 +1573,26 @@ public:
     }
 
     b.Addr() += 4;
-    for (uint32_t i = 0; i < size; i++) {
-      if (absl::Status status = CompactField(b, dest, T{}); !status.ok()) {
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      size_t body = size_t(size) * sizeof(T);
+      if (absl::Status status = b.Check(body); !status.ok()) {
         return status;
       }
+      if (absl::Status status = WriteCompactValues<typename CompactScalar<T>::type>(
+              dest, b.Addr(), size_t(size) * CompactScalar<T>::kCount);
+          !status.ok()) {
+        return status;
+      }
+      b.Addr() += body;
+      return absl::OkStatus();
+    } else {
+      for (uint32_t i = 0; i < size; i++) {
+        if (absl::Status status = CompactField(b, dest, T{}); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   template <>
@@ -875,6 +1605,7 @@ public:
     if (size == 0) {
       // Empty vector has a zero length and no body.  No need to flush
       // the zeroes.
+      b.Addr() += 4;
       if (absl::Status status = dest.WriteUnsignedLeb128(0); !status.ok()) {
         return status;
       }
@@ -888,6 +1619,9 @@ public:
     }
 
     b.Addr() += 4;
+    if (absl::Status status = b.Check(size); !status.ok()) {
+      return status;
+    }
     if (absl::Status status = dest.HasSpaceFor(size); !status.ok()) {
       return status;
     }
@@ -899,50 +1633,56 @@ public:
 
   template <typename T, size_t N>
   inline absl::Status Write(Buffer& b, const std::array<T, N> &vec) {
-    for (auto &v : vec) {
-      if (absl::Status status = Write(b, v); !status.ok()) {
+    if constexpr (IsBulkCopyable<T>()) {
+      if (absl::Status status = b.HasSpaceFor(sizeof(vec)); !status.ok()) {
         return status;
       }
+      memcpy(b.Addr(), vec.data(), sizeof(vec));
+      b.Addr() += sizeof(vec);
+      return absl::OkStatus();
+    } else {
+      for (auto &v : vec) {
+        if (absl::Status status = Write(b, v); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
-  }
-
-  template <size_t N> inline absl::Status Write(Buffer& b, const std::array<uint8_t, N> &vec) {
-    if (absl::Status status = b.HasSpaceFor(N); !status.ok()) {
-      return status;
-    }
-    memcpy(b.Addr(), vec.data(), N);
-    b.Addr() += N;
-    return absl::OkStatus();
   }
 
   template <typename T, size_t N>
   inline absl::Status Read(const Buffer& b, std::array<T, N> &vec) {
-    for (int i = 0; i < N; i++) {
-      if (absl::Status status = Read(b, vec[i]); !status.ok()) {
+    if constexpr (IsBulkCopyable<T>()) {
+      if (absl::Status status = b.Check(sizeof(vec)); !status.ok()) {
         return status;
       }
+      memcpy(vec.data(), b.Addr(), sizeof(vec));
+      b.Addr() += sizeof(vec);
+      return absl::OkStatus();
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        if (absl::Status status = Read(b, vec[i]); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
-  }
-
-  template <size_t N> inline absl::Status Read(const Buffer& b, std::array<uint8_t, N> &vec) {
-    if (absl::Status status = b.Check(N); !status.ok()) {
-      return status;
-    }
-    memcpy(vec.data(), b.Addr(), N);
-    b.Addr() += N;
-    return absl::OkStatus();
   }
 
   template <typename T, size_t N>
   inline absl::Status WriteCompact(Buffer& b, const std::array<T, N> &vec) {
-    for (auto &v : vec) {
-      if (absl::Status status = WriteCompact(b, v); !status.ok()) {
-        return status;
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      return WriteCompactValues<typename CompactScalar<T>::type>(
+          b, reinterpret_cast<const char *>(vec.data()),
+          N * CompactScalar<T>::kCount);
+    } else {
+      for (auto &v : vec) {
+        if (absl::Status status = WriteCompact(b, v); !status.ok()) {
+          return status;
+        }
       }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   template <size_t N>
@@ -956,12 +1696,16 @@ public:
 
   template <typename T, size_t N>
   inline absl::Status ReadCompact(const Buffer& b, std::array<T, N> &vec) {
-    for (int i = 0; i < N; i++) {
-      if (absl::Status status = ReadCompact(b, vec[i]); !status.ok()) {
-        return status;
+    if constexpr (std::is_integral<T>::value) {
+      return b.ReadLeb128Values<T>(reinterpret_cast<char *>(vec.data()), N);
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        if (absl::Status status = ReadCompact(b, vec[i]); !status.ok()) {
+          return status;
+        }
       }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   template <size_t N>
@@ -971,12 +1715,24 @@ public:
 
   template <typename T, size_t N>
   inline absl::Status ExpandField(const Buffer& b, const std::array<T, N> &, Buffer &dest) {
-    for (int i = 0; i < N; i++) {
-      if (absl::Status status = ExpandField(b, dest, T{}); !status.ok()) {
+    if constexpr (std::is_integral<T>::value) {
+      if (absl::Status status = dest.HasSpaceFor(N * sizeof(T)); !status.ok()) {
         return status;
       }
+      if (absl::Status status = b.ReadLeb128Values<T>(dest.Addr(), N);
+          !status.ok()) {
+        return status;
+      }
+      dest.Addr() += N * sizeof(T);
+      return absl::OkStatus();
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        if (absl::Status status = ExpandField(b, dest, T{}); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   template <size_t N>
@@ -995,12 +1751,25 @@ public:
 
   template <typename T, size_t N>
   inline absl::Status CompactField(const Buffer& b, const std::array<T, N> &, Buffer &dest) {
-    for (int i = 0; i < N; i++) {
-      if (absl::Status status = CompactField(b, dest, T{}); !status.ok()) {
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      if (absl::Status status = b.Check(N * sizeof(T)); !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = WriteCompactValues<typename CompactScalar<T>::type>(
+              dest, b.Addr(), N * CompactScalar<T>::kCount);
+          !status.ok()) {
         return status;
       }
+      b.Addr() += N * sizeof(T);
+      return absl::OkStatus();
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        if (absl::Status status = CompactField(b, dest, T{}); !status.ok()) {
+          return status;
+        }
+      }
+      return absl::OkStatus();
     }
-    return absl::OkStatus();
   }
 
   template <size_t N>
@@ -1140,4 +1909,695 @@ public:
     return absl::OkStatus();
   }
 
+  // Unchecked writers used by the presized serializers.  The caller has
+  // reserved the exact number of bytes from SerializedSize or
+  // CompactSerializedSize so there are no capacity checks and no status.
+  template <typename T> inline void WriteUnchecked(Buffer& b, const T &v) {
+    memcpy(b.Addr(), &v, sizeof(T));
+    b.Addr() += sizeof(T);
+  }
+
+  template <typename A> inline void WriteUnchecked(Buffer& b, const BasicString<A> &v) {
+    uint32_t size = static_cast<uint32_t>(v.size());
+    memcpy(b.Addr(), &size, sizeof(size));
+    memcpy(b.Addr() + 4, v.data(), v.size());
+    b.Addr() += 4 + v.size();
+  }
+
+  template <typename T, typename A>
+  inline void WriteUnchecked(Buffer& b, const std::vector<T, A> &vec) {
+    uint32_t size = static_cast<uint32_t>(vec.size());
+    memcpy(b.Addr(), &size, sizeof(size));
+    b.Addr() += 4;
+    if constexpr (IsBulkCopyable<T>()) {
+      size_t body = vec.size() * sizeof(T);
+      if (body > 0) {
+        memcpy(b.Addr(), vec.data(), body);
+      }
+      b.Addr() += body;
+    } else {
+      for (auto &v : vec) {
+        WriteUnchecked(b, v);
+      }
+    }
+  }
+
+  template <typename T, size_t N>
+  inline void WriteUnchecked(Buffer& b, const std::array<T, N> &vec) {
+    if constexpr (IsBulkCopyable<T>()) {
+      memcpy(b.Addr(), vec.data(), sizeof(vec));
+      b.Addr() += sizeof(vec);
+    } else {
+      for (auto &v : vec) {
+        WriteUnchecked(b, v);
+      }
+    }
+  }
+
+  // Latched writers and readers for ROS format.  Each makes one space check
+  // and uses the unchecked writers or a memcpy.  A failure is latched in the
+  // buffer (see Buffer::Latch) and the field is skipped.  Fixed size values
+  // include enums, Time and Duration.
+  template <typename T> inline void WriteLatched(Buffer& b, const T &v) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "WriteLatched needs a fixed size type");
+    if (b.ReserveLatched(sizeof(T))) {
+      WriteUnchecked(b, v);
+    }
+  }
+
+  template <typename A> inline void WriteLatched(Buffer& b, const BasicString<A> &v) {
+    if (b.ReserveLatched(4 + v.size())) {
+      WriteUnchecked(b, v);
+    }
+  }
+
+  template <typename T, typename A>
+  inline void WriteLatched(Buffer& b, const std::vector<T, A> &vec) {
+    if constexpr (IsBulkCopyable<T>()) {
+      if (b.ReserveLatched(4 + vec.size() * sizeof(T))) {
+        WriteUnchecked(b, vec);
+      }
+    } else {
+      WriteLatched(b, uint32_t(vec.size()));
+      for (auto &v : vec) {
+        WriteLatched(b, v);
+      }
+    }
+  }
+
+  template <typename T, size_t N>
+  inline void WriteLatched(Buffer& b, const std::array<T, N> &vec) {
+    if constexpr (IsBulkCopyable<T>()) {
+      if (b.ReserveLatched(sizeof(vec))) {
+        WriteUnchecked(b, vec);
+      }
+    } else {
+      for (auto &v : vec) {
+        WriteLatched(b, v);
+      }
+    }
+  }
+
+  template <typename T> inline void ReadLatched(const Buffer& b, T &v) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "ReadLatched needs a fixed size type");
+    if (b.CheckLatched(sizeof(T))) {
+      memcpy(&v, b.Addr(), sizeof(T));
+      b.Addr() += sizeof(T);
+    }
+  }
+
+  template <typename A> inline void ReadLatched(const Buffer& b, BasicString<A> &v) {
+    uint32_t size = 0;
+    if (!b.CheckLatched(4)) {
+      return;
+    }
+    memcpy(&size, b.Addr(), sizeof(size));
+    if (!b.CheckLatched(4 + size_t(size))) {
+      return;
+    }
+    v.assign(b.Addr() + 4, size);
+    b.Addr() += 4 + size_t(size);
+  }
+
+  template <typename T, typename A>
+  inline void ReadLatched(const Buffer& b, std::vector<T, A> &vec) {
+    uint32_t size = 0;
+    ReadLatched(b, size);
+    if (b.Failed()) {
+      // Don't size the vector from a length that may not be one.
+      return;
+    }
+    if constexpr (IsBulkCopyable<T>()) {
+      size_t body = size_t(size) * sizeof(T);
+      if (!b.CheckLatched(body)) {
+        return;
+      }
+      vec.resize(size);
+      if (body > 0) {
+        memcpy(vec.data(), b.Addr(), body);
+      }
+      b.Addr() += body;
+    } else {
+      vec.resize(size);
+      for (uint32_t i = 0; i < size && !b.Failed(); i++) {
+        ReadLatched(b, vec[i]);
+      }
+    }
+  }
+
+  template <typename T, size_t N>
+  inline void ReadLatched(const Buffer& b, std::array<T, N> &vec) {
+    if constexpr (IsBulkCopyable<T>()) {
+      if (b.CheckLatched(sizeof(vec))) {
+        memcpy(vec.data(), b.Addr(), sizeof(vec));
+        b.Addr() += sizeof(vec);
+      }
+    } else {
+      for (auto &v : vec) {
+        ReadLatched(b, v);
+      }
+    }
+  }
+
+  template <typename T>
+  inline void WriteCompactUnchecked(Buffer& b, const T &v) {
+    if constexpr (std::is_unsigned<T>::value) {
+      b.WriteUnsignedLeb128Unchecked(v);
+    } else {
+      b.WriteSignedLeb128Unchecked(v);
+    }
+  }
+
+  inline void WriteCompactUnchecked(Buffer& b, const float &v) {
+    uint32_t x;
+    memcpy(&x, &v, sizeof(x));
+    b.WriteUnsignedLeb128Unchecked(x);
+  }
+
+  inline void WriteCompactUnchecked(Buffer& b, const double &v) {
+    uint64_t x;
+    memcpy(&x, &v, sizeof(x));
+    b.WriteUnsignedLeb128Unchecked(x);
+  }
+
+  template <typename A> inline void WriteCompactUnchecked(Buffer& b, const BasicString<A> &v) {
+    b.WriteUnsignedLeb128Unchecked(v.size());
+    memcpy(b.Addr(), v.data(), v.size());
+    b.Addr() += v.size();
+  }
+
+  template <> inline void WriteCompactUnchecked(Buffer& b, const Time &t) {
+    WriteCompactUnchecked(b, t.secs);
+    WriteCompactUnchecked(b, t.nsecs);
+  }
+
+  template <> inline void WriteCompactUnchecked(Buffer& b, const Duration &d) {
+    WriteCompactUnchecked(b, d.secs);
+    WriteCompactUnchecked(b, d.nsecs);
+  }
+
+  template <typename T>
+  inline void WriteCompactValuesUnchecked(Buffer& b, const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+      size_t zeroes =
+          CountZeroBytes(p + i * sizeof(T), (n - i) * sizeof(T)) / sizeof(T);
+      if (zeroes > 0) {
+        b.PutZeroesUnchecked(zeroes);
+        i += zeroes;
+        continue;
+      }
+      T v;
+      memcpy(&v, p + i * sizeof(T), sizeof(T));
+      WriteCompactUnchecked(b, v);
+      i++;
+    }
+  }
+
+  template <typename T, typename A>
+  inline void WriteCompactUnchecked(Buffer& b, const std::vector<T, A> &vec) {
+    b.WriteUnsignedLeb128Unchecked(vec.size());
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      WriteCompactValuesUnchecked<typename CompactScalar<T>::type>(
+          b, reinterpret_cast<const char *>(vec.data()),
+          vec.size() * CompactScalar<T>::kCount);
+    } else {
+      for (auto &v : vec) {
+        WriteCompactUnchecked(b, v);
+      }
+    }
+  }
+
+  template <typename A>
+  inline void WriteCompactUnchecked(Buffer& b, const std::vector<uint8_t, A> &vec) {
+    if (vec.empty()) {
+      b.WriteUnsignedLeb128Unchecked(0);
+      return;
+    }
+    b.FlushZeroesUnchecked();
+    b.WriteUnsignedLeb128Unchecked(vec.size());
+    memcpy(b.Addr(), vec.data(), vec.size());
+    b.Addr() += vec.size();
+  }
+
+  template <typename T, size_t N>
+  inline void WriteCompactUnchecked(Buffer& b, const std::array<T, N> &vec) {
+    if constexpr (CompactScalar<T>::kCount > 0) {
+      WriteCompactValuesUnchecked<typename CompactScalar<T>::type>(
+          b, reinterpret_cast<const char *>(vec.data()),
+          N * CompactScalar<T>::kCount);
+    } else {
+      for (auto &v : vec) {
+        WriteCompactUnchecked(b, v);
+      }
+    }
+  }
+
+  template <size_t N>
+  inline void WriteCompactUnchecked(Buffer& b, const std::array<uint8_t, N> &vec) {
+    b.FlushZeroesUnchecked();
+    memcpy(b.Addr(), vec.data(), N);
+    b.Addr() += N;
+  }
+
+  // Compact v2 encoding of float32 and float64 vectors and arrays.  The
+  // generator uses these instead of the regular compact functions for
+  // those fields when run with --compact_v2.  The values are XOR encoded
+  // (see float_xor.h) as raw bytes after the length, like uint8_t vectors,
+  // so any pending zeroes are flushed first.  An empty vector is just a
+  // zero length.
+  template <typename T> struct XorBits;
+  template <> struct XorBits<float> { using type = uint32_t; };
+  template <> struct XorBits<double> { using type = uint64_t; };
+
+  template <typename T>
+  inline void AccumulateXorValues(SizeAccumulator &acc, const T *v, size_t n) {
+    acc.Close();
+    acc.size_ += XorEncodedSize<typename XorBits<T>::type>(
+        reinterpret_cast<const char *>(v), n);
+  }
+
+  template <typename T, typename A>
+  inline void AccumulateXor(SizeAccumulator &acc, const std::vector<T, A> &v) {
+    if (v.empty()) {
+      Accumulate(acc, uint8_t(0));
+      return;
+    }
+    acc.Close();
+    Accumulate(acc, v.size());
+    AccumulateXorValues(acc, v.data(), v.size());
+  }
+
+  template <typename T, size_t N>
+  inline void AccumulateXor(SizeAccumulator &acc, const std::array<T, N> &v) {
+    AccumulateXorValues(acc, v.data(), N);
+  }
+
+  template <typename T>
+  inline absl::Status WriteCompactXorValues(Buffer &b, const char *p, size_t n) {
+    if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+      return status;
+    }
+    size_t size = XorEncodedSize<typename XorBits<T>::type>(p, n);
+    if (absl::Status status = b.HasSpaceFor(size); !status.ok()) {
+      return status;
+    }
+    XorBitWriter writer(b.Addr());
+    XorEncode<typename XorBits<T>::type>(p, n, writer);
+    b.Addr() = writer.Addr();
+    return absl::OkStatus();
+  }
+
+  template <typename T, typename A>
+  inline absl::Status WriteCompactXor(Buffer &b, const std::vector<T, A> &vec) {
+    if (vec.empty()) {
+      return b.WriteUnsignedLeb128(0);
+    }
+    if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.WriteUnsignedLeb128(vec.size()); !status.ok()) {
+      return status;
+    }
+    return WriteCompactXorValues<T>(
+        b, reinterpret_cast<const char *>(vec.data()), vec.size());
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status WriteCompactXor(Buffer &b, const std::array<T, N> &vec) {
+    return WriteCompactXorValues<T>(
+        b, reinterpret_cast<const char *>(vec.data()), N);
+  }
+
+  template <typename T>
+  inline void WriteCompactXorValuesUnchecked(Buffer &b, const char *p,
+                                             size_t n) {
+    b.FlushZeroesUnchecked();
+    XorBitWriter writer(b.Addr());
+    XorEncode<typename XorBits<T>::type>(p, n, writer);
+    b.Addr() = writer.Addr();
+  }
+
+  template <typename T, typename A>
+  inline void WriteCompactXorUnchecked(Buffer &b, const std::vector<T, A> &vec) {
+    if (vec.empty()) {
+      b.WriteUnsignedLeb128Unchecked(0);
+      return;
+    }
+    b.FlushZeroesUnchecked();
+    b.WriteUnsignedLeb128Unchecked(vec.size());
+    WriteCompactXorValuesUnchecked<T>(
+        b, reinterpret_cast<const char *>(vec.data()), vec.size());
+  }
+
+  template <typename T, size_t N>
+  inline void WriteCompactXorUnchecked(Buffer &b, const std::array<T, N> &vec) {
+    WriteCompactXorValuesUnchecked<T>(
+        b, reinterpret_cast<const char *>(vec.data()), N);
+  }
+
+  template <typename T, typename A>
+  inline absl::Status ReadCompactXor(const Buffer &b, std::vector<T, A> &vec) {
+    uint32_t size = 0;
+    if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    // Each value takes at least one bit.
+    if (absl::Status status = b.Check(size_t(size) / 8); !status.ok()) {
+      return status;
+    }
+    vec.resize(size);
+    return b.ReadXorValues<typename XorBits<T>::type>(
+        reinterpret_cast<char *>(vec.data()), size);
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status ReadCompactXor(const Buffer &b, std::array<T, N> &vec) {
+    return b.ReadXorValues<typename XorBits<T>::type>(
+        reinterpret_cast<char *>(vec.data()), N);
+  }
+
+  template <typename T>
+  inline absl::Status ExpandFieldXor(const Buffer &b, const std::vector<T> &,
+                                     Buffer &dest) {
+    uint32_t size = 0;
+    if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.Check(size_t(size) / 8); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = dest.HasSpaceFor(4 + size_t(size) * sizeof(T));
+        !status.ok()) {
+      return status;
+    }
+    memcpy(dest.Addr(), &size, sizeof(size));
+    if (absl::Status status =
+            b.ReadXorValues<typename XorBits<T>::type>(dest.Addr() + 4, size);
+        !status.ok()) {
+      return status;
+    }
+    dest.Addr() += 4 + size_t(size) * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status ExpandFieldXor(const Buffer &b, const std::array<T, N> &,
+                                     Buffer &dest) {
+    if (absl::Status status = dest.HasSpaceFor(N * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status =
+            b.ReadXorValues<typename XorBits<T>::type>(dest.Addr(), N);
+        !status.ok()) {
+      return status;
+    }
+    dest.Addr() += N * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T>
+  inline absl::Status CompactFieldXor(const Buffer &b, const std::vector<T> &,
+                                      Buffer &dest) {
+    if (absl::Status status = b.Check(4); !status.ok()) {
+      return status;
+    }
+    uint32_t size;
+    memcpy(&size, b.Addr(), sizeof(size));
+    b.Addr() += 4;
+    if (size == 0) {
+      return dest.WriteUnsignedLeb128(0);
+    }
+    if (absl::Status status = b.Check(size_t(size) * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = dest.FlushZeroes(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = dest.WriteUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = WriteCompactXorValues<T>(dest, b.Addr(), size);
+        !status.ok()) {
+      return status;
+    }
+    b.Addr() += size_t(size) * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status CompactFieldXor(const Buffer &b, const std::array<T, N> &,
+                                      Buffer &dest) {
+    if (absl::Status status = b.Check(N * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = WriteCompactXorValues<T>(dest, b.Addr(), N);
+        !status.ok()) {
+      return status;
+    }
+    b.Addr() += N * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  // Compact v2 encoding of integer vectors and arrays.  The generator uses
+  // these for 16, 32 and 64 bit integer fields when run with --compact_v2.
+  // After the length of a vector, a mode byte says how the values are
+  // encoded.  kCompactLeb128 is the regular compact encoding.  For
+  // kCompactDeltaPacked, any pending zeroes are flushed and the values
+  // follow as raw bytes (see delta_pack.h).  The encoding that gives the
+  // smaller size is used, decided from the values alone so that
+  // SizeAccumulator makes the same choice.  An empty vector is just a zero
+  // length.
+  constexpr uint8_t kCompactLeb128 = 0;
+  constexpr uint8_t kCompactDeltaPacked = 1;
+
+  // Returns true if n values of type T at p should be delta packed and sets
+  // packed_size to the size of the packed values.
+  template <typename T>
+  inline bool UseDeltaPacking(const char *p, size_t n, size_t &packed_size) {
+    packed_size = PackedSize<T>(p, n);
+    SizeAccumulator acc;
+    AccumulateValues<T>(acc, p, n);
+    acc.Close();
+    return packed_size < acc.Size();
+  }
+
+  template <typename T>
+  inline void AccumulatePackedValues(SizeAccumulator &acc, const char *p,
+                                     size_t n) {
+    size_t packed_size;
+    if (UseDeltaPacking<T>(p, n, packed_size)) {
+      acc.Close();
+      acc.size_ += 1 + packed_size;
+      return;
+    }
+    Accumulate(acc, kCompactLeb128);
+    AccumulateValues<T>(acc, p, n);
+  }
+
+  template <typename T, typename A>
+  inline void AccumulatePacked(SizeAccumulator &acc, const std::vector<T, A> &v) {
+    Accumulate(acc, v.size());
+    if (!v.empty()) {
+      AccumulatePackedValues<T>(acc, reinterpret_cast<const char *>(v.data()),
+                                v.size());
+    }
+  }
+
+  template <typename T, size_t N>
+  inline void AccumulatePacked(SizeAccumulator &acc, const std::array<T, N> &v) {
+    AccumulatePackedValues<T>(acc, reinterpret_cast<const char *>(v.data()),
+                              N);
+  }
+
+  template <typename T>
+  inline absl::Status WriteCompactPackedValues(Buffer &b, const char *p,
+                                               size_t n) {
+    size_t packed_size;
+    if (!UseDeltaPacking<T>(p, n, packed_size)) {
+      if (absl::Status status = b.Put(kCompactLeb128); !status.ok()) {
+        return status;
+      }
+      return WriteCompactValues<T>(b, p, n);
+    }
+    if (absl::Status status = b.FlushZeroes(); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.HasSpaceFor(1 + packed_size); !status.ok()) {
+      return status;
+    }
+    *b.Addr()++ = char(kCompactDeltaPacked);
+    b.Addr() += PackEncode<T>(p, n, b.Addr());
+    return absl::OkStatus();
+  }
+
+  template <typename T, typename A>
+  inline absl::Status WriteCompactPacked(Buffer &b, const std::vector<T, A> &vec) {
+    if (absl::Status status = b.WriteUnsignedLeb128(vec.size()); !status.ok()) {
+      return status;
+    }
+    if (vec.empty()) {
+      return absl::OkStatus();
+    }
+    return WriteCompactPackedValues<T>(
+        b, reinterpret_cast<const char *>(vec.data()), vec.size());
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status WriteCompactPacked(Buffer &b, const std::array<T, N> &vec) {
+    return WriteCompactPackedValues<T>(
+        b, reinterpret_cast<const char *>(vec.data()), N);
+  }
+
+  template <typename T>
+  inline void WriteCompactPackedValuesUnchecked(Buffer &b, const char *p,
+                                                size_t n) {
+    size_t packed_size;
+    if (!UseDeltaPacking<T>(p, n, packed_size)) {
+      b.PutUnchecked(kCompactLeb128);
+      WriteCompactValuesUnchecked<T>(b, p, n);
+      return;
+    }
+    b.FlushZeroesUnchecked();
+    *b.Addr()++ = char(kCompactDeltaPacked);
+    b.Addr() += PackEncode<T>(p, n, b.Addr());
+  }
+
+  template <typename T, typename A>
+  inline void WriteCompactPackedUnchecked(Buffer &b, const std::vector<T, A> &vec) {
+    b.WriteUnsignedLeb128Unchecked(vec.size());
+    if (!vec.empty()) {
+      WriteCompactPackedValuesUnchecked<T>(
+          b, reinterpret_cast<const char *>(vec.data()), vec.size());
+    }
+  }
+
+  template <typename T, size_t N>
+  inline void WriteCompactPackedUnchecked(Buffer &b,
+                                          const std::array<T, N> &vec) {
+    WriteCompactPackedValuesUnchecked<T>(
+        b, reinterpret_cast<const char *>(vec.data()), N);
+  }
+
+  template <typename T>
+  inline absl::Status ReadPackedValues(const Buffer &b, char *out, size_t n) {
+    uint8_t mode;
+    if (absl::Status status = b.Get(mode); !status.ok()) {
+      return status;
+    }
+    switch (mode) {
+    case kCompactLeb128:
+      return b.ReadLeb128Values<T>(out, n);
+    case kCompactDeltaPacked:
+      return b.ReadPackValues<T>(out, n);
+    default:
+      return absl::InternalError(
+          absl::StrFormat("Unknown compact integer encoding %d", mode));
+    }
+  }
+
+  template <typename T, typename A>
+  inline absl::Status ReadCompactPacked(const Buffer &b, std::vector<T, A> &vec) {
+    uint32_t size = 0;
+    if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.Check(size_t(size) / kMaxZeroes);
+        !status.ok()) {
+      return status;
+    }
+    vec.resize(size);
+    if (size == 0) {
+      return absl::OkStatus();
+    }
+    return ReadPackedValues<T>(b, reinterpret_cast<char *>(vec.data()), size);
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status ReadCompactPacked(const Buffer &b, std::array<T, N> &vec) {
+    return ReadPackedValues<T>(b, reinterpret_cast<char *>(vec.data()), N);
+  }
+
+  template <typename T>
+  inline absl::Status ExpandFieldPacked(const Buffer &b, const std::vector<T> &,
+                                        Buffer &dest) {
+    uint32_t size = 0;
+    if (absl::Status status = b.ReadUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = b.Check(size_t(size) / kMaxZeroes);
+        !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = dest.HasSpaceFor(4 + size_t(size) * sizeof(T));
+        !status.ok()) {
+      return status;
+    }
+    memcpy(dest.Addr(), &size, sizeof(size));
+    if (size > 0) {
+      if (absl::Status status = ReadPackedValues<T>(b, dest.Addr() + 4, size);
+          !status.ok()) {
+        return status;
+      }
+    }
+    dest.Addr() += 4 + size_t(size) * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status ExpandFieldPacked(const Buffer &b, const std::array<T, N> &,
+                                        Buffer &dest) {
+    if (absl::Status status = dest.HasSpaceFor(N * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = ReadPackedValues<T>(b, dest.Addr(), N);
+        !status.ok()) {
+      return status;
+    }
+    dest.Addr() += N * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T>
+  inline absl::Status CompactFieldPacked(const Buffer &b, const std::vector<T> &,
+                                         Buffer &dest) {
+    if (absl::Status status = b.Check(4); !status.ok()) {
+      return status;
+    }
+    uint32_t size;
+    memcpy(&size, b.Addr(), sizeof(size));
+    b.Addr() += 4;
+    if (absl::Status status = b.Check(size_t(size) * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = dest.WriteUnsignedLeb128(size); !status.ok()) {
+      return status;
+    }
+    if (size == 0) {
+      return absl::OkStatus();
+    }
+    if (absl::Status status = WriteCompactPackedValues<T>(dest, b.Addr(), size);
+        !status.ok()) {
+      return status;
+    }
+    b.Addr() += size_t(size) * sizeof(T);
+    return absl::OkStatus();
+  }
+
+  template <typename T, size_t N>
+  inline absl::Status CompactFieldPacked(const Buffer &b, const std::array<T, N> &,
+                                         Buffer &dest) {
+    if (absl::Status status = b.Check(N * sizeof(T)); !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = WriteCompactPackedValues<T>(dest, b.Addr(), N);
+        !status.ok()) {
+      return status;
+    }
+    b.Addr() += N * sizeof(T);
+    return absl::OkStatus();
+  }
+
 } // namespace neutron::serdes
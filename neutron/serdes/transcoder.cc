@@ -0,0 +1,566 @@
+#include "neutron/serdes/transcoder.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_format.h"
+#include "neutron/descriptor.h"
+#include "neutron/serdes/mux.h"
+
+namespace neutron::serdes {
+
+absl::StatusOr<absl::Span<const char>> MuxDescriptor(const std::string &name) {
+  return MessageMux::Instance().GetDescriptor(name);
+}
+
+namespace {
+
+using Op = Transcoder::Op;
+using Scalar = Transcoder::Scalar;
+using Step = Transcoder::Step;
+
+size_t ScalarSize(Scalar s) {
+  switch (s) {
+  case Scalar::kInt8:
+  case Scalar::kUint8:
+    return 1;
+  case Scalar::kInt16:
+  case Scalar::kUint16:
+    return 2;
+  case Scalar::kInt32:
+  case Scalar::kUint32:
+    return 4;
+  case Scalar::kInt64:
+  case Scalar::kUint64:
+    return 8;
+  }
+  return 1;
+}
+
+// Calls fn with a value of the C++ type for s.
+template <typename Fn> absl::Status WithScalar(Scalar s, Fn fn) {
+  switch (s) {
+  case Scalar::kInt8:
+    return fn(int8_t{});
+  case Scalar::kUint8:
+    return fn(uint8_t{});
+  case Scalar::kInt16:
+    return fn(int16_t{});
+  case Scalar::kUint16:
+    return fn(uint16_t{});
+  case Scalar::kInt32:
+    return fn(int32_t{});
+  case Scalar::kUint32:
+    return fn(uint32_t{});
+  case Scalar::kInt64:
+    return fn(int64_t{});
+  case Scalar::kUint64:
+    return fn(uint64_t{});
+  }
+  return absl::InternalError("Unknown scalar type");
+}
+
+// Adds a step, merging it with the last one if they do the same thing.
+void AddStep(std::vector<Step> &steps, const Step &step) {
+  if (step.count == 0 &&
+      (step.op == Op::kValues || step.op == Op::kBytes ||
+       step.op == Op::kStrings || step.op == Op::kMessages)) {
+    return;
+  }
+  if (!steps.empty()) {
+    Step &last = steps.back();
+    if (last.op == step.op && last.scalar == step.scalar &&
+        last.plan == step.plan &&
+        (step.op == Op::kValues || step.op == Op::kBytes ||
+         step.op == Op::kStrings || step.op == Op::kMessages)) {
+      last.count += step.count;
+      return;
+    }
+  }
+  steps.push_back(step);
+}
+
+absl::Status CompactString(const Buffer &src, Buffer &dest) {
+  if (absl::Status status = src.Check(4); !status.ok()) {
+    return status;
+  }
+  uint32_t size;
+  memcpy(&size, src.Addr(), sizeof(size));
+  if (absl::Status status = src.Check(4 + size_t(size)); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = dest.WriteUnsignedLeb128(size); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = dest.HasSpaceFor(size); !status.ok()) {
+    return status;
+  }
+  memcpy(dest.Addr(), src.Addr() + 4, size);
+  src.Addr() += 4 + size_t(size);
+  dest.Addr() += size;
+  return absl::OkStatus();
+}
+
+absl::Status ExpandString(const Buffer &src, Buffer &dest) {
+  uint32_t size = 0;
+  if (absl::Status status = src.ReadUnsignedLeb128(size); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = src.Check(size); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = dest.HasSpaceFor(4 + size_t(size)); !status.ok()) {
+    return status;
+  }
+  memcpy(dest.Addr(), &size, sizeof(size));
+  memcpy(dest.Addr() + 4, src.Addr(), size);
+  dest.Addr() += 4 + size_t(size);
+  src.Addr() += size;
+  return absl::OkStatus();
+}
+
+// Reads the length of a vector in ROS format and writes it in compact
+// format.
+absl::Status CompactLength(const Buffer &src, Buffer &dest, uint32_t &size) {
+  if (absl::Status status = src.Check(4); !status.ok()) {
+    return status;
+  }
+  memcpy(&size, src.Addr(), sizeof(size));
+  src.Addr() += 4;
+  return dest.WriteUnsignedLeb128(size);
+}
+
+absl::Status ExpandLength(const Buffer &src, Buffer &dest, uint32_t &size) {
+  if (absl::Status status = src.ReadUnsignedLeb128(size); !status.ok()) {
+    return status;
+  }
+  return Write(dest, size);
+}
+
+absl::Status CompactValues(Scalar scalar, size_t n, const Buffer &src,
+                           Buffer &dest) {
+  size_t body = n * ScalarSize(scalar);
+  if (absl::Status status = src.Check(body); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = WithScalar(scalar,
+                                       [&](auto v) {
+                                         return WriteCompactValues<decltype(v)>(
+                                             dest, src.Addr(), n);
+                                       });
+      !status.ok()) {
+    return status;
+  }
+  src.Addr() += body;
+  return absl::OkStatus();
+}
+
+absl::Status ExpandValues(Scalar scalar, size_t n, const Buffer &src,
+                          Buffer &dest) {
+  size_t body = n * ScalarSize(scalar);
+  if (absl::Status status = dest.HasSpaceFor(body); !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = WithScalar(scalar,
+                                       [&](auto v) {
+                                         return src.ReadLeb128Values<
+                                             decltype(v)>(dest.Addr(), n);
+                                       });
+      !status.ok()) {
+    return status;
+  }
+  dest.Addr() += body;
+  return absl::OkStatus();
+}
+
+// Decodes a descriptor the transcoder can compile.  The descriptor doesn't
+// say which fields use the v2 encodings, so v2 messages are rejected.
+absl::StatusOr<descriptor::Descriptor>
+DecodeTranscodable(absl::Span<const char> data) {
+  absl::StatusOr<descriptor::Descriptor> desc = DecodeDescriptor(data);
+  if (!desc.ok()) {
+    return desc.status();
+  }
+  if (absl::Status status = CheckDescriptorVersion(*desc); !status.ok()) {
+    return status;
+  }
+  if ((desc->flags & descriptor::Descriptor::FLAG_COMPACT_V2) != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Can't transcode %s/%s: it was generated with --compact_v2",
+        desc->package, desc->name));
+  }
+  return desc;
+}
+
+} // namespace
+
+// State used while compiling the plans.
+struct Transcoder::Builder {
+  Transcoder &t;
+  DescriptorResolver resolver;
+  absl::flat_hash_map<std::string, uint32_t> plans; // By message name.
+  absl::flat_hash_set<std::string> active;          // Being compiled.
+
+  absl::StatusOr<descriptor::Descriptor> Resolve(const std::string &name) {
+    absl::StatusOr<absl::Span<const char>> data = resolver(name);
+    if (!data.ok()) {
+      return absl::InternalError(absl::StrFormat(
+          "Can't find descriptor for %s: %s", name, data.status().ToString()));
+    }
+    return DecodeTranscodable(*data);
+  }
+
+  // Plan for messages in arrays and vectors.
+  absl::StatusOr<uint32_t> PlanFor(const std::string &name) {
+    if (auto it = plans.find(name); it != plans.end()) {
+      return it->second;
+    }
+    absl::StatusOr<descriptor::Descriptor> desc = Resolve(name);
+    if (!desc.ok()) {
+      return desc.status();
+    }
+    std::vector<Step> steps;
+    if (absl::Status status = AddMessage(*desc, steps); !status.ok()) {
+      return status;
+    }
+    return AddPlan(name, steps);
+  }
+
+  uint32_t AddPlan(const std::string &name, const std::vector<Step> &steps) {
+    uint32_t index = uint32_t(t.plans_.size());
+    uint32_t begin = uint32_t(t.steps_.size());
+    t.steps_.insert(t.steps_.end(), steps.begin(), steps.end());
+    t.plans_.push_back({begin, uint32_t(t.steps_.size())});
+    plans[name] = index;
+    return index;
+  }
+
+  // Adds steps for the fields of a message.
+  absl::Status AddMessage(const descriptor::Descriptor &desc,
+                          std::vector<Step> &steps) {
+    std::string name = desc.package + "/" + desc.name;
+    if (!active.insert(name).second) {
+      return absl::InternalError(
+          absl::StrFormat("Message %s contains itself", name));
+    }
+    for (auto &field : desc.fields) {
+      if (absl::Status status = AddField(field, steps); !status.ok()) {
+        return absl::InternalError(absl::StrFormat(
+            "%s.%s: %s", name, field.name, status.message()));
+      }
+    }
+    active.erase(name);
+    return absl::OkStatus();
+  }
+
+  absl::Status AddField(const descriptor::Field &field,
+                        std::vector<Step> &steps) {
+    bool fixed = field.array_size >= 0;
+    bool vector = field.array_size == descriptor::Field::FIELD_VECTOR;
+    uint32_t n = fixed ? uint32_t(field.array_size) : 1;
+    Scalar scalar;
+    uint32_t per = 1; // Values per element.
+    switch (field.type) {
+    case descriptor::Field::TYPE_INT8:
+      scalar = Scalar::kInt8;
+      break;
+    case descriptor::Field::TYPE_UINT8:
+    case descriptor::Field::TYPE_BOOL:
+      scalar = Scalar::kUint8;
+      // Enums are always sent one value at a time, even as uint8.
+      if (field.msg_name.empty()) {
+        if (fixed) {
+          AddStep(steps, {Op::kBytes, scalar, n});
+          return absl::OkStatus();
+        }
+        if (vector) {
+          AddStep(steps, {Op::kByteVector, scalar});
+          return absl::OkStatus();
+        }
+      }
+      break;
+    case descriptor::Field::TYPE_INT16:
+      scalar = Scalar::kInt16;
+      break;
+    case descriptor::Field::TYPE_UINT16:
+      scalar = Scalar::kUint16;
+      break;
+    case descriptor::Field::TYPE_INT32:
+      scalar = Scalar::kInt32;
+      break;
+    case descriptor::Field::TYPE_UINT32:
+    case descriptor::Field::TYPE_FLOAT32:
+      scalar = Scalar::kUint32;
+      break;
+    case descriptor::Field::TYPE_INT64:
+      scalar = Scalar::kInt64;
+      break;
+    case descriptor::Field::TYPE_UINT64:
+    case descriptor::Field::TYPE_FLOAT64:
+      scalar = Scalar::kUint64;
+      break;
+    case descriptor::Field::TYPE_TIME:
+    case descriptor::Field::TYPE_DURATION:
+      scalar = Scalar::kUint32;
+      per = 2;
+      break;
+    case descriptor::Field::TYPE_STRING:
+      AddStep(steps, {vector ? Op::kStringVector : Op::kStrings,
+                      Scalar::kUint8, n});
+      return absl::OkStatus();
+    case descriptor::Field::TYPE_MESSAGE:
+      return AddMessageField(field, steps);
+    default:
+      return absl::InternalError(
+          absl::StrFormat("Unknown field type %d", int(field.type)));
+    }
+    if (vector) {
+      AddStep(steps, {Op::kVector, scalar, per});
+    } else {
+      AddStep(steps, {Op::kValues, scalar, n * per});
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status AddMessageField(const descriptor::Field &field,
+                               std::vector<Step> &steps) {
+    std::string name = field.msg_package + "/" + field.msg_name;
+    if (field.array_size == descriptor::Field::FIELD_PRIMITIVE) {
+      // A single message is the same as its fields.
+      absl::StatusOr<descriptor::Descriptor> desc = Resolve(name);
+      if (!desc.ok()) {
+        return desc.status();
+      }
+      return AddMessage(*desc, steps);
+    }
+    absl::StatusOr<uint32_t> plan = PlanFor(name);
+    if (!plan.ok()) {
+      return plan.status();
+    }
+    if (field.array_size == descriptor::Field::FIELD_VECTOR) {
+      AddStep(steps, {Op::kMessageVector, Scalar::kUint8, 1, *plan});
+    } else {
+      AddStep(steps,
+              {Op::kMessages, Scalar::kUint8, uint32_t(field.array_size), *plan});
+    }
+    return absl::OkStatus();
+  }
+};
+
+absl::StatusOr<Transcoder>
+Transcoder::FromDescriptor(absl::Span<const char> descriptor,
+                           DescriptorResolver resolver) {
+  absl::StatusOr<descriptor::Descriptor> desc = DecodeTranscodable(descriptor);
+  if (!desc.ok()) {
+    return desc.status();
+  }
+  Transcoder t;
+  t.name_ = desc->package + "/" + desc->name;
+  Builder builder{t, std::move(resolver), {}, {}};
+  std::vector<Step> steps;
+  if (absl::Status status = builder.AddMessage(*desc, steps); !status.ok()) {
+    return status;
+  }
+  t.root_ = builder.AddPlan(t.name_, steps);
+  return t;
+}
+
+absl::StatusOr<Transcoder> Transcoder::Create(const std::string &name,
+                                              DescriptorResolver resolver) {
+  absl::StatusOr<absl::Span<const char>> desc = resolver(name);
+  if (!desc.ok()) {
+    return desc.status();
+  }
+  return FromDescriptor(*desc, std::move(resolver));
+}
+
+absl::Status Transcoder::Compact(const Buffer &src, Buffer &dest) const {
+  if (absl::Status status = CompactPlan(root_, src, dest); !status.ok()) {
+    return status;
+  }
+  return dest.FlushZeroes();
+}
+
+absl::Status Transcoder::Expand(const Buffer &src, Buffer &dest) const {
+  return ExpandPlan(root_, src, dest);
+}
+
+absl::Status Transcoder::CompactPlan(uint32_t plan, const Buffer &src,
+                                     Buffer &dest) const {
+  const Plan &p = plans_[plan];
+  for (uint32_t i = p.begin; i < p.end; i++) {
+    const Step &step = steps_[i];
+    absl::Status status;
+    switch (step.op) {
+    case Op::kValues:
+      status = CompactValues(step.scalar, step.count, src, dest);
+      break;
+    case Op::kBytes:
+      if (status = dest.FlushZeroes(); !status.ok()) {
+        break;
+      }
+      if (status = src.Check(step.count); !status.ok()) {
+        break;
+      }
+      if (status = dest.HasSpaceFor(step.count); !status.ok()) {
+        break;
+      }
+      memcpy(dest.Addr(), src.Addr(), step.count);
+      src.Addr() += step.count;
+      dest.Addr() += step.count;
+      break;
+    case Op::kStrings:
+      for (uint32_t j = 0; j < step.count && status.ok(); j++) {
+        status = CompactString(src, dest);
+      }
+      break;
+    case Op::kVector: {
+      uint32_t size;
+      if (status = CompactLength(src, dest, size); status.ok()) {
+        status = CompactValues(step.scalar, size_t(size) * step.count, src,
+                               dest);
+      }
+      break;
+    }
+    case Op::kByteVector: {
+      if (status = src.Check(4); !status.ok()) {
+        break;
+      }
+      uint32_t size;
+      memcpy(&size, src.Addr(), sizeof(size));
+      // As for CompactField, an empty vector doesn't flush the zeroes.
+      if (size > 0) {
+        if (status = dest.FlushZeroes(); !status.ok()) {
+          break;
+        }
+      }
+      if (status = CompactLength(src, dest, size); !status.ok()) {
+        break;
+      }
+      if (status = src.Check(size); !status.ok()) {
+        break;
+      }
+      if (status = dest.HasSpaceFor(size); !status.ok()) {
+        break;
+      }
+      memcpy(dest.Addr(), src.Addr(), size);
+      src.Addr() += size;
+      dest.Addr() += size;
+      break;
+    }
+    case Op::kStringVector: {
+      uint32_t size;
+      status = CompactLength(src, dest, size);
+      for (uint32_t j = 0; j < size && status.ok(); j++) {
+        status = CompactString(src, dest);
+      }
+      break;
+    }
+    case Op::kMessages:
+      for (uint32_t j = 0; j < step.count && status.ok(); j++) {
+        status = CompactPlan(step.plan, src, dest);
+      }
+      break;
+    case Op::kMessageVector: {
+      uint32_t size;
+      status = CompactLength(src, dest, size);
+      for (uint32_t j = 0; j < size && status.ok(); j++) {
+        status = CompactPlan(step.plan, src, dest);
+      }
+      break;
+    }
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Transcoder::ExpandPlan(uint32_t plan, const Buffer &src,
+                                    Buffer &dest) const {
+  const Plan &p = plans_[plan];
+  for (uint32_t i = p.begin; i < p.end; i++) {
+    const Step &step = steps_[i];
+    absl::Status status;
+    switch (step.op) {
+    case Op::kValues:
+      status = ExpandValues(step.scalar, step.count, src, dest);
+      break;
+    case Op::kBytes:
+      if (status = src.Check(step.count); !status.ok()) {
+        break;
+      }
+      if (status = dest.HasSpaceFor(step.count); !status.ok()) {
+        break;
+      }
+      memcpy(dest.Addr(), src.Addr(), step.count);
+      src.Addr() += step.count;
+      dest.Addr() += step.count;
+      break;
+    case Op::kStrings:
+      for (uint32_t j = 0; j < step.count && status.ok(); j++) {
+        status = ExpandString(src, dest);
+      }
+      break;
+    case Op::kVector: {
+      uint32_t size;
+      if (status = src.ReadUnsignedLeb128(size); !status.ok()) {
+        break;
+      }
+      // Each byte in the source holds at most kMaxZeroes values, so this
+      // stops a bad length from making a huge destination.
+      size_t n = size_t(size) * step.count;
+      if (status = src.Check(n / kMaxZeroes); !status.ok()) {
+        break;
+      }
+      if (status = Write(dest, size); status.ok()) {
+        status = ExpandValues(step.scalar, n, src, dest);
+      }
+      break;
+    }
+    case Op::kByteVector: {
+      uint32_t size;
+      if (status = ExpandLength(src, dest, size); !status.ok()) {
+        break;
+      }
+      if (status = src.Check(size); !status.ok()) {
+        break;
+      }
+      if (status = dest.HasSpaceFor(size); !status.ok()) {
+        break;
+      }
+      memcpy(dest.Addr(), src.Addr(), size);
+      src.Addr() += size;
+      dest.Addr() += size;
+      break;
+    }
+    case Op::kStringVector: {
+      uint32_t size;
+      status = ExpandLength(src, dest, size);
+      for (uint32_t j = 0; j < size && status.ok(); j++) {
+        status = ExpandString(src, dest);
+      }
+      break;
+    }
+    case Op::kMessages:
+      for (uint32_t j = 0; j < step.count && status.ok(); j++) {
+        status = ExpandPlan(step.plan, src, dest);
+      }
+      break;
+    case Op::kMessageVector: {
+      uint32_t size;
+      status = ExpandLength(src, dest, size);
+      for (uint32_t j = 0; j < size && status.ok(); j++) {
+        status = ExpandPlan(step.plan, src, dest);
+      }
+      break;
+    }
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+} // namespace neutron::serdes
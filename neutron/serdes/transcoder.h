@@ -0,0 +1,121 @@
+#pragma once
+
+// Conversion between ROS and compact formats driven by descriptors.
+//
+// The generated Compact and Expand functions are only there for messages a
+// program was built with.  A Transcoder does the same job for any message
+// whose descriptor it can get, such as one recorded in a log file.  The
+// descriptor, and those of the messages it refers to, are compiled once into
+// a flat list of steps.  Nested messages are flattened into their parent and
+// neighbouring fixed size fields of the same type are merged, so a run of
+// fields becomes one step converted in bulk by the kernels used for vectors
+// and arrays.  Messages in arrays and vectors have plans of their own.
+//
+//   absl::StatusOr<neutron::serdes::Transcoder> t =
+//       neutron::serdes::Transcoder::Create("test_msgs/All");
+//   ...
+//   absl::Status status = t->Compact(ros, compact);
+//
+// The result is the same as the generated functions produce.  Messages
+// generated with --compact_v2 are not supported since their descriptors
+// don't say which fields use the v2 encodings; their descriptors have
+// FLAG_COMPACT_V2 set and FromDescriptor returns an error for them, as it
+// does for descriptors older than descriptor::Descriptor::VERSION.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "neutron/serdes/runtime.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace descriptor {
+struct Descriptor;
+}
+
+namespace neutron::serdes {
+
+// Gets the descriptor of a message given its full name (package/Name).
+using DescriptorResolver = std::function<absl::StatusOr<absl::Span<const char>>(
+    const std::string &name)>;
+
+// Gets descriptors of the messages registered with the MessageMux.
+absl::StatusOr<absl::Span<const char>> MuxDescriptor(const std::string &name);
+
+class Transcoder {
+public:
+  enum class Op : uint8_t {
+    kValues,        // count integer values.
+    kBytes,         // count bytes of a uint8 or bool array.
+    kStrings,       // count strings.
+    kVector,        // Vector with count integer values per element.
+    kByteVector,    // Vector of uint8 or bool.
+    kStringVector,  // Vector of strings.
+    kMessages,      // count messages, each converted by plan.
+    kMessageVector, // Vector of messages converted by plan.
+  };
+
+  // Integer type of a value on the wire.  Floating point values are sent as
+  // their bits and Time and Duration as pairs of uint32.
+  enum class Scalar : uint8_t {
+    kInt8,
+    kUint8,
+    kInt16,
+    kUint16,
+    kInt32,
+    kUint32,
+    kInt64,
+    kUint64,
+  };
+
+  struct Step {
+    Op op;
+    Scalar scalar = Scalar::kUint8;
+    uint32_t count = 1;
+    uint32_t plan = 0; // Index into plans for messages.
+  };
+
+  // Compiles the plan for the message with the given descriptor.  The
+  // descriptors of its message fields are found by resolver, by default in
+  // the MessageMux.
+  static absl::StatusOr<Transcoder>
+  FromDescriptor(absl::Span<const char> descriptor,
+                 DescriptorResolver resolver = MuxDescriptor);
+
+  // As above, with the message's own descriptor also from resolver.
+  static absl::StatusOr<Transcoder>
+  Create(const std::string &name, DescriptorResolver resolver = MuxDescriptor);
+
+  // Full name (package/Name) of the message.
+  const std::string &Name() const { return name_; }
+
+  // Number of steps in all plans.
+  size_t NumSteps() const { return steps_.size(); }
+
+  // Converts a message in ROS format in src to compact format in dest.
+  absl::Status Compact(const Buffer &src, Buffer &dest) const;
+
+  // Converts a message in compact format in src to ROS format in dest.
+  absl::Status Expand(const Buffer &src, Buffer &dest) const;
+
+private:
+  struct Builder;
+
+  // A run of steps.
+  struct Plan {
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  absl::Status CompactPlan(uint32_t plan, const Buffer &src,
+                           Buffer &dest) const;
+  absl::Status ExpandPlan(uint32_t plan, const Buffer &src, Buffer &dest) const;
+
+  std::string name_;
+  std::vector<Step> steps_;
+  std::vector<Plan> plans_;
+  uint32_t root_ = 0;
+};
+
+} // namespace neutron::serdes
@@ -0,0 +1,269 @@
+#pragma once
+
+// Bulk helpers for compact format vectors and arrays.
+//
+// The compact format writes each integer as LEB128 and replaces runs of
+// zero bytes with kZeroMarker followed by a count.  A literal kZeroMarker
+// byte is escaped as two kZeroMarker bytes.  Since kZeroMarker has its
+// high bit set, any block of bytes that all have their high bit clear
+// contains only complete single byte values and no markers.  We use SIMD
+// to find such blocks and decode them in one go.  Multi-byte values are
+// decoded with a tight scalar loop that reads directly from memory rather
+// than going through Buffer::Get.  We stop as soon as we see a marker and
+// let the caller deal with it using the marker-aware path.
+//
+// When encoding, sparse vectors and arrays are mostly zero bytes.  Rather
+// than feeding them through the zero run one byte at a time we find the
+// length of each run of zeroes with SIMD and add it in one go.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace neutron::serdes {
+
+constexpr uint8_t kZeroMarker = 0xfa;
+// The max number of zeroes in a run is one more than than the zero marker since
+// the zero marker is followed by the number of zeroes - 2
+constexpr size_t kMaxZeroes = kZeroMarker + 1;
+
+// Returns a mask with bit i set if byte i of the block starting at p has its
+// high bit set.  Such a byte is either a continuation byte or a marker.
+#if defined(__AVX2__)
+constexpr size_t kLeb128BlockSize = 32;
+
+inline uint32_t Leb128HighBits(const char *p) {
+  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  return uint32_t(_mm256_movemask_epi8(v));
+}
+#elif defined(__SSE2__)
+constexpr size_t kLeb128BlockSize = 16;
+
+inline uint32_t Leb128HighBits(const char *p) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  return uint32_t(_mm_movemask_epi8(v));
+}
+#else
+constexpr size_t kLeb128BlockSize = 8;
+
+inline uint32_t Leb128HighBits(const char *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  uint64_t high = (w >> 7) & 0x0101010101010101ULL;
+  // Gather the low bit of each byte into the top byte.
+  return uint32_t((high * 0x0102040810204080ULL) >> 56);
+}
+#endif
+
+// Decodes n single byte values.  The caller has checked that none of them
+// have the high bit set.
+template <typename T>
+inline void DecodeLeb128Singles(const char *p, char *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    uint8_t byte = uint8_t(p[i]);
+    T v;
+    if constexpr (std::is_signed<T>::value) {
+      // Bit 6 is the sign bit for a single byte signed value.
+      v = T(int8_t(uint8_t(byte << 1)) >> 1);
+    } else {
+      v = T(byte);
+    }
+    memcpy(out + i * sizeof(T), &v, sizeof(T));
+  }
+}
+
+// Squeezes the 7 bit groups of the little endian bytes in x together.
+inline uint64_t Leb128Compress(uint64_t x) {
+#if defined(__BMI2__)
+  return _pext_u64(x, 0x7f7f7f7f7f7f7f7fULL);
+#else
+  return (x & 0x7f) | ((x >> 1) & (0x7fULL << 7)) |
+         ((x >> 2) & (0x7fULL << 14)) | ((x >> 3) & (0x7fULL << 21)) |
+         ((x >> 4) & (0x7fULL << 28)) | ((x >> 5) & (0x7fULL << 35)) |
+         ((x >> 6) & (0x7fULL << 42)) | ((x >> 7) & (0x7fULL << 49));
+#endif
+}
+
+// Decodes a single value at p.  Returns false, leaving p unchanged, if the
+// value runs past end or contains a marker byte.
+template <typename T>
+inline bool DecodeOneLeb128(const char *&p, const char *end, char *out) {
+  const char *q = p;
+  uint64_t v = 0;
+  int shift = 0;
+  uint8_t byte;
+  uint64_t w = 0;
+  uint64_t stops = 0;
+  if (size_t(end - p) >= sizeof(uint64_t)) {
+    memcpy(&w, p, sizeof(w));
+    stops = ~w & 0x8080808080808080ULL;
+  }
+  if (stops != 0) {
+    // Branch-free decode of a value of up to 8 bytes.  The terminating byte
+    // is the first one with its high bit clear.  The value is all the bits
+    // up to and including the terminating byte's high bit.
+    uint64_t value_bits = stops ^ (stops - 1);
+    uint64_t x = w & value_bits;
+    // Look for a marker byte in the value (SWAR zero byte test).
+    uint64_t t = x ^ 0xfafafafafafafafaULL;
+    if (((t - 0x0101010101010101ULL) & ~t & value_bits &
+         0x8080808080808080ULL) != 0) {
+      return false;
+    }
+    int len = (__builtin_ctzll(stops) >> 3) + 1;
+    v = Leb128Compress(x);
+    shift = 7 * len;
+    byte = uint8_t(x >> (8 * (len - 1)));
+    q += len;
+  } else {
+    do {
+      if (q == end) {
+        return false;
+      }
+      byte = uint8_t(*q++);
+      if (byte == kZeroMarker || shift >= 64) {
+        return false;
+      }
+      v |= uint64_t(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+  }
+  if constexpr (std::is_signed<T>::value) {
+    if ((byte & 0x40) != 0 && shift < 64) {
+      v |= ~uint64_t(0) << shift;
+    }
+  }
+  T x = T(v);
+  memcpy(out, &x, sizeof(T));
+  p = q;
+  return true;
+}
+
+// Decodes up to n values of type T from [p, end) into out, which need not
+// be aligned.  Returns the number of values decoded and leaves p at the start
+// of the first value not decoded.  Decoding stops before a value that
+// involves a zero-run marker or is truncated by end.
+template <typename T>
+inline size_t DecodeLeb128Run(const char *&p, const char *end, char *out,
+                              size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    if (n - i >= kLeb128BlockSize && size_t(end - p) >= kLeb128BlockSize) {
+      const char *block_end = p + kLeb128BlockSize;
+      uint32_t mask = Leb128HighBits(p);
+      size_t singles = mask == 0 ? kLeb128BlockSize : __builtin_ctz(mask);
+      DecodeLeb128Singles<T>(p, out + i * sizeof(T), singles);
+      p += singles;
+      i += singles;
+      if (mask == 0) {
+        continue;
+      }
+      // The block has multi-byte values.  Decode values one at a time until
+      // we are past the block before looking at the next one.
+      while (p < block_end && i < n) {
+        if (!DecodeOneLeb128<T>(p, end, out + i * sizeof(T))) {
+          return i;
+        }
+        i++;
+      }
+      continue;
+    }
+    if (!DecodeOneLeb128<T>(p, end, out + i * sizeof(T))) {
+      break;
+    }
+    i++;
+  }
+  return i;
+}
+
+// Returns the number of zero bytes at the start of [p, p + n).
+inline size_t CountZeroBytes(const char *p, size_t n) {
+  if (n == 0 || p[0] != 0) {
+    return 0;
+  }
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  for (; n - i >= 32; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+    uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+    if (mask != 0xffffffffU) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; n - i >= 16; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+    if (mask != 0xffff) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+#endif
+  for (; n - i >= 8; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    if (w != 0) {
+      // Little endian, so the lowest set bit is in the first nonzero byte.
+      return i + (__builtin_ctzll(w) >> 3);
+    }
+  }
+  while (i < n && p[i] == 0) {
+    i++;
+  }
+  return i;
+}
+
+// Result of decoding raw values from data that may stop part way through
+// them, as it does when a message arrives in chunks.
+enum class DecodeResult {
+  kOk,
+  kTruncated, // The data stops before the end of the values.
+  kMalformed,
+};
+
+// Plain LEB128 with no zero run markers, for formats that are raw bytes.
+inline size_t PackLeb128Size(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+inline char *PackLeb128(char *out, uint64_t v) {
+  while (v >= 0x80) {
+    *out++ = char(uint8_t(v) | 0x80);
+    v >>= 7;
+  }
+  *out++ = char(v);
+  return out;
+}
+
+// A value of more than 10 bytes is malformed.
+inline DecodeResult UnpackLeb128(const char *&p, const char *end,
+                                 uint64_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p == end) {
+      return DecodeResult::kTruncated;
+    }
+    uint8_t byte = uint8_t(*p++);
+    v |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return DecodeResult::kOk;
+    }
+  }
+  return DecodeResult::kMalformed;
+}
+
+} // namespace neutron::serdes
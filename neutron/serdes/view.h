@@ -0,0 +1,221 @@
+#pragma once
+
+// Runtime support for the generated zero-copy views over ROS serialized
+// messages.
+//
+// A view refers to the serialized bytes and doesn't own them.  The bytes
+// must outlive the view and anything obtained from it.  Strings are
+// returned as std::string_view and vectors and arrays of fixed size types as
+// absl::Span.  Since ROS serialization doesn't align anything, the elements
+// of a span may not be aligned for their type.  This is fine on the
+// platforms we support (x86_64 and aarch64) where unaligned loads are
+// allowed.
+
+#include "absl/types/span.h"
+#include "neutron/common_runtime.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+
+namespace neutron::serdes {
+
+// Tags used to say what type of field to skip.
+template <typename T> struct VectorTag {};
+template <typename T, size_t N> struct ArrayTag {};
+
+inline bool SkipBytes(const char *&p, const char *end, size_t n) {
+  if (size_t(end - p) < n) {
+    return false;
+  }
+  p += n;
+  return true;
+}
+
+inline bool ReadViewCount(const char *&p, const char *end, uint32_t &n) {
+  if (size_t(end - p) < sizeof(n)) {
+    return false;
+  }
+  memcpy(&n, p, sizeof(n));
+  p += sizeof(n);
+  return true;
+}
+
+// Fixed size values, including enums, Time and Duration.
+template <typename T>
+inline bool SkipField(const char *&p, const char *end, const T &) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SkipField needs a fixed size type");
+  return SkipBytes(p, end, sizeof(T));
+}
+
+inline bool SkipField(const char *&p, const char *end,
+                      const std::string_view &) {
+  uint32_t n;
+  return ReadViewCount(p, end, n) && SkipBytes(p, end, n);
+}
+
+template <typename T>
+inline bool SkipField(const char *&p, const char *end, const VectorTag<T> &) {
+  uint32_t n;
+  if (!ReadViewCount(p, end, n)) {
+    return false;
+  }
+  if constexpr (std::is_same<T, std::string_view>::value) {
+    for (uint32_t i = 0; i < n; i++) {
+      if (!SkipField(p, end, std::string_view())) {
+        return false;
+      }
+    }
+    return true;
+  } else {
+    return SkipBytes(p, end, size_t(n) * sizeof(T));
+  }
+}
+
+template <typename T, size_t N>
+inline bool SkipField(const char *&p, const char *end, const ArrayTag<T, N> &) {
+  if constexpr (std::is_same<T, std::string_view>::value) {
+    for (size_t i = 0; i < N; i++) {
+      if (!SkipField(p, end, std::string_view())) {
+        return false;
+      }
+    }
+    return true;
+  } else {
+    return SkipBytes(p, end, N * sizeof(T));
+  }
+}
+
+// These read fields that have already been checked by SkipField.
+template <typename T> inline T ReadViewValue(const char *p) {
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+inline std::string_view ReadViewString(const char *p) {
+  uint32_t n;
+  memcpy(&n, p, sizeof(n));
+  return std::string_view(p + sizeof(n), n);
+}
+
+template <typename T> inline absl::Span<const T> ReadViewSpan(const char *p) {
+  uint32_t n;
+  memcpy(&n, p, sizeof(n));
+  return absl::Span<const T>(reinterpret_cast<const T *>(p + sizeof(n)), n);
+}
+
+template <typename T, size_t N>
+inline absl::Span<const T> ReadViewArray(const char *p) {
+  return absl::Span<const T>(reinterpret_cast<const T *>(p), N);
+}
+
+// A vector or array of strings.  Elements are found by walking from the
+// start so indexing is linear in the index.  Iterate if you want them all.
+class StringVectorView {
+public:
+  class Iterator {
+  public:
+    Iterator(const char *p, uint32_t index) : p_(p), index_(index) {}
+    std::string_view operator*() const { return ReadViewString(p_); }
+    Iterator &operator++() {
+      p_ += sizeof(uint32_t) + ReadViewString(p_).size();
+      index_++;
+      return *this;
+    }
+    bool operator==(const Iterator &it) const { return index_ == it.index_; }
+    bool operator!=(const Iterator &it) const { return index_ != it.index_; }
+
+  private:
+    const char *p_;
+    uint32_t index_;
+  };
+
+  StringVectorView() = default;
+  // p is the first string.
+  StringVectorView(const char *p, uint32_t size) : p_(p), size_(size) {}
+
+  // p is the vector's length.
+  static StringVectorView FromVector(const char *p) {
+    return StringVectorView(p + sizeof(uint32_t), ReadViewValue<uint32_t>(p));
+  }
+
+  uint32_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view operator[](size_t i) const {
+    Iterator it = begin();
+    for (size_t j = 0; j < i; j++) {
+      ++it;
+    }
+    return *it;
+  }
+  Iterator begin() const { return Iterator(p_, 0); }
+  Iterator end() const { return Iterator(nullptr, size_); }
+
+private:
+  const char *p_ = nullptr;
+  uint32_t size_ = 0;
+};
+
+// A vector or array of messages, seen through their generated View class.
+// Like StringVectorView, indexing is linear.  Each element's view is set up
+// when it is accessed.
+template <typename View> class MessageVectorView {
+public:
+  class Iterator {
+  public:
+    Iterator(const char *p, const char *end, uint32_t index)
+        : p_(p), end_(end), index_(index) {}
+    View operator*() const {
+      View v;
+      const char *p = p_;
+      v.Index(p, end_);
+      return v;
+    }
+    Iterator &operator++() {
+      View v;
+      v.Index(p_, end_);
+      index_++;
+      return *this;
+    }
+    bool operator==(const Iterator &it) const { return index_ == it.index_; }
+    bool operator!=(const Iterator &it) const { return index_ != it.index_; }
+
+  private:
+    const char *p_;
+    const char *end_;
+    uint32_t index_;
+  };
+
+  MessageVectorView() = default;
+  // p is the first message and end is the end of the field.
+  MessageVectorView(const char *p, const char *end, uint32_t size)
+      : p_(p), end_(end), size_(size) {}
+
+  // p is the vector's length.
+  static MessageVectorView FromVector(const char *p, const char *end) {
+    return MessageVectorView(p + sizeof(uint32_t), end,
+                             ReadViewValue<uint32_t>(p));
+  }
+
+  uint32_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  View operator[](size_t i) const {
+    Iterator it = begin();
+    for (size_t j = 0; j < i; j++) {
+      ++it;
+    }
+    return *it;
+  }
+  Iterator begin() const { return Iterator(p_, end_, 0); }
+  Iterator end() const { return Iterator(nullptr, nullptr, size_); }
+
+private:
+  const char *p_ = nullptr;
+  const char *end_ = nullptr;
+  uint32_t size_ = 0;
+};
+
+} // namespace neutron::serdes
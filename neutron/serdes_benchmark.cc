@@ -0,0 +1,179 @@
+// Benchmarks for the serdes messages in ROS and compact formats.
+//
+// bazel run -c opt //neutron:serdes_benchmark
+//
+// Each benchmark is run for the messages in testdata/test_msgs.  The
+// argument is the number of elements in each vector, so All with large
+// arguments is the large array case.  The allocs counter is the number of
+// heap allocations per iteration.
+
+#include "neutron/alloc_counter.h"
+#include "neutron/serdes/runtime.h"
+#include "neutron/serdes/test_msgs/All.h"
+#include "neutron/serdes/test_msgs/Fixed.h"
+#include "neutron/serdes/test_msgs/Nested.h"
+#include "neutron/serdes/test_msgs/Vector.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+template <typename T> std::vector<T> Values(size_t n) {
+  std::vector<T> v(n);
+  for (size_t i = 0; i < n; i++) {
+    v[i] = T(i * 7 + 1);
+  }
+  return v;
+}
+
+// A message of each type with n elements in each vector.
+template <typename Msg> Msg Make(size_t n);
+
+template <> test_msgs::serdes::Nested Make(size_t n) {
+  test_msgs::serdes::Nested nested;
+  nested.foo = 1234;
+  nested.bar = "nested";
+  return nested;
+}
+
+template <> test_msgs::serdes::Fixed Make(size_t n) {
+  test_msgs::serdes::Fixed fixed;
+  fixed.foo = 1234;
+  fixed.sub.seq = 42;
+  for (size_t i = 0; i < fixed.afloat.size(); i++) {
+    fixed.afloat[i] = 1.5f * i;
+  }
+  for (size_t i = 0; i < fixed.adouble.size(); i++) {
+    fixed.adouble[i] = 2.5 * i;
+  }
+  fixed.t = {45, 67};
+  return fixed;
+}
+
+template <> test_msgs::Vector Make(size_t n) {
+  test_msgs::Vector vector;
+  vector.header.seq = 1;
+  vector.header.frame_id = "map";
+  vector.x = 1;
+  vector.y = 2;
+  vector.z = 3;
+  return vector;
+}
+
+template <> test_msgs::serdes::All Make(size_t n) {
+  test_msgs::serdes::All all;
+  all.i32 = 5;
+  all.ui64 = 8;
+  all.f64 = 10;
+  all.s = "dave";
+  all.n.foo = 1234;
+  all.n.bar = "baz";
+  all.vi8 = Values<int8_t>(n);
+  all.vui8 = Values<uint8_t>(n);
+  all.vi16 = Values<int16_t>(n);
+  all.vui32 = Values<uint32_t>(n);
+  all.vi64 = Values<int64_t>(n);
+  all.vf32 = Values<float>(n);
+  all.vf64 = Values<double>(n);
+  all.vt.resize(n, {45, 67});
+  all.vs.resize(n / 16, "a string");
+  all.vn.resize(n / 16, Make<test_msgs::serdes::Nested>(0));
+  return all;
+}
+
+template <typename Msg, bool kCompact>
+void BM_Serialize(benchmark::State &state) {
+  Msg msg = Make<Msg>(state.range(0));
+  neutron::serdes::Buffer buffer;
+  benchmark::DoNotOptimize(msg.SerializeToBuffer(buffer, kCompact));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    buffer.Rewind();
+    benchmark::DoNotOptimize(msg.SerializeToBuffer(buffer, kCompact));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+template <typename Msg, bool kCompact>
+void BM_Deserialize(benchmark::State &state) {
+  Msg msg = Make<Msg>(state.range(0));
+  neutron::serdes::Buffer buffer;
+  benchmark::DoNotOptimize(msg.SerializeToBuffer(buffer, kCompact));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    Msg msg2;
+    benchmark::DoNotOptimize(
+        msg2.DeserializeFromArray(buffer.data(), buffer.size(), kCompact));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+template <typename Msg> void BM_Compact(benchmark::State &state) {
+  Msg msg = Make<Msg>(state.range(0));
+  neutron::serdes::Buffer src;
+  benchmark::DoNotOptimize(msg.SerializeToBuffer(src));
+  neutron::serdes::Buffer dest;
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    src.Rewind();
+    dest.Rewind();
+    benchmark::DoNotOptimize(Msg::Compact(src, dest));
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+
+template <typename Msg> void BM_Expand(benchmark::State &state) {
+  Msg msg = Make<Msg>(state.range(0));
+  neutron::serdes::Buffer src;
+  benchmark::DoNotOptimize(msg.SerializeToBuffer(src, true));
+  neutron::serdes::Buffer dest;
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    src.Rewind();
+    dest.Rewind();
+    benchmark::DoNotOptimize(Msg::Expand(src, dest));
+  }
+  state.SetBytesProcessed(state.iterations() * src.size());
+}
+
+template <typename Msg, bool kCompact>
+void BM_SerializedSize(benchmark::State &state) {
+  Msg msg = Make<Msg>(state.range(0));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    if constexpr (kCompact) {
+      benchmark::DoNotOptimize(msg.CompactSerializedSize());
+    } else {
+      benchmark::DoNotOptimize(msg.SerializedSize());
+    }
+  }
+  size_t size = kCompact ? msg.CompactSerializedSize() : msg.SerializedSize();
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+// Messages without vectors only need one size.
+#define SMALL_BENCHMARKS(Msg)                                                  \
+  BENCHMARK_TEMPLATE(BM_Serialize, Msg, false)->Arg(0);                        \
+  BENCHMARK_TEMPLATE(BM_Serialize, Msg, true)->Arg(0);                         \
+  BENCHMARK_TEMPLATE(BM_Deserialize, Msg, false)->Arg(0);                      \
+  BENCHMARK_TEMPLATE(BM_Deserialize, Msg, true)->Arg(0);                       \
+  BENCHMARK_TEMPLATE(BM_Compact, Msg)->Arg(0);                                 \
+  BENCHMARK_TEMPLATE(BM_Expand, Msg)->Arg(0);                                  \
+  BENCHMARK_TEMPLATE(BM_SerializedSize, Msg, false)->Arg(0);                   \
+  BENCHMARK_TEMPLATE(BM_SerializedSize, Msg, true)->Arg(0)
+
+SMALL_BENCHMARKS(test_msgs::serdes::Nested);
+SMALL_BENCHMARKS(test_msgs::serdes::Fixed);
+SMALL_BENCHMARKS(test_msgs::Vector);
+
+#define ALL_RANGE RangeMultiplier(16)->Range(16, 1 << 16)
+
+BENCHMARK_TEMPLATE(BM_Serialize, test_msgs::serdes::All, false)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_Serialize, test_msgs::serdes::All, true)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_Deserialize, test_msgs::serdes::All, false)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_Deserialize, test_msgs::serdes::All, true)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_Compact, test_msgs::serdes::All)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_Expand, test_msgs::serdes::All)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_SerializedSize, test_msgs::serdes::All, false)->ALL_RANGE;
+BENCHMARK_TEMPLATE(BM_SerializedSize, test_msgs::serdes::All, true)->ALL_RANGE;
+
+} // namespace
@@ -0,0 +1,124 @@
+// Benchmarks for writing mostly zero messages in the compact format and for
+// LZ compression of serialized messages.
+//
+// bazel run -c opt //neutron:serdes_compact_benchmark
+
+#include "neutron/serdes/lz.h"
+#include "neutron/serdes/runtime.h"
+#include "neutron/serdes/test_msgs/All.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// A vector of n values with one nonzero value every 'stride' elements.
+template <typename T> std::vector<T> Sparse(size_t n, size_t stride) {
+  std::vector<T> v(n);
+  for (size_t i = 0; i < n; i += stride) {
+    v[i] = T(i + 1);
+  }
+  return v;
+}
+
+test_msgs::serdes::All SparseAll(size_t n) {
+  test_msgs::serdes::All all;
+  all.vi32 = Sparse<int32_t>(n, 100);
+  all.vui64 = Sparse<uint64_t>(n, 100);
+  all.vf32 = Sparse<float>(n, 100);
+  all.vf64 = Sparse<double>(n, 100);
+  all.vt.resize(n);
+  return all;
+}
+
+// Writes the vector one element at a time.  This is how all vectors used to
+// be written and is the baseline for BM_WriteCompactBulk.
+void BM_WriteCompactElements(benchmark::State &state) {
+  std::vector<double> v = Sparse<double>(state.range(0), 100);
+  neutron::serdes::Buffer buffer(v.size() * sizeof(double) + 16);
+  for (auto _ : state) {
+    buffer.Rewind();
+    benchmark::DoNotOptimize(buffer.WriteUnsignedLeb128(v.size()));
+    for (double d : v) {
+      benchmark::DoNotOptimize(neutron::serdes::WriteCompact(buffer, d));
+    }
+    benchmark::DoNotOptimize(buffer.FlushZeroes());
+  }
+  state.SetBytesProcessed(state.iterations() * v.size() * sizeof(double));
+}
+BENCHMARK(BM_WriteCompactElements)->Range(1 << 10, 1 << 20);
+
+void BM_WriteCompactBulk(benchmark::State &state) {
+  std::vector<double> v = Sparse<double>(state.range(0), 100);
+  neutron::serdes::Buffer buffer(v.size() * sizeof(double) + 16);
+  for (auto _ : state) {
+    buffer.Rewind();
+    benchmark::DoNotOptimize(neutron::serdes::WriteCompact(buffer, v));
+    benchmark::DoNotOptimize(buffer.FlushZeroes());
+  }
+  state.SetBytesProcessed(state.iterations() * v.size() * sizeof(double));
+}
+BENCHMARK(BM_WriteCompactBulk)->Range(1 << 10, 1 << 20);
+
+void BM_CompactSerializeSparseAll(benchmark::State &state) {
+  test_msgs::serdes::All all = SparseAll(state.range(0));
+  neutron::serdes::Buffer buffer;
+  for (auto _ : state) {
+    buffer.Rewind();
+    benchmark::DoNotOptimize(all.SerializeToBuffer(buffer, true));
+  }
+  state.SetBytesProcessed(state.iterations() * all.SerializedSize());
+}
+BENCHMARK(BM_CompactSerializeSparseAll)->Range(1 << 10, 1 << 18);
+
+void BM_CompactSerializedSizeSparseAll(benchmark::State &state) {
+  test_msgs::serdes::All all = SparseAll(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(all.CompactSerializedSize());
+  }
+  state.SetBytesProcessed(state.iterations() * all.SerializedSize());
+}
+BENCHMARK(BM_CompactSerializedSizeSparseAll)->Range(1 << 10, 1 << 18);
+
+// A serialized message with sparse vectors and repeated strings, much like
+// those sent on a stream.
+std::string LzInput(size_t n) {
+  test_msgs::serdes::All all = SparseAll(n / 32);
+  for (size_t i = 0; i < n / 64; i++) {
+    all.vs.push_back("frame_" + std::to_string(i % 7) + "/link_" +
+                     std::to_string(i % 13));
+  }
+  neutron::serdes::Buffer buffer;
+  (void)all.SerializeToBuffer(buffer);
+  return buffer.AsString();
+}
+
+// Without a Reset the same message would match the copy before it in full.
+void BM_LzCompress(benchmark::State &state) {
+  std::string in = LzInput(state.range(0));
+  neutron::serdes::LzContext lz;
+  neutron::serdes::Buffer frame;
+  for (auto _ : state) {
+    lz.Reset();
+    frame.Rewind();
+    benchmark::DoNotOptimize(lz.Compress(in.data(), in.size(), frame));
+  }
+  state.SetBytesProcessed(state.iterations() * in.size());
+  state.counters["ratio"] = double(in.size()) / frame.Size();
+}
+BENCHMARK(BM_LzCompress)->Range(1 << 10, 1 << 20);
+
+// Each frame starts a new stream so the same one can be decoded repeatedly.
+void BM_LzDecompress(benchmark::State &state) {
+  std::string in = LzInput(state.range(0));
+  neutron::serdes::LzContext enc;
+  neutron::serdes::Buffer frame;
+  (void)enc.Compress(in.data(), in.size(), frame);
+  neutron::serdes::LzContext lz;
+  for (auto _ : state) {
+    frame.Rewind();
+    benchmark::DoNotOptimize(lz.Decompress(frame));
+  }
+  state.SetBytesProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_LzDecompress)->Range(1 << 10, 1 << 20);
+
+} // namespace
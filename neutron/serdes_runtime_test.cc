@@ -1,7 +1,15 @@
 #include "neutron/descriptor.h"
+#include "neutron/serdes/buffer_pool.h"
+#include "neutron/serdes/dynamic.h"
+#include "neutron/serdes/lz.h"
 #include "neutron/serdes/other_msgs/Other.h"
 #include "neutron/serdes/runtime.h"
 #include "neutron/serdes/test_msgs/All.h"
+#include "neutron/serdes/test_msgs/Arena.h"
+#include "neutron/serdes/test_msgs/FloatSeries.h"
+#include "neutron/serdes/test_msgs/IntSeries.h"
+#include "neutron/serdes/transcoder.h"
+#include <cmath>
 #include "toolbelt/hexdump.h"
 #include <gtest/gtest.h>
 
@@ -62,6 +70,65 @@ TEST(Runtime, DynamicBuffer) {
   ASSERT_EQ(other, read);
 }
 
+TEST(Runtime, BufferPool) {
+  other_msgs::Other other;
+  other.header.frame_id = "frame1";
+  other.bar = std::string(3000, 'x');
+
+  neutron::serdes::BufferPool pool(16);
+  size_t capacity;
+  {
+    auto buffer = pool.Get();
+    ASSERT_TRUE(other.SerializeToBuffer(*buffer).ok());
+    capacity = buffer->Capacity();
+    ASSERT_LE(other.SerializedSize(), capacity);
+  }
+  ASSERT_EQ(1, pool.NumFree());
+  {
+    // The same buffer comes back, rewound and as big as it got.
+    auto buffer = pool.Get();
+    ASSERT_EQ(0, pool.NumFree());
+    ASSERT_EQ(0, buffer->size());
+    ASSERT_EQ(capacity, buffer->Capacity());
+
+    ASSERT_TRUE(other.SerializeToBuffer(*buffer).ok());
+    ASSERT_EQ(capacity, buffer->Capacity());
+
+    // Release hands over the data without a copy and the buffer starts again.
+    const char *addr = buffer->data();
+    neutron::serdes::BufferData data = buffer->Release();
+    ASSERT_EQ(addr, data.data());
+    ASSERT_EQ(other.SerializedSize(), data.size());
+    ASSERT_EQ(0, buffer->Capacity());
+    other_msgs::Other read;
+    ASSERT_TRUE(read.DeserializeFromArray(data.data(), data.size()).ok());
+    ASSERT_EQ(other, read);
+
+    ASSERT_TRUE(other.SerializeToBuffer(*buffer).ok());
+    ASSERT_EQ(other.SerializedSize(), buffer->size());
+  }
+}
+
+TEST(Runtime, BufferArena) {
+  other_msgs::Other other;
+  other.header.frame_id = "frame1";
+  other.bar = std::string(1000, 'x');
+
+  neutron::serdes::BufferArena arena(4096);
+  neutron::serdes::Buffer buffer(16, &arena);
+  ASSERT_TRUE(other.SerializeToBuffer(buffer).ok());
+  other_msgs::Other read;
+  ASSERT_TRUE(read.DeserializeFromArray(buffer.data(), buffer.size()).ok());
+  ASSERT_EQ(other, read);
+
+  // Bigger than a block.
+  neutron::serdes::Buffer big(16, &arena);
+  other.bar = std::string(10000, 'y');
+  ASSERT_TRUE(other.SerializeToBuffer(big).ok());
+  ASSERT_TRUE(read.DeserializeFromArray(big.data(), big.size()).ok());
+  ASSERT_EQ(other, read);
+}
+
 TEST(Runtime, Compact) {
   other_msgs::Other other;
   other.header.seq = 255;
@@ -339,6 +406,10 @@ TEST(Runtime, AllSerializeStandard) {
   ASSERT_TRUE(status.ok());
   // std::cout << all.DebugString();
   CheckAll(all2);
+  // Reading into the same message again replaces the vectors.
+  status = all2.DeserializeFromArray(dest.data(), length);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all2);
 }
 
 TEST(Runtime, AllSerializeCompact) {
@@ -366,6 +437,9 @@ TEST(Runtime, AllSerializeCompact) {
   ASSERT_TRUE(status.ok());
   // std::cout << all.DebugString();
   CheckAll(all2);
+  status = all2.DeserializeFromArray(dest.data(), length, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all2);
 }
 
 TEST(Runtime, AllCompact) {
@@ -448,6 +522,759 @@ TEST(Runtime, AllExpand) {
   CheckAll(all2);
 }
 
+TEST(Runtime, LargeVectors) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+
+  // Big enough to need several buffer expansions in one go.
+  for (int i = 0; i < 100000; i++) {
+    all.vf32.push_back(float(i) * 0.5f);
+    all.vf64.push_back(double(i) * 0.25);
+    all.vi32.push_back(-i);
+  }
+  all.vt.resize(1000, {1, 2});
+  all.ve16.resize(1000, test_msgs::serdes::Enum16::X3);
+
+  neutron::serdes::Buffer dest;
+  auto status = all.SerializeToBuffer(dest);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all.SerializedSize(), dest.size());
+
+  test_msgs::serdes::All all2;
+  status = all2.DeserializeFromArray(dest.data(), dest.size());
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all2);
+
+  // Truncated body must fail rather than read off the end.
+  test_msgs::serdes::All all3;
+  status = all3.DeserializeFromArray(dest.data(), dest.size() - 8);
+  ASSERT_FALSE(status.ok());
+}
+
+TEST(Runtime, Presized) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  for (int i = 0; i < 1000; i++) {
+    all.vf64.push_back(double(i));
+    all.vui8.push_back(uint8_t(i));
+  }
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer checked;
+    auto status = all.SerializeToBuffer(checked, compact);
+    ASSERT_TRUE(status.ok());
+
+    neutron::serdes::Buffer presized;
+    status = all.PresizedSerializeToBuffer(presized, compact);
+    ASSERT_TRUE(status.ok());
+    ASSERT_EQ(checked.size(), presized.size());
+    ASSERT_EQ(0, memcmp(checked.data(), presized.data(), checked.size()));
+
+    test_msgs::serdes::All all2;
+    status = all2.DeserializeFromArray(presized.data(), presized.size(),
+                                       compact);
+    ASSERT_TRUE(status.ok());
+    ASSERT_EQ(all, all2);
+  }
+
+  // A fixed buffer that is too small fails up front.
+  char small[64];
+  neutron::serdes::Buffer fixed(small, sizeof(small));
+  ASSERT_FALSE(all.PresizedSerializeToBuffer(fixed).ok());
+}
+
+TEST(Runtime, CompactIntegerVectors) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+
+  // Mix of single byte values, multi-byte values, long zero runs, values
+  // that encode to a kZeroMarker byte and large negative 64 bit values.
+  for (int i = 0; i < 5000; i++) {
+    int64_t v = (i % 7 == 0) ? 0 : (i % 5 == 0) ? 0x7a + 0x80 * i : i % 60;
+    if (i > 1000 && i < 2000) {
+      v = 0;
+    }
+    all.vi16.push_back(int16_t(i % 3 == 0 ? -v : v));
+    all.vui16.push_back(uint16_t(v));
+    all.vi32.push_back(int32_t(i % 2 == 0 ? -v : v));
+    all.vui32.push_back(uint32_t(v));
+    all.vi64.push_back(i % 11 == 0 ? -(int64_t(1) << 40) - v : -v);
+    all.vui64.push_back(uint64_t(v) << (i % 50));
+  }
+  all.ai64[3] = -(int64_t(1) << 50);
+
+  neutron::serdes::Buffer compact;
+  auto status = all.SerializeToBuffer(compact, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all.CompactSerializedSize(), compact.size());
+
+  test_msgs::serdes::All all2;
+  status = all2.DeserializeFromArray(compact.data(), compact.size(), true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all2);
+
+  // Expand to the standard format and read that back.
+  compact.Rewind();
+  neutron::serdes::Buffer expanded;
+  status = test_msgs::serdes::All::Expand(compact, expanded);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all.SerializedSize(), expanded.size());
+
+  test_msgs::serdes::All all3;
+  status = all3.DeserializeFromArray(expanded.data(), expanded.size());
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all3);
+}
+
+TEST(Runtime, SparseVectors) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+
+  // Mostly zero vectors with runs longer than kMaxZeroes, isolated nonzero
+  // values and values that contain zero bytes.
+  for (int i = 0; i < 3000; i++) {
+    bool set = i % 600 == 7 || i == 2999;
+    all.vi16.push_back(set ? -i : 0);
+    all.vui32.push_back(set ? 0x100 : 0);
+    all.vi64.push_back(set ? int64_t(1) << 40 : 0);
+    all.vf32.push_back(set ? 1.5f : 0.0f);
+    all.vf64.push_back(set ? -2.25 : 0.0);
+    all.vt.push_back(set ? neutron::Time{uint32_t(i), 0} : neutron::Time{});
+  }
+  all.af64 = {};
+  all.af64[5] = 3.0;
+
+  neutron::serdes::Buffer compact;
+  auto status = all.SerializeToBuffer(compact, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all.CompactSerializedSize(), compact.size());
+
+  test_msgs::serdes::All all2;
+  status = all2.DeserializeFromArray(compact.data(), compact.size(), true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(all, all2);
+
+  // The bulk zero scan must produce the same bytes as writing one element
+  // at a time.
+  neutron::serdes::Buffer bulk;
+  ASSERT_TRUE(neutron::serdes::WriteCompact(bulk, all.vf64).ok());
+  ASSERT_TRUE(bulk.FlushZeroes().ok());
+  neutron::serdes::Buffer single;
+  ASSERT_TRUE(single.WriteUnsignedLeb128(all.vf64.size()).ok());
+  for (double v : all.vf64) {
+    ASSERT_TRUE(neutron::serdes::WriteCompact(single, v).ok());
+  }
+  ASSERT_TRUE(single.FlushZeroes().ok());
+  ASSERT_EQ(bulk.size(), single.size());
+  ASSERT_EQ(0, memcmp(bulk.data(), single.data(), bulk.size()));
+
+  // Compact from the standard format and expand back.
+  neutron::serdes::Buffer expanded;
+  status = all.SerializeToBuffer(expanded);
+  ASSERT_TRUE(status.ok());
+  expanded.Rewind();
+  neutron::serdes::Buffer compacted;
+  status = test_msgs::serdes::All::Compact(expanded, compacted);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(compact.size(), compacted.size());
+  ASSERT_EQ(0, memcmp(compact.data(), compacted.data(), compact.size()));
+}
+
+TEST(Runtime, CompactVectorCounts) {
+  // Zero runs decode to many more values than there are input bytes, so the
+  // vector is filled in several steps.
+  std::vector<int64_t> zeros(100000);
+  zeros.back() = 5;
+  neutron::serdes::Buffer compact;
+  ASSERT_TRUE(neutron::serdes::WriteCompact(compact, zeros).ok());
+  ASSERT_TRUE(compact.FlushZeroes().ok());
+  ASSERT_LT(compact.size(), 1000);
+  compact.Rewind();
+  std::vector<int64_t> zeros2;
+  ASSERT_TRUE(neutron::serdes::ReadCompact(compact, zeros2).ok());
+  ASSERT_EQ(zeros, zeros2);
+
+  // A count of a million with only a few thousand values behind it fails
+  // once the input runs out.
+  std::string bad = "\xc0\x84\x3d" + std::string(4000, '\x01');
+  neutron::serdes::Buffer buffer(bad.data(), bad.size());
+  std::vector<int64_t> vec;
+  auto status = neutron::serdes::ReadCompact(buffer, vec);
+  ASSERT_FALSE(status.ok());
+  ASSERT_TRUE(neutron::serdes::IsTruncated(status));
+  ASSERT_LT(vec.size(), 10000);
+}
+
+TEST(Runtime, CompactV2Floats) {
+  // FloatSeries is generated with compact v2 so its float vectors and
+  // arrays are XOR encoded.
+  test_msgs::FloatSeries series;
+  series.seq = 1234;
+  for (int i = 0; i < 1000; i++) {
+    series.ranges.push_back(10.0f + 0.25f * float(i / 10));
+    series.positions.push_back(100.0 + 0.125 * (i / 4));
+  }
+  for (int i = 0; i < 100; i++) {
+    series.intensities.push_back(std::sin(i * 0.01f));
+  }
+  series.ranges[500] = -0.0f;
+  series.ranges[501] = std::nanf("");
+  series.covariance = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  series.orientation = {0, 0, 0.7071067811865476, 0.7071067811865476};
+
+  neutron::serdes::Buffer compact;
+  auto status = series.SerializeToBuffer(compact, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series.CompactSerializedSize(), compact.size());
+
+  // Slowly varying values take much less than the LEB128 encoding would.
+  ASSERT_LT(compact.size(), series.SerializedSize() / 2);
+
+  auto same = [](const test_msgs::FloatSeries &a,
+                 const test_msgs::FloatSeries &b) {
+    // Compare bits since there is a NaN.
+    return a.SerializedSize() == b.SerializedSize() &&
+           memcmp(a.ranges.data(), b.ranges.data(), a.ranges.size() * 4) ==
+               0 &&
+           a.positions == b.positions && a.covariance == b.covariance &&
+           a.orientation == b.orientation && a.intensities == b.intensities &&
+           a.seq == b.seq;
+  };
+
+  test_msgs::FloatSeries read;
+  status = read.DeserializeFromArray(compact.data(), compact.size(), true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_TRUE(same(series, read));
+
+  // The presized serializer writes the same bytes.
+  neutron::serdes::Buffer presized;
+  status = series.PresizedSerializeToBuffer(presized, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(compact.size(), presized.size());
+  ASSERT_EQ(0, memcmp(compact.data(), presized.data(), compact.size()));
+
+  // Expand to ROS format and compact it again.
+  compact.Rewind();
+  neutron::serdes::Buffer expanded;
+  status = test_msgs::FloatSeries::Expand(compact, expanded);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series.SerializedSize(), expanded.size());
+
+  test_msgs::FloatSeries read2;
+  status = read2.DeserializeFromArray(expanded.data(), expanded.size());
+  ASSERT_TRUE(status.ok());
+  ASSERT_TRUE(same(series, read2));
+
+  expanded.Rewind();
+  neutron::serdes::Buffer compacted;
+  status = test_msgs::FloatSeries::Compact(expanded, compacted);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(compact.size(), compacted.size());
+  ASSERT_EQ(0, memcmp(compact.data(), compacted.data(), compact.size()));
+
+  // Truncated input is an error.
+  test_msgs::FloatSeries bad;
+  status = bad.DeserializeFromArray(compact.data(), compact.size() / 2, true);
+  ASSERT_FALSE(status.ok());
+}
+
+TEST(Runtime, CompactV2Integers) {
+  // IntSeries is generated with compact v2 so its integer vectors and
+  // arrays are delta packed when that is smaller.
+  test_msgs::IntSeries series;
+  uint64_t noise = 0x9e3779b97f4a7c15ULL;
+  int32_t index = 1000;
+  for (int i = 0; i < 2000; i++) {
+    series.stamps.push_back(1700000000000000000ULL + 10000000ULL * i);
+    series.seqs.push_back(uint32_t(i + 42));
+    index += (i * 7) % 5 - 2;
+    series.indices.push_back(index);
+    noise = noise * 6364136223846793005ULL + 1442695040888963407ULL;
+    series.noise.push_back(int64_t(noise));
+  }
+  for (int i = 0; i < 64; i++) {
+    series.samples[i] = int16_t(1000 * std::sin(i * 0.1));
+  }
+
+  neutron::serdes::Buffer compact;
+  auto status = series.SerializeToBuffer(compact, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series.CompactSerializedSize(), compact.size());
+
+  // The stamps and seqs have a constant stride so pack to almost nothing.
+  // The noise doesn't pack and stays LEB128.
+  ASSERT_LT(compact.size(), 2000 * 9 + 2000);
+
+  test_msgs::IntSeries read;
+  status = read.DeserializeFromArray(compact.data(), compact.size(), true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series, read);
+
+  neutron::serdes::Buffer presized;
+  status = series.PresizedSerializeToBuffer(presized, true);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(compact.size(), presized.size());
+  ASSERT_EQ(0, memcmp(compact.data(), presized.data(), compact.size()));
+
+  compact.Rewind();
+  neutron::serdes::Buffer expanded;
+  status = test_msgs::IntSeries::Expand(compact, expanded);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series.SerializedSize(), expanded.size());
+
+  test_msgs::IntSeries read2;
+  status = read2.DeserializeFromArray(expanded.data(), expanded.size());
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(series, read2);
+
+  expanded.Rewind();
+  neutron::serdes::Buffer compacted;
+  status = test_msgs::IntSeries::Compact(expanded, compacted);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(compact.size(), compacted.size());
+  ASSERT_EQ(0, memcmp(compact.data(), compacted.data(), compact.size()));
+
+  test_msgs::IntSeries bad;
+  status = bad.DeserializeFromArray(compact.data(), 100, true);
+  ASSERT_FALSE(status.ok());
+}
+
+TEST(Runtime, View) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.vn.push_back(all.an[1]);
+
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+
+  auto view =
+      test_msgs::serdes::AllView::Create(buffer.data(), buffer.size());
+  ASSERT_TRUE(view.ok());
+  ASSERT_EQ(buffer.size(), view->SerializedSize());
+
+  ASSERT_EQ(all.i8, view->i8());
+  ASSERT_EQ(all.ui64, view->ui64());
+  ASSERT_EQ(all.f64, view->f64());
+  ASSERT_EQ(all.s, view->s());
+  ASSERT_EQ(all.t, view->t());
+  ASSERT_EQ(all.d, view->d());
+  ASSERT_EQ(all.n.foo, view->n().foo());
+  ASSERT_EQ(all.n.bar, view->n().bar());
+  ASSERT_EQ(all.e16, view->e16());
+  ASSERT_EQ(all.e64, view->e64());
+  ASSERT_EQ(all.auto_, view->auto_());
+  ASSERT_EQ(all.virtual_, view->virtual_());
+
+  // Fixed size arrays.
+  ASSERT_EQ(absl::MakeConstSpan(all.ai32), view->ai32());
+  ASSERT_EQ(absl::MakeConstSpan(all.af64), view->af64());
+  ASSERT_EQ(absl::MakeConstSpan(all.at), view->at());
+  ASSERT_EQ(absl::MakeConstSpan(all.ae32), view->ae32());
+  ASSERT_EQ(4, view->as().size());
+  ASSERT_EQ(all.as[1], view->as()[1]);
+  ASSERT_EQ(all.an[1].bar, view->an()[1].bar());
+
+  // Vectors.
+  ASSERT_EQ(absl::MakeConstSpan(all.vui8), view->vui8());
+  ASSERT_EQ(absl::MakeConstSpan(all.vi64), view->vi64());
+  ASSERT_EQ(absl::MakeConstSpan(all.vd), view->vd());
+  ASSERT_EQ(absl::MakeConstSpan(all.ve8), view->ve8());
+  std::vector<std::string> strings;
+  for (std::string_view s : view->vs()) {
+    strings.push_back(std::string(s));
+  }
+  ASSERT_EQ(all.vs, strings);
+  ASSERT_EQ(2, view->vn().size());
+  int i = 0;
+  for (auto n : view->vn()) {
+    ASSERT_EQ(all.vn[i].foo, n.foo());
+    ASSERT_EQ(all.vn[i].bar, n.bar());
+    i++;
+  }
+
+  // Truncated and oversized data.
+  ASSERT_FALSE(test_msgs::serdes::AllView::Create(buffer.data(),
+                                                  buffer.size() - 1)
+                   .ok());
+  ASSERT_FALSE(test_msgs::serdes::AllView::Create(buffer.data(), 100).ok());
+  ASSERT_FALSE(test_msgs::serdes::AllView::Create(buffer.data(),
+                                                  buffer.size() + 1)
+                   .ok());
+}
+
+// Feeds data to an incremental deserializer in chunks of the given size.
+template <typename M>
+absl::Status FeedInChunks(M &msg, const char *data, size_t size,
+                          size_t chunk, bool compact) {
+  neutron::serdes::IncrementalDeserializer<M> d(&msg, compact);
+  for (size_t offset = 0; offset < size; offset += chunk) {
+    size_t n = std::min(chunk, size - offset);
+    absl::StatusOr<bool> done = d.Feed(data + offset, n);
+    if (!done.ok()) {
+      return done.status();
+    }
+    if (*done && (d.Remaining() != 0 || offset + n != size)) {
+      return absl::InternalError("Finished early");
+    }
+  }
+  return d.Finish();
+}
+
+TEST(Runtime, Incremental) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.vui8.resize(5000, 3);
+  all.vs.push_back(std::string(300, 's'));
+  all.vn.resize(100);
+  for (size_t i = 0; i < all.vn.size(); i++) {
+    all.vn[i].foo = int32_t(i);
+  }
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer buffer;
+    ASSERT_TRUE(all.SerializeToBuffer(buffer, compact).ok());
+    for (size_t chunk : {size_t(1), size_t(3), size_t(64), size_t(1000),
+                         buffer.size()}) {
+      test_msgs::serdes::All read;
+      absl::Status status =
+          FeedInChunks(read, buffer.data(), buffer.size(), chunk, compact);
+      ASSERT_TRUE(status.ok()) << status << " compact " << compact
+                               << " chunk " << chunk;
+      ASSERT_EQ(all, read) << "compact " << compact << " chunk " << chunk;
+    }
+  }
+
+  // Compact v2 fields, split so that the packed data straddles chunks.
+  test_msgs::IntSeries series;
+  for (int i = 0; i < 500; i++) {
+    series.stamps.push_back(1000000ULL * i);
+    series.noise.push_back(int64_t(i) * 7919 - 100000);
+  }
+  for (int i = 0; i < 64; i++) {
+    series.samples[i] = int16_t(i * i);
+  }
+  neutron::serdes::Buffer compact;
+  ASSERT_TRUE(series.SerializeToBuffer(compact, true).ok());
+  for (size_t chunk : {size_t(1), size_t(5), size_t(300)}) {
+    test_msgs::IntSeries read;
+    absl::Status status =
+        FeedInChunks(read, compact.data(), compact.size(), chunk, true);
+    ASSERT_TRUE(status.ok()) << status << " chunk " << chunk;
+    ASSERT_EQ(series, read) << "chunk " << chunk;
+  }
+
+  test_msgs::FloatSeries floats;
+  floats.seq = 1234;
+  for (int i = 0; i < 1000; i++) {
+    floats.ranges.push_back(10.0f + 0.25f * float(i / 10));
+    floats.positions.push_back(100.0 + 0.125 * (i / 4));
+  }
+  floats.covariance = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  floats.intensities = {0.5f, 0.25f, -3.0f};
+  neutron::serdes::Buffer float_buffer;
+  ASSERT_TRUE(floats.SerializeToBuffer(float_buffer, true).ok());
+  for (size_t chunk : {size_t(1), size_t(7), size_t(300)}) {
+    test_msgs::FloatSeries read;
+    absl::Status status = FeedInChunks(read, float_buffer.data(),
+                                       float_buffer.size(), chunk, true);
+    ASSERT_TRUE(status.ok()) << status << " chunk " << chunk;
+    ASSERT_EQ(floats, read) << "chunk " << chunk;
+  }
+
+  // Bad data is an error as soon as it is seen rather than a wait for more.
+  // An over-long LEB128 number:
+  std::string bad(20, char(0xff));
+  test_msgs::serdes::All bad_all;
+  neutron::serdes::IncrementalDeserializer<test_msgs::serdes::All> d(
+      &bad_all, true);
+  ASSERT_FALSE(d.Feed(bad.data(), bad.size()).ok());
+  // An unknown integer encoding after the count of stamps.
+  std::string bad_series = compact.AsString();
+  bad_series[2] = 7;
+  test_msgs::IntSeries bad_read;
+  neutron::serdes::IncrementalDeserializer<test_msgs::IntSeries> d2(
+      &bad_read, true);
+  ASSERT_FALSE(d2.Feed(bad_series.data(), 10).ok());
+
+  // Not enough data.
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+  test_msgs::serdes::All partial;
+  ASSERT_FALSE(
+      FeedInChunks(partial, buffer.data(), buffer.size() - 1, 100, false)
+          .ok());
+}
+
+// Serializes into chunks of the given size and joins them up.
+template <typename M>
+absl::StatusOr<std::string> SerializeInChunks(const M &msg, size_t chunk,
+                                              bool compact) {
+  neutron::serdes::ChunkedSerializer<M> s(&msg, compact);
+  std::string joined;
+  std::vector<char> slot(chunk);
+  for (;;) {
+    absl::StatusOr<bool> done = s.Fill(slot.data(), slot.size());
+    if (!done.ok()) {
+      return done.status();
+    }
+    if (!*done && s.Used() != chunk) {
+      return absl::InternalError("Chunk not filled");
+    }
+    joined.append(slot.data(), s.Used());
+    if (*done) {
+      return joined;
+    }
+  }
+}
+
+TEST(Runtime, Chunked) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.vui8.resize(5000, 3);
+  all.vs.push_back(std::string(300, 's'));
+  all.vn.resize(100);
+  for (size_t i = 0; i < all.vn.size(); i++) {
+    all.vn[i].foo = int32_t(i);
+  }
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer buffer;
+    ASSERT_TRUE(all.SerializeToBuffer(buffer, compact).ok());
+    for (size_t chunk : {size_t(1), size_t(3), size_t(64), size_t(1000),
+                         buffer.size() + 10}) {
+      absl::StatusOr<std::string> joined =
+          SerializeInChunks(all, chunk, compact);
+      ASSERT_TRUE(joined.ok()) << joined.status();
+      ASSERT_EQ(buffer.AsString(), *joined)
+          << "compact " << compact << " chunk " << chunk;
+    }
+  }
+
+  test_msgs::IntSeries series;
+  for (int i = 0; i < 500; i++) {
+    series.stamps.push_back(1000000ULL * i);
+    series.noise.push_back(int64_t(i) * 7919 - 100000);
+  }
+  neutron::serdes::Buffer compact;
+  ASSERT_TRUE(series.SerializeToBuffer(compact, true).ok());
+  absl::StatusOr<std::string> joined = SerializeInChunks(series, 5, true);
+  ASSERT_TRUE(joined.ok());
+  ASSERT_EQ(compact.AsString(), *joined);
+}
+
+TEST(Runtime, Iovec) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.vui8.resize(10000);
+  for (size_t i = 0; i < all.vui8.size(); i++) {
+    all.vui8[i] = uint8_t(i * 7);
+  }
+
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+
+  neutron::serdes::IovecWriter writer(1000);
+  ASSERT_TRUE(all.SerializeToIovec(writer).ok());
+  ASSERT_EQ(buffer.size(), writer.Size());
+  auto iovecs = writer.Iovecs();
+  ASSERT_EQ(3, iovecs.size());
+  // The vector's body is used where it is.
+  ASSERT_EQ(all.vui8.data(), iovecs[1].iov_base);
+
+  std::string joined;
+  for (auto &iov : iovecs) {
+    joined.append(reinterpret_cast<const char *>(iov.iov_base), iov.iov_len);
+  }
+  ASSERT_EQ(buffer.AsString(), joined);
+
+  // Small vectors are copied.  The writer can be reused.
+  all.vui8.resize(10);
+  buffer.Rewind();
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+  ASSERT_TRUE(all.SerializeToIovec(writer).ok());
+  iovecs = writer.Iovecs();
+  ASSERT_EQ(1, iovecs.size());
+  ASSERT_EQ(buffer.AsString(),
+            std::string(reinterpret_cast<const char *>(iovecs[0].iov_base),
+                        iovecs[0].iov_len));
+}
+
+TEST(Runtime, OffsetIndex) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+  // Two messages back to back.
+  size_t size = buffer.size();
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+  ASSERT_EQ(2 * size, buffer.size());
+
+  const char *p = buffer.data();
+  const char *end = p + buffer.size();
+  ASSERT_TRUE(test_msgs::serdes::All::Skip(p, end));
+  ASSERT_EQ(buffer.data() + size, p);
+  ASSERT_TRUE(test_msgs::serdes::All::Skip(p, end));
+  ASSERT_EQ(end, p);
+  p = buffer.data();
+  ASSERT_FALSE(test_msgs::serdes::All::Skip(p, end - size - 1));
+
+  neutron::serdes::Buffer reader(buffer.data(), buffer.size());
+  ASSERT_TRUE(test_msgs::serdes::All::Skip(reader).ok());
+  test_msgs::serdes::All read;
+  ASSERT_TRUE(read.ReadFromBuffer(reader).ok());
+  ASSERT_EQ(all, read);
+  neutron::serdes::Buffer short_reader(buffer.data(), size - 1);
+  absl::Status status = test_msgs::serdes::All::Skip(short_reader);
+  ASSERT_TRUE(neutron::serdes::IsTruncated(status)) << status;
+  ASSERT_EQ(buffer.data(), short_reader.Addr());
+
+  auto index = test_msgs::serdes::All::BuildOffsetIndex(buffer.data(), size);
+  ASSERT_TRUE(index.ok());
+  ASSERT_EQ(0, (*index)[0]);
+  ASSERT_EQ(size, (*index)[test_msgs::serdes::All::kNumFields]);
+  // s is field 10, after the 42 bytes of numbers.
+  ASSERT_EQ(42, (*index)[10]);
+  ASSERT_EQ(46 + all.s.size(), (*index)[11]);
+  neutron::Time t;
+  memcpy(&t, buffer.data() + (*index)[11], sizeof(t));
+  ASSERT_EQ(all.t, t);
+
+  ASSERT_TRUE(neutron::serdes::IsTruncated(
+      test_msgs::serdes::All::BuildOffsetIndex(buffer.data(), size - 1)
+          .status()));
+  ASSERT_FALSE(
+      test_msgs::serdes::All::BuildOffsetIndex(buffer.data(), size + 1).ok());
+}
+
+TEST(Runtime, LatchedErrors) {
+  // The first error is kept and later ones are ignored.
+  char small[10];
+  neutron::serdes::Buffer fixed(small, sizeof(small));
+  neutron::serdes::WriteLatched(fixed, uint64_t(1));
+  ASSERT_FALSE(fixed.Failed());
+  neutron::serdes::WriteLatched(fixed, uint64_t(2));
+  ASSERT_TRUE(fixed.Failed());
+  neutron::serdes::WriteLatched(fixed, std::string("too long to fit"));
+  neutron::serdes::WriteLatched(fixed, uint16_t(3));
+  ASSERT_EQ(10, fixed.Size());
+  absl::Status status = fixed.TakeError();
+  ASSERT_FALSE(status.ok());
+  ASSERT_NE(std::string::npos, status.message().find("need: 16"));
+  ASSERT_FALSE(fixed.Failed());
+  ASSERT_TRUE(fixed.TakeError().ok());
+
+  test_msgs::serdes::All all;
+  FillAll(all);
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer).ok());
+  ASSERT_FALSE(buffer.Failed());
+
+  // Every truncation of the message fails, both writing and reading.
+  for (size_t size = 0; size < buffer.size(); size++) {
+    std::vector<char> out(size);
+    ASSERT_FALSE(all.SerializeToArray(out.data(), size).ok()) << size;
+    test_msgs::serdes::All read;
+    ASSERT_FALSE(read.DeserializeFromArray(buffer.data(), size).ok()) << size;
+  }
+  test_msgs::serdes::All read;
+  ASSERT_TRUE(read.DeserializeFromArray(buffer.data(), buffer.size()).ok());
+  ASSERT_EQ(all, read);
+  ASSERT_TRUE(read.DeserializeFromArray(buffer.data(), buffer.size()).ok());
+  ASSERT_EQ(all, read);
+}
+
+// Counts the allocations made through it.
+class CountingResource : public std::pmr::memory_resource {
+public:
+  int allocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &r) const noexcept override {
+    return this == &r;
+  }
+};
+
+TEST(Runtime, Pmr) {
+  // Strings are longer than the small string buffer so they allocate.
+  test_msgs::Arena arena;
+  arena.seq = 7;
+  arena.label = "a label that is too long to fit inline";
+  arena.tags = {"first tag that allocates memory", "second tag"};
+  arena.pair = {"left side of the pair of strings", "right"};
+  arena.ids = {1, 0, 0, 0, -5};
+  arena.gains = {1.5, 0, 2.5};
+  arena.item.name = "the single nested item in the message";
+  arena.item.values = {1.0, 2.0, 3.0};
+  arena.items.resize(3);
+  for (size_t i = 0; i < arena.items.size(); i++) {
+    arena.items[i].name = "element of the message vector number " +
+                          std::to_string(i);
+    arena.items[i].data.assign(100 + i, uint8_t(i));
+  }
+  arena.ends[1].values = {4.0};
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer buffer;
+    ASSERT_TRUE(arena.SerializeToBuffer(buffer, compact).ok());
+
+    CountingResource resource;
+    absl::StatusOr<test_msgs::Arena> read = test_msgs::Arena::DeserializeFromArray(
+        buffer.data(), buffer.size(), &resource, compact);
+    ASSERT_TRUE(read.ok()) << read.status();
+    ASSERT_EQ(arena, *read);
+    ASSERT_LT(0, resource.allocations);
+
+    // Every string and vector in the tree comes from the resource.
+    auto uses = [&resource](const auto &v) {
+      return v.get_allocator().resource() == &resource;
+    };
+    ASSERT_TRUE(uses(read->label));
+    ASSERT_TRUE(uses(read->tags));
+    ASSERT_TRUE(uses(read->tags[0]));
+    ASSERT_TRUE(uses(read->pair[0]));
+    ASSERT_TRUE(uses(read->item.name));
+    ASSERT_TRUE(uses(read->items));
+    ASSERT_TRUE(uses(read->items[2].name));
+    ASSERT_TRUE(uses(read->items[2].data));
+    ASSERT_TRUE(uses(read->ends[1].values));
+
+    // The incremental parser resizes vectors in place so the elements use
+    // the message's allocator too.
+    test_msgs::Arena incremental{test_msgs::Arena::allocator_type(&resource)};
+    neutron::serdes::IncrementalDeserializer<test_msgs::Arena> d(&incremental,
+                                                                 compact);
+    ASSERT_TRUE(d.Feed(buffer.data(), buffer.size()).ok());
+    ASSERT_TRUE(d.Done());
+    ASSERT_EQ(arena, incremental);
+    ASSERT_TRUE(uses(incremental.items[1].name));
+  }
+
+  // The whole tree fits in a fixed arena with nowhere else to go.
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(arena.SerializeToBuffer(buffer).ok());
+  alignas(16) char memory[4096];
+  std::pmr::monotonic_buffer_resource fixed(memory, sizeof(memory),
+                                            std::pmr::null_memory_resource());
+  absl::StatusOr<test_msgs::Arena> read = test_msgs::Arena::DeserializeFromArray(
+      buffer.data(), buffer.size(), &fixed);
+  ASSERT_TRUE(read.ok());
+  ASSERT_EQ(arena, *read);
+
+  // Copying with an allocator copies into the new allocator's memory.
+  CountingResource resource;
+  test_msgs::Arena copy(*read, test_msgs::Arena::allocator_type(&resource));
+  ASSERT_EQ(arena, copy);
+  ASSERT_EQ(&resource, copy.items[0].name.get_allocator().resource());
+}
+
 TEST(Runtime, Mux) {
   auto bad = neutron::serdes::MessageMux::Instance().GetDescriptor("bad");
   ASSERT_FALSE(bad.ok());
@@ -483,6 +1310,435 @@ TEST(Runtime, Mux) {
   toolbelt::Hexdump(compacted.data(), compacted.size());
 }
 
+TEST(Runtime, MuxHandles) {
+  neutron::serdes::MessageMux &mux = neutron::serdes::MessageMux::Instance();
+  ASSERT_FALSE(mux.Lookup("bad").ok());
+
+  absl::StatusOr<neutron::serdes::MessageHandle> handle =
+      mux.Lookup("test_msgs/All");
+  ASSERT_TRUE(handle.ok());
+  ASSERT_EQ(*handle, *mux.Lookup("test_msgs/All"));
+  ASSERT_NE(*handle, *mux.Lookup("other_msgs/Other"));
+  ASSERT_FALSE(mux.GetDescriptor(neutron::serdes::MessageHandle(-1)).ok());
+
+  // Registering again keeps the handle.  Metadata found earlier stays
+  // valid when more types are added.
+  const neutron::serdes::MessageMetadata *found = mux.Find(*handle);
+  neutron::serdes::MessageMetadata metadata = *found;
+  for (int i = 0; i < 100; i++) {
+    mux.Register(absl::StrFormat("mux_test/Handles%d", i), metadata);
+  }
+  ASSERT_EQ(found, mux.Find(*handle));
+  ASSERT_EQ(found->get_descriptor, metadata.get_descriptor);
+  ASSERT_EQ(mux.Register("test_msgs/All", metadata,
+                         test_msgs::serdes::All::MD5()),
+            *handle);
+
+  test_msgs::serdes::All all[3];
+  std::vector<const neutron::serdes::SerdesMessage *> msgs;
+  for (int i = 0; i < 3; i++) {
+    FillAll(all[i]);
+    all[i].s = std::string(i * 10, 'x');
+    msgs.push_back(&all[i]);
+  }
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer buffer;
+    absl::Status status = mux.SerializeBatch(*handle, msgs, buffer, compact);
+    ASSERT_TRUE(status.ok()) << status;
+
+    test_msgs::serdes::All out[3];
+    std::vector<neutron::serdes::SerdesMessage *> outs = {&out[0], &out[1],
+                                                          &out[2]};
+    status = mux.DeserializeBatch(*handle, outs, buffer.data(), buffer.size(),
+                                  compact);
+    ASSERT_TRUE(status.ok()) << status;
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ(out[i].s, all[i].s);
+      ASSERT_EQ(out[i].i32, all[i].i32);
+      ASSERT_EQ(out[i].vn.size(), all[i].vn.size());
+    }
+
+    // Too few or too many messages.
+    ASSERT_FALSE(mux.DeserializeBatch(*handle, absl::MakeSpan(outs).subspan(1),
+                                      buffer.data(), buffer.size(), compact)
+                     .ok());
+    outs.push_back(&out[0]);
+    ASSERT_FALSE(mux.DeserializeBatch(*handle, outs, buffer.data(),
+                                      buffer.size(), compact)
+                     .ok());
+  }
+}
+
+TEST(Runtime, MuxMD5) {
+  neutron::serdes::MessageMux &mux = neutron::serdes::MessageMux::Instance();
+  absl::StatusOr<absl::uint128> md5 =
+      neutron::serdes::MessageMux::ParseMD5(test_msgs::serdes::All::MD5());
+  ASSERT_TRUE(md5.ok()) << md5.status();
+  ASSERT_EQ(absl::Uint128High64(*md5), 0xb0c06d7b1712782dULL);
+  ASSERT_EQ(absl::Uint128Low64(*md5), 0x8909b9c8aa99d8e0ULL);
+  ASSERT_FALSE(neutron::serdes::MessageMux::ParseMD5("b0c06d7b").ok());
+  ASSERT_FALSE(neutron::serdes::MessageMux::ParseMD5(
+                   "x0c06d7b1712782d8909b9c8aa99d8e0")
+                   .ok());
+
+  absl::StatusOr<neutron::serdes::MessageHandle> handle = mux.Lookup(*md5);
+  ASSERT_TRUE(handle.ok()) << handle.status();
+  ASSERT_EQ(*handle, *mux.Lookup("test_msgs/All"));
+  ASSERT_FALSE(mux.Lookup(*md5 + 1).ok());
+
+  test_msgs::serdes::All all;
+  FillAll(all);
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(all.SerializeToBuffer(buffer, true).ok());
+  buffer.Rewind();
+  neutron::serdes::Buffer expanded;
+  absl::Status status = mux.Expand(*handle, buffer, expanded);
+  ASSERT_TRUE(status.ok()) << status;
+
+  test_msgs::serdes::All all2;
+  status = mux.DeserializeFromArray(*handle, all2, expanded.data(),
+                                    expanded.size(), false);
+  ASSERT_TRUE(status.ok()) << status;
+  CheckAll(all2);
+
+  // Registering a name with a different digest drops the old one.
+  neutron::serdes::MessageMetadata metadata = *mux.Find(*handle);
+  std::string d1(32, '1');
+  std::string d2(32, '2');
+  neutron::serdes::MessageHandle a = mux.Register("mux_test/A", metadata, d1);
+  neutron::serdes::MessageHandle b = mux.Register("mux_test/B", metadata, d1);
+  auto md5_1 = *neutron::serdes::MessageMux::ParseMD5(d1);
+  auto md5_2 = *neutron::serdes::MessageMux::ParseMD5(d2);
+  ASSERT_FALSE(mux.Lookup(md5_1).ok());
+  ASSERT_EQ(a, mux.Register("mux_test/A", metadata, d2));
+  ASSERT_EQ(b, *mux.Lookup(md5_1));
+  ASSERT_EQ(a, *mux.Lookup(md5_2));
+  ASSERT_EQ(a, mux.Register("mux_test/A", metadata));
+  ASSERT_FALSE(mux.Lookup(md5_2).ok());
+  ASSERT_EQ(b, mux.Register("mux_test/B", metadata, d2));
+  ASSERT_FALSE(mux.Lookup(md5_1).ok());
+  ASSERT_EQ(b, *mux.Lookup(md5_2));
+}
+
+TEST(Runtime, Lz) {
+  // Raw round trips, including short offsets and data that doesn't
+  // compress.
+  std::vector<std::string> inputs = {"", "abc", std::string(1000, 'a'),
+                                     "abcabcabcabcabcabcabcabcabcabcabcabc"};
+  std::string text;
+  for (int i = 0; i < 500; i++) {
+    text += absl::StrFormat("frame_%d/link_%d ", i % 7, i % 13);
+  }
+  inputs.push_back(text);
+  std::string noise(5000, 0);
+  uint32_t x = 12345;
+  for (char &c : noise) {
+    x = x * 1103515245 + 12345;
+    c = char(x >> 24);
+  }
+  inputs.push_back(noise);
+
+  neutron::serdes::LzContext enc;
+  neutron::serdes::LzContext dec;
+  for (const std::string &in : inputs) {
+    neutron::serdes::Buffer frame;
+    ASSERT_TRUE(enc.Compress(in.data(), in.size(), frame).ok());
+    if (in.size() > 100 && &in != &inputs.back()) {
+      ASSERT_LT(frame.Size(), in.size() / 2);
+    }
+    frame.Rewind();
+    absl::StatusOr<absl::Span<const char>> out = dec.Decompress(frame);
+    ASSERT_TRUE(out.ok()) << out.status();
+    ASSERT_EQ(std::string(out->data(), out->size()), in);
+  }
+
+  // A stream of messages that are much alike.
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.s = text.substr(0, 500);
+  all.vs.assign(20, "a string that repeats");
+  neutron::serdes::LzContext sender;
+  neutron::serdes::LzContext receiver;
+  std::vector<std::string> frames;
+  for (int i = 0; i < 5; i++) {
+    all.i32 = i;
+    neutron::serdes::Buffer buffer;
+    absl::Status status = all.SerializeToBuffer(buffer, true, &sender);
+    ASSERT_TRUE(status.ok()) << status;
+    frames.push_back(buffer.AsString());
+    ASSERT_LT(buffer.Size(), all.CompactSerializedSize());
+
+    neutron::serdes::Buffer frame(frames.back().data(), frames.back().size());
+    test_msgs::serdes::All all2;
+    status = all2.DeserializeFromBuffer(frame, true, &receiver);
+    ASSERT_TRUE(status.ok()) << status;
+    ASSERT_EQ(all2.i32, i);
+    ASSERT_EQ(all2.s, all.s);
+    ASSERT_EQ(all2.vs, all.vs);
+  }
+  // Later messages refer back to earlier ones.
+  ASSERT_LT(frames[1].size(), frames[0].size() / 4);
+
+  // Out of order.
+  {
+    neutron::serdes::LzContext fresh;
+    neutron::serdes::Buffer buffer(frames[1].data(), frames[1].size());
+    test_msgs::serdes::All all2;
+    ASSERT_FALSE(all2.DeserializeFromBuffer(buffer, true, &fresh).ok());
+  }
+  // Corrupt.
+  {
+    neutron::serdes::LzContext fresh;
+    std::string bad = frames[0];
+    bad.resize(bad.size() - 10);
+    neutron::serdes::Buffer buffer(bad.data(), bad.size());
+    test_msgs::serdes::All all2;
+    ASSERT_FALSE(all2.DeserializeFromBuffer(buffer, true, &fresh).ok());
+  }
+  // Message sizes that the body can't hold.
+  auto make_frame = [](uint8_t flags, uint64_t n, const std::string &body) {
+    std::string frame(neutron::serdes::kLzMaxHeader + body.size(), 0);
+    char *p = frame.data();
+    *p++ = char(neutron::serdes::kLzMagic);
+    *p++ = char(flags);
+    p = neutron::serdes::PackLeb128(p, n);
+    p = neutron::serdes::PackLeb128(p, 0);
+    uint32_t size = uint32_t(body.size());
+    memcpy(p, &size, sizeof(size));
+    p += sizeof(size);
+    memcpy(p, body.data(), body.size());
+    frame.resize(p + body.size() - frame.data());
+    return frame;
+  };
+  std::string literals = "\xf0\xc8" + std::string(215, 'x');
+  for (std::string bad :
+       {make_frame(neutron::serdes::kLzCompressed, ~uint64_t(7), literals),
+        make_frame(neutron::serdes::kLzCompressed, 1 << 20, literals),
+        make_frame(0, 216, literals), make_frame(0, 1 << 20, literals)}) {
+    neutron::serdes::LzContext fresh;
+    neutron::serdes::Buffer buffer(bad.data(), bad.size());
+    ASSERT_FALSE(fresh.Decompress(buffer).ok());
+  }
+  {
+    neutron::serdes::LzContext small;
+    small.SetMaxMessageSize(100);
+    std::string frame = make_frame(0, 217, literals);
+    neutron::serdes::Buffer buffer(frame.data(), frame.size());
+    ASSERT_FALSE(small.Decompress(buffer).ok());
+    neutron::serdes::LzContext fresh;
+    neutron::serdes::Buffer buffer2(frame.data(), frame.size());
+    ASSERT_TRUE(fresh.Decompress(buffer2).ok());
+  }
+
+  // A null context doesn't compress.
+  neutron::serdes::Buffer plain;
+  ASSERT_TRUE(all.SerializeToBuffer(plain, false, nullptr).ok());
+  ASSERT_EQ(plain.Size(), all.SerializedSize());
+}
+
+TEST(Runtime, Transcoder) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  // Zero runs that run into and out of raw bytes.
+  all.vi32.resize(1000);
+  all.vui8 = {0, 0, 1, 2, 0};
+
+  neutron::serdes::Buffer ros;
+  ASSERT_TRUE(all.SerializeToBuffer(ros).ok());
+  ros.Rewind();
+  neutron::serdes::Buffer expected;
+  ASSERT_TRUE(test_msgs::serdes::All::Compact(ros, expected).ok());
+
+  absl::StatusOr<neutron::serdes::Transcoder> t =
+      neutron::serdes::Transcoder::Create("test_msgs/All");
+  ASSERT_TRUE(t.ok()) << t.status();
+
+  ros.Rewind();
+  neutron::serdes::Buffer compact;
+  absl::Status status = t->Compact(ros, compact);
+  ASSERT_TRUE(status.ok()) << status;
+  ASSERT_EQ(std::string(compact.data(), compact.size()),
+            std::string(expected.data(), expected.size()));
+
+  compact.Rewind();
+  neutron::serdes::Buffer expanded;
+  status = t->Expand(compact, expanded);
+  ASSERT_TRUE(status.ok()) << status;
+  ASSERT_EQ(std::string(expanded.data(), expanded.size()),
+            std::string(ros.data(), ros.size()));
+
+  // Enums and messages from other packages.
+  other_msgs::Other other;
+  other.header.frame_id = "frame";
+  other.arr = {1, 0, 0, 3};
+  other.farr[2] = -1;
+  other.en = other_msgs::Enum::FOO;
+  neutron::serdes::Buffer other_compact;
+  ASSERT_TRUE(other.SerializeToBuffer(other_compact, true).ok());
+  absl::StatusOr<neutron::serdes::Transcoder> ot =
+      neutron::serdes::Transcoder::FromDescriptor(
+          other_msgs::Other::GetDescriptor());
+  ASSERT_TRUE(ot.ok()) << ot.status();
+  ASSERT_EQ(ot->Name(), "other_msgs/Other");
+  other_compact.Rewind();
+  neutron::serdes::Buffer other_ros;
+  ASSERT_TRUE(ot->Expand(other_compact, other_ros).ok());
+  other_msgs::Other read;
+  ASSERT_TRUE(
+      read.DeserializeFromArray(other_ros.data(), other_ros.size()).ok());
+  ASSERT_EQ(read, other);
+
+  // Truncated input.
+  neutron::serdes::Buffer truncated(const_cast<char *>(ros.data()),
+                                    ros.size() / 2);
+  neutron::serdes::Buffer out;
+  ASSERT_FALSE(t->Compact(truncated, out).ok());
+
+  // Messages that can't be resolved.
+  ASSERT_FALSE(neutron::serdes::Transcoder::Create("test_msgs/Missing").ok());
+  ASSERT_FALSE(neutron::serdes::Transcoder::Create(
+                   "test_msgs/All",
+                   [](const std::string &name)
+                       -> absl::StatusOr<absl::Span<const char>> {
+                     if (name == "test_msgs/All") {
+                       return test_msgs::serdes::All::GetDescriptor();
+                     }
+                     return absl::NotFoundError(name);
+                   })
+                   .ok());
+
+  // Messages generated with --compact_v2.
+  absl::StatusOr<neutron::serdes::Transcoder> v2 =
+      neutron::serdes::Transcoder::FromDescriptor(
+          test_msgs::FloatSeries::GetDescriptor());
+  ASSERT_FALSE(v2.ok());
+  ASSERT_TRUE(absl::IsInvalidArgument(v2.status())) << v2.status();
+
+  // Descriptors from before version 2 end after the fields.
+  absl::Span<const char> desc = other_msgs::Other::GetDescriptor();
+  std::string old(desc.data(), desc.size() - 2);
+  auto old_desc = neutron::DecodeDescriptor(old.data(), old.size());
+  ASSERT_TRUE(old_desc.ok()) << old_desc.status();
+  ASSERT_EQ(old_desc->version, 0);
+  absl::StatusOr<neutron::serdes::Transcoder> old_t =
+      neutron::serdes::Transcoder::FromDescriptor(
+          absl::MakeConstSpan(old.data(), old.size()));
+  ASSERT_FALSE(old_t.ok());
+  ASSERT_TRUE(absl::IsInvalidArgument(old_t.status())) << old_t.status();
+}
+
+TEST(Runtime, Dynamic) {
+  test_msgs::serdes::All all;
+  FillAll(all);
+  all.vui8 = {0, 0, 1, 2, 0};
+
+  neutron::serdes::DynamicTypeCache cache;
+  absl::StatusOr<const neutron::serdes::DynamicType *> type =
+      cache.Get("test_msgs/All");
+  ASSERT_TRUE(type.ok()) << type.status();
+  ASSERT_EQ(*type, *cache.Get("test_msgs/All"));
+
+  for (bool compact : {false, true}) {
+    neutron::serdes::Buffer buffer;
+    ASSERT_TRUE(all.SerializeToBuffer(buffer, compact).ok());
+
+    neutron::serdes::DynamicMessage msg(*type);
+    absl::Status status =
+        msg.DeserializeFromArray(buffer.data(), buffer.size(), compact);
+    ASSERT_TRUE(status.ok()) << status;
+
+    ASSERT_EQ(*msg.Get<int8_t>("i8"), 1);
+    ASSERT_EQ(*msg.Get<uint64_t>("ui64"), 8);
+    ASSERT_EQ(*msg.Get<float>("f32"), 9);
+    ASSERT_EQ(*msg.Get<double>(9), 10);
+    ASSERT_EQ(*msg.GetString("s"), "dave");
+    ASSERT_EQ(*msg.Get<neutron::Time>("t"), (neutron::Time{45, 67}));
+    ASSERT_EQ(*msg.Get<uint8_t>("e8"),
+              uint8_t(test_msgs::serdes::Enum8::X1));
+    ASSERT_EQ(*msg.Get<uint32_t>("e32"),
+              uint32_t(test_msgs::serdes::Enum32::X3));
+    ASSERT_EQ(*msg.GetMessage("n")->Get<int32_t>("foo"), 1234);
+    ASSERT_EQ(*msg.GetMessage("n")->GetString("bar"), "baz");
+
+    ASSERT_EQ(*msg.Get<int16_t>("ai16", 1), 22);
+    ASSERT_EQ(*msg.GetString("as", 1), "bar");
+    ASSERT_EQ(*msg.Get<neutron::Duration>("ad", 4),
+              (neutron::Duration{0xa3, 0xa4}));
+    ASSERT_EQ(*msg.GetMessage("an", 1)->GetString("bar"), "an[1]");
+    ASSERT_EQ(*msg.Get<uint64_t>("ae64", 4),
+              uint64_t(test_msgs::serdes::Enum64::X1));
+
+    absl::StatusOr<absl::Span<const uint8_t>> vui8 =
+        msg.GetSpan<uint8_t>("vui8");
+    ASSERT_TRUE(vui8.ok());
+    ASSERT_EQ(std::vector<uint8_t>(vui8->begin(), vui8->end()), all.vui8);
+    ASSERT_EQ(*msg.Size("vs"), 2);
+    ASSERT_EQ(*msg.GetString("vs", 1), "bar2");
+    ASSERT_EQ(*msg.GetMessage("vn", 0)->GetString("bar"), "vn");
+    ASSERT_EQ(*msg.Get<uint16_t>("ve16", 0),
+              uint16_t(test_msgs::serdes::Enum16::X2));
+
+    // Wrong types, names and indexes.
+    ASSERT_FALSE(msg.Get<int32_t>("i8").ok());
+    ASSERT_FALSE(msg.Get<int32_t>("nothing").ok());
+    ASSERT_FALSE(msg.Get<int32_t>(1000).ok());
+    ASSERT_FALSE(msg.GetString("vs", 2).ok());
+    ASSERT_FALSE(msg.GetMessage("s").ok());
+
+    // Encodes the same as the generated code in both formats.
+    for (bool out_compact : {false, true}) {
+      neutron::serdes::Buffer expected;
+      ASSERT_TRUE(all.SerializeToBuffer(expected, out_compact).ok());
+      neutron::serdes::Buffer encoded;
+      ASSERT_TRUE(msg.SerializeToBuffer(encoded, out_compact).ok());
+      ASSERT_EQ(std::string(encoded.data(), encoded.size()),
+                std::string(expected.data(), expected.size()));
+    }
+
+    // Truncated data.
+    ASSERT_FALSE(
+        msg.DeserializeFromArray(buffer.data(), buffer.size() - 1, compact)
+            .ok());
+  }
+
+  // Build a message and read it back with the generated code.
+  neutron::serdes::DynamicMessage msg(*type);
+  ASSERT_TRUE(msg.Set<int32_t>("i32", -42).ok());
+  ASSERT_TRUE(msg.SetString("s", "hello").ok());
+  ASSERT_TRUE(msg.GetMessage("an", 2)->Set<int32_t>("foo", 7).ok());
+  std::vector<int64_t> vi64 = {1, 0, 0, 0, -1};
+  ASSERT_TRUE(msg.SetVector<int64_t>("vi64", vi64).ok());
+  ASSERT_TRUE(msg.Resize("vn", 2).ok());
+  ASSERT_TRUE(msg.GetMessage("vn", 1)->SetString("bar", "second").ok());
+  ASSERT_TRUE(msg.Resize("vs", 1).ok());
+  ASSERT_TRUE(msg.SetString("vs", "only", 0).ok());
+
+  neutron::serdes::Buffer buffer;
+  ASSERT_TRUE(msg.SerializeToBuffer(buffer, true).ok());
+  test_msgs::serdes::All read;
+  ASSERT_TRUE(read.DeserializeFromArray(buffer.data(), buffer.size(), true)
+                  .ok());
+  ASSERT_EQ(read.i32, -42);
+  ASSERT_EQ(read.s, "hello");
+  ASSERT_EQ(read.an[2].foo, 7);
+  ASSERT_EQ(read.vi64, vi64);
+  ASSERT_EQ(read.vn.size(), 2);
+  ASSERT_EQ(read.vn[1].bar, "second");
+  ASSERT_EQ(read.vs, std::vector<std::string>{"only"});
+
+  // Vector lengths are checked against the smallest size of an element.
+  absl::StatusOr<const neutron::serdes::DynamicType *> nested =
+      cache.Get("test_msgs/Nested");
+  ASSERT_TRUE(nested.ok()) << nested.status();
+  ASSERT_EQ((*nested)->MinRosSize(), 8);
+  ASSERT_EQ((*nested)->MinCompactValues(), 2);
+
+  // Messages generated with --compact_v2.
+  ASSERT_FALSE(
+      cache.FromDescriptor(test_msgs::FloatSeries::GetDescriptor()).ok());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
 
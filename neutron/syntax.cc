@@ -1,4 +1,5 @@
 #include "neutron/syntax.h"
+#include <algorithm>
 #include "absl/strings/str_format.h"
 #include "neutron/package.h"
 
@@ -48,6 +49,33 @@ bool Message::IsEnum() const {
   return true;
 }
 
+int Message::EnumSize() const {
+  int size = 0;
+  for (auto & [ name, c ] : Constants()) {
+    switch (c->Type()) {
+    case FieldType::kInt8:
+    case FieldType::kUint8:
+      size = std::max(size, 1);
+      break;
+    case FieldType::kInt16:
+    case FieldType::kUint16:
+      size = std::max(size, 2);
+      break;
+    case FieldType::kInt32:
+    case FieldType::kUint32:
+      size = std::max(size, 4);
+      break;
+    case FieldType::kInt64:
+    case FieldType::kUint64:
+      size = std::max(size, 8);
+      break;
+    default:
+      break;
+    }
+  }
+  return size;
+}
+
 absl::Status Message::Parse(LexicalAnalyzer &lex) {
   if (field_types_.empty()) {
     field_types_.insert({Token::kBool, FieldType::kBool});
@@ -155,6 +155,11 @@ class Message {
 
   bool IsEnum() const;
 
+  // Size in bytes of an enum's underlying type, which is that of its widest
+  // constant, or 0 if it has none.  The generators and the descriptor
+  // writer both use this so that they agree on the wire type.
+  int EnumSize() const;
+
   const std::string Md5() const { return md5_; }
 
  private:
@@ -104,6 +104,24 @@ string s = this is a string
   ASSERT_EQ(input.str(), out.str());
 }
 
+TEST(SyntaxTest, EnumSize) {
+  std::stringstream input;
+  input << R"(uint8 A = 1
+int16 B = -2
+uint32 C = 3
+)";
+
+  neutron::LexicalAnalyzer lex("stdin", input,
+                              [](const std::string &error) { FAIL(); });
+  neutron::Message msg("Foo");
+
+  absl::Status status = msg.Parse(lex);
+  ASSERT_TRUE(status.ok());
+  ASSERT_TRUE(msg.IsEnum());
+  ASSERT_EQ(4, msg.EnumSize());
+  ASSERT_EQ(0, neutron::Message("Empty").EnumSize());
+}
+
 TEST(SyntaxTest, Arrays) {
   std::stringstream input;
   input << R"(int32[] i1
@@ -227,7 +227,7 @@ public:
 #undef CTYPE
 
   size_t size() const { return N; }
-  Enum *data() const { GetBuffer()->template ToAddress<Enum>(BaseOffset()); }
+  Enum *data() const { return GetBuffer()->template ToAddress<Enum>(BaseOffset()); }
   bool empty() const { return N == 0; }
   size_t max_size() const { return N; }
 
@@ -280,7 +280,7 @@ public:
   explicit MessageArrayField(uint32_t source_offset,
                              uint32_t relative_binary_offset)
       : relative_binary_offset_(relative_binary_offset) {
-    std::shared_ptr<toolbelt::PayloadBuffer *> buffer =
+    BufferHandle buffer =
         Message::GetSharedBuffer(this, source_offset);
     // Construct the embedded messages.
     size_t index = 0;
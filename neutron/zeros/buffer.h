@@ -159,7 +159,7 @@ class Buffer {
     }
     uint32_t size = 0;
     memcpy(&size, addr_, sizeof(size));
-    if (absl::Status status = Check(size_t(size)); !status.ok()) {
+    if (absl::Status status = Check(4 + size_t(size)); !status.ok()) {
       return status;
     }
     std::string s;
@@ -192,7 +192,7 @@ class Buffer {
     }
     uint32_t size = 0;
     memcpy(&size, addr_, sizeof(size));
-    if (absl::Status status = Check(size_t(size)); !status.ok()) {
+    if (absl::Status status = Check(4 + size_t(size)); !status.ok()) {
       return status;
     }
     std::string s;
@@ -259,6 +259,9 @@ class Buffer {
     uint32_t size = 0;
     memcpy(&size, addr_, sizeof(size));
     addr_ += 4;
+    if (absl::Status status = CheckLength(size, sizeof(T)); !status.ok()) {
+      return status;
+    }
     if (size > 0) {
       vec.resize(size);
       memcpy(vec.data(), addr_, size * sizeof(T));
@@ -287,6 +290,11 @@ class Buffer {
     uint32_t size = 0;
     memcpy(&size, addr_, sizeof(size));
     addr_ += 4;
+    if (absl::Status status =
+            CheckLength(size, sizeof(typename EnumVectorField<Enum>::T));
+        !status.ok()) {
+      return status;
+    }
     vec.resize(size);
     memcpy(vec.data(), addr_, size * sizeof(EnumVectorField<Enum>::T));
     addr_ += size * sizeof(EnumVectorField<Enum>::T);
@@ -315,6 +323,9 @@ class Buffer {
     uint32_t size = 0;
     memcpy(&size, addr_, sizeof(size));
     addr_ += 4;
+    if (absl::Status status = CheckLength(size, 4); !status.ok()) {
+      return status;
+    }
     vec.resize(size);
 
     for (auto &s : vec) {
@@ -385,6 +396,16 @@ class Buffer {
     return absl::OkStatus();
   }
 
+  // Checks a vector length read from the buffer.  It can't be negative and
+  // the rest of the buffer must hold n elements of at least min_size bytes,
+  // so that a bad length is rejected before the vector is resized.
+  absl::Status CheckLength(int64_t n, size_t min_size) {
+    if (n < 0) {
+      return absl::InternalError(absl::StrFormat("Invalid length %d", n));
+    }
+    return Check(size_t(n) * min_size);
+  }
+
   // TODO:
   // MessageArrayField
   // MessageVectorField
@@ -0,0 +1,189 @@
+#pragma once
+
+// Direct conversion between zeros messages and serdes messages.
+//
+// The generated ToSerdes and FromSerdes member templates of a zeros message
+// call these for each field, passing the field of the serdes message with
+// the same name.  The serdes message type is a template parameter so that
+// the zeros messages don't depend on the serdes messages; the conversion is
+// only compiled when both are used.
+//
+// Primitive and enum arrays and vectors have the same binary layout in
+// both messages and are copied with a single memcpy.  Strings and messages
+// are copied element by element.
+
+#include "neutron/zeros/arrays.h"
+#include "neutron/zeros/fields.h"
+#include "neutron/zeros/vectors.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+namespace neutron::zeros {
+
+// Primitive fields, including Time and Duration.
+template <typename F, typename T> void ToSerdes(const F &field, T &v) {
+  v = field.Get();
+}
+
+template <typename T, typename F> void FromSerdes(const T &v, F &field) {
+  field = v;
+}
+
+template <typename S> void ToSerdes(const StringField &field, S &v) {
+  std::string_view s = field.Get();
+  v.assign(s.data(), s.size());
+}
+
+template <typename S> void FromSerdes(const S &v, StringField &field) {
+  field = std::string_view(v.data(), v.size());
+}
+
+template <typename Enum, typename S>
+void ToSerdes(const EnumField<Enum> &field, S &v) {
+  v = static_cast<S>(field.GetUnderlying());
+}
+
+template <typename S, typename Enum>
+void FromSerdes(const S &v, EnumField<Enum> &field) {
+  field.Set(static_cast<typename EnumField<Enum>::T>(v));
+}
+
+template <typename MessageType, typename S>
+void ToSerdes(const MessageField<MessageType> &field, S &v) {
+  field.Get().ToSerdes(v);
+}
+
+template <typename S, typename MessageType>
+void FromSerdes(const S &v, MessageField<MessageType> &field) {
+  field.Get().FromSerdes(v);
+}
+
+// Fixed size arrays.
+template <typename T, int N, typename S>
+void ToSerdes(const PrimitiveArrayField<T, N> &field, S &v) {
+  static_assert(sizeof(v[0]) == sizeof(T));
+  memcpy(v.data(), field.data(), sizeof(T) * N);
+}
+
+template <typename S, typename T, int N>
+void FromSerdes(const S &v, PrimitiveArrayField<T, N> &field) {
+  static_assert(sizeof(v[0]) == sizeof(T));
+  memcpy(field.data(), v.data(), sizeof(T) * N);
+}
+
+template <typename Enum, int N, typename S>
+void ToSerdes(const EnumArrayField<Enum, N> &field, S &v) {
+  static_assert(sizeof(v[0]) == sizeof(Enum));
+  memcpy(v.data(), field.data(), sizeof(Enum) * N);
+}
+
+template <typename S, typename Enum, int N>
+void FromSerdes(const S &v, EnumArrayField<Enum, N> &field) {
+  static_assert(sizeof(v[0]) == sizeof(Enum));
+  memcpy(field.data(), v.data(), sizeof(Enum) * N);
+}
+
+template <int N, typename S>
+void ToSerdes(const StringArrayField<N> &field, S &v) {
+  for (int i = 0; i < N; i++) {
+    ToSerdes(field.Get()[i], v[i]);
+  }
+}
+
+template <typename S, int N>
+void FromSerdes(const S &v, StringArrayField<N> &field) {
+  for (int i = 0; i < N; i++) {
+    FromSerdes(v[i], field[i]);
+  }
+}
+
+template <typename T, int N, typename S>
+void ToSerdes(const MessageArrayField<T, N> &field, S &v) {
+  for (int i = 0; i < N; i++) {
+    field.Get()[i].ToSerdes(v[i]);
+  }
+}
+
+template <typename S, typename T, int N>
+void FromSerdes(const S &v, MessageArrayField<T, N> &field) {
+  for (int i = 0; i < N; i++) {
+    field[i].FromSerdes(v[i]);
+  }
+}
+
+// Variable length vectors.  The zeros vector is resized first, which can
+// move the data in the buffer, so its address is taken after that.
+template <typename T, typename S>
+void ToSerdes(const PrimitiveVectorField<T> &field, S &v) {
+  static_assert(sizeof(v[0]) == sizeof(T));
+  v.resize(field.size());
+  if (!v.empty()) {
+    memcpy(v.data(), field.data(), sizeof(T) * v.size());
+  }
+}
+
+template <typename S, typename T>
+void FromSerdes(const S &v, PrimitiveVectorField<T> &field) {
+  static_assert(sizeof(v[0]) == sizeof(T));
+  field.resize(v.size());
+  if (!v.empty()) {
+    memcpy(field.data(), v.data(), sizeof(T) * v.size());
+  }
+}
+
+template <typename Enum, typename S>
+void ToSerdes(const EnumVectorField<Enum> &field, S &v) {
+  static_assert(sizeof(v[0]) == sizeof(Enum));
+  v.resize(field.size());
+  if (!v.empty()) {
+    memcpy(v.data(), field.data(), sizeof(Enum) * v.size());
+  }
+}
+
+template <typename S, typename Enum>
+void FromSerdes(const S &v, EnumVectorField<Enum> &field) {
+  static_assert(sizeof(v[0]) == sizeof(Enum));
+  field.resize(v.size());
+  if (!v.empty()) {
+    memcpy(field.data(), v.data(), sizeof(Enum) * v.size());
+  }
+}
+
+template <typename S>
+void ToSerdes(const StringVectorField &field, S &v) {
+  v.resize(field.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    std::string_view s = field[i].Get();
+    v[i].assign(s.data(), s.size());
+  }
+}
+
+template <typename S>
+void FromSerdes(const S &v, StringVectorField &field) {
+  field.clear();
+  field.reserve(v.size());
+  for (auto &s : v) {
+    field.push_back(std::string(s.data(), s.size()));
+  }
+}
+
+template <typename T, typename S>
+void ToSerdes(const MessageVectorField<T> &field, S &v) {
+  v.resize(field.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    auto e = field[i];
+    e.Get().ToSerdes(v[i]);
+  }
+}
+
+template <typename S, typename T>
+void FromSerdes(const S &v, MessageVectorField<T> &field) {
+  field.resize(v.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    field[i]->FromSerdes(v[i]);
+  }
+}
+
+} // namespace neutron::zeros
@@ -165,14 +165,14 @@ class StringField {
 
 // This is a string field that is not embedded inside a message.  These will be
 // allocated from the heap, as is the case when used in a std::vector.  They
-// store the std::shared_ptr to the toolbelt::PayloadBuffer pointer instead of an offset
+// store the BufferHandle for the toolbelt::PayloadBuffer pointer instead of an offset
 // to the start of the message.
 class NonEmbeddedStringField {
  public:
   NonEmbeddedStringField() = default;
-  explicit NonEmbeddedStringField(std::shared_ptr<toolbelt::PayloadBuffer *> buffer,
+  explicit NonEmbeddedStringField(BufferHandle buffer,
                                   uint32_t relative_binary_offset)
-      : buffer_(buffer), relative_binary_offset_(relative_binary_offset) {}
+      : buffer_(std::move(buffer)), relative_binary_offset_(relative_binary_offset) {}
 
   operator std::string_view() const {
     return GetBuffer()->GetStringView(relative_binary_offset_);
@@ -222,7 +222,7 @@ class NonEmbeddedStringField {
 
   toolbelt::PayloadBuffer **GetBufferAddr() const { return buffer_.get(); }
 
-  std::shared_ptr<toolbelt::PayloadBuffer *> buffer_;
+  BufferHandle buffer_;
   toolbelt::BufferOffset
       relative_binary_offset_;  // Offset into toolbelt::PayloadBuffer of toolbelt::StringHeader
 };
@@ -296,6 +296,14 @@ class EnumField {
   toolbelt::BufferOffset relative_binary_offset_;
 };
 
+// What operator-> on a temporary message field returns: a copy of the
+// message that lives until the end of the full expression.
+template <typename MessageType>
+struct MessageArrow {
+  MessageType msg;
+  MessageType *operator->() { return &msg; }
+};
+
 // A message field enapsulates a message that is held inline in the
 // parent message, both in the source message and the
 // binary message.
@@ -306,18 +314,28 @@ template <typename MessageType>
 class MessageField {
  public:
   MessageField() = default;
-  MessageField(std::shared_ptr<toolbelt::PayloadBuffer *> buffer,
+  MessageField(BufferHandle buffer,
                toolbelt::BufferOffset source_offset, toolbelt::BufferOffset relative_binary_offset)
       : relative_binary_offset_(relative_binary_offset),
-        msg_(buffer, Message::GetMessageBinaryStart(this, source_offset) +
+        msg_(std::move(buffer), Message::GetMessageBinaryStart(this, source_offset) +
                          relative_binary_offset) {}
 
-  operator MessageType &() { return msg_; }
-  MessageType &operator*() { return msg_; }
-  MessageType *operator->() { return &msg_; }
+  // The message is inside the field, so a reference to it can't be taken
+  // from a temporary field such as a MessageVectorField element.
+  operator MessageType &() & { return msg_; }
+  operator MessageType &() && = delete;
+  MessageType &operator*() & { return msg_; }
+  MessageType *operator->() & { return &msg_; }
 
-  MessageType &Get() { return msg_; }
-  const MessageType &Get() const { return msg_; }
+  // A temporary field gives out a copy of the message instead.  It refers
+  // to the same buffer, so changes made through it are kept.
+  MessageType operator*() && { return msg_; }
+  MessageArrow<MessageType> operator->() && { return {msg_}; }
+
+  MessageType &Get() & { return msg_; }
+  const MessageType &Get() const & { return msg_; }
+  MessageType &Get() && = delete;
+  const MessageType &Get() const && = delete;
 
   toolbelt::BufferOffset BinaryEndOffset() const {
     return relative_binary_offset_ + MessageType::BinarySize();
@@ -355,16 +373,26 @@ template <typename MessageType>
 class NonEmbeddedMessageField {
  public:
   NonEmbeddedMessageField() = default;
-  NonEmbeddedMessageField(std::shared_ptr<toolbelt::PayloadBuffer *> buffer,
+  NonEmbeddedMessageField(BufferHandle buffer,
                           toolbelt::BufferOffset absolute_binary_offset)
-      : msg_(buffer, absolute_binary_offset) {}
-
-  operator MessageType &() { return msg_; }
-  MessageType &operator*() { return msg_; }
-  MessageType *operator->() { return &msg_; }
-
-  MessageType &Get() { return msg_; }
-  const MessageType &Get() const { return msg_; }
+      : msg_(std::move(buffer), absolute_binary_offset) {}
+
+  // The message is inside the field, so a reference to it can't be taken
+  // from a temporary field such as a MessageVectorField element.
+  operator MessageType &() & { return msg_; }
+  operator MessageType &() && = delete;
+  MessageType &operator*() & { return msg_; }
+  MessageType *operator->() & { return &msg_; }
+
+  // A temporary field gives out a copy of the message instead.  It refers
+  // to the same buffer, so changes made through it are kept.
+  MessageType operator*() && { return msg_; }
+  MessageArrow<MessageType> operator->() && { return {msg_}; }
+
+  MessageType &Get() & { return msg_; }
+  const MessageType &Get() const & { return msg_; }
+  MessageType &Get() && = delete;
+  const MessageType &Get() const && = delete;
 
   toolbelt::BufferOffset BinaryEndOffset() const {
     return msg_.absolute_binary_offset + MessageType::BinarySize();
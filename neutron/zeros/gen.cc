@@ -194,37 +194,8 @@ static std::string ConstantCType(FieldType type) {
     abort();
   }
 }
-static int EnumCSize(const Message &msg) {
-  // Look for the biggest constant type.
-
-  int size = 0;
-  for (auto & [ name, c ] : msg.Constants()) {
-    switch (c->Type()) {
-    case FieldType::kInt8:
-    case FieldType::kUint8:
-      size = std::max(size, 1);
-      break;
-    case FieldType::kInt16:
-    case FieldType::kUint16:
-      size = std::max(size, 2);
-      break;
-    case FieldType::kInt32:
-    case FieldType::kUint32:
-      size = std::max(size, 4);
-      break;
-    case FieldType::kInt64:
-    case FieldType::kUint64:
-      size = std::max(size, 8);
-      break;
-    default:
-      break;
-    }
-  }
-  return size;
-}
-
 static std::string EnumCType(const Message &msg) {
-  int size = EnumCSize(msg);
+  int size = msg.EnumSize();
 
   switch (size) {
   case 0:
@@ -424,6 +395,9 @@ absl::Status Generator::GenerateStruct(const Message &msg, std::ostream &os) {
   if (absl::Status status = GenerateBinarySize(msg, os); !status.ok()) {
     return status;
   }
+  if (absl::Status status = GenerateReadonly(msg, os); !status.ok()) {
+    return status;
+  }
   if (absl::Status status = GenerateCreators(msg, os); !status.ok()) {
     return status;
   }
@@ -509,6 +483,9 @@ absl::Status Generator::GenerateStruct(const Message &msg, std::ostream &os) {
   os << "  absl::Status DeserializeFromBuffer(neutron::zeros::Buffer& "
         "buffer);\n";
   os << "  size_t SerializedSize() const;\n";
+  if (absl::Status status = GenerateSerdesConverters(msg, os); !status.ok()) {
+    return status;
+  }
   os << "  bool operator==(const " << msg.Name() << "& m) const;\n";
   os << "  bool operator!=(const " << msg.Name() << "& m) const {\n";
   os << "    return !this->operator==(m);\n";
@@ -584,7 +561,7 @@ absl::Status Generator::GenerateDefaultConstructor(const Message &msg,
 absl::Status Generator::GenerateEmbeddedConstructor(const Message &msg,
                                                     std::ostream &os) {
   os << "  " << msg.Name()
-     << "(std::shared_ptr<toolbelt::PayloadBuffer *> buffer, "
+     << "(neutron::zeros::BufferHandle buffer, "
         "toolbelt::BufferOffset offset) : "
         "Message(buffer, offset)";
   if (absl::Status status = GenerateFieldInitializers(msg, os, ", ");
@@ -598,7 +575,7 @@ absl::Status Generator::GenerateEmbeddedConstructor(const Message &msg,
 absl::Status Generator::GenerateNonEmbeddedConstructor(const Message &msg,
                                                        std::ostream &os) {
   os << "  " << msg.Name()
-     << "(std::shared_ptr<toolbelt::PayloadBuffer *> buffer)";
+     << "(neutron::zeros::BufferHandle buffer)";
   if (absl::Status status = GenerateFieldInitializers(msg, os); !status.ok()) {
     return status;
   }
@@ -612,6 +589,36 @@ absl::Status Generator::GenerateNonEmbeddedConstructor(const Message &msg,
   return absl::OkStatus();
 }
 
+// Expression for the number of bytes taken by the field in the binary
+// message.
+std::string Generator::FieldBinarySize(const Message &msg,
+                                       std::shared_ptr<Field> field) {
+  auto resolved_field = ResolveField(field);
+  if (field->Type() == FieldType::kMessage) {
+    auto msg_field = std::static_pointer_cast<MessageField>(field);
+    if (msg_field->Msg()->IsEnum()) {
+      return "sizeof(" + EnumCType(*msg_field->Msg()) + ")";
+    }
+    return MessageFieldTypeName(msg, msg_field) + "::BinarySize()";
+  }
+  if (field->IsArray()) {
+    auto array = std::static_pointer_cast<ArrayField>(field);
+    if (!array->IsFixedSize()) {
+      return "sizeof(toolbelt::VectorHeader)";
+    }
+    std::string n = std::to_string(array->Size());
+    if (array->Base()->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+      if (msg_field->Msg()->IsEnum()) {
+        return "sizeof (" + EnumCType(*msg_field->Msg()) + ") * " + n;
+      }
+      return MessageFieldTypeName(msg, msg_field) + "::BinarySize() * " + n;
+    }
+    return "sizeof(" + FieldCType(resolved_field->Type()) + ") * " + n;
+  }
+  return "sizeof(" + FieldCType(resolved_field->Type()) + ")";
+}
+
 absl::Status Generator::GenerateBinarySize(const Message &msg,
                                            std::ostream &os) {
   os << "  static constexpr size_t BinarySize() {\n";
@@ -624,7 +631,6 @@ absl::Status Generator::GenerateBinarySize(const Message &msg,
 
   auto align = [this, &os, msg](std::shared_ptr<Field> prev,
                                 std::shared_ptr<Field> field) {
-    auto resolved_prev = ResolveField(prev);
     auto resolved_field = ResolveField(field);
     // The new offset is calculated by adding the current offset to the size
     // of the previous field and then aligning it to the alignment of the
@@ -638,37 +644,7 @@ absl::Status Generator::GenerateBinarySize(const Message &msg,
     }
     os << "offset = neutron::zeros::AlignedOffset<"
        << FieldAlignmentType(resolved_field) << ">(";
-    os << "offset + ";
-    if (prev->Type() == FieldType::kMessage) {
-      auto msg_field = std::static_pointer_cast<MessageField>(prev);
-      if (msg_field->Msg()->IsEnum()) {
-        os << "sizeof(" << EnumCType(*msg_field->Msg()) << "));\n";
-      } else {
-        os << MessageFieldTypeName(msg, msg_field) << "::BinarySize());\n";
-      }
-    } else if (prev->IsArray()) {
-      auto array = std::static_pointer_cast<ArrayField>(prev);
-      if (array->IsFixedSize()) {
-        if (array->Base()->Type() == FieldType::kMessage) {
-          auto msg_field =
-              std::static_pointer_cast<MessageField>(array->Base());
-          if (msg_field->Msg()->IsEnum()) {
-            os << "sizeof (" << EnumCType(*msg_field->Msg()) << ") * "
-               << array->Size() << ");\n";
-          } else {
-            os << MessageFieldTypeName(msg, msg_field) << "::BinarySize() * "
-               << array->Size() << ");\n";
-          }
-        } else {
-          os << "sizeof(" << FieldCType(resolved_prev->Type()) << ") * "
-             << array->Size() << ");\n";
-        }
-      } else {
-        os << "sizeof(toolbelt::VectorHeader));\n";
-      }
-    } else {
-      os << "sizeof(" << FieldCType(resolved_prev->Type()) << "));\n";
-    }
+    os << "offset + " << FieldBinarySize(msg, prev) << ");\n";
   };
 
   // The remaining fields are aligned by their type from the end of the
@@ -686,6 +662,188 @@ absl::Status Generator::GenerateBinarySize(const Message &msg,
   return absl::OkStatus();
 }
 
+absl::Status Generator::GenerateSerdesConverters(const Message &msg,
+                                                 std::ostream &os) {
+  // These are templates so that the zeros message doesn't need to include
+  // the serdes message.  They are only compiled if they are used.
+  os << "  // Field by field copies to and from the serdes message of the same "
+        "type.\n";
+  os << "  template <typename S> void ToSerdes(S& m) const {\n";
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    os << "    neutron::zeros::ToSerdes(" << name << ", m." << name << ");\n";
+  }
+  os << "  }\n";
+  os << "  template <typename S> void FromSerdes(const S& m) {\n";
+  for (auto &field : msg.Fields()) {
+    std::string name = SanitizeFieldName(field->Name());
+    os << "    neutron::zeros::FromSerdes(m." << name << ", " << name
+       << ");\n";
+  }
+  os << "  }\n";
+  return absl::OkStatus();
+}
+
+absl::Status Generator::GenerateReadonly(const Message &msg,
+                                         std::ostream &os) {
+  os << "  // Read-only view of the message for memory that doesn't move.  The\n"
+        "  // fields are read at constant offsets from the start of the binary\n"
+        "  // message.\n";
+  os << "  class Readonly : public neutron::zeros::ReadonlyMessage {\n";
+  os << "  public:\n";
+  os << "    using ReadonlyMessage::ReadonlyMessage;\n";
+  os << "    static constexpr size_t BinarySize() { return " << msg.Name()
+     << "::BinarySize(); }\n\n";
+
+  auto &fields = msg.Fields();
+  for (auto &field : fields) {
+    std::string name = SanitizeFieldName(field->Name());
+    std::string offset = name + "_offset_";
+    os << "    ";
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      std::string type = MessageFieldTypeName(msg, msg_field);
+      if (msg_field->Msg()->IsEnum()) {
+        os << type << " " << name << "() const { return " << type << "(Load<"
+           << EnumCType(*msg_field->Msg()) << ">(" << offset << ")); }\n";
+      } else {
+        os << type << "::Readonly " << name
+           << "() const { return LoadMessage<" << type << "::Readonly>("
+           << offset << "); }\n";
+      }
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      std::string args = offset;
+      std::string kind = "Vector";
+      if (array->IsFixedSize()) {
+        args += ", " + std::to_string(array->Size());
+        kind = "Array";
+      }
+      if (array->Base()->Type() == FieldType::kString) {
+        os << "neutron::zeros::ReadonlyStringSpan " << name
+           << "() const { return LoadString" << kind << "(" << args
+           << "); }\n";
+      } else if (array->Base()->Type() == FieldType::kMessage) {
+        auto msg_field = std::static_pointer_cast<MessageField>(array->Base());
+        std::string type = MessageFieldTypeName(msg, msg_field);
+        if (msg_field->Msg()->IsEnum()) {
+          os << "neutron::zeros::ReadonlySpan<" << type << "> " << name
+             << "() const { return Load" << kind << "<" << type << ">("
+             << args << "); }\n";
+        } else {
+          os << "neutron::zeros::ReadonlyMessageSpan<" << type
+             << "::Readonly> " << name << "() const { return LoadMessage"
+             << kind << "<" << type << "::Readonly>(" << args << "); }\n";
+        }
+      } else {
+        std::string type = FieldCType(array->Base()->Type());
+        os << "neutron::zeros::ReadonlySpan<" << type << "> " << name
+           << "() const { return Load" << kind << "<" << type << ">(" << args
+           << "); }\n";
+      }
+    } else if (field->Type() == FieldType::kString) {
+      os << "std::string_view " << name << "() const { return LoadString("
+         << offset << "); }\n";
+    } else if (field->Type() == FieldType::kBool) {
+      os << "bool " << name << "() const { return Load<uint8_t>(" << offset
+         << ") != 0; }\n";
+    } else {
+      std::string type = FieldCType(field->Type());
+      os << type << " " << name << "() const { return Load<" << type << ">("
+         << offset << "); }\n";
+    }
+  }
+
+  // Validation of the message at an offset in the buffer.
+  os << "\n    // Checks that the message at offset and everything it "
+        "refers to are\n    // inside the buffer.\n";
+  os << "    static absl::Status ValidateAt(const "
+        "neutron::zeros::BufferValidator &v, size_t offset) {\n";
+  os << "      if (absl::Status status = v.CheckRange(offset, BinarySize(), \""
+     << msg.Name() << "\"); !status.ok()) return status;\n";
+  for (auto &field : fields) {
+    std::string name = SanitizeFieldName(field->Name());
+    std::string what = "\"" + msg.Name() + "." + field->Name() + "\"";
+    std::string at = "offset + " + name + "_offset_";
+    if (field->Type() == FieldType::kMessage) {
+      auto msg_field = std::static_pointer_cast<MessageField>(field);
+      if (msg_field->Msg()->IsEnum()) {
+        continue;
+      }
+      os << "      if (absl::Status status = "
+         << MessageFieldTypeName(msg, msg_field)
+         << "::Readonly::ValidateAt(v, " << at
+         << "); !status.ok()) return status;\n";
+    } else if (field->IsArray()) {
+      auto array = std::static_pointer_cast<ArrayField>(field);
+      auto base = array->Base();
+      bool is_message = base->Type() == FieldType::kMessage && !IsEnum(base);
+      if (array->IsFixedSize()) {
+        // Only strings and messages in a fixed array refer to other data.
+        if (base->Type() == FieldType::kString) {
+          os << "      for (size_t i = 0; i < " << array->Size()
+             << "; i++) {\n";
+          os << "        if (absl::Status status = v.CheckString(" << at
+             << " + i * sizeof(toolbelt::BufferOffset), " << what
+             << "); !status.ok()) return status;\n";
+          os << "      }\n";
+        } else if (is_message) {
+          std::string type = MessageFieldTypeName(
+              msg, std::static_pointer_cast<MessageField>(base));
+          os << "      for (size_t i = 0; i < " << array->Size()
+             << "; i++) {\n";
+          os << "        if (absl::Status status = " << type
+             << "::Readonly::ValidateAt(v, " << at << " + i * " << type
+             << "::BinarySize()); !status.ok()) return status;\n";
+          os << "      }\n";
+        }
+      } else if (base->Type() == FieldType::kString) {
+        os << "      if (absl::Status status = v.CheckStringVector(" << at
+           << ", " << what << "); !status.ok()) return status;\n";
+      } else if (is_message) {
+        std::string type = MessageFieldTypeName(
+            msg, std::static_pointer_cast<MessageField>(base));
+        os << "      if (absl::Status status = v.CheckMessageVector<" << type
+           << "::Readonly>(" << at << ", " << what
+           << "); !status.ok()) return status;\n";
+      } else {
+        std::string type =
+            base->Type() == FieldType::kMessage
+                ? EnumCType(
+                      *std::static_pointer_cast<MessageField>(base)->Msg())
+                : FieldCType(base->Type());
+        os << "      if (absl::StatusOr<toolbelt::VectorHeader> vec = "
+              "v.CheckVector("
+           << at << ", sizeof(" << type << "), " << what
+           << "); !vec.ok()) return vec.status();\n";
+      }
+    } else if (field->Type() == FieldType::kString) {
+      os << "      if (absl::Status status = v.CheckString(" << at << ", "
+         << what << "); !status.ok()) return status;\n";
+    }
+  }
+  os << "      return absl::OkStatus();\n";
+  os << "    }\n";
+
+  // The offsets follow the same layout as the field initializers.
+  os << "\n  private:\n";
+  for (size_t i = 0; i < fields.size(); i++) {
+    os << "    static constexpr size_t "
+       << SanitizeFieldName(fields[i]->Name()) << "_offset_ = ";
+    if (i == 0) {
+      os << "0;\n";
+      continue;
+    }
+    auto prev = fields[i - 1];
+    os << "neutron::zeros::AlignedOffset<"
+       << FieldAlignmentType(ResolveField(fields[i])) << ">("
+       << SanitizeFieldName(prev->Name()) << "_offset_ + "
+       << FieldBinarySize(msg, prev) << ");\n";
+  }
+  os << "  };\n\n";
+  return absl::OkStatus();
+}
+
 absl::Status Generator::GenerateStructStreamer(const Message &msg,
                                                std::ostream &os) {
   os << "inline std::ostream& operator<<(std::ostream& os, const " << msg.Name()
@@ -855,6 +1013,16 @@ absl::Status Generator::GenerateDeserializer(const Message &msg,
           os << "    if (absl::Status status = buffer.Read(size); "
                 "!status.ok()) "
                 "return status;\n";
+          // The size comes from the wire so check it before making the
+          // elements that are read into.  Every element takes at least a
+          // byte unless the message has no fields.
+          int min_size = msg_field->Msg()->IsEnum()
+                             ? msg_field->Msg()->EnumSize()
+                             : (msg_field->Msg()->Fields().empty() ? 0 : 1);
+          os << "    if (absl::Status status = buffer.CheckLength(size, "
+             << min_size << "); !status.ok()) return status;\n";
+          os << "    this->" << SanitizeFieldName(field->Name())
+             << ".resize(size);\n";
         }
         os << "    for (int32_t i = 0; i < size; i++) {\n";
         if (msg_field->Msg()->IsEnum()) {
@@ -900,7 +1068,7 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
     if (field->Type() == FieldType::kMessage) {
       auto msg_field = std::static_pointer_cast<MessageField>(field);
       if (msg_field->Msg()->IsEnum()) {
-        os << "  length += " << EnumCSize(*msg_field->Msg()) << ";\n";
+        os << "  length += " << msg_field->Msg()->EnumSize() << ";\n";
       } else {
         os << "  length += this->" << SanitizeFieldName(field->Name())
            << ".SerializedSize();\n";
@@ -912,7 +1080,7 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
         if (msg_field->Msg()->IsEnum()) {
           os << "  length += " << (array->IsFixedSize() ? 0 : 4) << " + this->"
              << SanitizeFieldName(field->Name()) << ".size() * "
-             << EnumCSize(*msg_field->Msg()) << ";\n";
+             << msg_field->Msg()->EnumSize() << ";\n";
         } else {
 
           if (!array->IsFixedSize()) {
@@ -955,6 +1123,11 @@ absl::Status Generator::GenerateLength(const Message &msg, std::ostream &os) {
 }
 
 absl::Status Generator::GenerateCreators(const Message &msg, std::ostream &os) {
+  // The handle shared by the tree of a created message.
+  std::string handle = single_thread_buffers_
+                           ? "neutron::zeros::BufferHandle(pb, "
+                             "neutron::zeros::BufferHandle::kSingleThread)"
+                           : "neutron::zeros::BufferHandle(pb)";
   os << "// Create a mutable message in the given memory.\n";
   os << "[[maybe_unused]] static " << msg.Name()
      << " CreateMutable(void *addr, size_t size) {\n"
@@ -963,7 +1136,7 @@ absl::Status Generator::GenerateCreators(const Message &msg, std::ostream &os) {
         "  ::toolbelt::PayloadBuffer::AllocateMainMessage(&pb, "
      << msg.Name() << "::BinarySize());\n"
      << "  return " << msg.Name()
-     << "(std::make_shared<toolbelt::PayloadBuffer *>(pb), pb->message);\n"
+     << "(" << handle << ", pb->message);\n"
         "}\n\n";
 
   os << "// Create a readonly message that already exists at the given "
@@ -974,7 +1147,25 @@ absl::Status Generator::GenerateCreators(const Message &msg, std::ostream &os) {
         "reinterpret_cast<::toolbelt::PayloadBuffer "
         "*>(const_cast<void*>(addr));\n"
      << "  return " << msg.Name()
-     << "(std::make_shared<toolbelt::PayloadBuffer *>(pb), pb->message);\n"
+     << "(" << handle << ", pb->message);\n"
+        "}\n\n";
+
+  os << "// Create a read-only view of a message that already exists at the "
+        "given address.  The memory must not move while the view is in use.\n";
+  os << "[[maybe_unused]] static Readonly CreateReadonlyView(const void *addr, "
+        "size_t size) {\n"
+        "  return Readonly(addr);\n"
+        "}\n\n";
+
+  os << "// Check that the offsets and lengths in a message received in a "
+        "buffer\n// are inside the buffer.  The message can then be read "
+        "without checks.\n";
+  os << "[[maybe_unused]] static absl::Status Validate(const void *addr, "
+        "size_t size) {\n"
+        "  neutron::zeros::BufferValidator v(addr, size);\n"
+        "  absl::StatusOr<size_t> offset = v.MainMessage();\n"
+        "  if (!offset.ok()) return offset.status();\n"
+        "  return Readonly::ValidateAt(v, *offset);\n"
         "}\n\n";
 
   os << "// Create a message in a dynamically resized buffer allocated from "
@@ -993,7 +1184,7 @@ absl::Status Generator::GenerateCreators(const Message &msg, std::ostream &os) {
         "  ::toolbelt::PayloadBuffer::AllocateMainMessage(&pb, "
      << msg.Name() << "::BinarySize());\n"
      << "  return " << msg.Name()
-     << "(std::make_shared<toolbelt::PayloadBuffer *>(pb), pb->message);\n"
+     << "(" << handle << ", pb->message);\n"
         "}\n\n";
 
   os << "[[maybe_unused]] static " << msg.Name()
@@ -9,11 +9,13 @@ namespace neutron::zeros {
 class Generator : public neutron::Generator {
  public:
   Generator(std::filesystem::path root, std::string runtime_path,
-            std::string msg_path, std::string ns)
+            std::string msg_path, std::string ns,
+            bool single_thread_buffers = false)
       : root_(std::move(root)),
         runtime_path_(std::move(runtime_path)),
         msg_path_(std::move(msg_path)),
-        namespace_(std::move(ns)) {}
+        namespace_(std::move(ns)),
+        single_thread_buffers_(single_thread_buffers) {}
 
   absl::Status Generate(const Message& msg) override;
 
@@ -29,6 +31,8 @@ class Generator : public neutron::Generator {
   absl::Status GenerateNonEmbeddedConstructor(const Message& msg,
                                               std::ostream& os);
   absl::Status GenerateBinarySize(const Message& msg, std::ostream& os);
+  absl::Status GenerateReadonly(const Message& msg, std::ostream& os);
+  absl::Status GenerateSerdesConverters(const Message& msg, std::ostream& os);
   absl::Status GenerateStructStreamer(const Message& msg, std::ostream& os);
   absl::Status GenerateEnumStreamer(const Message& msg, std::ostream& os);
 
@@ -43,10 +47,13 @@ class Generator : public neutron::Generator {
   std::string Namespace(bool prefix_colon_colon);
   std::string MessageFieldTypeName(const Message& msg,
                                    std::shared_ptr<MessageField> field);
+  std::string FieldBinarySize(const Message& msg,
+                              std::shared_ptr<Field> field);
   std::filesystem::path root_;
   std::string runtime_path_;
   std::string msg_path_;
   std::string namespace_;
+  bool single_thread_buffers_;
 };
 
 }  // namespace neutron::zeros
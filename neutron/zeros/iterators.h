@@ -4,6 +4,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <cstddef>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -174,4 +177,56 @@ struct EnumFieldIterator {
   bool reverse;
 };
 
+// Iterator over MessageVectorField and StringVectorField, whose elements
+// are made when they are reached rather than kept in the field.  The
+// element is held in the iterator, so a reference to it is good until the
+// iterator moves.  That is why it is only an input iterator even though it
+// can step both ways.
+template <typename Field, typename Element>
+struct ElementIterator {
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::remove_const_t<Element>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Element *;
+  using reference = Element &;
+
+  ElementIterator(const Field *f, ptrdiff_t i, bool r = false)
+      : field(f), index(i), reverse(r) {}
+
+  ElementIterator &operator++() {
+    index += reverse ? -1 : 1;
+    return *this;
+  }
+  ElementIterator operator++(int) {
+    ElementIterator it(field, index, reverse);
+    ++*this;
+    return it;
+  }
+  ElementIterator &operator--() {
+    index += reverse ? 1 : -1;
+    return *this;
+  }
+  ElementIterator operator+(size_t i) const {
+    return ElementIterator(field, reverse ? index - i : index + i, reverse);
+  }
+  ElementIterator operator-(size_t i) const {
+    return ElementIterator(field, reverse ? index + i : index - i, reverse);
+  }
+  Element &operator*() const {
+    element.emplace(field->ElementAt(index));
+    return *element;
+  }
+  Element *operator->() const { return &**this; }
+
+  bool operator==(const ElementIterator &it) const {
+    return field == it.field && index == it.index;
+  }
+  bool operator!=(const ElementIterator &it) const { return !operator==(it); }
+
+  const Field *field;
+  ptrdiff_t index;
+  bool reverse;
+  mutable std::optional<std::remove_const_t<Element>> element;
+};
+
 }  // namespace neutron::zeros
@@ -2,14 +2,15 @@
 
 #include "absl/status/statusor.h"
 #include "toolbelt/payload_buffer.h"
+#include <atomic>
 #include <memory>
 #include <stdint.h>
 
 namespace neutron::zeros {
 
 // Payload buffers can move. All messages in a message tree must all use the
-// same payload buffer. We hold a shared pointer to a pointer to the payload
-// buffer.
+// same payload buffer. We hold a BufferHandle, which is a reference counted
+// pointer to a pointer to the payload buffer.
 //
 //            +-------+
 //            |       |
@@ -38,17 +39,144 @@ namespace neutron::zeros {
 // |               +------+      |             |
 // +---------------+             +-------------+
 
+// Reference counted handle to the pointer to the toolbelt::PayloadBuffer
+// shared by a message tree.  It is copied into every message and
+// non-embedded field in the tree and keeps the count in a single intrusive
+// block rather than a std::shared_ptr control block.
+//
+// By default the count is atomic, like std::shared_ptr, so copies of a
+// tree can be made and destroyed on different threads.  A tree created
+// with kSingleThread (the generator's --single_thread_buffers flag) updates
+// the count without atomic instructions, which is cheaper when a tree has
+// many fields; it must then only be copied or destroyed on one thread at a
+// time.  Copies share the sharing mode of the handle they were made from.
+// Use the Readonly view (readonly.h) for a message that is only read,
+// which borrows the buffer without a count at all.
+class BufferHandle {
+public:
+  enum Sharing {
+    kThreadSafe,   // Atomic count.
+    kSingleThread, // Plain count; the tree stays on one thread at a time.
+  };
+
+  BufferHandle() = default;
+
+  // A new handle holding the pointer to pb.
+  explicit BufferHandle(toolbelt::PayloadBuffer *pb,
+                        Sharing sharing = kThreadSafe)
+      : rep_(new Rep) {
+    rep_->pb = pb;
+    rep_->sharing = sharing;
+    cell_ = &rep_->pb;
+  }
+
+  // A handle sharing the pointer held by a std::shared_ptr, which is kept
+  // alive as long as the handle.
+  BufferHandle(std::shared_ptr<toolbelt::PayloadBuffer *> pb) {
+    if (pb != nullptr) {
+      rep_ = new Rep;
+      cell_ = pb.get();
+      rep_->owner = std::move(pb);
+    }
+  }
+
+  BufferHandle(const BufferHandle &h) : rep_(h.rep_), cell_(h.cell_) {
+    Retain(rep_);
+  }
+
+  BufferHandle(BufferHandle &&h) : rep_(h.rep_), cell_(h.cell_) {
+    h.rep_ = nullptr;
+    h.cell_ = nullptr;
+  }
+
+  ~BufferHandle() { Release(); }
+
+  BufferHandle &operator=(const BufferHandle &h) {
+    Retain(h.rep_);
+    Release();
+    rep_ = h.rep_;
+    cell_ = h.cell_;
+    return *this;
+  }
+
+  BufferHandle &operator=(BufferHandle &&h) {
+    if (this != &h) {
+      Release();
+      rep_ = h.rep_;
+      cell_ = h.cell_;
+      h.rep_ = nullptr;
+      h.cell_ = nullptr;
+    }
+    return *this;
+  }
+
+  toolbelt::PayloadBuffer **get() const { return cell_; }
+  toolbelt::PayloadBuffer *&operator*() const { return *cell_; }
+
+  explicit operator bool() const { return cell_ != nullptr; }
+  bool operator==(const BufferHandle &h) const { return cell_ == h.cell_; }
+  bool operator!=(const BufferHandle &h) const { return cell_ != h.cell_; }
+
+  size_t use_count() const {
+    return rep_ == nullptr ? 0 : rep_->refs.load(std::memory_order_relaxed);
+  }
+
+  Sharing sharing() const {
+    return rep_ == nullptr ? kThreadSafe : rep_->sharing;
+  }
+
+private:
+  struct Rep {
+    toolbelt::PayloadBuffer *pb = nullptr;
+    std::atomic<size_t> refs = 1;
+    Sharing sharing = kThreadSafe;
+    std::shared_ptr<toolbelt::PayloadBuffer *> owner;
+  };
+
+  // A single thread count is still a std::atomic but is updated with a
+  // relaxed load and store, which compile to plain moves.
+  static void Retain(Rep *rep) {
+    if (rep == nullptr) {
+      return;
+    }
+    if (rep->sharing == kSingleThread) {
+      rep->refs.store(rep->refs.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    } else {
+      rep->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void Release() {
+    if (rep_ == nullptr) {
+      return;
+    }
+    size_t refs;
+    if (rep_->sharing == kSingleThread) {
+      refs = rep_->refs.load(std::memory_order_relaxed);
+      rep_->refs.store(refs - 1, std::memory_order_relaxed);
+    } else {
+      refs = rep_->refs.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    if (refs == 1) {
+      delete rep_;
+    }
+  }
+
+  Rep *rep_ = nullptr;
+  toolbelt::PayloadBuffer **cell_ = nullptr;
+};
+
 struct Message {
   Message() = default;
-  Message(std::shared_ptr<toolbelt::PayloadBuffer *> pb,
-          toolbelt::BufferOffset start)
-      : buffer(pb), absolute_binary_offset(start) {}
-  std::shared_ptr<toolbelt::PayloadBuffer *> buffer;
+  Message(BufferHandle pb, toolbelt::BufferOffset start)
+      : buffer(std::move(pb)), absolute_binary_offset(start) {}
+  BufferHandle buffer;
   toolbelt::BufferOffset absolute_binary_offset;
 
   // 'field' is the offset from the start of the message to the field (positive)
   // Subtract the field offset from the field to get the address of the
-  // std::shared_ptr to the pointer to the toolbelt::PayloadBuffer.
+  // BufferHandle for the pointer to the toolbelt::PayloadBuffer.
   static toolbelt::PayloadBuffer *GetBuffer(const void *field,
                                             uint32_t offset) {
     const Message *msg = reinterpret_cast<const Message *>(
@@ -63,8 +191,7 @@ struct Message {
     return msg->buffer.get();
   }
 
-  static std::shared_ptr<toolbelt::PayloadBuffer *>
-  GetSharedBuffer(void *field, uint32_t offset) {
+  static BufferHandle GetSharedBuffer(void *field, uint32_t offset) {
         const Message *msg = reinterpret_cast<const Message *>(
         reinterpret_cast<const char *>(field) - offset);
     return msg->buffer;
@@ -22,7 +22,7 @@ struct InnerMessage : public Message {
       : str(offsetof(InnerMessage, str), 0),
         f(offsetof(InnerMessage, f),
           neutron::zeros::AlignedOffset<uint64_t>(str.BinaryEndOffset())) {}
-  explicit InnerMessage(std::shared_ptr<toolbelt::PayloadBuffer *> buffer)
+  explicit InnerMessage(neutron::zeros::BufferHandle buffer)
       : str(offsetof(InnerMessage, str), 0),
         f(offsetof(InnerMessage, f),
           neutron::zeros::AlignedOffset<uint64_t>(str.BinaryEndOffset())) {
@@ -32,7 +32,7 @@ struct InnerMessage : public Message {
     std::cout << "InnerMessage start: " << std::hex
               << this->absolute_binary_offset << std::dec << std::endl;
   }
-  InnerMessage(std::shared_ptr<toolbelt::PayloadBuffer *> buffer, toolbelt::BufferOffset offset)
+  InnerMessage(neutron::zeros::BufferHandle buffer, toolbelt::BufferOffset offset)
       : Message(buffer, offset),
         str(offsetof(InnerMessage, str), 0),
         f(offsetof(InnerMessage, f),
@@ -43,7 +43,7 @@ struct InnerMessage : public Message {
 };
 
 struct TestMessage : public Message {
-  TestMessage(std::shared_ptr<toolbelt::PayloadBuffer *> buffer, toolbelt::BufferOffset offset)
+  TestMessage(neutron::zeros::BufferHandle buffer, toolbelt::BufferOffset offset)
       : Message(buffer, offset),
         x(offsetof(TestMessage, x), 0),
         y(offsetof(TestMessage, y),
@@ -524,8 +524,8 @@ TEST(MessageTest, BasicMessageVector) {
   toolbelt::Hexdump(pb, pb->hwm);
 
   ASSERT_EQ(1, msg.mvec.size());
-  InnerMessage &mv = msg.mvec[0];
-  ASSERT_EQ(0xffee, uint64_t(mv.f));
+  auto mv = msg.mvec[0];
+  ASSERT_EQ(0xffee, uint64_t(mv->f));
   free(buffer);
 }
 
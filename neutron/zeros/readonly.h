@@ -0,0 +1,402 @@
+#pragma once
+
+// Read-only views of zeros messages.
+//
+// The fields of a zeros message find their binary data through the
+// enclosing Message, its shared toolbelt::PayloadBuffer pointer and the
+// buffer itself on every access, since a mutable buffer can be moved by an
+// allocation.  A message that is only read, such as one received in shared
+// memory, can't move, so the generated Readonly view of a message resolves
+// the address of the binary message once and reads each field as a load
+// from that address plus a constant offset.
+//
+// The memory holding the message must stay where it is for as long as the
+// view, or anything obtained from it, is used.
+//
+// The views trust the offsets in the buffer.  A buffer from another
+// process can be checked once with the generated Validate function, which
+// walks the message and everything it refers to using a BufferValidator.
+
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "neutron/common_runtime.h"
+#include "toolbelt/payload_buffer.h"
+
+namespace neutron::zeros {
+
+// Reads the string whose toolbelt::StringHeader is at the given address.
+// The header holds the offset of the string data in the buffer, which is
+// a 4 byte length followed by the characters.
+inline std::string_view ReadonlyString(const char *buffer, const char *hdr) {
+  toolbelt::BufferOffset offset;
+  memcpy(&offset, hdr, sizeof(offset));
+  if (offset == 0) {
+    return {};
+  }
+  uint32_t length;
+  memcpy(&length, buffer + offset, sizeof(length));
+  return std::string_view(buffer + offset + sizeof(length), length);
+}
+
+// A fixed array or vector of primitives or enums in the binary message.
+template <typename T> class ReadonlySpan {
+public:
+  ReadonlySpan() = default;
+  ReadonlySpan(const T *data, size_t size) : data_(data), size_(size) {}
+
+  using value_type = T;
+  using const_iterator = const T *;
+  using iterator = const_iterator;
+
+  const T &operator[](size_t index) const { return data_[index]; }
+  const T &front() const { return data_[0]; }
+  const T &back() const { return data_[size_ - 1]; }
+
+  const T *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// A fixed array or vector of strings.  An array holds the string headers
+// inline.  A vector holds the offsets of the string headers.
+class ReadonlyStringSpan {
+public:
+  ReadonlyStringSpan() = default;
+  ReadonlyStringSpan(const char *buffer, const char *data, size_t size,
+                     bool indirect)
+      : buffer_(buffer), data_(data), size_(size), indirect_(indirect) {}
+
+  std::string_view operator[](size_t index) const {
+    const char *hdr = data_ + index * sizeof(toolbelt::BufferOffset);
+    if (indirect_) {
+      toolbelt::BufferOffset offset;
+      memcpy(&offset, hdr, sizeof(offset));
+      hdr = buffer_ + offset;
+    }
+    return ReadonlyString(buffer_, hdr);
+  }
+  std::string_view front() const { return (*this)[0]; }
+  std::string_view back() const { return (*this)[size_ - 1]; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  struct const_iterator {
+    std::string_view operator*() const { return (*span)[index]; }
+    const_iterator &operator++() {
+      index++;
+      return *this;
+    }
+    bool operator==(const const_iterator &it) const {
+      return index == it.index;
+    }
+    bool operator!=(const const_iterator &it) const { return !(*this == it); }
+
+    const ReadonlyStringSpan *span;
+    size_t index;
+  };
+  using iterator = const_iterator;
+
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, size_}; }
+
+private:
+  const char *buffer_ = nullptr;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool indirect_ = false;
+};
+
+// A fixed array or vector of messages, each seen through its Readonly view
+// V.  An array holds the messages inline, one after the other.  A vector
+// holds the offsets of the messages.
+template <typename V> class ReadonlyMessageSpan {
+public:
+  ReadonlyMessageSpan() = default;
+  ReadonlyMessageSpan(const char *buffer, const char *data, size_t size,
+                      bool indirect)
+      : buffer_(buffer), data_(data), size_(size), indirect_(indirect) {}
+
+  V operator[](size_t index) const {
+    if (indirect_) {
+      toolbelt::BufferOffset offset;
+      memcpy(&offset, data_ + index * sizeof(offset), sizeof(offset));
+      return V(buffer_, buffer_ + offset);
+    }
+    return V(buffer_, data_ + index * V::BinarySize());
+  }
+  V front() const { return (*this)[0]; }
+  V back() const { return (*this)[size_ - 1]; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  struct const_iterator {
+    V operator*() const { return (*span)[index]; }
+    const_iterator &operator++() {
+      index++;
+      return *this;
+    }
+    bool operator==(const const_iterator &it) const {
+      return index == it.index;
+    }
+    bool operator!=(const const_iterator &it) const { return !(*this == it); }
+
+    const ReadonlyMessageSpan *span;
+    size_t index;
+  };
+  using iterator = const_iterator;
+
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, size_}; }
+
+private:
+  const char *buffer_ = nullptr;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool indirect_ = false;
+};
+
+// Base class for the generated Readonly views.  The generated accessors
+// read their fields at constant offsets from base_.
+class ReadonlyMessage {
+public:
+  ReadonlyMessage() = default;
+
+  // A view of the main message in the toolbelt::PayloadBuffer at addr.
+  explicit ReadonlyMessage(const void *addr)
+      : buffer_(reinterpret_cast<const char *>(addr)),
+        base_(buffer_ +
+              reinterpret_cast<const toolbelt::PayloadBuffer *>(addr)->message) {
+  }
+
+  // A view of a message at the address base in the buffer.
+  ReadonlyMessage(const char *buffer, const char *base)
+      : buffer_(buffer), base_(base) {}
+
+  // Address of the binary message.
+  const char *Data() const { return base_; }
+
+protected:
+  template <typename T> T Load(size_t offset) const {
+    T v;
+    memcpy(&v, base_ + offset, sizeof(T));
+    return v;
+  }
+
+  std::string_view LoadString(size_t offset) const {
+    return ReadonlyString(buffer_, base_ + offset);
+  }
+
+  template <typename T> ReadonlySpan<T> LoadArray(size_t offset, size_t n) const {
+    return ReadonlySpan<T>(reinterpret_cast<const T *>(base_ + offset), n);
+  }
+
+  template <typename T> ReadonlySpan<T> LoadVector(size_t offset) const {
+    toolbelt::VectorHeader hdr = Load<toolbelt::VectorHeader>(offset);
+    return ReadonlySpan<T>(reinterpret_cast<const T *>(buffer_ + hdr.data),
+                           hdr.num_elements);
+  }
+
+  ReadonlyStringSpan LoadStringArray(size_t offset, size_t n) const {
+    return ReadonlyStringSpan(buffer_, base_ + offset, n, false);
+  }
+
+  ReadonlyStringSpan LoadStringVector(size_t offset) const {
+    toolbelt::VectorHeader hdr = Load<toolbelt::VectorHeader>(offset);
+    return ReadonlyStringSpan(buffer_, buffer_ + hdr.data, hdr.num_elements,
+                              true);
+  }
+
+  template <typename V> V LoadMessage(size_t offset) const {
+    return V(buffer_, base_ + offset);
+  }
+
+  template <typename V>
+  ReadonlyMessageSpan<V> LoadMessageArray(size_t offset, size_t n) const {
+    return ReadonlyMessageSpan<V>(buffer_, base_ + offset, n, false);
+  }
+
+  template <typename V>
+  ReadonlyMessageSpan<V> LoadMessageVector(size_t offset) const {
+    toolbelt::VectorHeader hdr = Load<toolbelt::VectorHeader>(offset);
+    return ReadonlyMessageSpan<V>(buffer_, buffer_ + hdr.data,
+                                  hdr.num_elements, true);
+  }
+
+  const char *buffer_ = nullptr;
+  const char *base_ = nullptr;
+};
+
+// Checks the offsets and lengths in a toolbelt::PayloadBuffer of a given
+// size.  The generated Readonly::ValidateAt functions use it to check each
+// string, vector and message in a message tree.
+//
+// Strings, vector data and the messages in vectors are separate
+// allocations in a well formed buffer, so their sizes add up to no more
+// than the buffer size.  The validator counts them and fails if they add
+// up to more.  Offsets that point at the same data more than once would
+// otherwise make the checks take time exponential in the nesting depth.
+class BufferValidator {
+public:
+  BufferValidator(const void *addr, size_t size)
+      : buffer_(reinterpret_cast<const char *>(addr)), size_(size) {}
+
+  // Offset of the main message in the buffer.
+  absl::StatusOr<size_t> MainMessage() const {
+    if (size_ < sizeof(toolbelt::PayloadBuffer)) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Buffer size %d is too small for a PayloadBuffer", size_));
+    }
+    return size_t(
+        reinterpret_cast<const toolbelt::PayloadBuffer *>(buffer_)->message);
+  }
+
+  // Checks that length bytes at offset are inside the buffer.
+  absl::Status CheckRange(size_t offset, size_t length,
+                          const char *what) const {
+    if (offset > size_ || length > size_ - offset) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s at offset %d with size %d is outside the buffer of size %d",
+          what, offset, length, size_));
+    }
+    return absl::OkStatus();
+  }
+
+  // Checks the toolbelt::StringHeader at hdr and the string it refers to.
+  absl::Status CheckString(size_t hdr, const char *what) const {
+    if (absl::Status status =
+            CheckRange(hdr, sizeof(toolbelt::BufferOffset), what);
+        !status.ok()) {
+      return status;
+    }
+    toolbelt::BufferOffset offset = Load<toolbelt::BufferOffset>(hdr);
+    if (offset == 0) {
+      return absl::OkStatus();
+    }
+    if (absl::Status status = CheckRange(offset, sizeof(uint32_t), what);
+        !status.ok()) {
+      return status;
+    }
+    uint32_t length = Load<uint32_t>(offset);
+    if (absl::Status status =
+            CheckRange(offset + sizeof(uint32_t), length, what);
+        !status.ok()) {
+      return status;
+    }
+    return Charge(sizeof(uint32_t) + length, what);
+  }
+
+  // Checks the toolbelt::VectorHeader at hdr and the elements it refers to.
+  absl::StatusOr<toolbelt::VectorHeader>
+  CheckVector(size_t hdr, size_t element_size, const char *what) const {
+    if (absl::Status status =
+            CheckRange(hdr, sizeof(toolbelt::VectorHeader), what);
+        !status.ok()) {
+      return status;
+    }
+    toolbelt::VectorHeader vec = Load<toolbelt::VectorHeader>(hdr);
+    if (vec.num_elements == 0) {
+      return vec;
+    }
+    if (vec.data == 0) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("%s has %d elements but no data", what,
+                          vec.num_elements));
+    }
+    size_t length = size_t(vec.num_elements) * element_size;
+    if (absl::Status status = CheckRange(vec.data, length, what);
+        !status.ok()) {
+      return status;
+    }
+    if (absl::Status status = Charge(length, what); !status.ok()) {
+      return status;
+    }
+    return vec;
+  }
+
+  // Checks a vector of strings.  The vector holds the offsets of the
+  // string headers.
+  absl::Status CheckStringVector(size_t hdr, const char *what) const {
+    absl::StatusOr<toolbelt::VectorHeader> vec =
+        CheckVector(hdr, sizeof(toolbelt::BufferOffset), what);
+    if (!vec.ok()) {
+      return vec.status();
+    }
+    for (uint32_t i = 0; i < vec->num_elements; i++) {
+      toolbelt::BufferOffset offset = Load<toolbelt::BufferOffset>(
+          vec->data + i * sizeof(toolbelt::BufferOffset));
+      if (offset == 0) {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "Invalid string vector entry in %s at index %d", what, i));
+      }
+      if (absl::Status status = CheckString(offset, what); !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Checks a vector of messages, each of which is checked by the Readonly
+  // view V.  The vector holds the offsets of the messages.
+  template <typename V>
+  absl::Status CheckMessageVector(size_t hdr, const char *what) const {
+    absl::StatusOr<toolbelt::VectorHeader> vec =
+        CheckVector(hdr, sizeof(toolbelt::BufferOffset), what);
+    if (!vec.ok()) {
+      return vec.status();
+    }
+    for (uint32_t i = 0; i < vec->num_elements; i++) {
+      toolbelt::BufferOffset offset = Load<toolbelt::BufferOffset>(
+          vec->data + i * sizeof(toolbelt::BufferOffset));
+      if (offset == 0) {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "Invalid message vector entry in %s at index %d", what, i));
+      }
+      if (absl::Status status = Charge(V::BinarySize(), what);
+          !status.ok()) {
+        return status;
+      }
+      if (absl::Status status = V::ValidateAt(*this, offset); !status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+private:
+  template <typename T> T Load(size_t offset) const {
+    T v;
+    memcpy(&v, buffer_ + offset, sizeof(T));
+    return v;
+  }
+
+  // Counts n more bytes of checked data.
+  absl::Status Charge(size_t n, const char *what) const {
+    if (n > size_ - checked_) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s: the data checked is more than the buffer size %d, so offsets "
+          "in the buffer are shared",
+          what, size_));
+    }
+    checked_ += n;
+    return absl::OkStatus();
+  }
+
+  const char *buffer_;
+  size_t size_;
+  mutable size_t checked_ = 0;
+};
+
+}  // namespace neutron::zeros
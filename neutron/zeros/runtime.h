@@ -1,8 +1,10 @@
 #pragma once
 
 #include "neutron/zeros/arrays.h"
+#include "neutron/zeros/convert.h"
 #include "neutron/zeros/fields.h"
 #include "neutron/zeros/iterators.h"
+#include "neutron/zeros/readonly.h"
 #include "neutron/zeros/vectors.h"
 
 namespace neutron::zeros {
@@ -270,7 +272,7 @@ inline std::ostream &operator<<(std::ostream &os,
 
 inline std::ostream &operator<<(std::ostream &os,
                                 const StringVectorField &field) {
-  for (auto &v : field.Get()) {
+  for (auto &v : field) {
     os << v << std::endl;
   }
   return os;
@@ -279,7 +281,7 @@ inline std::ostream &operator<<(std::ostream &os,
 template <typename T>
 inline std::ostream &operator<<(std::ostream &os,
                                 const MessageVectorField<T> &field) {
-  for (auto &v : field.Get()) {
+  for (auto &v : field) {
     os << v << std::endl;
   }
   return os;
@@ -68,10 +68,10 @@ namespace neutron::zeros {
         this, BaseOffset() + NumElements() * sizeof(value_type), true);        \
   }
 
+// Iterators for vectors whose elements are made on demand by ElementAt.
+// ftype: field type
 // vtype: value type
-// rtype: relay type (like std::array<T,N>)
-// relay: member to relay through
-#define DECLARE_VECTOR_ARRAY_BITS(vtype, rtype, relay)                         \
+#define DECLARE_ELEMENT_VECTOR_BITS(ftype, vtype)                              \
   using value_type = vtype;                                                    \
   using reference = value_type &;                                              \
   using const_reference = value_type &;                                        \
@@ -80,23 +80,21 @@ namespace neutron::zeros {
   using size_type = size_t;                                                    \
   using difference_type = ptrdiff_t;                                           \
                                                                                \
-  using iterator = typename rtype::iterator;                                   \
-  using const_iterator = typename rtype::const_iterator;                       \
-  using reverse_iterator = typename rtype::reverse_iterator;                   \
-  using const_reverse_iterator = typename rtype::const_reverse_iterator;       \
+  using iterator = ElementIterator<ftype, value_type>;                         \
+  using const_iterator = iterator;                                             \
+  using reverse_iterator = iterator;                                           \
+  using const_reverse_iterator = iterator;                                     \
                                                                                \
-  iterator begin() { return relay.begin(); }                                   \
-  iterator end() { return relay.end(); }                                       \
-  reverse_iterator rbegin() { return relay.rbegin(); }                         \
-  reverse_iterator rend() { return relay.rend(); }                             \
-  const_iterator begin() const { return relay.begin(); }                       \
-  const_iterator end() const { return relay.end(); }                           \
-  const_iterator cbegin() const { return relay.begin(); }                      \
-  const_iterator cend() const { return relay.end(); }                          \
-  const_reverse_iterator rbegin() const { return relay.rbegin(); }             \
-  const_reverse_iterator rend() const { return relay.rend(); }                 \
-  const_reverse_iterator crbegin() const { return relay.crbegin(); }           \
-  const_reverse_iterator crend() const { return relay.crend(); }
+  iterator begin() const { return iterator(this, 0); }                         \
+  iterator end() const { return iterator(this, size()); }                      \
+  iterator cbegin() const { return begin(); }                                  \
+  iterator cend() const { return end(); }                                      \
+  iterator rbegin() const {                                                    \
+    return iterator(this, ptrdiff_t(size()) - 1, true);                        \
+  }                                                                            \
+  iterator rend() const { return iterator(this, -1, true); }                   \
+  iterator crbegin() const { return rbegin(); }                                \
+  iterator crend() const { return rend(); }
 
 // This is a variable length vector of T.  It looks like a std::vector<T>.
 // The binary message contains a toolbelt::VectorHeader at the binary offset.
@@ -275,7 +273,7 @@ public:
   void clear() { Header()->num_elements = 0; }
 
   size_t size() const { return Header()->num_elements; }
-  Enum *data() const { GetBuffer()->template ToAddress<Enum>(BaseOffset()); }
+  Enum *data() const { return GetBuffer()->template ToAddress<Enum>(BaseOffset()); }
   bool empty() const { return size() == 0; }
 
   size_t capacity() const {
@@ -340,51 +338,30 @@ private:
 };
 
 // The vector contains a set of toolbelt::BufferOffsets allocated in the buffer,
-// each of which contains the absolute offset of the message.
+// each of which contains the absolute offset of the message.  The
+// MessageFields referring to the messages are made when they are accessed so
+// creating the field doesn't depend on the number of elements.
 template <typename T> class MessageVectorField {
 public:
   MessageVectorField() = default;
   explicit MessageVectorField(uint32_t source_offset,
                               uint32_t relative_binary_offset)
       : source_offset_(source_offset),
-        relative_binary_offset_(relative_binary_offset) {
-    // Populate the msgs vector with MessageField objects referring to the
-    // binary messages.
-    toolbelt::VectorHeader *hdr = Header();
-    toolbelt::BufferOffset *data =
-        GetBuffer()->template ToAddress<toolbelt::BufferOffset>(hdr->data);
-    for (uint32_t i = 0; i < hdr->num_elements; i++) {
-      if (data[i] == 0) {
-        // If the vector says there's a message at this index but
-        // the data is 0 it shows corruption in the binary message.
-        // TODO: How do we deal with this?
-        // abort for now
-        std::cerr << "Invalid message vector entry at index " << i << std::endl;
-        abort();
-      }
-      NonEmbeddedMessageField<T> field(GetSharedBuffer(), data[i]);
-      msgs_.push_back(std::move(field));
-    }
-  }
+        relative_binary_offset_(relative_binary_offset) {}
 
-  NonEmbeddedMessageField<T> &operator[](int index) { return msgs_[index]; }
+  NonEmbeddedMessageField<T> operator[](int index) const {
+    return ElementAt(index);
+  }
 
-  NonEmbeddedMessageField<T> &front() { return msgs_.front(); }
-  const NonEmbeddedMessageField<T> &front() const { return msgs_.front(); }
-  NonEmbeddedMessageField<T> &back() { return msgs_.back(); }
-  const NonEmbeddedMessageField<T> &back() const { return msgs_.back(); }
+  NonEmbeddedMessageField<T> front() const { return ElementAt(0); }
+  NonEmbeddedMessageField<T> back() const { return ElementAt(size() - 1); }
 
-#define RTYPE std::vector<NonEmbeddedMessageField<T>>
-  DECLARE_VECTOR_ARRAY_BITS(NonEmbeddedMessageField<T>, RTYPE, msgs_)
-#undef RTYPE
+  DECLARE_ELEMENT_VECTOR_BITS(MessageVectorField, NonEmbeddedMessageField<T>)
 
   void push_back(const T &v) {
     toolbelt::BufferOffset offset = v.absolute_binary_offset;
     toolbelt::PayloadBuffer::VectorPush<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), offset);
-    NonEmbeddedMessageField<T> field(GetSharedBuffer(), offset);
-    field.msg_ = v;
-    msgs_.push_back(std::move(field));
   }
 
   size_t capacity() const {
@@ -401,7 +378,6 @@ public:
   void reserve(size_t n) {
     toolbelt::PayloadBuffer::VectorReserve<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), n);
-    msgs_.reserve(n);
   }
 
   void resize(size_t n) {
@@ -411,27 +387,24 @@ public:
     // Resize the vector data in the binary.  This contains BufferOffets.
     toolbelt::PayloadBuffer::VectorResize<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), n);
-    msgs_.resize(n);
 
-    // If the size has increased, allocate messages for the new entries and set
-    // the offsets in the MessageFields in the source message.
+    // If the size has increased, allocate messages for the new entries and
+    // store their offsets in the vector.  The allocation can move the buffer
+    // so the vector data is looked up again each time.
     if (n > current_size) {
       for (uint32_t i = current_size; i < uint32_t(n); i++) {
         void *binary = toolbelt::PayloadBuffer::Allocate(
             GetBufferAddr(), T::BinarySize(), 8, true);
         toolbelt::BufferOffset absolute_binary_offset =
             GetBuffer()->ToOffset(binary);
-        auto &m = msgs_[i];
-        m.msg_.buffer = GetSharedBuffer();
-        m.msg_.absolute_binary_offset = absolute_binary_offset;
+        Data()[i] = absolute_binary_offset;
       }
     }
   }
 
   void clear() { Header()->num_elements = 0; }
 
-  size_t size() const { return Header()->num_elements; }
-  T *data() { GetBuffer()->template ToAddress<T>(BaseOffset()); }
+  size_t size() const { return NumElements(); }
   bool empty() const { return size() == 0; }
 
   toolbelt::BufferOffset BinaryEndOffset() const {
@@ -442,7 +415,17 @@ public:
   }
 
   bool operator==(const MessageVectorField<T> &other) const {
-    return msgs_ != other.msgs_;
+    if (size() != other.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < size(); i++) {
+      NonEmbeddedMessageField<T> a = ElementAt(i);
+      NonEmbeddedMessageField<T> b = other.ElementAt(i);
+      if (!(a.Get() == b.Get())) {
+        return false;
+      }
+    }
+    return true;
   }
   bool operator!=(const MessageVectorField<T> &other) const {
     return !(*this == other);
@@ -450,19 +433,37 @@ public:
 
   size_t SerializedSize() const {
     size_t n = 4;
-    for (auto &msg : msgs_) {
-      n += msg.SerializedSize();
+    for (size_t i = 0; i < size(); i++) {
+      n += ElementAt(i).SerializedSize();
     }
     return n;
   }
 
-  std::vector<NonEmbeddedMessageField<T>> &Get() { return msgs_; }
-
-  const std::vector<NonEmbeddedMessageField<T>> &Get() const { return msgs_; }
+  // Makes a field for every message in the vector.
+  std::vector<NonEmbeddedMessageField<T>> Get() const {
+    std::vector<NonEmbeddedMessageField<T>> msgs;
+    msgs.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+      msgs.push_back(ElementAt(i));
+    }
+    return msgs;
+  }
+
+  NonEmbeddedMessageField<T> ElementAt(size_t index) const {
+    toolbelt::BufferOffset offset = Data()[index];
+    if (offset == 0) {
+      // If the vector says there's a message at this index but
+      // the data is 0 it shows corruption in the binary message.
+      // TODO: How do we deal with this?
+      // abort for now
+      std::cerr << "Invalid message vector entry at index " << index
+                << std::endl;
+      abort();
+    }
+    return NonEmbeddedMessageField<T>(GetSharedBuffer(), offset);
+  }
 
 private:
-  friend FieldIterator<MessageVectorField, T>;
-  friend FieldIterator<MessageVectorField, const T>;
   toolbelt::VectorHeader *Header() const {
     return GetBuffer()->template ToAddress<toolbelt::VectorHeader>(
         Message::GetMessageBinaryStart(this, source_offset_) +
@@ -471,6 +472,11 @@ private:
 
   toolbelt::BufferOffset BaseOffset() const { return Header()->data; }
 
+  toolbelt::BufferOffset *Data() const {
+    return GetBuffer()->template ToAddress<toolbelt::BufferOffset>(
+        BaseOffset());
+  }
+
   size_t NumElements() const { return Header()->num_elements; }
 
   toolbelt::PayloadBuffer *GetBuffer() const {
@@ -484,13 +490,13 @@ private:
     return Message::GetMessageBinaryStart(this, source_offset_);
   }
 
-  std::shared_ptr<toolbelt::PayloadBuffer *> GetSharedBuffer() {
-    return Message::GetSharedBuffer(this, source_offset_);
+  BufferHandle GetSharedBuffer() const {
+    return Message::GetSharedBuffer(const_cast<MessageVectorField *>(this),
+                                    source_offset_);
   }
 
   uint32_t source_offset_;
   toolbelt::BufferOffset relative_binary_offset_;
-  std::vector<NonEmbeddedMessageField<T>> msgs_;
 };
 
 // This is a little more complex.  The binary vector contains a set of
@@ -514,42 +520,29 @@ public:
   explicit StringVectorField(uint32_t source_offset,
                              uint32_t relative_binary_offset)
       : source_offset_(source_offset),
-        relative_binary_offset_(relative_binary_offset) {
-    toolbelt::VectorHeader *hdr = Header();
-    toolbelt::BufferOffset *data =
-        GetBuffer()->ToAddress<toolbelt::BufferOffset>(hdr->data);
-    for (uint32_t i = 0; i < hdr->num_elements; i++) {
-      if (data[i] == 0) {
-        // If the vector says there's a string at this index but
-        // the data is 0 it shows corruption in the binary message.
-        // TODO: How do we deal with this?
-        // abort for now
-        std::cerr << "Invalid string vector entry at index " << i << std::endl;
-        abort();
-      }
-      NonEmbeddedStringField field(
-          Message::GetSharedBuffer(this, source_offset), data[i]);
-      strings_.push_back(std::move(field));
-    }
-  }
+        relative_binary_offset_(relative_binary_offset) {}
 
-  NonEmbeddedStringField &operator[](int index) { return strings_[index]; }
+  NonEmbeddedStringField operator[](int index) const {
+    return ElementAt(index);
+  }
 
-#define RTYPE std::vector<NonEmbeddedStringField>
-  DECLARE_VECTOR_ARRAY_BITS(NonEmbeddedStringField, RTYPE, strings_)
-#undef RTYPE
+  DECLARE_ELEMENT_VECTOR_BITS(StringVectorField, NonEmbeddedStringField)
 
-  size_t size() const { return strings_.size(); }
-  NonEmbeddedStringField *data() { return strings_.data(); }
+  size_t size() const { return Header()->num_elements; }
   bool empty() const { return size() == 0; }
 
-  NonEmbeddedStringField &front() { return strings_.front(); }
-  const NonEmbeddedStringField &front() const { return strings_.front(); }
-  NonEmbeddedStringField &back() { return strings_.back(); }
-  const NonEmbeddedStringField &back() const { return strings_.back(); }
+  NonEmbeddedStringField front() const { return ElementAt(0); }
+  NonEmbeddedStringField back() const { return ElementAt(size() - 1); }
 
-  std::vector<NonEmbeddedStringField> &Get() { return strings_; }
-  const std::vector<NonEmbeddedStringField> &Get() const { return strings_; }
+  // Makes a field for every string in the vector.
+  std::vector<NonEmbeddedStringField> Get() const {
+    std::vector<NonEmbeddedStringField> strings;
+    strings.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+      strings.push_back(ElementAt(i));
+    }
+    return strings;
+  }
 
   void push_back(const std::string &s) {
     // Allocate string header in buffer.
@@ -561,11 +554,6 @@ public:
     // Add an offset for the new string to the binary.
     toolbelt::PayloadBuffer::VectorPush<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), hdr_offset);
-
-    // Add a source string field.
-    NonEmbeddedStringField field(Message::GetSharedBuffer(this, source_offset_),
-                                 hdr_offset);
-    strings_.push_back(std::move(field));
   }
 
   size_t capacity() const {
@@ -582,7 +570,6 @@ public:
   void reserve(size_t n) {
     toolbelt::PayloadBuffer::VectorReserve<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), n);
-    strings_.reserve(n);
   }
 
   void resize(size_t n) {
@@ -592,17 +579,15 @@ public:
     // Resize the vector data in the binary.  This contains BufferOffets.
     toolbelt::PayloadBuffer::VectorResize<toolbelt::BufferOffset>(
         GetBufferAddr(), Header(), n);
-    strings_.resize(n);
 
     // If the size has increased, allocate string headers for the new entries
+    // and store their offsets in the vector.
     if (n > current_size) {
       for (uint32_t i = current_size; i < uint32_t(n); i++) {
         void *str_hdr = toolbelt::PayloadBuffer::Allocate(
             GetBufferAddr(), sizeof(toolbelt::StringHeader), 4);
         toolbelt::BufferOffset hdr_offset = GetBuffer()->ToOffset(str_hdr);
-        NonEmbeddedStringField field(
-            Message::GetSharedBuffer(this, source_offset_), hdr_offset);
-        strings_[i] = std::move(field);
+        Data()[i] = hdr_offset;
       }
     }
   }
@@ -617,7 +602,15 @@ public:
   }
 
   bool operator==(const StringVectorField &other) const {
-    return strings_ == other.strings_;
+    if (size() != other.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < size(); i++) {
+      if (ElementAt(i) != other.ElementAt(i)) {
+        return false;
+      }
+    }
+    return true;
   }
   bool operator!=(const StringVectorField &other) const {
     return !(*this == other);
@@ -625,18 +618,38 @@ public:
 
   size_t SerializedSize() const {
     size_t n = 4;
-    for (auto &s : strings_) {
-      n += s.SerializedSize();
+    for (size_t i = 0; i < size(); i++) {
+      n += ElementAt(i).SerializedSize();
     }
     return n;
   }
 
+  NonEmbeddedStringField ElementAt(size_t index) const {
+    toolbelt::BufferOffset offset = Data()[index];
+    if (offset == 0) {
+      // If the vector says there's a string at this index but
+      // the data is 0 it shows corruption in the binary message.
+      // TODO: How do we deal with this?
+      // abort for now
+      std::cerr << "Invalid string vector entry at index " << index
+                << std::endl;
+      abort();
+    }
+    return NonEmbeddedStringField(
+        Message::GetSharedBuffer(const_cast<StringVectorField *>(this),
+                                 source_offset_),
+        offset);
+  }
+
 private:
   toolbelt::VectorHeader *Header() const {
     return GetBuffer()->template ToAddress<toolbelt::VectorHeader>(
         Message::GetMessageBinaryStart(this, source_offset_) +
         relative_binary_offset_);
   }
+  toolbelt::BufferOffset *Data() const {
+    return GetBuffer()->ToAddress<toolbelt::BufferOffset>(Header()->data);
+  }
   toolbelt::PayloadBuffer *GetBuffer() const {
     return Message::GetBuffer(this, source_offset_);
   }
@@ -646,8 +659,8 @@ private:
   }
   uint32_t source_offset_;
   toolbelt::BufferOffset relative_binary_offset_;
-  std::vector<NonEmbeddedStringField> strings_;
 };
 #undef DECLARE_ZERO_COPY_VECTOR_BITS
 #undef DECLARE_RELAY_VECTOR_BITS
+#undef DECLARE_ELEMENT_VECTOR_BITS
 }
@@ -0,0 +1,338 @@
+// Benchmarks for the zero-copy messages.
+//
+// bazel run -c opt //neutron:zeros_benchmark
+//
+// Field access is the main cost for zeros messages since they are sent
+// as they are.  Conversion to and from the ROS format is measured too, for
+// comparison with serdes_benchmark.  The argument is the number of
+// elements in each vector.  The Readonly benchmarks read a received
+// message through CreateReadonly and through the Readonly view made by
+// CreateReadonlyView.  The Serdes benchmarks copy the message to and from a
+// serdes message directly and through the serialized format.
+
+#include "neutron/alloc_counter.h"
+#include "neutron/serdes/test_msgs/All.h"
+#include "neutron/zeros/runtime.h"
+#include "neutron/zeros/test_msgs/All.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+// Zeros messages refer to their buffer, so the memory is kept alongside.
+struct ZerosAll {
+  explicit ZerosAll(size_t n)
+      : memory(test_msgs::zeros::All::BinarySize() + 1024 + n * 256),
+        all(test_msgs::zeros::All::CreateMutable(memory.data(),
+                                                 memory.size())) {
+    all.i32 = 5;
+    all.ui64 = 8;
+    all.f64 = 10;
+    all.s = "dave";
+    all.n->foo = 1234;
+    all.n->bar = "baz";
+    all.vi32.reserve(n);
+    all.vf64.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      all.vi32.push_back(int32_t(i * 7 + 1));
+      all.vf64.push_back(double(i * 7 + 1));
+    }
+    for (size_t i = 0; i < n / 16; i++) {
+      all.vs.push_back("a string");
+    }
+    all.vn.resize(n / 16);
+  }
+
+  std::vector<char> memory;
+  test_msgs::zeros::All all;
+};
+
+void BM_ZerosReadScalars(benchmark::State &state) {
+  ZerosAll z(0);
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = z.all.i32 + int64_t(z.all.ui64) + int64_t(z.all.f64) +
+                  z.all.n->foo;
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_ZerosReadScalars);
+
+void BM_ZerosWriteScalars(benchmark::State &state) {
+  ZerosAll z(0);
+  neutron::AllocationCounter allocs(state);
+  int32_t i = 0;
+  for (auto _ : state) {
+    z.all.i32 = i;
+    z.all.ui64 = uint64_t(i);
+    z.all.n->foo = i++;
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_ZerosWriteScalars);
+
+void BM_ZerosReadString(benchmark::State &state) {
+  ZerosAll z(0);
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(z.all.s.Get());
+    benchmark::DoNotOptimize(z.all.n->bar.Get());
+  }
+}
+BENCHMARK(BM_ZerosReadString);
+
+void BM_ZerosIndexVector(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < z.all.vi32.size(); i++) {
+      sum += z.all.vi32[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          sizeof(int32_t));
+}
+BENCHMARK(BM_ZerosIndexVector)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosIterateVector(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    double sum = 0;
+    for (double d : z.all.vf64) {
+      sum += d;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          sizeof(double));
+}
+BENCHMARK(BM_ZerosIterateVector)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+// Making a message and its fields copies the buffer handle into every
+// message in the tree.
+void BM_ZerosCreateReadonly(benchmark::State &state) {
+  ZerosAll z(0);
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    test_msgs::zeros::All all = test_msgs::zeros::All::CreateReadonly(
+        z.memory.data(), z.memory.size());
+    benchmark::DoNotOptimize(all);
+  }
+}
+BENCHMARK(BM_ZerosCreateReadonly);
+
+void BM_ZerosIterateMessageVector(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (auto &n : z.all.vn) {
+      sum += n->foo;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * z.all.vn.size());
+}
+BENCHMARK(BM_ZerosIterateMessageVector)
+    ->RangeMultiplier(16)
+    ->Range(256, 1 << 16);
+
+// Reading a received message.  The memory is only read so either
+// CreateReadonly or the Readonly view can be used.
+void BM_ZerosReadonlyScalars(benchmark::State &state) {
+  ZerosAll z(0);
+  test_msgs::zeros::All all = test_msgs::zeros::All::CreateReadonly(
+      z.memory.data(), z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = all.i32 + int64_t(all.ui64) + int64_t(all.f64) + all.n->foo;
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_ZerosReadonlyScalars);
+
+void BM_ZerosReadonlyViewScalars(benchmark::State &state) {
+  ZerosAll z(0);
+  test_msgs::zeros::All::Readonly all =
+      test_msgs::zeros::All::CreateReadonlyView(z.memory.data(),
+                                                z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = all.i32() + int64_t(all.ui64()) + int64_t(all.f64()) +
+                  all.n().foo();
+    benchmark::DoNotOptimize(sum);
+  }
+}
+BENCHMARK(BM_ZerosReadonlyViewScalars);
+
+void BM_ZerosReadonlyString(benchmark::State &state) {
+  ZerosAll z(0);
+  test_msgs::zeros::All all = test_msgs::zeros::All::CreateReadonly(
+      z.memory.data(), z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(all.s.Get());
+    benchmark::DoNotOptimize(all.n->bar.Get());
+  }
+}
+BENCHMARK(BM_ZerosReadonlyString);
+
+void BM_ZerosReadonlyViewString(benchmark::State &state) {
+  ZerosAll z(0);
+  test_msgs::zeros::All::Readonly all =
+      test_msgs::zeros::All::CreateReadonlyView(z.memory.data(),
+                                                z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(all.s());
+    benchmark::DoNotOptimize(all.n().bar());
+  }
+}
+BENCHMARK(BM_ZerosReadonlyViewString);
+
+void BM_ZerosReadonlyIndexVector(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::zeros::All all = test_msgs::zeros::All::CreateReadonly(
+      z.memory.data(), z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < all.vi32.size(); i++) {
+      sum += all.vi32[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          sizeof(int32_t));
+}
+BENCHMARK(BM_ZerosReadonlyIndexVector)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 16);
+
+void BM_ZerosReadonlyViewIndexVector(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::zeros::All::Readonly all =
+      test_msgs::zeros::All::CreateReadonlyView(z.memory.data(),
+                                                z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    auto vi32 = all.vi32();
+    for (size_t i = 0; i < vi32.size(); i++) {
+      sum += vi32[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          sizeof(int32_t));
+}
+BENCHMARK(BM_ZerosReadonlyViewIndexVector)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 16);
+
+void BM_ZerosSerializedSize(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(z.all.SerializedSize());
+  }
+  state.SetBytesProcessed(state.iterations() * z.all.SerializedSize());
+}
+BENCHMARK(BM_ZerosSerializedSize)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosSerialize(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  std::vector<char> buffer(z.all.SerializedSize());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        z.all.SerializeToArray(buffer.data(), buffer.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_ZerosSerialize)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosDeserialize(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  std::vector<char> buffer(z.all.SerializedSize());
+  (void)z.all.SerializeToArray(buffer.data(), buffer.size());
+  std::vector<char> memory(z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    // Each message needs a new payload buffer since the deserialized
+    // vectors and strings are allocated in it.
+    test_msgs::zeros::All all =
+        test_msgs::zeros::All::CreateMutable(memory.data(), memory.size());
+    benchmark::DoNotOptimize(
+        all.DeserializeFromArray(buffer.data(), buffer.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_ZerosDeserialize)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosToSerdes(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::serdes::All sall;
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    z.all.ToSerdes(sall);
+    benchmark::DoNotOptimize(sall);
+  }
+  state.SetBytesProcessed(state.iterations() * z.all.SerializedSize());
+}
+BENCHMARK(BM_ZerosToSerdes)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosToSerdesViaWire(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::serdes::All sall;
+  std::vector<char> buffer(z.all.SerializedSize());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    (void)z.all.SerializeToArray(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(
+        sall.DeserializeFromArray(buffer.data(), buffer.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_ZerosToSerdesViaWire)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosFromSerdes(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::serdes::All sall;
+  z.all.ToSerdes(sall);
+  std::vector<char> memory(z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    test_msgs::zeros::All all =
+        test_msgs::zeros::All::CreateMutable(memory.data(), memory.size());
+    all.FromSerdes(sall);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sall.SerializedSize());
+}
+BENCHMARK(BM_ZerosFromSerdes)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+void BM_ZerosFromSerdesViaWire(benchmark::State &state) {
+  ZerosAll z(state.range(0));
+  test_msgs::serdes::All sall;
+  z.all.ToSerdes(sall);
+  std::vector<char> buffer(sall.SerializedSize());
+  std::vector<char> memory(z.memory.size());
+  neutron::AllocationCounter allocs(state);
+  for (auto _ : state) {
+    (void)sall.SerializeToArray(buffer.data(), buffer.size());
+    test_msgs::zeros::All all =
+        test_msgs::zeros::All::CreateMutable(memory.data(), memory.size());
+    benchmark::DoNotOptimize(
+        all.DeserializeFromArray(buffer.data(), buffer.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_ZerosFromSerdesViaWire)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 16);
+
+} // namespace
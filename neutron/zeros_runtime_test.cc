@@ -1,4 +1,9 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 #include "neutron/serdes/other_msgs/Other.h"
 #include "neutron/serdes/runtime.h"
 #include "neutron/serdes/test_msgs/All.h"
@@ -9,6 +14,13 @@
 
 using PayloadBuffer = toolbelt::PayloadBuffer;
 
+template <typename T, typename = void>
+struct CanGetFromTemporary : std::false_type {};
+
+template <typename T>
+struct CanGetFromTemporary<T, std::void_t<decltype(std::declval<T>().Get())>>
+    : std::true_type {};
+
 TEST(Runtime, ZeroToSerdes) {
   char *buffer = (char *)malloc(4096);
           
@@ -295,6 +307,350 @@ TEST(Runtime, AllZeroToSerdes) {
   free(buffer);
 }
 
+TEST(Runtime, BufferHandle) {
+  char *buffer = (char *)malloc(4096);
+  toolbelt::PayloadBuffer *pb = new (buffer) toolbelt::PayloadBuffer(4096);
+
+  // Copies made and dropped on several threads at once.
+  neutron::zeros::BufferHandle shared(pb);
+  ASSERT_EQ(shared.sharing(), neutron::zeros::BufferHandle::kThreadSafe);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&shared] {
+      for (int j = 0; j < 10000; j++) {
+        neutron::zeros::BufferHandle copy = shared;
+        ASSERT_EQ(*copy, *shared);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(1, shared.use_count());
+
+  // A single thread handle passes its mode to its copies.
+  neutron::zeros::BufferHandle single(
+      pb, neutron::zeros::BufferHandle::kSingleThread);
+  neutron::zeros::BufferHandle copy = single;
+  ASSERT_EQ(copy.sharing(), neutron::zeros::BufferHandle::kSingleThread);
+  ASSERT_EQ(2, single.use_count());
+  copy = neutron::zeros::BufferHandle();
+  ASSERT_EQ(1, single.use_count());
+  free(buffer);
+}
+
+TEST(Runtime, LazyVectors) {
+  char *buffer = (char *)malloc(8192);
+  test_msgs::zeros::All all =
+      test_msgs::zeros::All::CreateMutable(buffer, 8192);
+
+  all.vs.push_back("foo");
+  all.vs.push_back("bar");
+  all.vs.resize(3);
+  all.vs[2] = "baz";
+
+  all.vn.resize(2);
+  all.vn[0]->foo = 1;
+  all.vn[0]->bar = "one";
+  all.vn[1]->foo = 2;
+  all.vn[1]->bar = "two";
+
+  // A readonly view of the same buffer sees the elements without copying
+  // them out.
+  test_msgs::zeros::All ro =
+      test_msgs::zeros::All::CreateReadonly(buffer, 8192);
+  ASSERT_EQ(3, ro.vs.size());
+  ASSERT_EQ("foo", ro.vs[0].Get());
+  ASSERT_EQ("baz", ro.vs.back().Get());
+  std::vector<std::string> strings;
+  for (auto &s : ro.vs) {
+    strings.push_back(std::string(s.Get()));
+  }
+  ASSERT_EQ((std::vector<std::string>{"foo", "bar", "baz"}), strings);
+
+  ASSERT_EQ(2, ro.vn.size());
+  std::vector<int32_t> foos;
+  for (auto it = ro.vn.rbegin(); it != ro.vn.rend(); ++it) {
+    foos.push_back((*it)->foo);
+  }
+  ASSERT_EQ((std::vector<int32_t>{2, 1}), foos);
+  ASSERT_EQ("two", ro.vn[1]->bar.Get());
+  ASSERT_TRUE(ro.vn == all.vn);
+  ASSERT_TRUE(ro.vs == all.vs);
+
+  // Elements are returned by value so their messages can't be referenced
+  // from the temporary.
+  using Element = decltype(ro.vn[0]);
+  static_assert(!CanGetFromTemporary<Element>::value);
+  static_assert(
+      !std::is_convertible_v<Element, test_msgs::zeros::Nested &>);
+  static_assert(std::is_same_v<decltype(*ro.vn[0]), test_msgs::zeros::Nested>);
+  static_assert(
+      !std::is_pointer_v<decltype(std::declval<Element>().operator->())>);
+  Element first = ro.vn[0];
+  ASSERT_EQ(1, first.Get().foo);
+  test_msgs::zeros::Nested second = *ro.vn[1];
+  ASSERT_EQ(2, second.foo);
+
+  // The element iterators work with the standard algorithms.
+  using Traits = std::iterator_traits<decltype(ro.vn.begin())>;
+  static_assert(std::is_same_v<Traits::iterator_category,
+                               std::input_iterator_tag>);
+  static_assert(std::is_same_v<Traits::value_type, Element>);
+  ASSERT_EQ(2, std::distance(ro.vn.begin(), ro.vn.end()));
+  auto two = std::find_if(ro.vn.begin(), ro.vn.end(),
+                          [](auto &e) { return e->foo == 2; });
+  ASSERT_NE(ro.vn.end(), two);
+  ASSERT_EQ("two", (*two)->bar.Get());
+  ASSERT_EQ(1, std::count_if(ro.vs.begin(), ro.vs.end(),
+                             [](auto &s) { return s.Get() == "bar"; }));
+  std::ostringstream os;
+  os << ro.vn;
+  ASSERT_NE(os.str().find("two"), std::string::npos);
+
+  // Round trip through the ROS format.
+  size_t length = all.SerializedSize();
+  std::vector<char> serdes_buffer(length);
+  ASSERT_TRUE(all.SerializeToArray(serdes_buffer.data(), length).ok());
+
+  char *buffer2 = (char *)malloc(8192);
+  test_msgs::zeros::All all2 =
+      test_msgs::zeros::All::CreateMutable(buffer2, 8192);
+  ASSERT_TRUE(all2.DeserializeFromArray(serdes_buffer.data(), length).ok());
+  ASSERT_EQ(2, all2.vn.size());
+  ASSERT_EQ(2, all2.vn[1]->foo);
+  ASSERT_EQ("one", all2.vn[0]->bar.Get());
+  ASSERT_TRUE(all2.vs == all.vs);
+
+  // A bad length for the message vector is rejected before the vector is
+  // resized.
+  const char vn[] = "\x02\0\0\0\x01\0\0\0\x03\0\0\0one";
+  auto vn_start = std::search(serdes_buffer.begin(), serdes_buffer.end(), vn,
+                              vn + sizeof(vn) - 1);
+  ASSERT_NE(vn_start, serdes_buffer.end());
+  for (int32_t bad : {-1, 0x7fffffff}) {
+    std::vector<char> corrupt = serdes_buffer;
+    memcpy(corrupt.data() + (vn_start - serdes_buffer.begin()), &bad,
+           sizeof(bad));
+    char *buffer3 = (char *)malloc(8192);
+    test_msgs::zeros::All all3 =
+        test_msgs::zeros::All::CreateMutable(buffer3, 8192);
+    ASSERT_FALSE(all3.DeserializeFromArray(corrupt.data(), length).ok());
+    free(buffer3);
+  }
+
+  free(buffer);
+  free(buffer2);
+}
+
+TEST(Runtime, ReadonlyView) {
+  char *buffer = (char *)malloc(8192);
+  test_msgs::zeros::All all =
+      test_msgs::zeros::All::CreateMutable(buffer, 8192);
+  all.i8 = 1;
+  all.ui16 = 4;
+  all.i64 = 7;
+  all.f64 = 10;
+  all.s = "dave";
+  all.t = neutron::Time{45, 67};
+  all.n->foo = 1234;
+  all.n->bar = "bar";
+  all.e32 = test_msgs::zeros::Enum32::X3;
+  all.ai16[1] = 22;
+  all.af64[7] = 28;
+  all.as[1] = "as[1]";
+  all.an[2].foo = 16;
+  all.an[2].bar = "an[2]";
+  all.ae16[2] = test_msgs::zeros::Enum16::X2;
+  all.vi8.push_back(20);
+  all.vui64.push_back(27);
+  all.vui64.push_back(28);
+  all.vs.push_back("foo");
+  all.vs.push_back("bar");
+  all.vn.resize(2);
+  all.vn[1]->foo = 17;
+  all.vn[1]->bar = "vn[1]";
+  all.ve64.push_back(test_msgs::zeros::Enum64::X1);
+  all.virtual_ = 8765;
+
+  test_msgs::zeros::All::Readonly ro =
+      test_msgs::zeros::All::CreateReadonlyView(buffer, 8192);
+  ASSERT_EQ(1, ro.i8());
+  ASSERT_EQ(4, ro.ui16());
+  ASSERT_EQ(7, ro.i64());
+  ASSERT_EQ(10, ro.f64());
+  ASSERT_EQ("dave", ro.s());
+  ASSERT_EQ((neutron::Time{45, 67}), ro.t());
+  ASSERT_EQ(1234, ro.n().foo());
+  ASSERT_EQ("bar", ro.n().bar());
+  ASSERT_EQ(test_msgs::zeros::Enum32::X3, ro.e32());
+  ASSERT_EQ(22, ro.ai16()[1]);
+  ASSERT_EQ(28, ro.af64()[7]);
+  ASSERT_EQ("", ro.as()[0]);
+  ASSERT_EQ("as[1]", ro.as()[1]);
+  ASSERT_EQ(16, ro.an()[2].foo());
+  ASSERT_EQ("an[2]", ro.an()[2].bar());
+  ASSERT_EQ(test_msgs::zeros::Enum16::X2, ro.ae16()[2]);
+  ASSERT_EQ(1, ro.vi8().size());
+  ASSERT_EQ(20, ro.vi8()[0]);
+  ASSERT_EQ((std::vector<uint64_t>{27, 28}),
+            std::vector<uint64_t>(ro.vui64().begin(), ro.vui64().end()));
+  ASSERT_EQ(2, ro.vs().size());
+  ASSERT_EQ("bar", ro.vs()[1]);
+  std::string joined;
+  for (std::string_view s : ro.vs()) {
+    joined += s;
+  }
+  ASSERT_EQ("foobar", joined);
+  ASSERT_EQ(2, ro.vn().size());
+  ASSERT_EQ(17, ro.vn()[1].foo());
+  ASSERT_EQ("vn[1]", ro.vn()[1].bar());
+  ASSERT_EQ(test_msgs::zeros::Enum64::X1, ro.ve64()[0]);
+  ASSERT_TRUE(ro.vd().empty());
+  ASSERT_EQ(8765, ro.virtual_());
+
+  free(buffer);
+}
+
+TEST(Runtime, Validate) {
+  char *buffer = (char *)malloc(8192);
+  test_msgs::zeros::All all =
+      test_msgs::zeros::All::CreateMutable(buffer, 8192);
+  all.s = "dave";
+  all.n->bar = "bar";
+  all.as[1] = "as[1]";
+  all.an[2].bar = "an[2]";
+  all.vi32.push_back(20);
+  all.vs.push_back("foo");
+  all.vn.resize(2);
+  all.vn[1]->bar = "vn[1]";
+  ASSERT_TRUE(test_msgs::zeros::All::Validate(buffer, 8192).ok());
+
+  // The strings and vectors are allocated after the message so cutting
+  // the buffer short leaves them outside it.
+  toolbelt::PayloadBuffer *pb =
+      reinterpret_cast<toolbelt::PayloadBuffer *>(buffer);
+  ASSERT_FALSE(test_msgs::zeros::All::Validate(
+                   buffer, pb->message + test_msgs::zeros::All::BinarySize())
+                   .ok());
+  ASSERT_FALSE(test_msgs::zeros::All::Validate(buffer, 16).ok());
+
+  // Corrupt the string header of s.
+  char *msg = buffer + pb->message;
+  toolbelt::BufferOffset *s =
+      reinterpret_cast<toolbelt::BufferOffset *>(msg + all.s.BinaryOffset());
+  toolbelt::BufferOffset old_s = *s;
+  *s = 100000;
+  absl::Status status = test_msgs::zeros::All::Validate(buffer, 8192);
+  ASSERT_FALSE(status.ok());
+  ASSERT_NE(std::string::npos, status.message().find("All.s"));
+  *s = old_s;
+
+  // A vector with more elements than fit in the buffer.
+  toolbelt::VectorHeader *vi32 =
+      reinterpret_cast<toolbelt::VectorHeader *>(msg + all.vi32.BinaryOffset());
+  vi32->num_elements = 0x40000000;
+  status = test_msgs::zeros::All::Validate(buffer, 8192);
+  ASSERT_FALSE(status.ok());
+  ASSERT_NE(std::string::npos, status.message().find("All.vi32"));
+  vi32->num_elements = 1;
+
+  // A missing message in a message vector.
+  toolbelt::VectorHeader *vn =
+      reinterpret_cast<toolbelt::VectorHeader *>(msg + all.vn.BinaryOffset());
+  toolbelt::BufferOffset *vn0 =
+      reinterpret_cast<toolbelt::BufferOffset *>(buffer + vn->data);
+  toolbelt::BufferOffset old_vn0 = *vn0;
+  *vn0 = 0;
+  ASSERT_FALSE(test_msgs::zeros::All::Validate(buffer, 8192).ok());
+  *vn0 = old_vn0;
+
+  ASSERT_TRUE(test_msgs::zeros::All::Validate(buffer, 8192).ok());
+
+  // Offsets that share data.  Every entry of vs points at the header of
+  // s, so s is checked five times, which is more than the buffer holds.
+  all.s = std::string(2000, 'x');
+  all.vs.resize(4);
+  ASSERT_TRUE(test_msgs::zeros::All::Validate(buffer, 8192).ok());
+  msg = buffer + pb->message;
+  toolbelt::VectorHeader *vs =
+      reinterpret_cast<toolbelt::VectorHeader *>(msg + all.vs.BinaryOffset());
+  for (uint32_t i = 0; i < vs->num_elements; i++) {
+    toolbelt::BufferOffset entry = pb->message + all.s.BinaryOffset();
+    memcpy(buffer + vs->data + i * sizeof(entry), &entry, sizeof(entry));
+  }
+  status = test_msgs::zeros::All::Validate(buffer, 8192);
+  ASSERT_FALSE(status.ok());
+  ASSERT_NE(std::string::npos, status.message().find("shared"));
+  free(buffer);
+}
+
+TEST(Runtime, SerdesConversion) {
+  test_msgs::serdes::All sall;
+  sall.i8 = 1;
+  sall.ui64 = 8;
+  sall.f64 = 10;
+  sall.s = "dave";
+  sall.t = neutron::Time{45, 67};
+  sall.n.foo = 1234;
+  sall.n.bar = "bar";
+  sall.e32 = test_msgs::serdes::Enum32::X3;
+  sall.ai16[1] = 22;
+  sall.af64[7] = 28;
+  sall.as[1] = "as[1]";
+  sall.an[2].foo = 16;
+  sall.an[2].bar = "an[2]";
+  sall.ae16[2] = test_msgs::serdes::Enum16::X2;
+  sall.vi8 = {20, 21};
+  sall.vf64 = {1.5, 2.5, 3.5};
+  sall.vs = {"foo", "bar"};
+  sall.vt = {neutron::Time{1, 2}};
+  sall.vn.resize(2);
+  sall.vn[1].foo = 17;
+  sall.vn[1].bar = "vn[1]";
+  sall.ve64 = {test_msgs::serdes::Enum64::X1};
+  sall.virtual_ = 8765;
+
+  char *buffer = (char *)malloc(8192);
+  test_msgs::zeros::All all =
+      test_msgs::zeros::All::CreateMutable(buffer, 8192);
+  all.FromSerdes(sall);
+  ASSERT_EQ(1, all.i8);
+  ASSERT_EQ("dave", all.s.Get());
+  ASSERT_EQ(1234, all.n->foo);
+  ASSERT_EQ("an[2]", all.an[2].bar.Get());
+  ASSERT_EQ(3, all.vf64.size());
+  ASSERT_EQ(2.5, all.vf64[1]);
+  ASSERT_EQ("bar", all.vs[1].Get());
+  ASSERT_EQ(17, all.vn[1]->foo);
+  ASSERT_EQ(test_msgs::zeros::Enum64::X1, all.ve64[0]);
+
+  // The direct conversion gives the same message as going through the
+  // serialized format.
+  size_t length = all.SerializedSize();
+  ASSERT_EQ(sall.SerializedSize(), length);
+  std::vector<char> zbytes(length);
+  std::vector<char> sbytes(length);
+  ASSERT_TRUE(all.SerializeToArray(zbytes.data(), length).ok());
+  ASSERT_TRUE(sall.SerializeToArray(sbytes.data(), length).ok());
+  ASSERT_EQ(sbytes, zbytes);
+
+  test_msgs::serdes::All sall2;
+  all.ToSerdes(sall2);
+  ASSERT_EQ(sall, sall2);
+
+  // Converting again replaces the vectors.
+  sall.vs = {"one"};
+  sall.vn.clear();
+  all.FromSerdes(sall);
+  ASSERT_EQ(1, all.vs.size());
+  ASSERT_EQ(0, all.vn.size());
+  all.ToSerdes(sall2);
+  ASSERT_EQ(sall, sall2);
+
+  free(buffer);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
 